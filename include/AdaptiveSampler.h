@@ -0,0 +1,63 @@
+#ifndef ADAPTIVESAMPLER_H
+#define ADAPTIVESAMPLER_H
+
+#include <vector>
+#include <optixu/optixpp_namespace.h>
+#include <optixu/optixu_math_namespace.h>
+
+//same as in rt.cu
+#define ADAPTIVE_TILE 16
+//largest relative standard error of the luminance a tile may keep
+#define ADAPTIVE_THRESHOLD 0.01f
+
+
+//Host side of pinhole_camera_adaptive.
+//Every launch adds one sample to each pixel of the active tiles only; afterwards the tiles whose
+//largest per-pixel error is still above the threshold stay active, all others are converged and
+//cost nothing until the next reset. The accumulated image is in accum_buffer and output0 as with
+//pinhole_camera_progressive.
+class AdaptiveSampler
+{
+    public:
+        AdaptiveSampler();
+        virtual ~AdaptiveSampler();
+
+        //creates and binds variance_buffer, sample_count, active_tiles and tile_error
+        void init(optix::Context context, unsigned entry, int w, int h);
+        void setSize(int w, int h);
+        void setThreshold(float t);
+
+        //all tiles active again, on the next launch every pixel starts over
+        void reset();
+
+        //one launch over the active tiles; false once every tile converged, then nothing is launched
+        bool launch();
+
+        int getActiveTiles();
+        int getTileCount();
+        //pixels sampled and pixels skipped in the last launch, one ray each
+        long long getRaysTraced();
+        long long getRaysSaved();
+
+        //rays saved in the last launch and since the reset
+        void report();
+
+    protected:
+    private:
+        void updateTiles();
+
+        optix::Context context;
+        unsigned entry;
+        optix::Buffer variance, counts, tiles, errors;
+
+        int width, height;
+        int tiles_x, tiles_y;
+        float threshold;
+        int frame;
+        std::vector<uint2> active;
+
+        long long rays_traced, rays_saved;
+        long long total_traced, total_saved;
+};
+
+#endif // ADAPTIVESAMPLER_H
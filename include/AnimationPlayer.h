@@ -0,0 +1,64 @@
+#ifndef ANIMATIONPLAYER_H
+#define ANIMATIONPLAYER_H
+
+#include <vector>
+#include <assimp/scene.h>
+
+#include "SceneEditor.h"
+
+//for files that leave aiAnimation::mTicksPerSecond at 0
+#define ANIMATION_DEFAULT_TICKS 25.0
+
+//what one frame of playback took, from the keys to the image
+struct AnimationFrameCost{
+    //channels evaluated and transforms set
+    int channels;
+    double evaluate_ms, transform_ms, refit_ms, launch_ms;
+};
+
+
+//Node animation playback on the per node graph of a SceneEditor. Every frame the aiNodeAnim channels
+//of one aiAnimation are evaluated, positions and scalings linearly and rotations by slerp between the
+//keys around the time, and set as the local Transform of the node the channel names. Only the Group
+//accelerations above moved nodes are marked, so a frame refits them and leaves the meshes alone.
+class AnimationPlayer
+{
+    public:
+        AnimationPlayer();
+        virtual ~AnimationPlayer();
+
+        //false if scene has no animation index; channels of nodes the editor does not have are skipped
+        bool init(const aiScene *scene, int index, SceneEditor *e);
+        bool hasAnimation();
+        //of one loop, in seconds
+        double getDuration();
+
+        //evaluates every channel at seconds, looping over the duration, and sets the transforms;
+        //starts the cost of a frame, returns the number of channels set
+        int update(double seconds);
+        void setRefitTime(double ms);
+        //ends the cost of the frame update started
+        void endFrame(double launch_ms);
+
+        //mean and worst cost of every part over the frames played
+        void report();
+
+        //local transform of the node of channel at ticks
+        static aiMatrix4x4 evaluate(const aiNodeAnim *channel, double ticks);
+
+    protected:
+    private:
+        struct Channel{
+            const aiNodeAnim *anim;
+            int node;
+        };
+
+        const aiAnimation *animation;
+        SceneEditor *editor;
+        std::vector<Channel> channels;
+        std::vector<aiMatrix4x4> matrices;
+        AnimationFrameCost current;
+        std::vector<AnimationFrameCost> costs;
+};
+
+#endif // ANIMATIONPLAYER_H
@@ -0,0 +1,52 @@
+#ifndef BATCHRENDERER_H
+#define BATCHRENDERER_H
+
+#include <string>
+#include <vector>
+#include <optixu/optixpp_namespace.h>
+#include <optixu/optixu_math_namespace.h>
+
+
+//Renders a camera path without a window: one launch per keyframe, each written to a png,
+//plus a json report of the launch, readback and write time of every frame.
+//Pngs are written on a FramePipeline consumer thread while the next keyframe renders.
+//The path file has one keyframe per line, '#' starts a comment:
+//  eye x y z lookDir x y z [up x y z] [fov f]
+//up defaults to 0 1 0 and fov to 1, as in the interactive viewer.
+class BatchRenderer
+{
+    public:
+        BatchRenderer();
+        virtual ~BatchRenderer();
+
+        bool loadPath(std::string file);
+        int getFrameCount();
+
+        //renders every keyframe through entry into <dir>/frame_NNNN.png, reading back the float4 output buffer
+        bool render(optix::Context context, optix::Buffer output, unsigned entry, std::string dir);
+        bool writeReport(std::string file, std::string scene, std::string entry_name);
+
+        static bool writePNG(std::string file, const float *rgba, int w, int h);
+
+    protected:
+    private:
+        struct CameraKey{
+            float3 eye, look_dir, up;
+            float fov;
+        };
+        struct FrameStats{
+            std::string image;
+            double launch_ms, readback_ms, write_ms, total_ms;
+        };
+
+        void setCamera(optix::Context context, const CameraKey &key);
+
+        std::vector<CameraKey> keys;
+        std::vector<FrameStats> frames;
+        double setup_ms;
+        //first launch to last png, with launches and writes overlapped
+        double wall_ms;
+        int width, height;
+};
+
+#endif // BATCHRENDERER_H
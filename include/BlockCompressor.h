@@ -0,0 +1,62 @@
+#ifndef BLOCKCOMPRESSOR_H
+#define BLOCKCOMPRESSOR_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "TextureLoader.h"
+
+#define BC_CACHE_VERSION 2
+#define BC_CACHE_EXTENSION ".bcache"
+
+
+//BC1/BC3/BC4 encoder for decoded textures and their mips.
+//Opaque RGBA8 goes to BC1, RGBA8 with alpha to BC3, L8 to BC4.
+//compress() keeps the blocks and replaces the texels with the decoded blocks,
+//so uploads see exactly what a block compressed sampler would return.
+//The blocks are cached in <texture file>.rgba.bcache or .l8.bcache, keyed by the content hash and size of the source file.
+class BlockCompressor
+{
+    public:
+        BlockCompressor();
+        virtual ~BlockCompressor();
+
+        //encodes tex.pixels and tex.mips, fills tex.blocks and tex.psnr
+        void compress(DecodedTexture &tex);
+
+        //restores a texture from its cache file, which must hold a full mip chain when mipmaps is set
+        bool load(DecodedTexture &tex, bool mipmaps);
+        bool save(const DecodedTexture &tex);
+
+        static int blockBytes(BlockFormat format);
+        static size_t rawBytes(const DecodedTexture &tex);
+        static size_t compressedBytes(const DecodedTexture &tex);
+
+    protected:
+    private:
+        struct Header{
+            char magic[4];
+            uint32_t version;
+            uint64_t source_hash;
+            uint64_t source_size;
+            uint32_t format;
+            uint32_t block_format;
+            uint32_t width;
+            uint32_t height;
+            uint32_t levels;
+            float psnr;
+        };
+
+        static std::string cachePath(std::string file, TextureFormat format);
+
+        void encodeLevel(const unsigned char *pixels, int w, int h, BlockFormat format, std::vector<unsigned char> &blocks);
+        void decodeLevel(const std::vector<unsigned char> &blocks, int w, int h, BlockFormat format, unsigned char *pixels);
+
+        void encodeColor(const unsigned char *rgba, unsigned char *block);
+        void encodeAlpha(const unsigned char *values, int stride, unsigned char *block);
+        void decodeColor(const unsigned char *block, unsigned char *rgba);
+        void decodeAlpha(const unsigned char *block, unsigned char *values, int stride);
+};
+
+#endif // BLOCKCOMPRESSOR_H
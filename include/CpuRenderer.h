@@ -0,0 +1,198 @@
+#ifndef CPURENDERER_H
+#define CPURENDERER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <optixu/optixu_math_namespace.h>
+#include <assimp/scene.h>
+
+#include "SceneCache.h"
+#include "TextureLoader.h"
+#include "ThreadPool.h"
+#include "WideBvh.h"
+
+
+//Host value behind a CpuRenderer::variable() call.
+//operator-> returns itself so code written as renderer.variable("eye")->setFloat(eye)
+//works unchanged with either backend.
+class CpuVariable
+{
+    public:
+        CpuVariable();
+
+        CpuVariable* operator->();
+
+        void setFloat(float x);
+        void setFloat(float x, float y, float z);
+        void setFloat(float x, float y, float z, float w);
+        void setFloat(float3 v);
+        void setFloat(float4 v);
+        void setInt(int i);
+
+        float4 getFloat4();
+        float3 getFloat3();
+        float getFloat();
+        int getInt();
+
+    private:
+        float4 value;
+        int ivalue;
+};
+
+//Host-only backend with the OptixRenderer API.
+//Reproduces the programs in rt.cu by name; the PTX file arguments are ignored.
+class CpuRenderer
+{
+    public:
+        CpuRenderer(std::string path, std::string file, int nthreads=0);
+        virtual ~CpuRenderer();
+
+        void setRayTypeCount(int n);
+        void setOutputSize(int w, int h);
+
+        void setEntryProgram(std::string file, std::string program);
+        void setExceptionProgram(std::string file, std::string program);
+        void setMissProgram(int ray_type, std::string file, std::string program);
+
+        void setIntersectionProgram(std::string file, std::string program);
+        void setBoundingBoxProgram(std::string file, std::string program);
+
+        void setDefaultClosestHitProgram(int ray_type, std::string file, std::string program);
+        void setDefaultAnyHitProgram(int ray_type, std::string file, std::string program);
+
+        void setMaterialClosestHitProgram(std::string mat_name, int ray_type, std::string file, std::string program);
+        void setMaterialAnyHitProgram(std::string mat_name, int ray_type, std::string file, std::string program);
+
+        //binds an image file to a texture variable such as "sky"
+        void setTexture(std::string name, std::string file);
+
+        void setTextureCompression(bool enabled);
+
+        void init();
+
+        //pinhole_camera_progressive adds to the samples of the launches before until
+        //resetAccumulation, setOutputSize or a variable() call
+        void run();
+        void resetAccumulation();
+        int getFrameIndex();
+
+        void* mapOutputBuffer();
+        void unmapOutputBuffer();
+
+        CpuVariable& variable(const std::string &name);
+
+        int getThreadCount();
+
+    protected:
+    private:
+        enum HostProgram{
+            PROGRAM_NONE,
+            PINHOLE_CAMERA,
+            PINHOLE_CAMERA_MS,
+            PINHOLE_CAMERA_PROGRESSIVE,
+            CLOSEST_HIT_RADIANCE,
+            ANY_HIT_RADIANCE,
+            ANY_HIT_SHADOW,
+            MISS_RADIANCE,
+            MISS_SHADOW
+        };
+
+        enum TriangleFlags{
+            HAS_TEXCOORD=1,
+            HAS_TANGENTS=2
+        };
+
+        struct HostMaterial{
+            float4 diffuse;
+            int diffuse_tex;
+            int bump_tex;
+            std::vector<HostProgram> closest_hit;
+            std::vector<HostProgram> any_hit;
+        };
+
+        struct Hit{
+            float t, beta, gamma;
+            int prim;
+            float3 n;
+        };
+
+        struct Payload{
+            float4 color;
+            int hit;
+        };
+
+        //variables read once per launch instead of per ray
+        struct LaunchState{
+            float3 eye, U, V, W, lightDir;
+            float fov;
+            //angle covered by one pixel, for texture lod
+            float spread;
+            int phong, shadow;
+            int sky;
+            int frame;
+        };
+
+        struct LeafVisitor;
+
+        HostProgram lookupProgram(std::string program);
+
+        int loadTexture(std::string file, bool luminance);
+        int addTexture(DecodedTexture &tex);
+        float4 sampleLevel(const DecodedTexture &t, int level, float u, float v);
+        float4 sampleTexture(int tex, float u, float v, float lod=0.f);
+
+        void loadMaterials();
+        void loadGeometry();
+        void loadNode(aiNode *node, aiMatrix4x4 parent);
+        void buildBvh();
+
+        void trace(const LaunchState &ls, float3 origin, float3 direction, int ray_type, float tmin, float tmax, Payload &payload);
+        bool intersectTriangle(int prim, float3 origin, float3 direction, float tmin, float tmax, Hit &hit);
+        bool anyHit(const LaunchState &ls, const Hit &hit, int ray_type, Payload &payload, bool &terminate);
+        void closestHit(const LaunchState &ls, const Hit &hit, float3 origin, float3 direction, int ray_type, Payload &payload);
+        void miss(const LaunchState &ls, float3 direction, int ray_type, Payload &payload);
+        float4 materialColor(const HostMaterial &mat, float2 uv);
+        float2 hitTexCoord(const Hit &hit);
+        float texelDensity(const Hit &hit);
+
+        void renderTile(const LaunchState &ls, int tile);
+
+        std::string scene_path, scene_file;
+
+        SceneCache scene_cache;
+        const aiScene *scene;
+        ThreadPool pool;
+
+        std::map<std::string, CpuVariable> variables;
+        std::map<std::string, std::string> texture_vars;
+
+        std::map<std::string, int> material_index;
+        std::vector<HostMaterial> materials;
+        std::vector<DecodedTexture> textures;
+        std::map<std::string, int> texture_files;
+
+        //world space vertex attributes of all meshes
+        std::vector<float3> positions;
+        std::vector<float3> normals;
+        std::vector<float3> tangents;
+        std::vector<float3> bitangents;
+        std::vector<float2> texcoords;
+
+        std::vector<int3> triangles;
+        std::vector<int> triangle_material;
+        std::vector<int> triangle_flags;
+        WideBvh bvh;
+
+        bool compress_textures;
+
+        HostProgram entry;
+        std::vector<HostProgram> miss_programs;
+
+        std::vector<float4> output;
+        std::vector<float4> accum;
+        int frame;
+        int width, height;
+};
+
+#endif // CPURENDERER_H
@@ -0,0 +1,54 @@
+#ifndef FRAMECODEC_H
+#define FRAMECODEC_H
+
+#include <string>
+#include <vector>
+
+//default JPEG quality
+#define FRAME_JPEG_QUALITY 85
+
+//same values on the wire, see RenderServer
+enum FrameEncoding{
+    //RGBA8 as read back, bottom row first
+    FRAME_RAW,
+    //changed pixels against the previous frame of the same size, see encodeDelta
+    FRAME_DELTA,
+    FRAME_PNG,
+    //RGB only, the decoded alpha is 255
+    FRAME_JPEG,
+    FRAME_ENCODING_COUNT
+};
+
+
+//Encoding of RGBA8 frames for the render server. Frames are bottom row first like the output
+//buffer and glDrawPixels; PNG and JPEG store them top row first as every viewer expects and
+//decode flips them back.
+class FrameCodec
+{
+    public:
+        FrameCodec();
+        virtual ~FrameCodec();
+
+        static const char* name(FrameEncoding encoding);
+        //by name as in name(), FRAME_ENCODING_COUNT if unknown
+        static FrameEncoding parse(const std::string &name);
+
+        //previous is the last frame sent to the same receiver, only read by FRAME_DELTA;
+        //empty or of another size makes a key frame against black
+        static bool encode(FrameEncoding encoding, const std::vector<unsigned char> &rgba, const std::vector<unsigned char> &previous,
+                           int width, int height, int quality, std::vector<unsigned char> &data);
+        //rgba holds the previous frame for FRAME_DELTA and is replaced by the decoded one;
+        //the receiver empties it first for a key frame, which the sender has to flag
+        static bool decode(FrameEncoding encoding, const unsigned char *data, size_t size, int width, int height,
+                           std::vector<unsigned char> &rgba);
+
+    protected:
+    private:
+        //runs of unchanged pixels and of changed ones: uint32 skip, uint32 count, count RGBA8 pixels
+        static void encodeDelta(const std::vector<unsigned char> &rgba, const std::vector<unsigned char> &previous, std::vector<unsigned char> &data);
+        static bool decodeDelta(const unsigned char *data, size_t size, std::vector<unsigned char> &rgba);
+        static bool encodeJpeg(const std::vector<unsigned char> &rgba, int width, int height, int quality, std::vector<unsigned char> &data);
+        static bool decodeJpeg(const unsigned char *data, size_t size, int width, int height, std::vector<unsigned char> &rgba);
+};
+
+#endif // FRAMECODEC_H
@@ -0,0 +1,98 @@
+#ifndef FRAMEPIPELINE_H
+#define FRAMEPIPELINE_H
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+
+//One slot of the ring: an image read back from the output buffer and the times of its stages.
+struct PipelineFrame{
+    std::vector<unsigned char> pixels;
+    int width, height;
+    //submission order, from 0
+    int index;
+    //set by the producer
+    double render_ms, readback_ms;
+    //set by the pipeline
+    double acquire_wait_ms, queue_ms, consume_ms, latency_ms;
+    std::chrono::steady_clock::time_point acquired, submitted, taken;
+};
+
+//Fixed ring of frames between a producer that launches and reads back and a consumer that
+//displays, encodes or saves, so frame N+1 renders while frame N is consumed.
+//acquire blocks while every slot is queued or being consumed, which bounds the queue.
+//The consumer is either the caller of next/release, e.g. the GLUT thread, or a thread started
+//with startConsumer. Frames are consumed in submission order.
+class FramePipeline
+{
+    public:
+        //returns false to stop the pipeline, e.g. when an image cannot be written
+        typedef std::function<bool(PipelineFrame &frame)> Consumer;
+
+        FramePipeline(int nbuffers=3);
+        virtual ~FramePipeline();
+
+        int getBufferCount();
+
+        //a free slot, or NULL once the pipeline is stopped
+        PipelineFrame* acquire();
+        void submit(PipelineFrame *frame);
+        //gives an acquired slot back unsubmitted, when the producer had nothing new to show
+        void cancel(PipelineFrame *frame);
+        //producer with nothing to render: blocks until wake, stop or timeout_ms; false once stopped
+        bool idle(int timeout_ms);
+        //ends an idle wait, e.g. after an input change
+        void wake();
+
+        //the oldest submitted frame; NULL if there is none after timeout_ms, or right away when
+        //wait is false, or once stopped. A negative timeout waits for a frame
+        PipelineFrame* next(bool wait, int timeout_ms=-1);
+        void release(PipelineFrame *frame);
+
+        void startConsumer(Consumer consume);
+        //consumes what was submitted, then joins the consumer thread
+        void finish();
+        //wakes both sides and makes acquire and next return NULL
+        void stop();
+        bool failed();
+
+        //mean and max of every stage over the frames consumed so far
+        void report();
+        int getConsumedCount();
+
+    protected:
+    private:
+        enum Stage{
+            STAGE_ACQUIRE_WAIT,
+            STAGE_RENDER,
+            STAGE_READBACK,
+            STAGE_QUEUE,
+            STAGE_CONSUME,
+            STAGE_LATENCY,
+            STAGE_COUNT
+        };
+
+        void consumerLoop(Consumer consume);
+
+        std::vector<PipelineFrame> slots;
+        std::deque<PipelineFrame*> free_slots;
+        std::deque<PipelineFrame*> ready;
+
+        std::mutex lock;
+        std::condition_variable changed;
+        std::thread consumer;
+
+        bool finishing, stopped, failure, woken;
+        int submitted;
+
+        double stage_sum[STAGE_COUNT], stage_max[STAGE_COUNT];
+        int consumed;
+};
+
+#endif // FRAMEPIPELINE_H
@@ -0,0 +1,162 @@
+#ifndef GEOMETRYSTREAMER_H
+#define GEOMETRYSTREAMER_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <stdint.h>
+#include <optix_world.h>
+#include <assimp/scene.h>
+
+#define STREAM_VERSION 2
+#define STREAM_EXTENSION ".chunks"
+//cells of the chunk grid along the longest side of the scene
+#define STREAM_GRID 8
+//chunks read in one update at most, the rest wait for the next frames
+#define STREAM_LOADS_PER_UPDATE 4
+#define STREAM_DEFAULT_BUDGET (256ull<<20)
+
+//axis aligned box of a chunk in world space
+struct ChunkBounds{
+    float min[3], max[3];
+};
+
+//one chunk of the file and its residency
+struct StreamChunk{
+    ChunkBounds bounds;
+    uint64_t offset, size;
+    uint32_t meshes, triangles;
+    //NULL while not resident
+    optix::GeometryGroup group;
+    std::vector<optix::Buffer> buffers;
+    std::vector<optix::GeometryInstance> instances;
+    //update that last wanted the chunk, for the LRU eviction
+    uint32_t last_used;
+    //set by markVisible, wanted by the next update whatever its distance
+    bool visible;
+};
+
+struct StreamStats{
+    int loads, evictions, hits, deferred;
+    //chunks larger than the whole budget, never loaded
+    int oversized;
+    uint64_t bytes_read;
+    double read_ms, upload_ms;
+    uint64_t peak_bytes;
+};
+
+
+//Out of core geometry. The meshes of every node are put in world space and gathered into the cells
+//of a grid over the scene, and every cell is written to a file next to the scene as one block, so
+//the scene can be released after it is written. Every update ranks the chunks by distance from the
+//camera, chunks reported visible first, and reads the ones wanted from disk into device buffers
+//under a byte budget, evicting the ones least recently wanted. Resident chunks are GeometryGroups
+//under one top Group, and only its acceleration changes with the residency. The file also keeps the
+//materials of the scene, so a scene whose chunk file is up to date need not be imported at all.
+class GeometryStreamer
+{
+    public:
+        //acceleration of a chunk, the meshes of a chunk use the float layout of OptixRenderer
+        typedef std::function<optix::Acceleration()> AccelerationFunction;
+
+        GeometryStreamer();
+        virtual ~GeometryStreamer();
+
+        //hashes file and opens its chunk file if there is one for the same contents and flags;
+        //the scene is then not needed by open, only its materials, see readMaterials
+        bool find(const std::string &file, unsigned int flags);
+        //the materials stored in the chunk file opened by find, in a scene without meshes or nodes
+        //that the caller deletes; NULL when there is none
+        aiScene* readMaterials();
+        //writes the chunk file of scene unless one for the same source file and flags is there,
+        //then opens it; scene may be NULL after find. materials are indexed by aiMesh::mMaterialIndex
+        bool open(optix::Context c, const std::string &file, const aiScene *scene, unsigned int flags,
+                  const std::vector<optix::Material> &materials, AccelerationFunction mesh_acceleration,
+                  optix::Acceleration top_acceleration);
+        void close();
+
+        //device bytes of resident chunks at most, STREAM_DEFAULT_BUDGET by default;
+        //chunks count as their size on disk
+        void setBudget(uint64_t bytes);
+        //set on the chunks loaded from now on and on the resident ones
+        void setPrograms(optix::Program bounding_box, optix::Program intersect);
+
+        //visibility feedback: the chunk is wanted by the next update first
+        void markVisible(int chunk);
+        //loads and evicts for a camera at eye; returns the number of chunks loaded and evicted
+        int update(const float *eye);
+
+        optix::Group getTop();
+        int getChunkCount();
+        const StreamChunk& getChunk(int chunk);
+        //of all chunks together
+        ChunkBounds getSceneBounds();
+        int getResidentCount();
+        uint64_t getResidentBytes();
+        const StreamStats& getStats();
+        void report();
+
+    protected:
+    private:
+        struct Header{
+            char magic[4];
+            uint32_t version;
+            uint64_t source_hash;
+            uint64_t source_size;
+            uint32_t flags;
+            uint32_t nchunks;
+            uint64_t chunks;
+            uint32_t nmaterials;
+            uint32_t pad;
+            uint64_t materials, material_bytes;
+        };
+        //on disk, the StreamChunk fields that are not residency
+        struct ChunkEntry{
+            ChunkBounds bounds;
+            uint64_t offset, size;
+            uint32_t meshes, triangles;
+        };
+        //before the arrays of every mesh in a chunk
+        struct MeshRecord{
+            uint32_t nvertex, nface, material, flags;
+        };
+        enum MeshFlags{
+            STREAM_TANGENTS=1,
+            STREAM_TEXCOORDS=2
+        };
+        enum MaterialFlags{
+            STREAM_DIFFUSE=1,
+            STREAM_SHININESS=2
+        };
+        //before the name and the diffuse, specular and height texture paths of a material,
+        //lengths[i] bytes each without a terminating 0; an empty path is no texture
+        struct MaterialRecord{
+            float diffuse[4];
+            float shininess;
+            uint32_t flags;
+            uint32_t lengths[4];
+        };
+
+        bool write(const std::string &path, const aiScene *scene, uint64_t hash, uint64_t size, unsigned int flags);
+        bool readIndex(const std::string &path, uint64_t hash, uint64_t size, unsigned int flags);
+        bool load(int chunk);
+        void evict(int chunk);
+        void setTop();
+
+        optix::Context context;
+        int fd;
+        //source file of the open chunk file
+        std::string source;
+        uint32_t material_count;
+        uint64_t material_offset, material_bytes;
+        std::vector<optix::Material> materials;
+        AccelerationFunction mesh_acceleration;
+        optix::Group top;
+        optix::Program bounding_box, intersect;
+        std::vector<StreamChunk> chunks;
+        uint64_t budget, resident_bytes;
+        uint32_t updates;
+        StreamStats stats;
+};
+
+#endif // GEOMETRYSTREAMER_H
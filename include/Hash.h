@@ -0,0 +1,21 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <stdint.h>
+
+#define HASH_SEED 14695981039346656037ULL
+#define HASH_PRIME 1099511628211ULL
+
+//64 bit FNV-1a, byte by byte. Pass the previous result as hash to continue over data read in chunks.
+//Not collision free; caches keyed by it also compare the size of what was hashed.
+inline uint64_t hashBytes(const void *data, size_t size, uint64_t hash=HASH_SEED){
+    const unsigned char *bytes=static_cast<const unsigned char*>(data);
+    for(size_t i=0; i<size; i++){
+        hash^=bytes[i];
+        hash*=HASH_PRIME;
+    }
+    return hash;
+}
+
+#endif // HASH_H
@@ -0,0 +1,70 @@
+#ifndef INPUTRECORDER_H
+#define INPUTRECORDER_H
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <chrono>
+#include <stdint.h>
+
+#define INPUT_LOG_VERSION 1
+
+enum InputEventType{
+    //a is the key given to keyboard()
+    INPUT_KEY,
+    //a and b are the new render width and height
+    INPUT_RESIZE,
+    //the recording stopped before frame
+    INPUT_END
+};
+
+//state when the recording started; config describes the compile time render settings so a
+//replay with different ones can warn
+struct InputHeader{
+    char magic[4];
+    uint32_t version;
+    uint32_t config;
+    int32_t width, height;
+    float eye[3], look_dir[3];
+};
+
+//the camera after the event is kept to catch a replay that went a different way
+struct InputEvent{
+    //launched frames before the event, it is replayed right before launch number frame
+    uint32_t frame;
+    //since the recording started, for reference only, the replay is locked to frames
+    float time_ms;
+    uint32_t type;
+    int32_t a, b;
+    float eye[3], look_dir[3];
+};
+
+
+//Log of the input of an interactive session, fixed size binary records after an InputHeader.
+//Events are tagged with the number of frames launched before them instead of only a time, so
+//InputReplay issues every change before the same launch as in the session it was recorded in.
+//Every event is flushed when it is recorded, a session that is killed keeps its log.
+class InputRecorder
+{
+    public:
+        InputRecorder();
+        virtual ~InputRecorder();
+
+        bool start(const std::string &path, const InputHeader &header);
+        void record(uint32_t frame, InputEventType type, int a, int b, const float *eye, const float *look_dir);
+        //writes INPUT_END
+        void stop(uint32_t frame);
+        bool isRecording();
+
+        //the frame count is that of INPUT_END, or one past the last event if there is none
+        static bool load(const std::string &path, InputHeader &header, std::vector<InputEvent> &events, uint32_t &frames);
+
+    protected:
+    private:
+        FILE *file;
+        std::string path;
+        int count;
+        std::chrono::steady_clock::time_point started;
+};
+
+#endif // INPUTRECORDER_H
@@ -0,0 +1,54 @@
+#ifndef INPUTREPLAY_H
+#define INPUTREPLAY_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <stdint.h>
+
+#include "InputRecorder.h"
+
+
+//Frame locked replay of an InputRecorder log without a window: the events of frame n are applied,
+//frame n is launched and read back, for as many frames as were recorded. The json report has the
+//launch and readback time of every frame and, when asked for, a hash of its pixels, so two builds
+//replaying the same log can be compared frame by frame.
+class InputReplay
+{
+    public:
+        //applies one event and returns the camera it left behind in eye and look_dir
+        typedef std::function<void(const InputEvent &event, float *eye, float *look_dir)> EventFunction;
+        //launches and reads back one frame; hash is NULL when no hashes are wanted
+        typedef std::function<bool(double &launch_ms, double &readback_ms, uint64_t *hash)> FrameFunction;
+
+        InputReplay();
+        virtual ~InputReplay();
+
+        bool load(const std::string &path);
+        const InputHeader& getHeader();
+
+        //false if a frame fails; a camera that differs from the recorded one is counted and reported
+        bool run(EventFunction apply, FrameFunction frame, bool hashes);
+
+        bool writeReport(const std::string &file, const std::string &scene);
+        void report();
+
+    protected:
+    private:
+        struct FrameStats{
+            double launch_ms, readback_ms;
+            uint64_t hash;
+            int events;
+        };
+
+        std::string log;
+        InputHeader header;
+        std::vector<InputEvent> events;
+        uint32_t frame_count;
+        std::vector<FrameStats> frames;
+        bool hashed;
+        int diverged;
+        double wall_ms;
+};
+
+#endif // INPUTREPLAY_H
@@ -0,0 +1,29 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <string>
+#include <cstdio>
+
+//s as the contents of a JSON string: quotes and backslashes escaped, e.g. in Windows paths,
+//and control characters written as \uXXXX
+inline std::string escapeJson(const std::string &s){
+    std::string res;
+    for(size_t i=0; i<s.size(); i++){
+        unsigned char c=s[i];
+        if(c=='"' || c=='\\'){
+            res+='\\';
+            res+=c;
+        }
+        else if(c<0x20){
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            res+=code;
+        }
+        else{
+            res+=c;
+        }
+    }
+    return res;
+}
+
+#endif // JSON_H
@@ -0,0 +1,59 @@
+#ifndef LOADPROFILER_H
+#define LOADPROFILER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <ostream>
+
+
+//Wall time of each scene bring-up stage over repeated loads, and the peak RSS of every load.
+//Stages run one after the other: stage() closes the open one, so a run is a plain sequence.
+//A stage entered twice in a run adds up; a stage missing from a run (a scene cache hit
+//skips the import) only counts the runs it appears in.
+class LoadProfiler
+{
+    public:
+        LoadProfiler(std::string name);
+        virtual ~LoadProfiler();
+
+        //resets the peak RSS and starts a new run
+        void beginRun();
+        void stage(std::string name);
+        void endStage();
+        //closes the open stage and records the peak RSS of the run
+        void endRun();
+
+        int getRunCount();
+
+        //median and p95 of every stage, of the run total and of the peak RSS
+        void report();
+        //one json object with the same statistics and every sample
+        void writeJson(std::ostream &out);
+
+        //VmHWM of this process in KB, 0 where /proc is missing
+        static size_t peakRSS();
+        //restarts VmHWM from the current RSS, if the kernel allows it
+        static bool resetPeakRSS();
+
+    protected:
+    private:
+        struct Stats{
+            double median, p95, min, max;
+        };
+
+        static Stats statistics(std::vector<double> samples);
+        std::vector<double> samples(std::string stage);
+
+        std::string name;
+        std::vector<std::string> stages;
+        std::vector<std::map<std::string, double> > runs;
+        std::vector<double> totals;
+        std::vector<double> peak_rss;
+
+        std::string current;
+        std::chrono::steady_clock::time_point stage_start, run_start;
+};
+
+#endif // LOADPROFILER_H
@@ -0,0 +1,110 @@
+#ifndef MEMORYTRACKER_H
+#define MEMORYTRACKER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <ostream>
+#include <stdint.h>
+#include <optix_world.h>
+#include <assimp/scene.h>
+
+//meshes and materials listed by report, the largest first
+#define MEMORY_REPORT_TOP 10
+
+enum MemoryCategory{
+    //index and vertex attribute buffers
+    MEMORY_GEOMETRY,
+    //every mip level of every texture
+    MEMORY_TEXTURE,
+    //built accelerations, as the size of their serialized data
+    MEMORY_ACCELERATION,
+    //output, display and accumulation buffers
+    MEMORY_OUTPUT,
+    //one element buffers and white textures bound where nothing else is
+    MEMORY_PLACEHOLDER,
+    //host: the imported aiScene, estimated from its arrays
+    MEMORY_SCENE,
+    MEMORY_CATEGORY_COUNT
+};
+
+struct MemoryRecord{
+    MemoryCategory category;
+    std::string name;
+    //aiScene indices, -1 for none
+    int mesh, material;
+    uint64_t bytes;
+};
+
+
+//Accounting of the device buffers and samplers a renderer creates and of the host copy of the scene.
+//A record is named by its category, name, mesh and material; tracking the same one again replaces its
+//size, so resized output buffers are tracked again and a released scene is tracked as 0 bytes. Shared
+//buffers are tracked once, geometry under the mesh that owns it and textures under the first material
+//that asked for them. Budgets are optional per category and for the device total; a budget crossed
+//warns once until the category is back under it.
+class MemoryTracker
+{
+    public:
+        MemoryTracker();
+        virtual ~MemoryTracker();
+
+        void track(MemoryCategory category, const std::string &name, uint64_t bytes, int mesh=-1, int material=-1);
+        void trackBuffer(optix::Buffer buffer, MemoryCategory category, const std::string &name, int mesh=-1, int material=-1);
+        //every mip level of array slice 0, as "name mip l"
+        void trackSampler(optix::TextureSampler sampler, MemoryCategory category, const std::string &name, int material=-1);
+        //shown next to the material index in report
+        void setMaterialName(int material, const std::string &name);
+        void clear();
+
+        //0 for none, the default
+        void setBudget(MemoryCategory category, uint64_t bytes);
+        void setDeviceBudget(uint64_t bytes);
+        //warns about every budget exceeded, returns false if any is
+        bool checkBudgets();
+
+        uint64_t getBytes(MemoryCategory category);
+        uint64_t getMeshBytes(int mesh);
+        uint64_t getMaterialBytes(int material);
+        //every category but MEMORY_SCENE
+        uint64_t getDeviceBytes();
+        uint64_t getHostBytes();
+        const std::vector<MemoryRecord>& getRecords();
+
+        //table of the categories against their budgets, then the largest meshes and materials
+        void report();
+        //one json object with the totals and every record
+        void writeJson(std::ostream &out);
+
+        //element size times every dimension
+        static uint64_t bufferBytes(optix::Buffer buffer);
+        //vertex attributes, faces and index arrays of every mesh
+        static uint64_t sceneBytes(const aiScene *scene);
+        static const char* categoryName(MemoryCategory category);
+
+    protected:
+    private:
+        struct Key{
+            int category;
+            std::string name;
+            int mesh, material;
+            bool operator<(const Key &k) const;
+        };
+
+        bool overBudget(MemoryCategory category);
+        bool overDeviceBudget();
+        void warn(const char *what, uint64_t bytes, uint64_t budget);
+        std::string materialLabel(int material);
+
+        std::vector<MemoryRecord> records;
+        std::map<Key, int> index;
+        std::vector<std::string> material_names;
+        uint64_t totals[MEMORY_CATEGORY_COUNT];
+        uint64_t budgets[MEMORY_CATEGORY_COUNT];
+        uint64_t device_budget;
+        //a budget warned about stays quiet until it is met again
+        bool warned[MEMORY_CATEGORY_COUNT];
+        bool device_warned;
+};
+
+#endif // MEMORYTRACKER_H
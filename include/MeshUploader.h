@@ -0,0 +1,89 @@
+#ifndef MESHUPLOADER_H
+#define MESHUPLOADER_H
+
+#include <vector>
+#include <stdint.h>
+#include <optix_world.h>
+#include <assimp/scene.h>
+
+#include "MemoryTracker.h"
+#include "ThreadPool.h"
+
+//elements of one attribute filled by one task, so a few large meshes still spread over the threads
+#define UPLOAD_SLICE 65536
+
+struct UploadStats{
+    int meshes, buffers, tasks, threads;
+    //host bytes written into mapped buffers
+    uint64_t bytes;
+    //of the packed layout, before and after packing
+    uint64_t float_bytes, packed_bytes;
+    double create_ms, fill_ms, finish_ms;
+};
+
+
+//Mesh buffers of a whole scene in two phases. Every buffer of every mesh is created and mapped
+//first on the calling thread, since a context is not to be used from several threads at once. The
+//mapped host copies are then filled on the pool, one task per slice of one attribute, and unmapped
+//and validated on the calling thread again. Positions, normals and tangents are copied as they are,
+//face indices gathered from the aiFace arrays and uvs narrowed from aiVector3D to float2, with SSE2
+//when the compiler has it. Attributes a mesh does not have keep the placeholders of
+//VertexPacker::setDefaults.
+class MeshUploader
+{
+    public:
+        MeshUploader(ThreadPool &pool);
+        virtual ~MeshUploader();
+
+        //every buffer created from now on is recorded under its mesh and material; none by default
+        void setMemoryTracker(MemoryTracker *m);
+
+        //float layout: fills the buffers of geometries[i] from scene->mMeshes[meshes[i]]
+        void upload(optix::Context context, const aiScene *scene, const std::vector<int> &meshes,
+                    const std::vector<optix::Geometry> &geometries);
+        //packed layout: packs every mesh on the pool, then uploads them in order
+        void pack(optix::Context context, const aiScene *scene, const std::vector<int> &meshes,
+                  const std::vector<optix::Geometry> &geometries);
+
+        const UploadStats& getStats();
+        void report();
+
+        //nface triangles to 3*nface ints
+        static void copyIndices(const aiFace *faces, int nface, int *out);
+        //x and y of nvertex uvs to 2*nvertex floats
+        static void narrowTexCoords(const aiVector3D *uvs, int nvertex, float *out);
+        static void narrowTexCoordsScalar(const aiVector3D *uvs, int nvertex, float *out);
+
+        //host only: packs every mesh of scene on the pool and compares it with the float attributes
+        //through VertexPacker::check; returns false if any mesh fails
+        bool check(const aiScene *scene);
+        //host only: fills synthetic meshes serially and on the pool, and diffs the SSE2 narrowing
+        //against the scalar one; returns false if any output differs
+        bool benchmark(int meshes, int vertices);
+
+    protected:
+    private:
+        enum FillKind{
+            FILL_COPY,
+            FILL_INDICES,
+            FILL_TEXCOORDS
+        };
+        //elements [begin, begin+count) of one attribute
+        struct FillTask{
+            FillKind kind;
+            const void *source;
+            void *target;
+            int begin, count;
+        };
+
+        static void addTasks(std::vector<FillTask> &tasks, FillKind kind, const void *source, void *target, int count);
+        static void fill(const FillTask &task);
+        void fillAll(const std::vector<FillTask> &tasks);
+        void track(optix::Buffer buffer, const char *name, const aiMesh *mesh, int index);
+
+        ThreadPool &pool;
+        MemoryTracker *memory;
+        UploadStats stats;
+};
+
+#endif // MESHUPLOADER_H
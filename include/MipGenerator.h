@@ -0,0 +1,51 @@
+#ifndef MIPGENERATOR_H
+#define MIPGENERATOR_H
+
+#include "TextureLoader.h"
+
+//entries of the linear to sRGB table, linear values are quantized to 12 bits
+#define SRGB_TABLE_SIZE 4096
+
+
+//Builds the full mip chain of a decoded texture with a 2x2 box filter.
+//RGBA8 textures hold sRGB colour and are averaged in linear space, alpha and
+//L8 bump maps are averaged as stored. Each level is half the previous one rounded
+//down, an odd last row or column is dropped.
+//The colour path uses AVX2 gathers on CPUs that have them, checked at run time so the build
+//needs no -mavx2, and is scalar otherwise; L8 uses SSE2. downsampleScalar is the plain
+//reference both are checked against.
+class MipGenerator
+{
+    public:
+        MipGenerator();
+        virtual ~MipGenerator();
+
+        //fills tex.mips with levels 1 and up
+        void build(DecodedTexture &tex);
+
+        //one level from src (sw x sh) into dst (max(1,sw/2) x max(1,sh/2))
+        void downsample(const unsigned char *src, int sw, int sh, TextureFormat format, unsigned char *dst);
+        void downsampleScalar(const unsigned char *src, int sw, int sh, TextureFormat format, unsigned char *dst);
+
+        static int levelCount(int width, int height);
+        static int levelSize(int size, int level);
+
+        //times the scalar and SIMD chains on a synthetic size x size image and diffs
+        //them against each other and against an exact double precision downsample
+        //returns false if any texel is off by more than one
+        bool benchmark(int size, int repeats);
+
+    protected:
+    private:
+        void downsampleRowRGBA(const unsigned char *row0, const unsigned char *row1, int dw, unsigned char *dst);
+        void downsampleRowL8(const unsigned char *row0, const unsigned char *row1, int dw, unsigned char *dst);
+
+        //the CPU runs the AVX2 colour kernel
+        bool avx2;
+        //[0,256) sRGB to linear, [256,512) alpha to [0,1]
+        float decode[512];
+        //[0,SRGB_TABLE_SIZE) linear to sRGB, then 256 entries of identity for alpha
+        int encode[SRGB_TABLE_SIZE+256];
+};
+
+#endif // MIPGENERATOR_H
@@ -5,6 +5,19 @@
 #include <optix_world.h>
 #include <assimp/scene.h>
 
+#include "AnimationPlayer.h"
+#include "GeometryStreamer.h"
+#include "LoadProfiler.h"
+#include "MemoryTracker.h"
+#include "OutputConverter.h"
+#include "ProgramCache.h"
+#include "SceneCache.h"
+#include "SceneEditor.h"
+#include "SceneFlattener.h"
+#include "TextureLoader.h"
+#include "ThreadPool.h"
+#include "TileLauncher.h"
+
 
 
 class OptixRenderer
@@ -15,7 +28,12 @@ class OptixRenderer
 
         void setRayTypeCount(int n);
         void setOutputSize(int w, int h);
+        //the buffer mapOutputBuffer returns, tonemapped on the device unless OUTPUT_FLOAT4; float4 by default
+        void setOutputFormat(OutputFormat format);
+        void setTonemap(float exposure, float white);
 
+        //programs are shared through a ProgramCache, every PTX file is read once and every
+        //program created once however many materials it is set on
         void setEntryProgram(std::string file, std::string program);
         void setExceptionProgram(std::string file, std::string program);
         void setMissProgram(int ray_type, std::string file, std::string program);
@@ -28,41 +46,171 @@ class OptixRenderer
 
         void setMaterialClosestHitProgram(std::string mat_name, int ray_type, std::string file, std::string program);
         void setMaterialAnyHitProgram(std::string mat_name, int ray_type, std::string file, std::string program);
+        //sets the programs of the PTX files changed on disk again, the scene stays loaded.
+        //Returns the number of programs set, accumulation restarts if there are any
+        int reloadPrograms();
+        //hit and miss counts
+        ProgramCache& getProgramCache();
+
+        //block compress textures on load, cached next to the images; off by default
+        void setTextureCompression(bool enabled);
+        //octahedral normals and tangents, half uvs and 16 bit indices in the mesh buffers; off by default
+        void setPackedVertices(bool enabled);
+
+        //times the stages of init and compile, see LoadProfiler
+        void setLoadProfiler(LoadProfiler *p);
+        //reuse the binary scene cache next to the scene file; on by default
+        void setSceneCache(bool enabled);
+        //two level graph with shared GeometryGroups for identical meshes, see SceneFlattener; on by default
+        void setFlattenScene(bool enabled);
+        //keeps the per node graph for the edits below, with Group accelerations that refit;
+        //off by default, turns setFlattenScene off
+        void setSceneEdits(bool enabled);
+
+        //out of core geometry under a device budget in bytes, see GeometryStreamer; 0 for off by
+        //default. init writes or opens the chunk file and releases the aiScene, no mesh is loaded
+        //until updateStreaming; with an up to date chunk file the scene is not imported at all.
+        //The edits, the animation and setPackedVertices do not apply
+        void setStreaming(uint64_t budget_bytes);
+
+        //frees the imported aiScene at the end of init, once the device has everything it needs;
+        //off by default. The scene of setAnimation is kept, its channels point into it
+        void setReleaseScene(bool enabled);
 
         void init();
-
+        //builds the accelerations and compiles the programs ahead of the first frame,
+        //then reports the memory use
+        void compile();
+
+        //buffers, samplers and built accelerations by category, mesh and material, and the
+        //imported scene; budgets set on it warn when crossed, see MemoryTracker
+        MemoryTracker& getMemoryTracker();
+        //the tracker report with the host memory of OptiX and the free device memory
+        void reportMemory();
+
+        //launches the entry program; pinhole_camera_progressive adds to the samples of the
+        //launches before until resetAccumulation, setOutputSize or a variable() call
         inline void run();
+        void resetAccumulation();
+        //launches accumulated since the last reset
+        int getFrameIndex();
+
+        //launch over parts of the image only, see TileLauncher. Both count frames like run(), so with
+        //pinhole_camera_progressive they suit a region that is launched every frame in place of run()
+        void markDirty(const TileRect &rect);
+        //the dirty parts since the last call; the whole image is dirty after setOutputSize,
+        //resetAccumulation and variable(). Returns the number of launches, 0 when nothing changed
+        int runDirty();
+        void runTiles(const std::vector<TileRect> &rects);
+        //timings of the last runDirty or runTiles and the cost of every square
+        TileLauncher& getTileLauncher();
+
+        //loads and evicts chunks for a pinhole camera at eye with the U, V and W of the context,
+        //chunks in its view first; returns the number of chunks that changed, accumulation
+        //restarts if there are any
+        int updateStreaming(const float *eye, const float *U, const float *V, const float *W);
+        //residency and I/O stats, visibility feedback
+        GeometryStreamer& getStreamer();
+
+        //plays aiScene::mAnimations[index] on the node Transforms, see AnimationPlayer; -1 for none
+        //by default. Turns setSceneEdits on
+        void setAnimation(int index);
+        //sets the transforms at seconds and refits the Groups above them, returns the refit ms
+        //or -1 without an animation. Accumulation restarts
+        double updateAnimation(double seconds);
+        //cost of every frame, the launch time is added by the caller with endFrame
+        AnimationPlayer& getAnimationPlayer();
+
+        //edits after init, see SceneEditor; meshes are shared instances, so a material set on a
+        //mesh shows in every node that holds it. Each restarts accumulation
+        int findNode(const std::string &name);
+        //row major, relative to the parent node
+        bool setNodeTransform(int node, const float *matrix);
+        bool insertMesh(int node, int mesh);
+        bool removeMesh(int node, int mesh);
+        bool setMeshMaterial(int mesh, const std::string &mat_name);
+        //builds the accelerations the edits marked, returns the ms it took;
+        //without it they are built by the next launch
+        double commitEdits();
+        //per edit timings
+        SceneEditor& getSceneEditor();
 
         void* mapOutputBuffer();
         void unmapOutputBuffer();
 
         optix::Variable variable(const std::string &name);
+        optix::Context getContext();
 
     protected:
     private:
         std::string scene_path, scene_file;
 
-        optix::TextureSampler createTextureRGBA(std::string file);
-        optix::TextureSampler createTextureLum(std::string file);
+        //NULL or a failed decode gives a 1x1 white texture
+        optix::TextureSampler createTextureRGBA(DecodedTexture *tex);
+        optix::TextureSampler createTextureLum(DecodedTexture *tex);
+        void setTextureLevels(optix::TextureSampler res, DecodedTexture *tex, RTformat format, int channels);
+        //samplers are shared between slots with the same file contents and format,
+        //and every empty or failed slot shares one white texture per format
+        //new samplers are tracked under material
+        optix::TextureSampler getTexture(TextureLoader &loader, int index, TextureFormat format, int material);
+
 
+        void stage(const char *name);
+        void endStage();
 
         void loadMaterials();
         void loadGeometry();
         void loadSceneGraph();
+        void loadStreaming();
+        bool canEdit();
+        void releaseScene();
+        void trackOutput();
+        void trackAccelerations();
 
         optix::Acceleration createAccelerationMeshes();
         optix::Acceleration createAccelerationGroups();
 
-        optix::Transform loadNode(aiNode * node);
+        optix::Transform loadNode(aiNode * node, int parent);
         optix::GeometryGroup loadGeometryGroup(aiNode * node);
+        optix::Group loadFlatScene();
 
+        ThreadPool pool;
         optix::Context context;
         optix::Buffer output;
+        optix::Buffer display;
+        OutputFormat output_format;
+        optix::Buffer accum;
+        int frame;
+        TileLauncher tiles;
+        SceneCache scene_cache;
         const aiScene *scene;
+        bool release_scene;
+        MemoryTracker memory;
+        std::vector<optix::Acceleration> mesh_accelerations, group_accelerations;
         std::map<std::string, optix::Material> materials;
+        std::map<TextureKey, optix::TextureSampler> texture_cache;
+        optix::TextureSampler white_rgba, white_lum;
+        int texture_hits, texture_misses;
+        size_t texture_bytes_saved;
+        bool compress_textures;
+        bool pack_vertices;
+        bool flatten_scene;
+        bool scene_edits;
+        SceneEditor editor;
+        int animation_index;
+        AnimationPlayer player;
+        uint64_t stream_budget;
+        GeometryStreamer streamer;
+        //materials read from the chunk file in place of the imported scene, owned
+        aiScene *stream_materials;
+        LoadProfiler *profiler;
         std::vector<optix::GeometryInstance> meshes;
         optix::Transform top;
+        SceneFlattener flattener;
+        FlatScene flat;
+        optix::Group flat_top;
 
+        ProgramCache programs;
         optix::Program bounding_box;
         optix::Program intersect;
 
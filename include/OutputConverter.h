@@ -0,0 +1,58 @@
+#ifndef OUTPUTCONVERTER_H
+#define OUTPUTCONVERTER_H
+
+#include <stdint.h>
+#include <optixu/optixpp_namespace.h>
+
+//entries of the linear to sRGB table, tonemapped values are quantized to 12 bits
+#define OUTPUT_SRGB_TABLE_SIZE 4096
+
+//same values as in rt.cu
+enum OutputFormat{
+    OUTPUT_FLOAT4,
+    //sRGB encoded, alpha linear; r in the lowest byte
+    OUTPUT_RGBA8,
+    //linear, r in the lowest 10 bits, alpha in the top 2, as GL_UNSIGNED_INT_2_10_10_10_REV
+    OUTPUT_RGB10A2,
+    //not tonemapped, only exposure is applied, so it keeps the range above 1
+    OUTPUT_HALF4,
+    OUTPUT_FORMAT_COUNT
+};
+
+
+//Tonemap and quantize of the float4 image into the compact output formats.
+//rt.cu does the same per pixel when outputFormat is set, then only the compact buffer is read
+//back; this is the host side for images that are already float4, e.g. from CpuRenderer.
+//The tonemap is exposure followed by extended Reinhard, c*(1+c/white^2)/(1+c), so white 1
+//leaves [0,1] untouched and larger values roll highlights off instead of clipping them.
+//convert uses SSE2 on four pixels at a time, convertScalar is the reference it is checked against.
+class OutputConverter
+{
+    public:
+        OutputConverter();
+        virtual ~OutputConverter();
+
+        static size_t pixelSize(OutputFormat format);
+        static const char* name(OutputFormat format);
+
+        //binds output0 and the buffer rt.cu writes for format, with a one element placeholder
+        //for the other one, and returns the buffer to map: output0 for OUTPUT_FLOAT4
+        static optix::Buffer bind(optix::Context context, OutputFormat format, optix::Buffer output0);
+        static void setTonemap(optix::Context context, float exposure, float white);
+
+        void convert(const float *rgba, void *dst, size_t count, OutputFormat format, float exposure=1.f, float white=1.f);
+        void convertScalar(const float *rgba, void *dst, size_t count, OutputFormat format, float exposure=1.f, float white=1.f);
+
+        //times both paths on a synthetic width x height HDR image for every compact format and
+        //compares them; returns false if they differ or RGBA8 is more than one off an exact conversion
+        bool benchmark(int width, int height, int repeats);
+
+    protected:
+    private:
+        void convertPixel(const float *rgba, void *dst, OutputFormat format, float exposure, float inv_white2);
+
+        //tonemapped [0,1] to sRGB bytes
+        uint8_t encode[OUTPUT_SRGB_TABLE_SIZE];
+};
+
+#endif // OUTPUTCONVERTER_H
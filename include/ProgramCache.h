@@ -0,0 +1,67 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <string>
+#include <map>
+#include <functional>
+#include <ctime>
+#include <stdint.h>
+#include <optix_world.h>
+
+
+//Shares the Program objects created from PTX files: every (file, program) pair is created once per
+//context, and every file is read once and kept with its mtime, size and a hash of its contents.
+//Programs that are handed out through bind() also record where they went, so reloadChanged() can
+//create them again from a PTX file that changed on disk and set them in the same places, without
+//loading the scene again. Programs from get() are only shared, the caller keeps what it got.
+class ProgramCache
+{
+    public:
+        //puts the program in its place, called again with the new program on a reload
+        typedef std::function<void(optix::Program)> Setter;
+
+        ProgramCache();
+        virtual ~ProgramCache();
+
+        //drops everything cached for an earlier context
+        void init(optix::Context c);
+
+        optix::Program get(const std::string &file, const std::string &program);
+        //get() and set; target names the place, a later bind to the same target replaces it,
+        //so a material program set after the default one survives a reload of the default
+        optix::Program bind(const std::string &target, const std::string &file, const std::string &program, Setter setter);
+
+        //rereads the files whose mtime or size changed; if the contents changed too, their programs
+        //are created again and set through every bound target. A file whose new PTX does not compile
+        //keeps its old contents and programs. Returns the number of targets set
+        int reloadChanged();
+
+        int getHits();
+        int getMisses();
+        void report();
+
+    protected:
+    private:
+        struct PtxFile{
+            std::string ptx;
+            time_t mtime;
+            long long size;
+            uint64_t hash;
+        };
+        struct Binding{
+            std::string file, program;
+            Setter setter;
+        };
+
+        //false if the file cannot be read, it keeps what was read before
+        bool readFile(const std::string &file, PtxFile &f);
+        PtxFile* findFile(const std::string &file);
+
+        optix::Context context;
+        std::map<std::string, PtxFile> files;
+        std::map<std::pair<std::string, std::string>, optix::Program> programs;
+        std::map<std::string, Binding> bindings;
+        int hits, misses, file_reads, reloads;
+};
+
+#endif // PROGRAMCACHE_H
@@ -0,0 +1,12 @@
+#ifndef RAYTYPES_H
+#define RAYTYPES_H
+
+//ray type indices, set in the Phong and Shadow variables rt.cu reads them from
+enum ray_types
+{
+    Shadow,
+    Phong,
+    RAY_TYPE_COUNT,
+};
+
+#endif // RAYTYPES_H
@@ -0,0 +1,39 @@
+#ifndef RENDERCLIENT_H
+#define RENDERCLIENT_H
+
+#include <string>
+#include <vector>
+
+#include "RenderServer.h"
+
+
+//Client side of RenderServer, and a stand-in for the viewer to test a server with.
+class RenderClient
+{
+    public:
+        RenderClient();
+        virtual ~RenderClient();
+
+        bool connect(const std::string &address);
+        bool setEncoding(FrameEncoding encoding, int quality=FRAME_JPEG_QUALITY);
+        bool resize(int width, int height);
+        bool sendCamera(uint32_t id, const ServerCamera &camera);
+        bool shutdownServer();
+
+        //blocks for the next frame and decodes it into rgba, bottom row first;
+        //false once the server closed the connection or sent something that does not decode
+        bool receiveFrame(FrameHeader &header, std::vector<unsigned char> &rgba);
+
+        //moves the camera away from start for frames frames, sometimes several updates at once so the
+        //server has to merge them, and prints the round trip latency and the size of the frames
+        bool runTest(const ServerCamera &start, int frames, FrameEncoding encoding, int width, int height);
+
+    protected:
+    private:
+        int fd;
+        //the last decoded frame, the base of FRAME_DELTA
+        std::vector<unsigned char> last;
+        std::vector<unsigned char> payload;
+};
+
+#endif // RENDERCLIENT_H
@@ -0,0 +1,128 @@
+#ifndef RENDERSERVER_H
+#define RENDERSERVER_H
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <stdint.h>
+#include <optixu/optixu_math_namespace.h>
+
+#include "FrameCodec.h"
+
+//wait for clients while nobody needs a frame
+#define SERVER_POLL_MS 100
+//largest frame side a client may ask for
+#define SERVER_MAX_SIZE 8192
+//largest message a client may send, a camera update is 52 bytes
+#define SERVER_MAX_REQUEST 256
+//largest payload receiveMessage accepts: a frame of the largest size at 8 bytes per pixel, more
+//than any encoding takes
+#define SERVER_MAX_PAYLOAD (64+8ull*SERVER_MAX_SIZE*SERVER_MAX_SIZE)
+//a client that takes no part of a frame for this long, or leaves a frame owed unread, is dropped
+#define SERVER_SEND_TIMEOUT_MS 2000
+
+
+//Every message is a uint32 type and a uint32 payload size followed by the payload, in host byte
+//order since both ends run on the same machine.
+enum ServerMessage{
+    //client: uint32 id, then eye, U, V, W as in keyboard(), 12 floats
+    MSG_CAMERA=1,
+    //client: uint32 width, height
+    MSG_RESIZE,
+    //client: uint32 FrameEncoding, uint32 JPEG quality
+    MSG_ENCODING,
+    //client: stop serving after the frames in flight
+    MSG_SHUTDOWN,
+    //server: FrameHeader, then the encoded frame
+    MSG_FRAME
+};
+
+struct ServerCamera{
+    float3 eye, U, V, W;
+};
+
+struct FrameHeader{
+    //of the newest camera update in the frame, 0 before the first one
+    uint32_t camera_id;
+    uint32_t width, height;
+    uint32_t encoding;
+    //FRAME_DELTA against black instead of the previous frame
+    uint32_t key;
+    float render_ms, encode_ms;
+};
+
+//Long-lived headless renderer for clients on a local TCP or Unix socket, so the scene is imported
+//once instead of for every job. Addresses are unix:<path> or tcp:<port>, always on 127.0.0.1.
+//Clients send camera updates and sizes and get a frame whenever their view changed, encoded
+//as they chose. One context renders for everyone, one client frame after the other; camera
+//updates that arrive meanwhile are merged so a client only ever gets its newest view.
+//The latency of a client is the time from the oldest update a frame answers to its sending.
+//A frame is only rendered for a client whose socket has room for it, so a client that reads
+//slowly gets fewer frames instead of stalling the others, and one that stops reading is dropped.
+class RenderServer
+{
+    public:
+        //renders camera at width x height into RGBA8, bottom row first
+        typedef std::function<bool(const ServerCamera &camera, int width, int height, std::vector<unsigned char> &rgba)> RenderFunction;
+
+        RenderServer();
+        virtual ~RenderServer();
+
+        bool listen(const std::string &address);
+        //view and size of clients that did not send theirs yet
+        void setDefaults(const ServerCamera &camera, int width, int height);
+        //serves until a client sends MSG_SHUTDOWN; false if the socket fails
+        bool run(RenderFunction render);
+
+        //per client frames, bytes, merged updates and latencies, also printed when a client leaves
+        void report();
+
+        //shared with RenderClient; -1 on failure
+        static int connectTo(const std::string &address);
+        static bool sendMessage(int fd, uint32_t type, const void *a, size_t a_size, const void *b=NULL, size_t b_size=0);
+        //blocking; false on a payload over SERVER_MAX_PAYLOAD
+        static bool receiveMessage(int fd, uint32_t &type, std::vector<unsigned char> &payload);
+
+    protected:
+    private:
+        struct Client{
+            int fd;
+            int id;
+            std::vector<unsigned char> inbox;
+            ServerCamera camera;
+            uint32_t camera_id;
+            int width, height;
+            FrameEncoding encoding;
+            int quality;
+            //last frame sent, for FRAME_DELTA
+            std::vector<unsigned char> previous;
+            bool dirty;
+            std::chrono::steady_clock::time_point pending_since;
+
+            int frames, updates, merged;
+            long long bytes, raw_bytes;
+            double latency_sum, latency_max, render_sum, encode_sum;
+        };
+
+        void acceptClient();
+        //reads what arrived and handles every complete message; false once the client is gone
+        //or sent more than SERVER_MAX_REQUEST bytes in one message
+        bool receive(Client &c);
+        bool handle(Client &c, uint32_t type, const unsigned char *payload, uint32_t size);
+        void markDirty(Client &c);
+        bool serve(Client &c, RenderFunction &render);
+        void closeClient(Client &c);
+        void reportClient(const Client &c);
+
+        int listener;
+        std::string unix_path;
+        std::vector<Client> clients;
+        ServerCamera default_camera;
+        int default_width, default_height;
+        int next_id;
+        bool stopping;
+        std::vector<unsigned char> rgba, encoded;
+};
+
+#endif // RENDERSERVER_H
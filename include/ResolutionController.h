@@ -0,0 +1,89 @@
+#ifndef RESOLUTIONCONTROLLER_H
+#define RESOLUTIONCONTROLLER_H
+
+#include <string>
+#include <vector>
+
+//weight of the newest frame in the running frame time
+#define RESOLUTION_SMOOTHING 0.2
+//scale down above budget*(1+RESOLUTION_HIGH) for RESOLUTION_DOWN_FRAMES frames in a row
+#define RESOLUTION_HIGH 0.1
+#define RESOLUTION_DOWN_FRAMES 3
+//scale up when the next step is predicted below budget*(1-RESOLUTION_LOW) for RESOLUTION_UP_FRAMES frames
+#define RESOLUTION_LOW 0.15
+#define RESOLUTION_UP_FRAMES 30
+//frames to ignore after a change, the first launches at a new size are not representative
+#define RESOLUTION_SETTLE_FRAMES 4
+//scales are multiples of this
+#define RESOLUTION_STEP 0.05f
+//a new scale aims at this part of the budget
+#define RESOLUTION_AIM 0.9
+//frames kept for writeTrace, the oldest are overwritten
+#define RESOLUTION_HISTORY 3600
+//replay: scale changes allowed by default, the last frames that must be settled and stay within
+//the band, and how soon going back to a scale counts as oscillation
+#define RESOLUTION_REPLAY_MAX_CHANGES 10
+#define RESOLUTION_REPLAY_TAIL 60
+#define RESOLUTION_REPLAY_OSCILLATION 120
+
+
+//one frame of a trace: launch time, part of the image that was launched and the scale it ran at
+struct ResolutionSample{
+    double launch_ms;
+    double fraction;
+    float scale;
+};
+
+//Scale of the render resolution against the window that holds the launch time within a budget.
+//The cost of a frame is the launch time divided by the part of the image launched, so tiled and
+//adaptive launches that render less than the whole image do not look cheap. The cost is taken
+//to grow with the pixel count, scale squared. A different scale is only chosen after the
+//running cost stayed out of a band around the budget for several frames, going up takes much
+//longer than going down and every change is followed by a few frames that are ignored, so
+//a frame time close to the budget does not make the resolution flip back and forth.
+class ResolutionController
+{
+    public:
+        ResolutionController();
+        virtual ~ResolutionController();
+
+        //0 disables the controller, the scale stays at the largest one
+        void setBudget(double ms);
+        void setScaleLimits(float min_scale, float max_scale);
+        //forget the running cost, e.g. after the scene changed
+        void reset();
+
+        //launch_ms of a launch over fraction of the image at the current scale; frames with fraction 0
+        //are not counted. Returns true when the scale changed, the decision is logged
+        bool update(double launch_ms, double fraction=1.0);
+        float getScale();
+        //render resolution for a window, at least 1x1
+        void getRenderSize(int window_width, int window_height, int &width, int &height);
+
+        //the last RESOLUTION_HISTORY frames given to update, oldest first, as lines of launch_ms fraction scale
+        bool writeTrace(const std::string &path);
+        static bool readTrace(const std::string &path, std::vector<ResolutionSample> &trace);
+        //runs a fresh controller over a recorded trace, with every frame's cost moved to the scale
+        //the controller chose by the pixel count; prints its decisions and how often both went over budget.
+        //Fails on more than max_changes scale changes, a change or frames over the band in the last
+        //RESOLUTION_REPLAY_TAIL frames unless at the smallest scale, or a return to a scale left
+        //less than RESOLUTION_REPLAY_OSCILLATION frames before
+        static bool replay(const std::vector<ResolutionSample> &trace, double budget_ms, int max_changes=RESOLUTION_REPLAY_MAX_CHANGES);
+
+    protected:
+    private:
+        float quantize(float scale);
+        void change(float next, const char *reason);
+
+        double budget;
+        float min_scale, max_scale;
+        float scale;
+        double cost;
+        int frames, over, under, settle;
+        int changes;
+        //ring of RESOLUTION_HISTORY frames, history_next is the oldest once it is full
+        std::vector<ResolutionSample> history;
+        size_t history_next;
+};
+
+#endif // RESOLUTIONCONTROLLER_H
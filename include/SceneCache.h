@@ -0,0 +1,153 @@
+#ifndef SCENECACHE_H
+#define SCENECACHE_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <assimp/scene.h>
+
+#include "LoadProfiler.h"
+
+#define SCENE_CACHE_VERSION 2
+#define SCENE_CACHE_EXTENSION ".scache"
+
+
+//Binary image of a post-processed aiScene, written next to the source file.
+//On a hit the file is memory mapped and the returned aiScene points straight into the mapping,
+//so the loaders keep working on aiMesh/aiNode/aiMaterial and copy from mapped pages.
+//Scenes with animations are not written, the cache has no place for them.
+class SceneCache
+{
+    public:
+        SceneCache();
+        virtual ~SceneCache();
+
+        //imports file with flags, then applies each post_flags step on its own, lowest bit first
+        //returns the cached scene when the cache matches the source content, the files it
+        //references and the flags
+        const aiScene* import(std::string file, unsigned int flags, unsigned int post_flags=0);
+
+        //frees the scene returned by import, whichever way it was created
+        void release();
+
+        bool fromCache();
+
+        //when disabled import neither reads nor writes cache files; on by default
+        void setEnabled(bool enable);
+        //times hashing, import, post-processing and the cache map or write as profiler stages
+        void setProfiler(LoadProfiler *p);
+
+        static uint64_t hashFile(std::string file, uint64_t &size);
+        //hashFile of file continued over the files the importer reads along with it, see
+        //findDependencies; size is the size of file alone
+        static uint64_t hashSource(std::string file, uint64_t &size);
+        //material libraries of an OBJ, nothing for other formats
+        static std::vector<std::string> findDependencies(std::string file);
+
+    protected:
+    private:
+        struct Header{
+            char magic[4];
+            uint32_t version;
+            uint64_t source_hash;
+            uint64_t source_size;
+            uint32_t import_flags;
+            uint32_t post_flags;
+            uint32_t nmeshes;
+            uint32_t nmaterials;
+            uint32_t nnodes;
+            uint32_t pad;
+            uint64_t meshes;
+            uint64_t materials;
+            uint64_t nodes;
+        };
+
+        enum MeshFlags{
+            MESH_NORMALS=1,
+            MESH_TANGENTS=2,
+            MESH_TEXCOORDS=4
+        };
+
+        //all offsets are relative to the start of the file
+        struct Mesh{
+            uint32_t nvertex;
+            uint32_t nface;
+            uint32_t material;
+            //index count of every face, 0 when faces differ and face_counts is used
+            uint32_t face_size;
+            uint32_t flags;
+            uint32_t primitive_types;
+            uint64_t name;
+            uint64_t vertices;
+            uint64_t normals;
+            uint64_t tangents;
+            uint64_t bitangents;
+            uint64_t texcoords;
+            uint64_t indices;
+            uint64_t face_counts;
+        };
+
+        enum MaterialFlags{
+            MATERIAL_DIFFUSE=1,
+            MATERIAL_SPECULAR=2,
+            MATERIAL_SHININESS=4,
+            MATERIAL_REFRACTI=8
+        };
+
+        struct Material{
+            uint64_t name;
+            float diffuse[4];
+            float specular[4];
+            float shininess;
+            float refracti;
+            uint32_t flags;
+            uint32_t ntextures;
+            uint64_t textures;
+        };
+
+        struct Texture{
+            uint32_t type;
+            uint32_t index;
+            uint64_t path;
+        };
+
+        //nodes are stored breadth first so the children of a node are contiguous
+        struct Node{
+            uint64_t name;
+            float transform[16];
+            uint32_t nchildren;
+            uint32_t first_child;
+            uint32_t nmeshes;
+            uint32_t pad;
+            uint64_t meshes;
+        };
+
+        static std::string cachePath(std::string file);
+
+        bool write(std::string path, const aiScene *s, uint64_t hash, uint64_t size, unsigned int flags, unsigned int post_flags);
+        bool mapFile(std::string path, uint64_t hash, uint64_t size, unsigned int flags, unsigned int post_flags);
+        void unmap();
+        //every offset and count of the mapping points inside it, and every index between
+        //meshes, materials and nodes is in range
+        bool validate();
+        bool inMapping(uint64_t offset, uint64_t count, size_t size);
+        bool isString(uint64_t offset);
+        aiScene* buildScene();
+
+        void stage(const char *name);
+        void endStage();
+
+        uint64_t append(std::vector<char> &blob, const void *data, size_t size);
+        uint64_t appendString(std::vector<char> &blob, const char *str);
+        const char* getString(uint64_t offset);
+
+        const aiScene *scene;
+        bool cached;
+        bool enabled;
+        LoadProfiler *profiler;
+
+        char *mapping;
+        size_t mapping_size;
+};
+
+#endif // SCENECACHE_H
@@ -0,0 +1,95 @@
+#ifndef SCENEEDITOR_H
+#define SCENEEDITOR_H
+
+#include <string>
+#include <vector>
+#include <set>
+#include <optix_world.h>
+
+//one aiNode of the per node graph: Transform, then a Group over the child nodes and the
+//GeometryGroup if there are children, else the GeometryGroup alone
+struct SceneNode{
+    std::string name;
+    //-1 for the root
+    int parent;
+    optix::Transform transform;
+    //as set on transform, row major
+    float matrix[16];
+    optix::GeometryGroup geometry;
+    //NULL without child nodes
+    optix::Group children;
+    //scene mesh index of every child of geometry, in order
+    std::vector<int> meshes;
+};
+
+struct EditTiming{
+    const char *edit;
+    int node, mesh;
+    //accelerations this edit marked, those marked by an earlier edit of the same commit are not counted
+    int rebuilt, refit;
+    double edit_ms;
+    //of the commit that built them, shared by all its edits
+    double build_ms;
+};
+
+
+//Edits of the per node graph after it was loaded. Only the accelerations between the edited node
+//and the root are marked dirty: the one over the meshes of a node is rebuilt when its meshes
+//change, the Group ones above are refit when they are built with refit on, see
+//OptixRenderer::setSceneEdits. The rest of the graph is left alone. Marked accelerations are
+//built on the next launch, or right away by commit() to time them.
+class SceneEditor
+{
+    public:
+        SceneEditor();
+        virtual ~SceneEditor();
+
+        void clear();
+        //in depth first order, the parent first; returns the node index
+        int addNode(const std::string &name, int parent, optix::Transform transform, const float *matrix, optix::GeometryGroup geometry, const std::vector<int> &meshes);
+        void setChildren(int node, optix::Group children);
+
+        //keep an EditTiming of every edit; on by default, AnimationPlayer keeps its own per frame
+        void setTimed(bool enabled);
+
+        //first node with the name, -1 if there is none
+        int findNode(const std::string &name);
+        int getNodeCount();
+        const SceneNode& getNode(int node);
+
+        //row major like aiMatrix4x4, relative to the parent node
+        bool setTransform(int node, const float *matrix);
+        //adds instance, the shared instance of scene mesh mesh, to the meshes of node
+        bool insertMesh(int node, int mesh, optix::GeometryInstance instance);
+        //removes the first instance of scene mesh mesh from node
+        bool removeMesh(int node, int mesh);
+        //materials are not part of any acceleration, nothing is marked
+        void setMaterial(int mesh, optix::GeometryInstance instance, optix::Material material);
+
+        //builds what the edits since the last commit marked with an empty launch, returns the ms
+        double commit(optix::Context context);
+        //edits since the last commit
+        int getPendingCount();
+
+        const std::vector<EditTiming>& getTimings();
+        void report();
+
+    protected:
+    private:
+        bool validNode(int node);
+        //geometry of node, then the Groups up to the root
+        void markGeometry(int node, EditTiming &timing);
+        void markPath(int node, EditTiming &timing);
+        void markChildren(int node, EditTiming &timing);
+
+        std::vector<SceneNode> nodes;
+        //node and 0 for its GeometryGroup, 1 for its Group, marked since the last commit
+        std::set<std::pair<int, int> > marked;
+        std::vector<EditTiming> timings;
+        size_t committed;
+        int commits;
+        double build_ms;
+        bool timed;
+};
+
+#endif // SCENEEDITOR_H
@@ -0,0 +1,63 @@
+#ifndef SCENEFLATTENER_H
+#define SCENEFLATTENER_H
+
+#include <vector>
+#include <stdint.h>
+#include <assimp/scene.h>
+
+
+//one placement of a shared GeometryGroup
+struct FlatInstance{
+    aiMatrix4x4 transform;
+    bool identity;
+    int group;
+};
+
+//Two level form of an aiScene: a top Group over GeometryGroups, each under a Transform unless
+//it sits at the identity.
+//canonical[m] is the first mesh with the same geometry and material as mesh m; only canonical
+//meshes need buffers, and groups list canonical mesh indices only.
+struct FlatScene{
+    std::vector<int> canonical;
+    std::vector<std::vector<int> > groups;
+    std::vector<FlatInstance> instances;
+};
+
+//Pre-pass over the node tree before the optix graph is built.
+//Transform chains are multiplied down to one world matrix per node, meshes of all nodes with the
+//same world matrix are merged into one GeometryGroup, and groups with the same meshes become
+//instances of one GeometryGroup, so they share its acceleration.
+class SceneFlattener
+{
+    public:
+        SceneFlattener();
+        virtual ~SceneFlattener();
+
+        void flatten(const aiScene *scene, FlatScene &flat);
+
+        //node, acceleration and depth counts of the per-node graph and of the flat one;
+        //depth is the number of graph nodes from the root down to a GeometryGroup
+        void report();
+
+        //hash of the vertex attributes, faces and material of a mesh
+        static uint64_t hashMesh(const aiMesh *mesh);
+        static bool sameMesh(const aiMesh *a, const aiMesh *b);
+
+    protected:
+    private:
+        struct Placement{
+            aiMatrix4x4 transform;
+            std::vector<int> meshes;
+        };
+
+        void collect(const aiNode *node, aiMatrix4x4 parent, int depth, const FlatScene &flat, std::vector<Placement> &placements);
+
+        int nodes, mesh_nodes, mesh_refs, meshes, unique_meshes;
+        int max_depth_before;
+        double mesh_depth_before;
+        int transforms_after, max_depth_after;
+        double mesh_depth_after;
+        int groups_after, instances_after;
+};
+
+#endif // SCENEFLATTENER_H
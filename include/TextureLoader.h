@@ -0,0 +1,117 @@
+#ifndef TEXTURELOADER_H
+#define TEXTURELOADER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdint.h>
+
+#include "ThreadPool.h"
+
+
+enum TextureFormat{
+    TEXTURE_RGBA8,
+    TEXTURE_L8
+};
+
+enum BlockFormat{
+    BLOCK_NONE,
+    BLOCK_BC1,
+    BLOCK_BC3,
+    BLOCK_BC4
+};
+
+//pixels are tightly packed with the origin in the lower left corner, like DevIL's IL_ORIGIN_LOWER_LEFT
+struct DecodedTexture{
+    std::string file;
+    TextureFormat format;
+    bool ok;
+    int width, height;
+    std::vector<unsigned char> pixels;
+    //levels 1 and up when the loader builds mipmaps, see MipGenerator
+    std::vector<std::vector<unsigned char> > mips;
+    //per level blocks when the loader compresses, see BlockCompressor;
+    //pixels and mips then hold the decoded blocks
+    BlockFormat block_format;
+    std::vector<std::vector<unsigned char> > blocks;
+    //of level 0 against the uncompressed image
+    float psnr;
+    bool block_cache_hit;
+
+    //hash and size of the file contents; files with the same contents and format are decoded once
+    uint64_t hash;
+    uint64_t size;
+    //index of the entry holding the pixels, the entry itself unless it duplicates an earlier file
+    int source;
+
+    double read_ms;
+    double decode_ms;
+    double mip_ms;
+    double compress_ms;
+    //filled in by whoever uploads the texture
+    double upload_ms;
+};
+
+//contents of a texture file decoded to a format; textures with equal keys share their pixels
+struct TextureKey{
+    uint64_t hash, size;
+    int format;
+    TextureKey(const DecodedTexture &tex, int format);
+    bool operator<(const TextureKey &k) const;
+};
+
+//Decode stage of texture loading.
+//All requested images are read, decoded, converted and flipped on the thread pool;
+//PNG and JPEG use libpng/libjpeg directly, other formats go through DevIL one at a time
+//since DevIL keeps a single global bound image.
+//Requests are deduplicated by path, decodes by content hash, so a file copied under
+//another name costs one decode and, if the caller uploads resolve(i), one upload.
+//Uploading stays with the caller, which walks the results in request order.
+class TextureLoader
+{
+    public:
+        TextureLoader(ThreadPool &pool);
+        virtual ~TextureLoader();
+
+        //returns the index of the decoded texture; repeated requests share one entry
+        int request(std::string file, TextureFormat format);
+
+        //build the full mip chain of every texture as part of its decode
+        void setMipmaps(bool enabled);
+        //block compress every texture, reusing the .bcache files next to the images
+        void setCompression(bool enabled);
+
+        void decodeAll();
+
+        int getTextureCount();
+        DecodedTexture& get(int index);
+        //index of the entry whose pixels back index
+        int resolve(int index);
+        //entries sharing the pixels of an earlier entry
+        int getDuplicateCount();
+        //level 0 and every mip of tex, what an upload of it takes
+        static size_t levelBytes(const DecodedTexture &tex);
+
+        //per texture read, decode and upload times, with the cache size on disk and PSNR when compressing
+        void report();
+
+        void clear();
+
+    protected:
+    private:
+        void read(DecodedTexture &tex, std::vector<unsigned char> &data);
+        void decode(DecodedTexture &tex, const std::vector<unsigned char> &data);
+
+        ThreadPool &pool;
+        std::vector<DecodedTexture> textures;
+        std::map<std::string, int> requested;
+        //first entry with that content
+        std::map<TextureKey, int> contents;
+        int decoded;
+        bool mipmaps;
+        bool compression;
+        double decode_wall_ms;
+};
+
+#endif // TEXTURELOADER_H
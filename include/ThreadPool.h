@@ -0,0 +1,59 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <deque>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+
+//Fixed set of worker threads running indexed tasks.
+//Each worker owns a queue of indices; idle workers steal from the back of the others.
+class ThreadPool
+{
+    public:
+        typedef std::function<void(int index, int thread)> Task;
+
+        ThreadPool(int nthreads=0);
+        virtual ~ThreadPool();
+
+        int getThreadCount();
+
+        //runs task(i, thread) for i in [0, count) and returns when all are done
+        //not reentrant: a task must not call parallelFor on the same pool
+        void parallelFor(int count, Task task);
+
+        //number of indices taken from another worker's queue in the last parallelFor
+        int getStealCount();
+
+    protected:
+    private:
+        struct WorkQueue{
+            std::mutex lock;
+            std::deque<int> items;
+        };
+
+        void workerLoop(int thread);
+        bool popLocal(int thread, int &index);
+        bool steal(int thread, int &index);
+
+        std::vector<std::thread> workers;
+        std::vector<WorkQueue*> queues;
+
+        std::mutex submit_lock;
+        std::mutex state_lock;
+        std::condition_variable work_ready;
+        std::condition_variable work_done;
+
+        Task current;
+        unsigned int generation;
+        bool stopping;
+        int active;
+        std::atomic<int> remaining;
+        std::atomic<int> steals;
+};
+
+#endif // THREADPOOL_H
@@ -0,0 +1,75 @@
+#ifndef TILELAUNCHER_H
+#define TILELAUNCHER_H
+
+#include <vector>
+#include <optixu/optixpp_namespace.h>
+
+//side of the squares dirty regions and costs are tracked in
+#define TILE_LAUNCH_SIZE 64
+
+
+//rectangle of the image in pixels
+struct TileRect{
+    int x, y, width, height;
+};
+
+struct TileTiming{
+    TileRect rect;
+    double ms;
+};
+
+//Launches of the ray generation programs over parts of the image.
+//rt.cu adds launchOffset to launch_index and takes the image size from accum_buffer, so a launch
+//over a rectangle writes the same pixels with the same samples as a full launch would.
+//Dirty regions are kept on a grid of TILE_LAUNCH_SIZE squares. launchDirty renders the dirty
+//squares only, one launch per run of neighbouring dirty squares in a row, and nothing while the
+//image is clean. Every launch is timed and the cost per pixel of the squares it covered is kept,
+//for splitting the image into launches of even cost.
+class TileLauncher
+{
+    public:
+        TileLauncher();
+        virtual ~TileLauncher();
+
+        //binds launchOffset and imageExtent, the image being the whole buffer; the whole image starts dirty
+        void init(optix::Context context, int w, int h);
+        //the whole image becomes dirty
+        void setSize(int w, int h);
+
+        //rectangles are clipped to the image
+        void markDirty(const TileRect &rect);
+        void markAllDirty();
+        bool isDirty();
+
+        //launches entry over the dirty squares and clears them; returns the number of launches
+        int launchDirty(unsigned entry);
+        //launches entry over every rectangle, e.g. a region of interest;
+        //squares they cover completely are clean afterwards
+        void launchTiles(unsigned entry, const std::vector<TileRect> &rects);
+        void launchRegion(unsigned entry, const TileRect &rect);
+
+        //every launch of the last launchDirty or launchTiles call
+        const std::vector<TileTiming>& getTimings();
+        //ms per million pixels of the last launch that covered the square, 0 before the first
+        double getTileCost(int tx, int ty);
+        int getTilesX();
+        int getTilesY();
+
+        //launches and pixels of the last call, and the cheapest and most expensive square
+        void report();
+
+    protected:
+    private:
+        TileRect clip(const TileRect &rect);
+        void launchRect(unsigned entry, const TileRect &rect);
+        void markClean(const TileRect &rect);
+
+        optix::Context context;
+        int width, height;
+        int tiles_x, tiles_y;
+        std::vector<char> dirty;
+        std::vector<double> cost;
+        std::vector<TileTiming> timings;
+};
+
+#endif // TILELAUNCHER_H
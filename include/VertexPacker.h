@@ -0,0 +1,64 @@
+#ifndef VERTEXPACKER_H
+#define VERTEXPACKER_H
+
+#include <vector>
+#include <stdint.h>
+#include <optix_world.h>
+#include <assimp/scene.h>
+
+#include "MemoryTracker.h"
+
+//uvs beyond this magnitude lose too much precision as half floats and stay float
+#define HALF_UV_RANGE 4.f
+
+
+//Vertex attributes of one mesh in the layout read by intersectMesh when packedVertices is set.
+//Positions stay float3 so the intersection itself is unchanged; each vertex then has one uint3:
+//  x  normal, octahedral snorm16x2
+//  y  tangent, octahedral snorm16x2 with the lowest bit of y holding the bitangent sign
+//  z  uv as two half floats, unless the uvs left HALF_UV_RANGE and went to texCoord_buffer
+//Indices are 16 bit when every vertex index fits.
+struct PackedMesh{
+    std::vector<uint32_t> attributes;
+    std::vector<uint16_t> index16;
+    std::vector<int> index32;
+    std::vector<float> texcoords;
+    bool has_tangents;
+    bool has_texcoords;
+    bool half_texcoords;
+
+    size_t float_bytes;
+    size_t packed_bytes;
+};
+
+class VertexPacker
+{
+    public:
+        VertexPacker();
+        virtual ~VertexPacker();
+
+        static void pack(const aiMesh *mesh, PackedMesh &packed);
+
+        //creates the buffers of a packed mesh on geometry, tracked under index when memory is set
+        static void upload(optix::Context context, optix::Geometry geometry, const aiMesh *mesh, const PackedMesh &packed,
+                           MemoryTracker *memory=NULL, int index=-1);
+
+        //binds one element placeholders for every buffer intersectMesh declares, so packed and float
+        //meshes only need to set the buffers they use
+        static void setDefaults(optix::Context context, MemoryTracker *memory=NULL);
+
+        //decodes every vertex and compares it with the float attributes; prints the error and memory use
+        //returns false if indices differ or an attribute is further off than the format allows,
+        //the rebuilt bitangent included
+        static bool check(const aiMesh *mesh, const PackedMesh &packed, int index);
+
+        static uint32_t encodeOct(aiVector3D v);
+        static float3 decodeOct(uint32_t bits);
+        static uint16_t floatToHalf(float f);
+        static float halfToFloat(uint16_t h);
+
+    protected:
+    private:
+};
+
+#endif // VERTEXPACKER_H
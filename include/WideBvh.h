@@ -0,0 +1,214 @@
+#ifndef WIDEBVH_H
+#define WIDEBVH_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <xmmintrin.h>
+#include <optixu/optixu_math_namespace.h>
+
+#include "ThreadPool.h"
+
+#define BVH_WIDTH 4
+#define BVH_MAX_LEAF 4
+#define BVH_BINS 16
+#define BVH_TRAVERSAL_COST 1.f
+#define BVH_INTERSECT_COST 1.f
+//traversal stack on the stack of traverse, deeper trees get one on the heap
+#define BVH_STACK_SIZE 64
+
+#define BVH_CACHE_VERSION 2
+#define BVH_CACHE_EXTENSION ".bvh"
+
+
+//Four children per node with their boxes stored per axis, so one node is tested with a
+//single SSE slab test. 128 bytes, two cache lines, and every node starts on a line.
+//child[i] is a node index when count[i] is 0, the first entry of prims when count[i]>0;
+//unused slots have child -1 and count 0.
+struct WideBvhNode{
+    float bmin_x[BVH_WIDTH], bmin_y[BVH_WIDTH], bmin_z[BVH_WIDTH];
+    float bmax_x[BVH_WIDTH], bmax_y[BVH_WIDTH], bmax_z[BVH_WIDTH];
+    int32_t child[BVH_WIDTH];
+    int32_t count[BVH_WIDTH];
+};
+
+struct BvhStats{
+    int nodes, leaves, prims;
+    int max_depth;
+    double mean_leaf_depth;
+    double mean_leaf_size;
+    int max_leaf_size;
+    //average number of used slots in a node
+    double fill;
+    //expected traversal and intersection cost of a random ray, relative to the root box
+    double sah_cost;
+    size_t bytes;
+    double build_ms;
+};
+
+//Host BVH over triangles given as the float3 vertex_buffer and int3 index_buffer of a mesh.
+//Built top down with binned SAH into a binary tree, then collapsed into 4 wide nodes by
+//opening the child with the largest surface area until a node is full.
+//The upper levels are split on the calling thread with parallel binning; once there are enough
+//independent subtrees they are built concurrently on the pool.
+//Triangles with zero area are left out, they can never be hit.
+class WideBvh
+{
+    public:
+        WideBvh();
+        virtual ~WideBvh();
+
+        void build(const float3 *vertices, const int3 *indices, int ntriangles, ThreadPool &pool);
+
+        //the file is only used when its key matches, e.g. a hash of the vertex and index data,
+        //it was built over the same number of triangles and every node and leaf index is in range
+        bool save(std::string file, uint64_t key);
+        bool load(std::string file, uint64_t key, int ntriangles);
+
+        const BvhStats& getStats();
+        void report(std::string name);
+
+        int getNodeCount();
+        const WideBvhNode* getNodes();
+        const int* getPrims();
+
+        //calls visit(prims, count, tmax) for every leaf the ray reaches, nearest box first;
+        //visit may lower tmax and returns true to stop
+        template<class Visitor>
+        void traverse(float3 origin, float3 direction, float tmin, float &tmax, Visitor &visit) const;
+
+    protected:
+    private:
+        struct PrimRef{
+            float3 bmin, bmax, centroid;
+            int index;
+        };
+
+        struct BuildNode{
+            float3 bmin, bmax;
+            //leaf when count>0, otherwise left and right are node indices
+            int left, right;
+            int first, count;
+        };
+
+        struct Bin{
+            float3 bmin, bmax;
+            int count;
+        };
+
+        struct Split{
+            int axis, bin;
+            float cost;
+            float3 cmin;
+            float scale;
+        };
+
+        struct Task{
+            int node, begin, end;
+        };
+
+        WideBvh(const WideBvh&);
+        WideBvh& operator=(const WideBvh&);
+
+        void allocate(int count);
+        void release();
+
+        Split findSplit(int begin, int end, float3 cmin, float3 cmax, ThreadPool *pool);
+        int partition(int begin, int end, const Split &split);
+        int buildTop(int begin, int end, int task_size, ThreadPool &pool, std::vector<Task> &tasks);
+        int buildRecursive(std::vector<BuildNode> &out, int begin, int end);
+        void makeNode(BuildNode &node, int begin, int end, float3 &cmin, float3 &cmax);
+        int collapse(const std::vector<BuildNode> &binary, int root);
+        bool validate();
+        void computeStats();
+
+        std::vector<PrimRef> refs;
+        std::vector<BuildNode> binary;
+
+        WideBvhNode *nodes;
+        int node_count, node_capacity;
+        std::vector<int> prims;
+        //given to build, zero area ones included
+        int triangle_count;
+        //traversal stack entries the deepest path can need, set with the stats
+        int stack_size;
+        BvhStats stats;
+};
+
+template<class Visitor>
+void WideBvh::traverse(float3 origin, float3 direction, float tmin, float &tmax, Visitor &visit) const{
+    if(node_count==0){
+        return;
+    }
+    const __m128 ox=_mm_set1_ps(origin.x), oy=_mm_set1_ps(origin.y), oz=_mm_set1_ps(origin.z);
+    const __m128 ix=_mm_set1_ps(1.f/direction.x), iy=_mm_set1_ps(1.f/direction.y), iz=_mm_set1_ps(1.f/direction.z);
+    const __m128 near_limit=_mm_set1_ps(tmin);
+
+    //entry distance kept with each node, so nodes behind a hit found meanwhile are skipped
+    int local_stack[BVH_STACK_SIZE];
+    float local_distance[BVH_STACK_SIZE];
+    std::vector<int> heap_stack;
+    std::vector<float> heap_distance;
+    int *stack=local_stack;
+    float *stack_distance=local_distance;
+    if(stack_size>BVH_STACK_SIZE){
+        heap_stack.resize(stack_size);
+        heap_distance.resize(stack_size);
+        stack=&heap_stack[0];
+        stack_distance=&heap_distance[0];
+    }
+    int sp=0;
+    stack[sp]=0;
+    stack_distance[sp++]=tmin;
+    while(sp>0){
+        sp--;
+        if(stack_distance[sp]>tmax){
+            continue;
+        }
+        const WideBvhNode &node=nodes[stack[sp]];
+        __m128 t0x=_mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bmin_x), ox), ix);
+        __m128 t1x=_mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bmax_x), ox), ix);
+        __m128 t0y=_mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bmin_y), oy), iy);
+        __m128 t1y=_mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bmax_y), oy), iy);
+        __m128 t0z=_mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bmin_z), oz), iz);
+        __m128 t1z=_mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bmax_z), oz), iz);
+        __m128 enter=_mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)), _mm_max_ps(_mm_min_ps(t0z, t1z), near_limit));
+        __m128 exit=_mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)), _mm_min_ps(_mm_max_ps(t0z, t1z), _mm_set1_ps(tmax)));
+        int mask=_mm_movemask_ps(_mm_cmple_ps(enter, exit));
+        if(!mask){
+            continue;
+        }
+        float distance[BVH_WIDTH];
+        _mm_storeu_ps(distance, enter);
+
+        //leaves right away, inner children sorted so the nearest is popped first
+        int order[BVH_WIDTH];
+        int ninner=0;
+        for(int i=0; i<BVH_WIDTH; i++){
+            if(!(mask&(1<<i)) || (node.count[i]==0 && node.child[i]<0)){
+                continue;
+            }
+            if(node.count[i]>0){
+                if(distance[i]>tmax){
+                    continue;
+                }
+                if(visit(&prims[node.child[i]], node.count[i], tmax)){
+                    return;
+                }
+                continue;
+            }
+            int j=ninner++;
+            while(j>0 && distance[order[j-1]]<distance[i]){
+                order[j]=order[j-1];
+                j--;
+            }
+            order[j]=i;
+        }
+        for(int j=0; j<ninner; j++){
+            stack[sp]=node.child[order[j]];
+            stack_distance[sp++]=distance[order[j]];
+        }
+    }
+}
+
+#endif // WIDEBVH_H
@@ -3,6 +3,13 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <thread>
+#include <mutex>
 
 #include <GL/glew.h>
 #include <GL/gl.h>
@@ -10,7 +17,6 @@
 #include <IL/il.h>
 #include <IL/ilu.h>
 
-#include <assimp/Importer.hpp>
 #include <assimp/cimport.h>
 #include <assimp/material.h>
 #include <assimp/scene.h>
@@ -23,45 +29,135 @@
 #include <optixu/optixu_math_namespace.h>
 #include <optixu/optixu_vector_types.h>
 
+#include "AdaptiveSampler.h"
+#include "BatchRenderer.h"
+#include "CpuRenderer.h"
+#include "FramePipeline.h"
+#include "TileLauncher.h"
+#include "ResolutionController.h"
+#include "RenderServer.h"
+#include "RenderClient.h"
+#include "InputRecorder.h"
+#include "InputReplay.h"
+#include "Json.h"
+#include "Hash.h"
+#include "LoadProfiler.h"
+#include "MemoryTracker.h"
+#include "MeshUploader.h"
+#include "MipGenerator.h"
+#include "OptixRenderer.h"
+#include "OutputConverter.h"
+#include "ProgramCache.h"
+#include "RayTypes.h"
+#include "SceneCache.h"
+#include "SceneFlattener.h"
+#include "TextureLoader.h"
+#include "ThreadPool.h"
+#include "VertexPacker.h"
+#include "WideBvh.h"
+
 #define ANISOTROPY 16.0f
-#define MIPMAPS 1
 
 #define STEP 2
 #define ANG_STEP 0.1
 
 #define USE_MS 1
+//accumulate PROGRESSIVE_SAMPLES (rt.cu) per frame while the camera stands still, instead of USE_MS
+#define PROGRESSIVE 1
+//a still image stops launching after this many frames
+#define PROGRESSIVE_MAX_FRAMES 1024
+//with PROGRESSIVE, new samples only go to tiles that have not converged, see AdaptiveSampler
+#define ADAPTIVE_SAMPLING 1
+//OUTPUT_RGBA8, OUTPUT_RGB10A2 or OUTPUT_HALF4 are tonemapped on the device and read back
+//in 4 or 8 bytes per pixel instead of 16, see OutputConverter
+#define OUTPUT_FORMAT OUTPUT_FLOAT4
+#define EXPOSURE 1.f
+#define WHITE_POINT 1.f
+//frames in flight between the render thread and the display; 0 launches and draws in turn on the GLUT thread
+#define PIPELINE_BUFFERS 3
+//frames between two pipeline latency reports
+#define PIPELINE_REPORT_FRAMES 300
+//longest the render thread sleeps with nothing to launch, and the display waits for a frame
+#define PIPELINE_IDLE_MS 20
+//launch time the render resolution is scaled to hold, upscaled to the window; 0 renders at the window size
+#define FRAME_BUDGET_MS 33.f
+#define MIN_RESOLUTION_SCALE 0.25f
+//written by the r key, read by --replay
+#define INPUT_LOG "input.log"
+//block compress scene textures on load, see BlockCompressor
+#define COMPRESS_TEXTURES 0
+//octahedral normals and tangents, half uvs and 16 bit indices, see VertexPacker
+#define PACK_VERTICES 0
+//collapse the node tree and instance identical meshes, see SceneFlattener
+#define FLATTEN_SCENE 1
+//free the imported scene once the geometry is on the device
+#define RELEASE_SCENE 1
+//device memory the tracked buffers and samplers should stay under, 0 for no budget; see MemoryTracker
+#define MEMORY_BUDGET_MB 0
+//written by the m key with every tracked allocation
+#define MEMORY_DUMP "memory.json"
 
 unsigned int LoadFlags = aiProcessPreset_TargetRealtime_MaxQuality|aiProcess_RemoveRedundantMaterials|aiProcess_PreTransformVertices;
 
 enum EntryPoints {
     ENTRY_PINHOLE,
     ENTRY_PINHOLE_MS,
+    ENTRY_PROGRESSIVE,
+    ENTRY_ADAPTIVE,
     ENTRY_COUNT
 };
 
 using namespace optix;
 
+//render resolution, the window size scaled by resolution
 int width=720;
 int height=720;
+int windowWidth=720;
+int windowHeight=720;
+ResolutionController resolution;
+//launchFrame calls, input events are recorded against it
+uint32_t launchCount=0;
+InputRecorder recorder;
 
 Context renderer;
 Buffer out;
+//out, or the compact buffer of OUTPUT_FORMAT
+Buffer display;
+Buffer accum;
+//launches accumulated into accum since the view last changed
+int frameIndex=0;
+AdaptiveSampler adaptive;
+//without PROGRESSIVE only what changed is launched again, nothing while the camera stands still
+TileLauncher tiles;
+//with PIPELINE_BUFFERS the render thread launches while keyboard() and reshape() change the context
+std::mutex contextLock;
+FramePipeline *pipeline=NULL;
 
 float3 eye=make_float3(0.f, 0.f, 0.f);
 float3 up=make_float3(0.f,1.f,0.f);
 float3 lookDir=normalize(make_float3(0.f, 0.f, -1.f));
 
-Assimp::Importer importer;
+SceneCache scene_cache;
+ThreadPool pool;
+//buffers and samplers of initContext by category, mesh and material
+MemoryTracker memory;
+//set by --load-bench to time the loader stages
+LoadProfiler *profiler=NULL;
 std::string scene_p="crytek-sponza/";
 std::string scene_name="sponza.obj";
 std::string ptx_p="rt.ptx";
+//the programs of ptx_p, the p key sets them again after rt.ptx was rebuilt
+ProgramCache programs;
 
-enum ray_types
+void profileStage(const char *name)
 {
-    Shadow,
-    Phong,
-    RAY_TYPE_COUNT,
-};
+    if(profiler) profiler->stage(name);
+}
+
+void profileEnd()
+{
+    if(profiler) profiler->endStage();
+}
 
 Buffer genOutputBuffer()
 {
@@ -71,22 +167,173 @@ Buffer genOutputBuffer()
     return outBuffer;
 }
 
-void reshape(int w, int h)
+void trackOutput()
+{
+    memory.trackBuffer(out,MEMORY_OUTPUT,"output");
+    //float4 is read from out itself
+    memory.track(MEMORY_OUTPUT,"display",display.get()!=out.get()?MemoryTracker::bufferBytes(display):0);
+    memory.trackBuffer(accum,MEMORY_OUTPUT,"accumulation");
+}
+
+//setRenderSize without the input recording, for sizes that are not the window's
+void resizeBuffers(int w, int h)
 {
     width=w;
     height=h;
-    glViewport(0,0,w,h);
     //Pass Arguments to Optix
     out->setSize(w,h);
+    if(display.get()!=out.get())
+        display->setSize(w,h);
+    accum->setSize(w,h);
+    trackOutput();
+    frameIndex=0;
+    adaptive.setSize(w,h);
+    tiles.setSize(w,h);
+}
+
+void setRenderSize(int w, int h)
+{
+    if(recorder.isRecording())
+        recorder.record(launchCount,INPUT_RESIZE,w,h,&eye.x,&lookDir.x);
+    resizeBuffers(w,h);
+}
+
+void reshape(int w, int h)
+{
+    std::lock_guard<std::mutex> guard(contextLock);
+    //the render thread launches again once the lock is free
+    if(pipeline)
+        pipeline->wake();
+    windowWidth=w;
+    windowHeight=h;
+    glViewport(0,0,w,h);
+    int rw,rh;
+    resolution.getRenderSize(w,h,rw,rh);
+    setRenderSize(rw,rh);
+}
+
+GLenum pixelType()
+{
+    switch(OUTPUT_FORMAT)
+    {
+    case OUTPUT_RGBA8:
+        return GL_UNSIGNED_BYTE;
+    case OUTPUT_RGB10A2:
+        return GL_UNSIGNED_INT_2_10_10_10_REV;
+    case OUTPUT_HALF4:
+        return GL_HALF_FLOAT;
+    default:
+        return GL_FLOAT;
+    }
+}
+
+//returns the part of the image that was launched, 0 if nothing was
+double launchFrame()
+{
+    launchCount++;
+    double pixels=(double)width*height;
+    if(!PROGRESSIVE)
+    {
+        if(tiles.launchDirty(USE_MS)==0)
+            return 0.0;
+        double launched=0.0;
+        const std::vector<TileTiming> &timings=tiles.getTimings();
+        for(size_t i=0; i<timings.size(); i++)
+            launched+=(double)timings[i].rect.width*timings[i].rect.height;
+        return launched/pixels;
+    }
+    else if(ADAPTIVE_SAMPLING)
+    {
+        if(!adaptive.launch())
+            return 0.0;
+        return adaptive.getRaysTraced()/pixels;
+    }
+    else if(frameIndex<PROGRESSIVE_MAX_FRAMES)
+    {
+        renderer["frame"]->setInt(frameIndex++);
+        renderer->launch(ENTRY_PROGRESSIVE,width,height);
+        return 1.0;
+    }
+    return 0.0;
+}
+
+//feeds a launch to the resolution controller and resizes the buffers when it picks another scale,
+//after the frame was read back
+void scaleResolution(double launchMs, double fraction)
+{
+    if(resolution.update(launchMs,fraction))
+    {
+        int w,h;
+        resolution.getRenderSize(windowWidth,windowHeight,w,h);
+        setRenderSize(w,h);
+    }
+}
 
+//returns false when there was no new frame to draw
+inline bool optix_draw()
+{
+    if(pipeline)
+    {
+        //the render thread keeps the next frames coming meanwhile and stops submitting once
+        //the image is done, so wait a little only and keep handling input
+        PipelineFrame *frame=pipeline->next(true,PIPELINE_IDLE_MS);
+        if(!frame)
+            return false;
+        glPixelZoom((float)windowWidth/frame->width,(float)windowHeight/frame->height);
+        glDrawPixels(frame->width,frame->height,GL_RGBA,pixelType(),&frame->pixels[0]);
+        //the render thread may take the slot again once it is released
+        int index=frame->index;
+        pipeline->release(frame);
+        if(index%PIPELINE_REPORT_FRAMES==PIPELINE_REPORT_FRAMES-1)
+            pipeline->report();
+        return true;
+    }
+    std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+    double fraction=launchFrame();
+    double launchMs=std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+    void *pixels=display->map();
+    glPixelZoom((float)windowWidth/width,(float)windowHeight/height);
+    glDrawPixels(width,height,GL_RGBA,pixelType(),pixels);
+    display->unmap();
+    scaleResolution(launchMs,fraction);
+    return true;
 }
 
-inline void optix_draw()
+//producer of the frame pipeline: launch and readback into the next free slot; once the image
+//is done nothing is read back or submitted until an input change wakes the pipeline
+void renderLoop()
 {
-    renderer->launch(USE_MS,width,height);
-    void *pixels=out->map();
-    glDrawPixels(width,height,GL_RGBA,GL_FLOAT,pixels);
-    out->unmap();
+    while(PipelineFrame *frame=pipeline->acquire())
+    {
+        {
+            std::lock_guard<std::mutex> guard(contextLock);
+            std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+            double fraction=launchFrame();
+            if(fraction>0.0)
+            {
+                std::chrono::steady_clock::time_point launched=std::chrono::steady_clock::now();
+                frame->render_ms=std::chrono::duration<double,std::milli>(launched-start).count();
+
+                frame->width=width;
+                frame->height=height;
+                frame->pixels.resize(OutputConverter::pixelSize((OutputFormat)OUTPUT_FORMAT)*width*height);
+                void *pixels=display->map();
+                memcpy(&frame->pixels[0],pixels,frame->pixels.size());
+                display->unmap();
+                frame->readback_ms=std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-launched).count();
+                scaleResolution(frame->render_ms,fraction);
+            }
+            else
+            {
+                pipeline->cancel(frame);
+                frame=NULL;
+            }
+        }
+        if(frame)
+            pipeline->submit(frame);
+        else if(!pipeline->idle(PIPELINE_IDLE_MS))
+            return;
+    }
 }
 
 void renderScene()
@@ -94,19 +341,26 @@ void renderScene()
     //Render with Optix
     //clear buffer
     glClear(GL_COLOR_BUFFER_BIT);
-    //optix
-    optix_draw();
+    //optix, nothing to swap while the pipeline has no new frame
+    if(!optix_draw())
+        return;
     //fps count
     static int frame=0, time,timebase=0;
 
     frame++;
     time=glutGet(GLUT_ELAPSED_TIME);
-    if(time-timebase){
+    //once a second, the adaptive report is too long for every frame
+    if(time-timebase>=1000){
         float fps=frame*1000.0/(time-timebase);
         timebase=time;
         frame=0;
 
         std::cout<<fps<<" FPS"<<std::endl;
+        if(PROGRESSIVE && ADAPTIVE_SAMPLING)
+        {
+            std::lock_guard<std::mutex> guard(contextLock);
+            adaptive.report();
+        }
     }
     //swap buffers
     glutSwapBuffers();
@@ -125,13 +379,11 @@ inline const aiScene* loadScene(std::string scene_path)
         return NULL;
     }
 
-    const aiScene *s=aiImportFile(scene_path.c_str(), LoadFlags);
-    aiApplyPostProcessing(s, aiProcess_CalcTangentSpace);
-    aiApplyPostProcessing(s, aiProcess_OptimizeGraph);
+    const aiScene *s=scene_cache.import(scene_path, LoadFlags, aiProcess_CalcTangentSpace|aiProcess_OptimizeGraph);
 
     if(!s)
     {
-        std::cout<<"Failed to load scene: "<<importer.GetErrorString()<<std::endl;
+        std::cout<<"Failed to load scene: "<<aiGetErrorString()<<std::endl;
         return NULL;
     }
     std::cout<<"Scene loaded sccessfully."<<std::endl;
@@ -139,13 +391,32 @@ inline const aiScene* loadScene(std::string scene_path)
     return s;
 }
 
-TextureSampler newTexture(std::string name)
+//level 0 and every mip the loader built
+void setTextureLevels(TextureSampler res, DecodedTexture &tex, RTformat format)
 {
-    ILuint image=iluGenImage();
-    ilBindImage(image);
-    ilEnable(IL_ORIGIN_SET);
-    ilOriginFunc(IL_ORIGIN_LOWER_LEFT);
-    iluBuildMipmaps();
+    int nlevels=tex.mips.size()+1;
+    res->setMipLevelCount(nlevels);
+    res->setFilteringModes(RT_FILTER_LINEAR,RT_FILTER_LINEAR,nlevels>1?RT_FILTER_LINEAR:RT_FILTER_NONE);
+    for(int l=0; l<nlevels; l++)
+    {
+        const std::vector<unsigned char> &level=l==0?tex.pixels:tex.mips[l-1];
+        Buffer image=renderer->createBuffer(RT_BUFFER_INPUT,format,MipGenerator::levelSize(tex.width,l),MipGenerator::levelSize(tex.height,l));
+        void * dataMap = image->map();
+        memcpy(dataMap,&level[0],level.size());
+        image->unmap();
+        image->validate();
+        res->setBuffer(0,l,image);
+    }
+}
+
+//tracked under material, the first one that uses the texture; -1 for none
+TextureSampler newTexture(DecodedTexture &tex, int material=-1)
+{
+    if(!tex.ok){
+        std::cout<<"Error reading texture: "<<tex.file<<std::endl;
+        return NULL;
+    }
+    std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
 
     TextureSampler res=renderer->createTextureSampler();;
     res->setArraySize(1);
@@ -155,54 +426,21 @@ TextureSampler newTexture(std::string name)
     res->setReadMode(RT_TEXTURE_READ_NORMALIZED_FLOAT);
     res->setIndexingMode(RT_TEXTURE_INDEX_NORMALIZED_COORDINATES);
     res->setMaxAnisotropy(ANISOTROPY);
-    res->setFilteringModes(RT_FILTER_LINEAR,RT_FILTER_LINEAR,RT_FILTER_NONE);
-
-    ILboolean success=ilLoadImage((ILstring)(scene_p+name).c_str());
-    if(success){
-        ilConvertImage(IL_RGBA,IL_UNSIGNED_BYTE);
-        std::vector<Buffer> mipmaps;
-        int nmipmap=0;
-        while(ilActiveMipmap(nmipmap)&&nmipmap<MIPMAPS){
-            int w=ilGetInteger(IL_IMAGE_WIDTH);
-            int h=ilGetInteger(IL_IMAGE_HEIGHT);
-            //std::cout<<w<<'x'<<h<<std::endl;
-            void * data= (void*)ilGetData();
-            mipmaps.push_back(renderer->createBuffer(RT_BUFFER_INPUT,RT_FORMAT_UNSIGNED_BYTE4,w,h));
-            void * dataMap = mipmaps[nmipmap]->map();
-            ILint size = ilGetInteger(IL_IMAGE_SIZE_OF_DATA);
-            //std::cout<<size<<std::endl;
-            memcpy(dataMap,data,size);
-            mipmaps[nmipmap]->unmap();
-            mipmaps[nmipmap]->validate();
-            nmipmap++;
-            ilBindImage(image);
-            iluBuildMipmaps();
-        }
+    setTextureLevels(res,tex,RT_FORMAT_UNSIGNED_BYTE4);
+    res->validate();
+    memory.trackSampler(res,MEMORY_TEXTURE,tex.file+" rgba",material);
 
-        res->setMipLevelCount(nmipmap);
-        for(int i=0; i<nmipmap; i++){
-            res->setBuffer(0,i,mipmaps[i]);
-        }
-
-        res->validate();
-    }
-    else{
-        res->destroy();
-        std::cout<<"Error reading texture: "<<name<<std::endl;
-        return NULL;
-    }
-    ilBindImage(0);
-    ilDeleteImage(image);
+    tex.upload_ms=std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
     return res;
 }
 
-TextureSampler newTextureBump(std::string name)
+TextureSampler newTextureBump(DecodedTexture &tex, int material=-1)
 {
-    ILuint image=iluGenImage();
-    ilBindImage(image);
-    ilEnable(IL_ORIGIN_SET);
-    ilOriginFunc(IL_ORIGIN_LOWER_LEFT);
-    iluBuildMipmaps();
+    if(!tex.ok){
+        std::cout<<"Error reading texture: "<<tex.file<<std::endl;
+        return NULL;
+    }
+    std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
 
     TextureSampler res=renderer->createTextureSampler();;
     res->setArraySize(1);
@@ -212,86 +450,92 @@ TextureSampler newTextureBump(std::string name)
     res->setReadMode(RT_TEXTURE_READ_NORMALIZED_FLOAT);
     res->setIndexingMode(RT_TEXTURE_INDEX_NORMALIZED_COORDINATES);
     res->setMaxAnisotropy(ANISOTROPY);
-    res->setFilteringModes(RT_FILTER_LINEAR,RT_FILTER_LINEAR,RT_FILTER_NONE);
-
-    ILboolean success=ilLoadImage((ILstring)(scene_p+name).c_str());
-    if(success){
-        ilConvertImage(IL_LUMINANCE,IL_UNSIGNED_BYTE);
-        std::vector<Buffer> mipmaps;
-        int nmipmap=0;
-        while(ilActiveMipmap(nmipmap)&&nmipmap<MIPMAPS){
-            int w=ilGetInteger(IL_IMAGE_WIDTH);
-            int h=ilGetInteger(IL_IMAGE_HEIGHT);
-            //std::cout<<w<<'x'<<h<<std::endl;
-            void * data= (void*)ilGetData();
-            mipmaps.push_back(renderer->createBuffer(RT_BUFFER_INPUT,RT_FORMAT_UNSIGNED_BYTE,w,h));
-            void * dataMap = mipmaps[nmipmap]->map();
-            ILint size = ilGetInteger(IL_IMAGE_SIZE_OF_DATA);
-            //std::cout<<size<<std::endl;
-            memcpy(dataMap,data,size);
-            mipmaps[nmipmap]->unmap();
-            mipmaps[nmipmap]->validate();
-            nmipmap++;
-            ilBindImage(image);
-            iluBuildMipmaps();
-        }
-        res->setMipLevelCount(nmipmap);
-        for(int i=0; i<nmipmap; i++){
-            res->setBuffer(0,i,mipmaps[i]);
-        }
-        res->validate();
-    }
-    else{
-        res->destroy();
-        std::cout<<"Error reading texture: "<<name<<std::endl;
-        return NULL;
-    }
-    ilBindImage(0);
-    ilDeleteImage(image);
+    setTextureLevels(res,tex,RT_FORMAT_UNSIGNED_BYTE);
+    res->validate();
+    memory.trackSampler(res,MEMORY_TEXTURE,tex.file+" lum",material);
+
+    tex.upload_ms=std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
     return res;
 }
 
-inline std::map<std::string,TextureSampler> loadTextures(const aiScene *s)
+inline std::map<std::string,TextureSampler> loadTextures(const aiScene *s, std::map<std::string,TextureSampler> &bumpMap)
 {
     ilInit();
-    std::map<std::string,TextureSampler> textureNameMap;
-    std::map<std::string,int> names;
-    int countTex=0;
+    //decode every diffuse and bump texture on the pool first
+    profileStage("texture decode");
+    TextureLoader loader(pool);
+    loader.setMipmaps(true);
+    loader.setCompression(COMPRESS_TEXTURES);
+    std::vector<std::string> names;
+    //first material asking for each texture, its samplers are tracked under it
+    std::vector<int> owners;
     for(unsigned int m=0; m< s->mNumMaterials; ++m)
     {
-        int texIndex=0;
         aiString path;
-        aiReturn texFound = s->mMaterials[m]->GetTexture(aiTextureType_DIFFUSE,texIndex,&path);
-        while(texFound==AI_SUCCESS)
+        for(unsigned int texIndex=0; AI_SUCCESS==s->mMaterials[m]->GetTexture(aiTextureType_DIFFUSE,texIndex,&path); texIndex++)
+        {
+            if(loader.request(scene_p+path.data,TEXTURE_RGBA8)==(int)names.size())
+            {
+                names.push_back(path.data);
+                owners.push_back(m);
+            }
+        }
+        if(AI_SUCCESS==s->mMaterials[m]->GetTexture(aiTextureType_HEIGHT,0,&path))
         {
-            texIndex++;
-            texFound = s->mMaterials[m]->GetTexture(aiTextureType_DIFFUSE,texIndex,&path);
-            countTex++;
-            names[path.data]=0;
+            if(loader.request(scene_p+path.data,TEXTURE_L8)==(int)names.size())
+            {
+                names.push_back(path.data);
+                owners.push_back(m);
+            }
         }
     }
-    ILuint imageIds[countTex];
-    ilGenImages(countTex,imageIds);
-    std::map<std::string,int>::iterator itr= names.begin();
-    for( int i=0; itr!=names.end(); itr++,i++)
+    loader.decodeAll();
+
+    //then upload them in request order, files with the same contents share one sampler
+    profileStage("texture upload");
+    std::map<std::string,TextureSampler> textureNameMap;
+    std::vector<TextureSampler> samplers(loader.getTextureCount());
+    size_t bytesSaved=0;
+    for(int i=0; i<loader.getTextureCount(); i++)
     {
-        std::string filename=itr->first;
-        textureNameMap[filename]=newTexture(filename);
-        std::cout<<"Successfully loaded texture: "<<filename<<std::endl;
+        int source=loader.resolve(i);
+        DecodedTexture &tex=loader.get(source);
+        if(source!=i)
+        {
+            samplers[i]=samplers[source];
+            bytesSaved+=TextureLoader::levelBytes(tex);
+        }
+        else
+        {
+            samplers[i]=tex.format==TEXTURE_RGBA8 ? newTexture(tex,owners[i]) : newTextureBump(tex,owners[i]);
+        }
+        if(tex.format==TEXTURE_RGBA8)
+        {
+            textureNameMap[names[i]]=samplers[i];
+        }
+        else
+        {
+            bumpMap[names[i]]=samplers[i];
+        }
+        if(tex.ok) std::cout<<"Successfully loaded texture: "<<names[i]<<std::endl;
     }
+    loader.report();
+    std::cout<<loader.getDuplicateCount()<<" textures shared by contents, "<<bytesSaved/1024<<" KB not uploaded"<<std::endl;
     return textureNameMap;
 }
 
 
-inline std::vector<Material> loadMaterials(const aiScene *s, std::map<std::string,TextureSampler> texMap, std::map<std::string,int> &matNameToIndex)
+inline std::vector<Material> loadMaterials(const aiScene *s, std::map<std::string,TextureSampler> texMap, std::map<std::string,TextureSampler> bumpMap, std::map<std::string,int> &matNameToIndex)
 {
     std::vector<Material> res;
-    Program closest_hit_radiance = renderer->createProgramFromPTXFile(ptx_p,"closest_hit_radiance");
-    Program any_hit_shadow = renderer->createProgramFromPTXFile(ptx_p,"any_hit_shadow");
-    Program any_hit_radiance = renderer->createProgramFromPTXFile(ptx_p,"any_hit_radiance");
+    Program closest_hit_radiance = programs.get(ptx_p,"closest_hit_radiance");
+    Program any_hit_shadow = programs.get(ptx_p,"any_hit_shadow");
+    Program any_hit_radiance = programs.get(ptx_p,"any_hit_radiance");
 
     Buffer noBuffer = renderer->createBuffer(RT_BUFFER_INPUT,RT_FORMAT_BYTE4,1,1);
     Buffer noBufferBump = renderer->createBuffer(RT_BUFFER_INPUT,RT_FORMAT_BYTE,1,1);
+    memory.trackBuffer(noBuffer,MEMORY_PLACEHOLDER,"no texture");
+    memory.trackBuffer(noBufferBump,MEMORY_PLACEHOLDER,"no bump");
 
     TextureSampler noTex=renderer->createTextureSampler();
     noTex->setWrapMode(0,RT_WRAP_CLAMP_TO_EDGE);
@@ -323,22 +567,28 @@ inline std::vector<Material> loadMaterials(const aiScene *s, std::map<std::strin
         aiString mat_name;
         aiGetMaterialString(mat,AI_MATKEY_NAME,&mat_name);
         std::cout<<"Loading material: "<<mat_name.data<<std::endl;
-        if(AI_SUCCESS==mat->GetTexture(aiTextureType_DIFFUSE,0,&texPath))
+        memory.setMaterialName(m,mat_name.data);
+        //a texture that failed to decode has a null sampler, the material goes without it
+        if(AI_SUCCESS==mat->GetTexture(aiTextureType_DIFFUSE,0,&texPath) && texMap[texPath.data].get())
         {
             std::cout<<"Texture: "<<texPath.data<<std::endl;
             optix_mat["tex0"]->setTextureSampler(texMap[texPath.data]);
             optix_mat["texCount"]->setInt(1);
+            RTsize texWidth, texHeight;
+            texMap[texPath.data]->getBuffer(0,0)->getSize(texWidth,texHeight);
+            optix_mat["tex0Size"]->setFloat(texWidth,texHeight);
         }
         else
         {
             optix_mat["tex0"]->setTextureSampler(noTex);
             optix_mat["texCount"]->setInt(0);
+            optix_mat["tex0Size"]->setFloat(1.f,1.f);
         }
 
-        if(AI_SUCCESS==mat->GetTexture(aiTextureType_HEIGHT,0,&texPath))
+        if(AI_SUCCESS==mat->GetTexture(aiTextureType_HEIGHT,0,&texPath) && bumpMap[texPath.data].get())
         {
             std::cout<<"Bump: "<<texPath.data<<std::endl;
-            optix_mat["bump"]->setTextureSampler(newTextureBump(texPath.data));
+            optix_mat["bump"]->setTextureSampler(bumpMap[texPath.data]);
             optix_mat["bumpCount"]->setInt(1);
         }
         else
@@ -391,6 +641,19 @@ inline std::vector<Material> loadMaterials(const aiScene *s, std::map<std::strin
         matNameToIndex[mat_name.data]=m;
         optix_mat->validate();
     }
+    //already set above, bound for the p key
+    programs.bind("closest hit radiance",ptx_p,"closest_hit_radiance",[res](Program p){
+        for(size_t i=0; i<res.size(); i++)
+            res[i]->setClosestHitProgram(Phong,p);
+    });
+    programs.bind("any hit shadow",ptx_p,"any_hit_shadow",[res](Program p){
+        for(size_t i=0; i<res.size(); i++)
+            res[i]->setAnyHitProgram(Shadow,p);
+    });
+    programs.bind("any hit radiance",ptx_p,"any_hit_radiance",[res](Program p){
+        for(size_t i=0; i<res.size(); i++)
+            res[i]->setAnyHitProgram(Phong,p);
+    });
 
     return res;
 }
@@ -403,10 +666,13 @@ Acceleration newAccelerator(){
 Acceleration newAcceleratorGeom(){
     //Acceleration acc=renderer->createAcceleration("TriangleKdTree","KdTree");
     Acceleration acc=renderer->createAcceleration("Sbvh","Bvh");
-    acc->setProperty("vertex_buffer_name","vertex_buffer");
-    acc->setProperty("vertex_buffer_stride","0");
-    acc->setProperty("index_buffer_name","index_buffer");
-    acc->setProperty("index_buffer_stride","0");
+    //packed meshes may have 16 bit indices, which Sbvh can't read; it falls back to boundingBoxMesh
+    if(!PACK_VERTICES){
+        acc->setProperty("vertex_buffer_name","vertex_buffer");
+        acc->setProperty("vertex_buffer_stride","0");
+        acc->setProperty("index_buffer_name","index_buffer");
+        acc->setProperty("index_buffer_stride","0");
+    }
     return acc;
 }
 
@@ -463,123 +729,120 @@ Transform loadNode(aiNode* node, GeometryInstance meshes[])
     return optix_trans;
 }
 
+//top Group over one GeometryGroup per flat group, under a Transform where it is not at the identity
+Group loadFlatScene(const FlatScene &flat, GeometryInstance meshes[])
+{
+    std::vector<GeometryGroup> groups;
+    for(unsigned int g=0; g<flat.groups.size(); g++)
+    {
+        GeometryGroup geom_g=renderer->createGeometryGroup();
+        geom_g->setChildCount(flat.groups[g].size());
+        geom_g->setAcceleration(newAcceleratorGeom());
+        for(unsigned int m=0; m<flat.groups[g].size(); m++)
+        {
+            geom_g->setChild(m,meshes[flat.groups[g][m]]);
+        }
+        geom_g->validate();
+        groups.push_back(geom_g);
+    }
+
+    Group top=renderer->createGroup();
+    top->setAcceleration(newAccelerator());
+    top->setChildCount(flat.instances.size());
+    for(unsigned int i=0; i<flat.instances.size(); i++)
+    {
+        const FlatInstance &instance=flat.instances[i];
+        if(instance.identity)
+        {
+            top->setChild(i,groups[instance.group]);
+            continue;
+        }
+        aiMatrix4x4 inverse=instance.transform;
+        inverse.Inverse();
+        Transform optix_trans=renderer->createTransform();
+        optix_trans->setMatrix(false,&instance.transform.a1,&inverse.a1);
+        optix_trans->setChild(groups[instance.group]);
+        optix_trans->validate();
+        top->setChild(i,optix_trans);
+    }
+    top->validate();
+    return top;
+}
 
 inline Group loadGeometry(const aiScene * s, std::vector<Material> materialVec)
 {
-    Buffer noTexCoord=renderer->createBuffer(RT_BUFFER_INPUT,RT_FORMAT_FLOAT2,1);
-    Program bounding_box = renderer->createProgramFromPTXFile(ptx_p,"boundingBoxMesh");
-    Program intersect = renderer->createProgramFromPTXFile(ptx_p,"intersectMesh");
+    Program bounding_box = programs.get(ptx_p,"boundingBoxMesh");
+    Program intersect = programs.get(ptx_p,"intersectMesh");
+    std::vector<Geometry> geometries;
+    VertexPacker::setDefaults(renderer,&memory);
     GeometryInstance meshes[s->mNumMeshes];
+    FlatScene flat;
+    if(FLATTEN_SCENE)
+    {
+        profileStage("flatten");
+        SceneFlattener flattener;
+        flattener.flatten(s,flat);
+        flattener.report();
+        profileStage("loadGeometry");
+    }
+    //buffers of every distinct mesh first, then all of them filled on the pool
+    std::vector<int> unique;
     for(unsigned int m=0; m<s->mNumMeshes; m++)
     {
-        std::cout<<"Loading mesh: "<<m<<std::endl;
-        //Initialize Geometry
-        std::cout<<"Initializing"<<std::endl;
-        aiMesh * mesh=s->mMeshes[m];
+        if(FLATTEN_SCENE && flat.canonical[m]!=(int)m)
+            continue;
         Geometry optix_mesh=renderer->createGeometry();
-        optix_mesh->setPrimitiveCount(mesh->mNumFaces);
-        //copy indices buffer to optix
-        std::cout<<"Loading Indices"<<std::endl;
-        optix_mesh->setPrimitiveCount(mesh->mNumFaces);
-        Buffer index_buffer = renderer->createBuffer(RT_BUFFER_INPUT,RT_FORMAT_INT3,mesh->mNumFaces);
-        int *temp_index=static_cast<int*>(index_buffer->map());
-        for(unsigned int i=0; i<mesh->mNumFaces; i++)
-        {
-            temp_index[3*i]=mesh->mFaces[i].mIndices[0];
-            temp_index[3*i+1]=mesh->mFaces[i].mIndices[1];
-            temp_index[3*i+2]=mesh->mFaces[i].mIndices[2];
-        }
-        index_buffer->unmap();
-        index_buffer->validate();
-        //copy vertices buffer
-        std::cout<<"Loading Vertices"<<std::endl;
-        Buffer vertex_buffer=renderer->createBuffer(RT_BUFFER_INPUT,RT_FORMAT_FLOAT3,mesh->mNumVertices);
-        void * temp_pos=vertex_buffer->map();
-        memcpy(temp_pos,mesh->mVertices,mesh->mNumVertices*3*sizeof(float));
-        vertex_buffer->unmap();
-        vertex_buffer->validate();
-        //copy normals
-        std::cout<<"Loading Normals"<<std::endl;
-        Buffer normal_buffer=renderer->createBuffer(RT_BUFFER_INPUT,RT_FORMAT_FLOAT3,mesh->mNumVertices);
-        void * temp_norm=normal_buffer->map();
-        memcpy(temp_norm,mesh->mNormals,mesh->mNumVertices*3*sizeof(float));
-        normal_buffer->unmap();
-        normal_buffer->validate();
-        //copy tangents
-
-        Buffer tangent_buffer;
-        Buffer bitangent_buffer;
-        if(mesh->HasTangentsAndBitangents()){
-            std::cout<<"Loading Tangents"<<std::endl;
-            tangent_buffer=renderer->createBuffer(RT_BUFFER_INPUT,RT_FORMAT_FLOAT3,mesh->mNumVertices);
-            bitangent_buffer=renderer->createBuffer(RT_BUFFER_INPUT,RT_FORMAT_FLOAT3,mesh->mNumVertices);
-
-            void * temp_tan=tangent_buffer->map();
-            memcpy(temp_tan,mesh->mTangents,mesh->mNumVertices*3*sizeof(float));
-            tangent_buffer->unmap();
-
-            void * temp_bitan=bitangent_buffer->map();
-            memcpy(temp_bitan,mesh->mBitangents,mesh->mNumVertices*3*sizeof(float));
-            bitangent_buffer->unmap();
-        }
-        //copy tex coordinates
-        Buffer texCoord_buffer;
-        if(mesh->HasTextureCoords(0))
+        optix_mesh->setPrimitiveCount(s->mMeshes[m]->mNumFaces);
+        unique.push_back(m);
+        geometries.push_back(optix_mesh);
+    }
+    MeshUploader uploader(pool);
+    uploader.setMemoryTracker(&memory);
+    if(PACK_VERTICES)
+        uploader.pack(renderer,s,unique,geometries);
+    else
+        uploader.upload(renderer,s,unique,geometries);
+    uploader.report();
+    size_t next=0;
+    for(unsigned int m=0; m<s->mNumMeshes; m++)
+    {
+        if(FLATTEN_SCENE && flat.canonical[m]!=(int)m)
         {
-            std::cout<<"Loading TexCoord"<<std::endl;
-            texCoord_buffer=renderer->createBuffer(RT_BUFFER_INPUT,RT_FORMAT_FLOAT2,mesh->mNumVertices);
-            float * temp_texCoord=static_cast<float*>(texCoord_buffer->map());
-            for(unsigned int i=0; i<mesh->mNumVertices; i++)
-            {
-                temp_texCoord[2*i]=mesh->mTextureCoords[0][i].x;
-                temp_texCoord[2*i+1]=mesh->mTextureCoords[0][i].y;
-                //std::cout<<"Loading TexCoord "<< mesh->mTextureCoords[0][i].x<<' '<<mesh->mTextureCoords[0][i].x <<std::endl;
-            }
-            texCoord_buffer->unmap();
-        }
-        //set atributes
-        std::cout<<"Setting Attributes"<<std::endl;
-        optix_mesh["vertex_buffer"]->set(vertex_buffer);
-        optix_mesh["index_buffer"]->set(index_buffer);
-        optix_mesh["normal_buffer"]->set(normal_buffer);
-        if(mesh->HasTextureCoords(0)) {
-            optix_mesh["texCoord_buffer"]->set(texCoord_buffer);
-            optix_mesh["hasTexCoord"]->setInt(1);
-        }
-        else{
-            optix_mesh["texCoord_buffer"]->set(noTexCoord);
-            optix_mesh["hasTexCoord"]->setInt(0);
-        }
-        if(mesh->HasTangentsAndBitangents()) {
-            optix_mesh["tangent_buffer"]->set(tangent_buffer);
-            optix_mesh["bitangent_buffer"]->set(bitangent_buffer);
-            optix_mesh["hasTangents"]->setInt(1);
-        }
-        else{
-            optix_mesh["tangent_buffer"]->set(renderer->createBuffer(RT_BUFFER_INPUT,RT_FORMAT_FLOAT3,1));
-            optix_mesh["bitangent_buffer"]->set(renderer->createBuffer(RT_BUFFER_INPUT,RT_FORMAT_FLOAT3,1));
-            optix_mesh["hasTangents"]->setInt(0);
-
+            //same geometry and material as an earlier mesh
+            meshes[m]=meshes[flat.canonical[m]];
+            continue;
         }
+        aiMesh * mesh=s->mMeshes[m];
+        Geometry optix_mesh=geometries[next++];
         //set optix programs
-        std::cout<<"Setting Programs"<<std::endl;
         optix_mesh->setBoundingBoxProgram(bounding_box);
         optix_mesh->setIntersectionProgram(intersect);
         //create geometry instance
-        std::cout<<"Instanctiating"<<std::endl;
         GeometryInstance instance=renderer->createGeometryInstance();
 
         instance->setGeometry(optix_mesh);
         instance->setMaterialCount(1);
         instance->setMaterial(0,materialVec[mesh->mMaterialIndex]);
 
-
-        //std::cout<<matName<<std::endl;
         meshes[m]=instance;
-        std::cout<<"Loaded mesh: "<<m<<std::endl<<std::endl;
         optix_mesh->validate();
         instance->validate();
     }
+    //already set above, bound for the p key
+    programs.bind("bounding box",ptx_p,"boundingBoxMesh",[geometries](Program p){
+        for(size_t i=0; i<geometries.size(); i++)
+            geometries[i]->setBoundingBoxProgram(p);
+    });
+    programs.bind("intersection",ptx_p,"intersectMesh",[geometries](Program p){
+        for(size_t i=0; i<geometries.size(); i++)
+            geometries[i]->setIntersectionProgram(p);
+    });
+    if(FLATTEN_SCENE)
+    {
+        profileStage("loadFlatScene");
+        return loadFlatScene(flat,meshes);
+    }
+    profileStage("loadNode");
     Transform t=loadNode(s->mRootNode,meshes);
     Group top = renderer->createGroup();
     top->setChildCount(1);
@@ -594,45 +857,75 @@ inline Group loadGeometry(const aiScene * s, std::vector<Material> materialVec)
 void inline initContext()
 {
     //create context
+    profileStage("context");
     renderer=Context::create();
+    programs.init(renderer);
     renderer->setRayTypeCount(RAY_TYPE_COUNT);
     renderer["Phong"]->setInt(Phong);
     renderer["Shadow"]->setInt(Shadow);
+    memory.clear();
+    memory.setDeviceBudget((uint64_t)MEMORY_BUDGET_MB<<20);
 
     const aiScene * scene = loadScene(scene_p+scene_name);
-    std::map<std::string,TextureSampler> texMap=loadTextures(scene);
+    memory.track(MEMORY_SCENE,"aiScene",MemoryTracker::sceneBytes(scene));
+    std::map<std::string,TextureSampler> bumpMap;
+    std::map<std::string,TextureSampler> texMap=loadTextures(scene,bumpMap);
     std::map<std::string,int> matNameToIndex;
-    std::vector<Material> materials=loadMaterials(scene,texMap,matNameToIndex);
+    profileStage("loadMaterials");
+    std::vector<Material> materials=loadMaterials(scene,texMap,bumpMap,matNameToIndex);
+    profileStage("loadGeometry");
     Group top=loadGeometry(scene,materials);
     renderer["top_object"]->set(top);
-
-    Program miss_radiance = renderer->createProgramFromPTXFile(ptx_p,"miss_radiance");
-    Program miss_shadow = renderer->createProgramFromPTXFile(ptx_p,"miss_shadow");
-
-    Program entryPoint=renderer->createProgramFromPTXFile(ptx_p,"pinhole_camera");
-
-    Program entryPoint_ms=renderer->createProgramFromPTXFile(ptx_p,"pinhole_camera_ms");
-
-    Program exept=renderer->createProgramFromPTXFile(ptx_p,"exception");
-
+    if(RELEASE_SCENE)
+    {
+        //everything from here on reads the device copies
+        scene_cache.release();
+        scene=NULL;
+        memory.track(MEMORY_SCENE,"aiScene",0);
+    }
+    profileStage("programs and sky");
 
     renderer->setEntryPointCount(ENTRY_COUNT);
-    renderer->setRayGenerationProgram(ENTRY_PINHOLE,entryPoint);
-    renderer->setRayGenerationProgram(ENTRY_PINHOLE_MS,entryPoint_ms);
-
-    for(int i=0; i<ENTRY_COUNT; i++){
-        renderer->setExceptionProgram(i,exept);
-    }
+    programs.bind("entry pinhole",ptx_p,"pinhole_camera",[](Program p){
+        renderer->setRayGenerationProgram(ENTRY_PINHOLE,p);
+    });
+    programs.bind("entry pinhole ms",ptx_p,"pinhole_camera_ms",[](Program p){
+        renderer->setRayGenerationProgram(ENTRY_PINHOLE_MS,p);
+    });
+    programs.bind("entry progressive",ptx_p,"pinhole_camera_progressive",[](Program p){
+        renderer->setRayGenerationProgram(ENTRY_PROGRESSIVE,p);
+    });
+    programs.bind("entry adaptive",ptx_p,"pinhole_camera_adaptive",[](Program p){
+        renderer->setRayGenerationProgram(ENTRY_ADAPTIVE,p);
+    });
+    programs.bind("exception",ptx_p,"exception",[](Program p){
+        for(int i=0; i<ENTRY_COUNT; i++){
+            renderer->setExceptionProgram(i,p);
+        }
+    });
 
     renderer->setExceptionEnabled(RT_EXCEPTION_ALL,true);
 
     renderer->setStackSize(1500);
 
-    renderer->setMissProgram(Phong,miss_radiance);
-    renderer->setMissProgram(Shadow,miss_shadow);
+    programs.bind("miss radiance",ptx_p,"miss_radiance",[](Program p){
+        renderer->setMissProgram(Phong,p);
+    });
+    programs.bind("miss shadow",ptx_p,"miss_shadow",[](Program p){
+        renderer->setMissProgram(Shadow,p);
+    });
 
     out=genOutputBuffer();
-    renderer["output0"]->set(out);
+    display=OutputConverter::bind(renderer,(OutputFormat)OUTPUT_FORMAT,out);
+    OutputConverter::setTonemap(renderer,EXPOSURE,WHITE_POINT);
+    //read back only by the next launch, never mapped
+    accum=renderer->createBuffer(RT_BUFFER_INPUT_OUTPUT|RT_BUFFER_GPU_LOCAL,RT_FORMAT_FLOAT4,width,height);
+    renderer["accum_buffer"]->set(accum);
+    trackOutput();
+    renderer["frame"]->setInt(0);
+    frameIndex=0;
+    adaptive.init(renderer,ENTRY_ADAPTIVE,width,height);
+    tiles.init(renderer,width,height);
 
     float3 V=normalize(cross(up,-lookDir));
     float3 U=cross(-lookDir,V);
@@ -645,15 +938,28 @@ void inline initContext()
 
     renderer["lightDir"]->setFloat(normalize(make_float3(-0.5f,-5.f,-1.f)));
 
-    TextureSampler sky = newTexture("../skydome.png");
+    TextureLoader skyLoader(pool);
+    int skyIndex=skyLoader.request(scene_p+"../skydome.png",TEXTURE_RGBA8);
+    skyLoader.decodeAll();
+    TextureSampler sky = newTexture(skyLoader.get(skyIndex));
 
     renderer["sky"]->set(sky);
 
     renderer->validate();
+    programs.report();
+    memory.report();
+    profileEnd();
 }
 
-void keyboard(unsigned char key, int x, int y){
+//compile time settings that change the image, replays with other ones are not comparable
+uint32_t renderConfig()
+{
+    return USE_MS|PROGRESSIVE<<1|ADAPTIVE_SAMPLING<<2|OUTPUT_FORMAT<<3;
+}
 
+//camera movement of the keyboard, also replayed by --replay
+void applyKey(unsigned char key)
+{
     float3 V=normalize(cross(up,-lookDir));
     float3 U=cross(-lookDir,V);
 
@@ -678,6 +984,8 @@ void keyboard(unsigned char key, int x, int y){
     case 'j':
         lookDir=normalize(lookDir-ANG_STEP*V);
         break;
+    default:
+        return;
     }
 
     V=normalize(cross(up,-lookDir));
@@ -687,16 +995,695 @@ void keyboard(unsigned char key, int x, int y){
     renderer["U"]->setFloat(U);
     renderer["V"]->setFloat(V);
     renderer["W"]->setFloat(lookDir);
+    //samples from the old view must not blend into the new one
+    frameIndex=0;
+    adaptive.reset();
+    tiles.markAllDirty();
 }
 
+void keyboard(unsigned char key, int x, int y){
+    std::lock_guard<std::mutex> guard(contextLock);
+    if(pipeline)
+        pipeline->wake();
+
+    switch(key){
+    //frame times seen by the resolution controller, for --resolution-replay
+    case 't':
+        resolution.writeTrace("resolution.trace");
+        return;
+    //memory use by category, mesh and material, with every allocation in MEMORY_DUMP
+    case 'm':
+        memory.report();
+        {
+            std::ofstream dump(MEMORY_DUMP);
+            memory.writeJson(dump);
+        }
+        return;
+    //set the programs of a rebuilt rt.ptx without loading the scene again
+    case 'p':
+        if(programs.reloadChanged()>0)
+        {
+            frameIndex=0;
+            adaptive.reset();
+            tiles.markAllDirty();
+        }
+        programs.report();
+        return;
+    //start or stop recording the input for --replay
+    case 'r':
+        if(recorder.isRecording())
+        {
+            recorder.stop(launchCount);
+            return;
+        }
+        {
+            InputHeader header;
+            header.config=renderConfig();
+            header.width=width;
+            header.height=height;
+            memcpy(header.eye,&eye.x,sizeof(header.eye));
+            memcpy(header.look_dir,&lookDir.x,sizeof(header.look_dir));
+            if(!recorder.start(INPUT_LOG,header))
+                return;
+        }
+        //the replay starts from nothing accumulated, so does the recording
+        launchCount=0;
+        frameIndex=0;
+        adaptive.reset();
+        tiles.markAllDirty();
+        return;
+    }
+
+    applyKey(key);
+    if(recorder.isRecording())
+        recorder.record(launchCount,INPUT_KEY,key,0,&eye.x,&lookDir.x);
+}
+
+
+//eye, U, V and W as keyboard() sets them
+ServerCamera currentCamera()
+{
+    ServerCamera camera;
+    camera.eye=eye;
+    camera.V=normalize(cross(up,-lookDir));
+    camera.U=cross(-lookDir,camera.V);
+    camera.W=lookDir;
+    return camera;
+}
+
+//one frame for a RenderServer client, tonemapped to RGBA8 on the device. The buffers only grow
+//to the largest size asked for and smaller frames are launched into their lower left corner with
+//imageExtent set to their size, so clients of different sizes taking turns do not resize and
+//reset them for every frame. These resizes are not the window's and are not recorded
+bool serveFrame(const ServerCamera &camera, int w, int h, std::vector<unsigned char> &rgba)
+{
+    if(w>width || h>height)
+        resizeBuffers(std::max(w,width),std::max(h,height));
+    renderer["eye"]->setFloat(camera.eye);
+    renderer["U"]->setFloat(camera.U);
+    renderer["V"]->setFloat(camera.V);
+    renderer["W"]->setFloat(camera.W);
+    renderer["imageExtent"]->setUint(w,h);
+    renderer->launch(USE_MS,w,h);
+    renderer["imageExtent"]->setUint(0,0);
+    const unsigned char *pixels=static_cast<const unsigned char*>(display->map());
+    rgba.resize(4*w*h);
+    for(int y=0; y<h; y++)
+        memcpy(&rgba[4*w*y],pixels+4*width*y,4*w);
+    display->unmap();
+    return true;
+}
+
+//one frame of --replay, with the pixels hashed as they were read back
+bool replayFrame(double &launchMs, double &readbackMs, uint64_t *hash)
+{
+    std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+    launchFrame();
+    std::chrono::steady_clock::time_point launched=std::chrono::steady_clock::now();
+    launchMs=std::chrono::duration<double,std::milli>(launched-start).count();
+    const void *pixels=display->map();
+    if(hash)
+        *hash=hashBytes(pixels,OutputConverter::pixelSize((OutputFormat)OUTPUT_FORMAT)*width*height);
+    display->unmap();
+    readbackMs=std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-launched).count();
+    return true;
+}
+
+void replayEvent(const InputEvent &event, float *eyeOut, float *lookDirOut)
+{
+    if(event.type==INPUT_KEY)
+        applyKey(event.a);
+    else if(event.type==INPUT_RESIZE)
+        setRenderSize(event.a,event.b);
+    memcpy(eyeOut,&eye.x,3*sizeof(float));
+    memcpy(lookDirOut,&lookDir.x,3*sizeof(float));
+}
+
+//headless and frame locked: the session of an input log again, without its timing
+int replayInput(std::string log, std::string results, bool hashes)
+{
+    InputReplay replay;
+    if(!replay.load(log))
+        return 1;
+    const InputHeader &header=replay.getHeader();
+    if(header.config!=renderConfig())
+        std::cout<<"Warning: "<<log<<" was recorded with other render settings, "<<header.config<<" instead of "<<renderConfig()<<std::endl;
+    width=header.width;
+    height=header.height;
+    eye=make_float3(header.eye[0],header.eye[1],header.eye[2]);
+    lookDir=make_float3(header.look_dir[0],header.look_dir[1],header.look_dir[2]);
+    ilInit();
+    initContext();
+    //compiles and builds the accelerations ahead of frame 0
+    renderer->launch(USE_MS,0,0);
+    bool ok=replay.run(replayEvent,replayFrame,hashes);
+    replay.report();
+    return replay.writeReport(results,scene_p+scene_name)&&ok?0:1;
+}
+
+//OptixRenderer materials only carry Kd/Ks/Ns/map_*, so the rt.cu variables they lack get context defaults
+void bindRendererDefaults(Context c)
+{
+    c["Phong"]->setInt(Phong);
+    c["Shadow"]->setInt(Shadow);
+    float3 V=normalize(cross(up,-lookDir));
+    float3 U=cross(-lookDir,V);
+    c["eye"]->setFloat(eye);
+    c["U"]->setFloat(U);
+    c["V"]->setFloat(V);
+    c["W"]->setFloat(lookDir);
+    c["fov"]->setFloat(1.f);
+    c["lightDir"]->setFloat(normalize(make_float3(-0.5f,-5.f,-1.f)));
+    c["texCount"]->setInt(0);
+    c["bumpCount"]->setInt(0);
+    c["tex0Size"]->setFloat(1.f,1.f);
+    c["diffuse"]->setFloat(1.f,1.f,1.f,1.f);
+    c["specular"]->setFloat(0.f,0.f,0.f,0.f);
+    c["shininess"]->setFloat(1.f);
+
+    RTformat formats[2]={RT_FORMAT_UNSIGNED_BYTE4,RT_FORMAT_UNSIGNED_BYTE};
+    const char *names[2]={"tex0","bump"};
+    for(int i=0; i<2; i++)
+    {
+        TextureSampler tex=c->createTextureSampler();
+        tex->setWrapMode(0,RT_WRAP_CLAMP_TO_EDGE);
+        tex->setWrapMode(1,RT_WRAP_CLAMP_TO_EDGE);
+        tex->setReadMode(RT_TEXTURE_READ_NORMALIZED_FLOAT);
+        tex->setIndexingMode(RT_TEXTURE_INDEX_NORMALIZED_COORDINATES);
+        tex->setFilteringModes(RT_FILTER_LINEAR,RT_FILTER_LINEAR,RT_FILTER_NONE);
+        tex->setMipLevelCount(1);
+        tex->setMaxAnisotropy(1.f);
+        tex->setArraySize(1);
+        tex->setBuffer(0,0,c->createBuffer(RT_BUFFER_INPUT,formats[i],1,1));
+        c[names[i]]->set(tex);
+        if(i==0) c["sky"]->set(tex);
+    }
+}
+
+//times every load stage of the main.cpp path and of OptixRenderer over runs loads each,
+//up to and including the first acceleration build, and writes the statistics as json. Without
+//useSceneCache every run imports the scene, with it every timed run reads the cache
+int loadBenchmark(int runs, std::string results, bool useSceneCache)
+{
+    LoadProfiler mainProfile("main"), rendererProfile("OptixRenderer");
+
+    scene_cache.setEnabled(useSceneCache);
+    ilInit();
+    //with the cache an untimed run first writes it, so every timed run is a warm one
+    int first=useSceneCache?-1:0;
+    for(int r=first; r<runs; r++)
+    {
+        profiler=r>=0?&mainProfile:NULL;
+        scene_cache.setProfiler(profiler);
+        if(profiler) mainProfile.beginRun();
+        initContext();
+        profileStage("acceleration build");
+        //an empty launch compiles the programs and builds the accelerations
+        renderer->launch(USE_MS,0,0);
+        if(profiler) mainProfile.endRun();
+        profiler=NULL;
+        scene_cache.setProfiler(NULL);
+        scene_cache.release();
+        renderer->destroy();
+    }
+
+    for(int r=first; r<runs; r++)
+    {
+        OptixRenderer *optixRenderer=new OptixRenderer(scene_p,scene_name);
+        optixRenderer->setLoadProfiler(r>=0?&rendererProfile:NULL);
+        optixRenderer->setSceneCache(useSceneCache);
+        optixRenderer->setRayTypeCount(RAY_TYPE_COUNT);
+        optixRenderer->setOutputSize(width,height);
+        optixRenderer->setEntryProgram(ptx_p,"pinhole_camera");
+        optixRenderer->setExceptionProgram(ptx_p,"exception");
+        optixRenderer->setMissProgram(Phong,ptx_p,"miss_radiance");
+        optixRenderer->setMissProgram(Shadow,ptx_p,"miss_shadow");
+        optixRenderer->setIntersectionProgram(ptx_p,"intersectMesh");
+        optixRenderer->setBoundingBoxProgram(ptx_p,"boundingBoxMesh");
+
+        if(r>=0) rendererProfile.beginRun();
+        optixRenderer->init();
+        optixRenderer->setDefaultClosestHitProgram(Phong,ptx_p,"closest_hit_radiance");
+        optixRenderer->setDefaultAnyHitProgram(Shadow,ptx_p,"any_hit_shadow");
+        bindRendererDefaults(optixRenderer->getContext());
+        optixRenderer->compile();
+        if(r>=0) rendererProfile.endRun();
+        delete optixRenderer;
+    }
+
+    mainProfile.report();
+    rendererProfile.report();
+
+    std::ofstream out(results.c_str());
+    if(out.fail())
+    {
+        std::cout<<"Error writing load benchmark results: "<<results<<std::endl;
+        return 1;
+    }
+    out<<"{\"scene\": \""<<escapeJson(scene_p+scene_name)<<"\", \"scene_cache\": "<<(useSceneCache?"true":"false")<<", \"results\": [\n    ";
+    mainProfile.writeJson(out);
+    out<<",\n    ";
+    rendererProfile.writeJson(out);
+    out<<"\n]}\n";
+    std::cout<<"Load benchmark written to "<<results<<std::endl;
+    return 0;
+}
+
+//host BVH of every distinct mesh, from the data that goes into its vertex_buffer and index_buffer;
+//trees are cached next to the scene under the mesh hash, so unchanged meshes are not rebuilt
+int bvhStats()
+{
+    const aiScene *scene=loadScene(scene_p+scene_name);
+    if(!scene)
+        return 1;
+
+    std::map<uint64_t,bool> seen;
+    int built=0, loaded=0;
+    double buildMs=0.0, sah=0.0;
+    size_t bytes=0, triangles=0;
+    for(unsigned int m=0; m<scene->mNumMeshes; m++)
+    {
+        const aiMesh *mesh=scene->mMeshes[m];
+        uint64_t key=SceneFlattener::hashMesh(mesh);
+        if(seen[key])
+            continue;
+        seen[key]=true;
+
+        std::vector<float3> vertices(mesh->mNumVertices);
+        for(unsigned int v=0; v<mesh->mNumVertices; v++)
+            vertices[v]=make_float3(mesh->mVertices[v].x,mesh->mVertices[v].y,mesh->mVertices[v].z);
+        std::vector<int3> indices;
+        for(unsigned int f=0; f<mesh->mNumFaces; f++)
+        {
+            const aiFace &face=mesh->mFaces[f];
+            if(face.mNumIndices==3)
+                indices.push_back(make_int3(face.mIndices[0],face.mIndices[1],face.mIndices[2]));
+        }
+
+        char hex[17];
+        snprintf(hex,sizeof(hex),"%016llx",(unsigned long long)key);
+        std::string file=scene_p+scene_name+"."+hex+BVH_CACHE_EXTENSION;
+        WideBvh bvh;
+        if(bvh.load(file,key,indices.size()))
+            loaded++;
+        else
+        {
+            bvh.build(vertices.empty()?NULL:&vertices[0],indices.empty()?NULL:&indices[0],indices.size(),pool);
+            bvh.save(file,key);
+            built++;
+            buildMs+=bvh.getStats().build_ms;
+        }
+        std::string name=mesh->mName.length>0?mesh->mName.C_Str():"mesh "+std::to_string(m);
+        bvh.report(name);
+        const BvhStats &stats=bvh.getStats();
+        sah+=stats.sah_cost*stats.prims;
+        bytes+=stats.bytes;
+        triangles+=stats.prims;
+    }
+    std::cout<<seen.size()<<" distinct meshes, "<<built<<" built in "<<buildMs<<" ms, "<<loaded<<" loaded from cache, "
+             <<triangles<<" triangles, "<<bytes/1024<<" KB";
+    if(triangles>0)
+        std::cout<<", triangle weighted mean SAH cost "<<sah/triangles;
+    std::cout<<std::endl;
+    return 0;
+}
+
+//programs and defaults of --load-bench, then init
+void initRenderer(OptixRenderer *optixRenderer)
+{
+    optixRenderer->setRayTypeCount(RAY_TYPE_COUNT);
+    optixRenderer->setOutputSize(width,height);
+    optixRenderer->setEntryProgram(ptx_p,"pinhole_camera");
+    optixRenderer->setExceptionProgram(ptx_p,"exception");
+    optixRenderer->setMissProgram(Phong,ptx_p,"miss_radiance");
+    optixRenderer->setMissProgram(Shadow,ptx_p,"miss_shadow");
+    optixRenderer->setIntersectionProgram(ptx_p,"intersectMesh");
+    optixRenderer->setBoundingBoxProgram(ptx_p,"boundingBoxMesh");
+    optixRenderer->init();
+    optixRenderer->setDefaultClosestHitProgram(Phong,ptx_p,"closest_hit_radiance");
+    optixRenderer->setDefaultAnyHitProgram(Shadow,ptx_p,"any_hit_shadow");
+    bindRendererDefaults(optixRenderer->getContext());
+}
+
+//loads the scene into an OptixRenderer with scene edits on, then moves every node with meshes
+//and takes out and puts back its first mesh, building after each edit, against the first full build
+int editBenchmark(int rounds)
+{
+    OptixRenderer *optixRenderer=new OptixRenderer(scene_p,scene_name);
+    optixRenderer->setSceneEdits(true);
+    initRenderer(optixRenderer);
+
+    std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+    optixRenderer->compile();
+    double fullMs=std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+
+    SceneEditor &editor=optixRenderer->getSceneEditor();
+    for(int r=0; r<rounds; r++)
+    {
+        for(int n=0; n<editor.getNodeCount(); n++)
+        {
+            if(editor.getNode(n).meshes.empty())
+                continue;
+            float matrix[16];
+            memcpy(matrix,editor.getNode(n).matrix,sizeof(matrix));
+            //there and back again over the rounds
+            matrix[3]+=r%2==0 ? STEP : -STEP;
+            optixRenderer->setNodeTransform(n,matrix);
+            optixRenderer->commitEdits();
+
+            int mesh=editor.getNode(n).meshes[0];
+            optixRenderer->removeMesh(n,mesh);
+            optixRenderer->commitEdits();
+            optixRenderer->insertMesh(n,mesh);
+            optixRenderer->commitEdits();
+        }
+    }
+    editor.report();
+    std::cout<<"Full build: "<<fullMs<<" ms"<<std::endl;
+    delete optixRenderer;
+    return 0;
+}
+
+//plays a node animation of scene at fps through OptixRenderer, refitting instead of rebuilding,
+//and prints what every part of a frame costs
+int animationPlayback(std::string scene, double seconds, double fps, int animation)
+{
+    size_t slash=scene.find_last_of('/');
+    std::string path=slash==std::string::npos ? "" : scene.substr(0,slash+1);
+    OptixRenderer *optixRenderer=new OptixRenderer(path,scene.substr(path.size()));
+    optixRenderer->setAnimation(animation);
+    initRenderer(optixRenderer);
+    optixRenderer->compile();
+
+    AnimationPlayer &player=optixRenderer->getAnimationPlayer();
+    if(!player.hasAnimation())
+    {
+        delete optixRenderer;
+        return 1;
+    }
+    int frames=(int)(seconds*fps);
+    for(int f=0; f<frames; f++)
+    {
+        optixRenderer->updateAnimation(f/fps);
+        std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+        optixRenderer->runDirty();
+        optixRenderer->mapOutputBuffer();
+        optixRenderer->unmapOutputBuffer();
+        player.endFrame(std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count());
+    }
+    player.report();
+    delete optixRenderer;
+    return 0;
+}
+
+//flies the camera across scene with its geometry streamed in chunks under budget bytes, one
+//streaming update per frame, and prints the residency and I/O stats
+int streamingFlight(std::string scene, uint64_t budget, int frames)
+{
+    size_t slash=scene.find_last_of('/');
+    std::string path=slash==std::string::npos ? "" : scene.substr(0,slash+1);
+    OptixRenderer *optixRenderer=new OptixRenderer(path,scene.substr(path.size()));
+    optixRenderer->setStreaming(budget);
+    initRenderer(optixRenderer);
+
+    //along the diagonal of the scene at half its height, looking ahead
+    GeometryStreamer &streamer=optixRenderer->getStreamer();
+    ChunkBounds bounds=streamer.getSceneBounds();
+    float3 from=make_float3(bounds.min[0],0.5f*(bounds.min[1]+bounds.max[1]),bounds.min[2]);
+    float3 to=make_float3(bounds.max[0],from.y,bounds.max[2]);
+    float3 W=normalize(to-from);
+    float3 V=normalize(cross(up,-W));
+    float3 U=cross(-W,V);
+    optixRenderer->variable("U")->setFloat(U);
+    optixRenderer->variable("V")->setFloat(V);
+    optixRenderer->variable("W")->setFloat(W);
+
+    double launchMs=0.0;
+    for(int f=0; f<frames; f++)
+    {
+        float3 camera=from+(to-from)*((f+0.5f)/frames);
+        optixRenderer->variable("eye")->setFloat(camera);
+        optixRenderer->updateStreaming(&camera.x,&U.x,&V.x,&W.x);
+        std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+        optixRenderer->runDirty();
+        optixRenderer->mapOutputBuffer();
+        optixRenderer->unmapOutputBuffer();
+        launchMs+=std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+    }
+    streamer.report();
+    std::cout<<"Launch and readback: "<<launchMs/(frames>0?frames:1)<<" ms per frame"<<std::endl;
+    delete optixRenderer;
+    return 0;
+}
+
+//renders the camera of the window on the host with CpuRenderer, with the programs of
+//initContext by name, and writes the image to file
+int cpuRender(std::string file)
+{
+    CpuRenderer cpu(scene_p,scene_name);
+    cpu.setRayTypeCount(RAY_TYPE_COUNT);
+    cpu.setOutputSize(width,height);
+    cpu.setEntryProgram(ptx_p,USE_MS?"pinhole_camera_ms":"pinhole_camera");
+    cpu.setExceptionProgram(ptx_p,"exception");
+    cpu.setMissProgram(Phong,ptx_p,"miss_radiance");
+    cpu.setMissProgram(Shadow,ptx_p,"miss_shadow");
+    cpu.setIntersectionProgram(ptx_p,"intersectMesh");
+    cpu.setBoundingBoxProgram(ptx_p,"boundingBoxMesh");
+    cpu.setTexture("sky",scene_p+"../skydome.png");
+    cpu.init();
+    cpu.setDefaultClosestHitProgram(Phong,ptx_p,"closest_hit_radiance");
+    cpu.setDefaultAnyHitProgram(Phong,ptx_p,"any_hit_radiance");
+    cpu.setDefaultAnyHitProgram(Shadow,ptx_p,"any_hit_shadow");
+
+    float3 V=normalize(cross(up,-lookDir));
+    float3 U=cross(-lookDir,V);
+    cpu.variable("eye")->setFloat(eye);
+    cpu.variable("U")->setFloat(U);
+    cpu.variable("V")->setFloat(V);
+    cpu.variable("W")->setFloat(lookDir);
+    cpu.variable("fov")->setFloat(1.f);
+    cpu.variable("lightDir")->setFloat(normalize(make_float3(-0.5f,-5.f,-1.f)));
+
+    std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+    cpu.run();
+    double ms=std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+    std::cout<<"CPU frame "<<width<<"x"<<height<<" in "<<ms<<" ms on "<<cpu.getThreadCount()<<" threads"<<std::endl;
+    bool ok=BatchRenderer::writePNG(file,static_cast<const float*>(cpu.mapOutputBuffer()),width,height);
+    cpu.unmapOutputBuffer();
+    if(!ok)
+    {
+        std::cout<<"Error writing "<<file<<std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+//loads the scene into an OptixRenderer that frees the aiScene after upload, builds it, and
+//writes what every buffer, sampler and acceleration takes to results
+int memoryReport(std::string results, uint64_t budget)
+{
+    OptixRenderer *optixRenderer=new OptixRenderer(scene_p,scene_name);
+    optixRenderer->setReleaseScene(true);
+    optixRenderer->getMemoryTracker().setDeviceBudget(budget);
+    initRenderer(optixRenderer);
+    optixRenderer->compile();
+
+    MemoryTracker &tracker=optixRenderer->getMemoryTracker();
+    bool within=tracker.checkBudgets();
+    std::ofstream out(results.c_str());
+    tracker.writeJson(out);
+    out.close();
+    if(out.fail())
+    {
+        std::cout<<"Error writing memory report: "<<results<<std::endl;
+        within=false;
+    }
+    else
+    {
+        std::cout<<"Memory report written to "<<results<<std::endl;
+    }
+    delete optixRenderer;
+    return within?0:1;
+}
 
 int main(int argc, char ** argv)
 {
+    //host only: time the mip downsampler and diff it against the reference
+    if(argc>1 && std::string(argv[1])=="--mip-bench")
+    {
+        MipGenerator mips;
+        return mips.benchmark(2048,5)?0:1;
+    }
+    //host only: tonemap and quantize throughput of the compact output formats
+    //--convert-bench [width height] [repeats]
+    if(argc>1 && std::string(argv[1])=="--convert-bench")
+    {
+        int w=argc>3?atoi(argv[2]):3840;
+        int h=argc>3?atoi(argv[3]):2160;
+        int repeats=argc>4?atoi(argv[4]):10;
+        OutputConverter converter;
+        return converter.benchmark(w,h,repeats>0?repeats:1)?0:1;
+    }
+    //host only: mesh buffer fill serial and on the pool, scalar and SSE2 uv narrowing
+    //--upload-bench [meshes] [vertices]
+    if(argc>1 && std::string(argv[1])=="--upload-bench")
+    {
+        int meshes=argc>2?atoi(argv[2]):2000;
+        int vertices=argc>3?atoi(argv[3]):20000;
+        MeshUploader uploader(pool);
+        return uploader.benchmark(meshes>0?meshes:1,vertices>2?vertices:3)?0:1;
+    }
+    //host only: packs every mesh of the scene and checks the packed layout against the floats
+    //--pack-check
+    if(argc>1 && std::string(argv[1])=="--pack-check")
+    {
+        const aiScene *scene=loadScene(scene_p+scene_name);
+        if(!scene)
+            return 1;
+        MeshUploader uploader(pool);
+        return uploader.check(scene)?0:1;
+    }
+    //host and device: per stage scene load times over repeated loads
+    //cold imports by default, warm ones from the scene cache with --scene-cache
+    //--load-bench [runs] [results.json] [--scene-cache]
+    if(argc>1 && std::string(argv[1])=="--load-bench")
+    {
+        int runs=argc>2?atoi(argv[2]):5;
+        std::string results=argc>3?argv[3]:"load_bench.json";
+        bool useSceneCache=argc>4 && std::string(argv[4])=="--scene-cache";
+        return loadBenchmark(runs>0?runs:1,results,useSceneCache);
+    }
+    //host and device: time scene edits and the builds they cause against a full build
+    //--edit-bench [rounds]
+    if(argc>1 && std::string(argv[1])=="--edit-bench")
+    {
+        int rounds=argc>2?atoi(argv[2]):2;
+        return editBenchmark(rounds>0?rounds:1);
+    }
+    //host and device: play a node animation and time every part of a frame
+    //--animate <scene> [seconds] [fps] [animation]
+    if(argc>2 && std::string(argv[1])=="--animate")
+    {
+        double seconds=argc>3?atof(argv[3]):10.0;
+        double fps=argc>4?atof(argv[4]):30.0;
+        int animation=argc>5?atoi(argv[5]):0;
+        return animationPlayback(argv[2],seconds,fps>0.0?fps:30.0,animation);
+    }
+    //host and device: fly through a scene with its geometry streamed from disk
+    //--stream <scene> [budget MB] [frames]
+    if(argc>2 && std::string(argv[1])=="--stream")
+    {
+        int budgetMb=argc>3?atoi(argv[3]):256;
+        int frames=argc>4?atoi(argv[4]):300;
+        return streamingFlight(argv[2],(uint64_t)(budgetMb>0?budgetMb:256)<<20,frames>0?frames:300);
+    }
+    //host and device: memory of the scene by category, mesh and material, against a device budget
+    //--memory [results.json] [budget MB]
+    if(argc>1 && std::string(argv[1])=="--memory")
+    {
+        std::string results=argc>2?argv[2]:"memory.json";
+        int budgetMb=argc>3?atoi(argv[3]):0;
+        return memoryReport(results,(uint64_t)(budgetMb>0?budgetMb:0)<<20);
+    }
+    //host only: render the camera of the window without OptiX, see CpuRenderer
+    //--cpu [output.png] [width height]
+    if(argc>1 && std::string(argv[1])=="--cpu")
+    {
+        if(argc>4)
+        {
+            width=atoi(argv[3]);
+            height=atoi(argv[4]);
+        }
+        return cpuRender(argc>2?argv[2]:"cpu.png");
+    }
+    //host only: build or load the BVH of every mesh and print its quality
+    if(argc>1 && std::string(argv[1])=="--bvh-stats")
+    {
+        return bvhStats();
+    }
+    //host only: run the resolution controller over a trace written with the t key
+    //--resolution-replay <trace> [budget ms] [max scale changes]
+    if(argc>2 && std::string(argv[1])=="--resolution-replay")
+    {
+        std::vector<ResolutionSample> trace;
+        if(!ResolutionController::readTrace(argv[2],trace))
+            return 1;
+        int maxChanges=argc>4?atoi(argv[4]):RESOLUTION_REPLAY_MAX_CHANGES;
+        return ResolutionController::replay(trace,argc>3?atof(argv[3]):FRAME_BUDGET_MS,maxChanges)?0:1;
+    }
+    //headless: render a camera path to images and a timing report
+    //--batch <camera path> [output dir] [width height]
+    if(argc>2 && std::string(argv[1])=="--batch")
+    {
+        std::string dir=argc>3?argv[3]:".";
+        if(argc>5)
+        {
+            width=atoi(argv[4]);
+            height=atoi(argv[5]);
+        }
+        BatchRenderer batch;
+        if(!batch.loadPath(argv[2]))
+            return 1;
+        ilInit();
+        initContext();
+        //the png writer reads float4
+        OutputConverter::bind(renderer,OUTPUT_FLOAT4,out);
+        if(!batch.render(renderer,out,USE_MS,dir))
+            return 1;
+        return batch.writeReport(dir+"/report.json",scene_p+scene_name,USE_MS?"pinhole_camera_ms":"pinhole_camera")?0:1;
+    }
+    //headless: replays an input log recorded with the r key, frame by frame
+    //--replay [input log] [results.json] [--hash]
+    if(argc>1 && std::string(argv[1])=="--replay")
+    {
+        std::string log=argc>2?argv[2]:INPUT_LOG;
+        std::string results=argc>3?argv[3]:"replay.json";
+        bool hashes=argc>4 && std::string(argv[4])=="--hash";
+        return replayInput(log,results,hashes);
+    }
+    //headless: keeps the scene loaded and renders frames for clients on a local socket
+    //--serve <unix:path|tcp:port>
+    if(argc>2 && std::string(argv[1])=="--serve")
+    {
+        ilInit();
+        initContext();
+        display=OutputConverter::bind(renderer,OUTPUT_RGBA8,out);
+        RenderServer server;
+        if(!server.listen(argv[2]))
+            return 1;
+        server.setDefaults(currentCamera(),width,height);
+        bool ok=server.run(serveFrame);
+        server.report();
+        return ok?0:1;
+    }
+    //stand-in viewer for --serve: moves the camera and measures latency and frame sizes
+    //--client <unix:path|tcp:port> [frames] [raw|delta|png|jpeg] [--shutdown]
+    if(argc>2 && std::string(argv[1])=="--client")
+    {
+        int frames=argc>3?atoi(argv[3]):100;
+        FrameEncoding encoding=argc>4?FrameCodec::parse(argv[4]):FRAME_DELTA;
+        if(encoding==FRAME_ENCODING_COUNT)
+        {
+            std::cout<<"Unknown encoding "<<argv[4]<<std::endl;
+            return 1;
+        }
+        RenderClient client;
+        if(!client.connect(argv[2]))
+            return 1;
+        bool ok=client.runTest(currentCamera(),frames,encoding,width,height);
+        if(argc>5 && std::string(argv[5])=="--shutdown")
+            client.shutdownServer();
+        return ok?0:1;
+    }
     //init glut
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_RGBA|GLUT_DOUBLE);
     glutInitWindowPosition(0,0);
     glutInitWindowSize(width,height);
+    windowWidth=width;
+    windowHeight=height;
+    resolution.setScaleLimits(MIN_RESOLUTION_SCALE,1.f);
+    resolution.setBudget(FRAME_BUDGET_MS);
     glutCreateWindow("OptiX Ray Tracing Engine");
     //callbacks
     glutReshapeFunc(reshape);
@@ -708,6 +1695,12 @@ int main(int argc, char ** argv)
     //setup optix
     ilInit();
     initContext();
+    if(PIPELINE_BUFFERS>0)
+    {
+        //never joined, the process ends in glutMainLoop
+        pipeline=new FramePipeline(PIPELINE_BUFFERS);
+        std::thread(renderLoop).detach();
+    }
     //main loop
     glutMainLoop();
     return 0;
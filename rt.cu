@@ -6,6 +6,14 @@
 #include "random.h"
 
 #define SQRT_MS_SAMPLES 4
+//jittered samples per pixel and launch of pinhole_camera_progressive
+#define PROGRESSIVE_SAMPLES 1
+//pinhole_camera_adaptive works on square tiles of this many pixels per side
+#define ADAPTIVE_TILE 16
+//a pixel's error estimate is trusted from this many samples on
+#define ADAPTIVE_MIN_SAMPLES 8
+//and it is converged after this many regardless
+#define ADAPTIVE_MAX_SAMPLES 1024
 
 //light properties
 rtDeclareVariable(float3, lightDir, , );
@@ -39,6 +47,7 @@ rtDeclareVariable(PerRayDataShadow, shadow_res, rtPayload, );
 //material variables
 rtDeclareVariable(int, texCount, , );
 rtTextureSampler<float4,2> tex0;
+rtDeclareVariable(float2, tex0Size, , );
 rtDeclareVariable(int, bumpCount, , );
 rtTextureSampler<float,2> bump;
 rtDeclareVariable(float4, diffuse, , );
@@ -55,6 +64,12 @@ rtDeclareVariable(int, hasTexCoord, , );
 rtBuffer<float3>tangent_buffer;
 rtBuffer<float3>bitangent_buffer;
 rtDeclareVariable(int, hasTangents, , );
+//packed layout written by VertexPacker
+rtBuffer<ushort3>index16_buffer;
+rtBuffer<uint3>packed_buffer;
+rtDeclareVariable(int, packedVertices, , );
+rtDeclareVariable(int, packedIndices, , );
+rtDeclareVariable(int, halfTexCoord, , );
 
 //intersection attributes
 rtDeclareVariable(float2, texCoord, attribute texCoord, );
@@ -63,6 +78,8 @@ rtDeclareVariable(float3, shading_normal, attribute shading_normal, );
 rtDeclareVariable(float, t_hit, rtIntersectionDistance, );
 rtDeclareVariable(float3, tangent, attribute tangent, );
 rtDeclareVariable(float3, bitangent, attribute bitangent, );
+//texture coordinate area per unit of surface area, for mip selection
+rtDeclareVariable(float, texelDensity, attribute texelDensity, );
 
 //ray and kernel size info
 rtDeclareVariable(optix::Ray, ray, rtCurrentRay, );
@@ -72,10 +89,91 @@ rtDeclareVariable(uint2, launch_dim,   rtLaunchDim, );
 //output buffer
 rtDeclareVariable(rtObject, top_object, , );
 rtBuffer<float4,2> output0;
+//compact output, see OutputConverter: RGBA8 sRGB and RGB10A2 in output_packed, half4 in output_half
+#define OUTPUT_FLOAT4 0
+#define OUTPUT_RGBA8 1
+#define OUTPUT_RGB10A2 2
+#define OUTPUT_HALF4 3
+rtBuffer<unsigned int,2> output_packed;
+rtBuffer<ushort4,2> output_half;
+rtDeclareVariable(int, outputFormat, , );
+rtDeclareVariable(float, exposure, , );
+rtDeclareVariable(float, whitePoint, , );
+
+//running mean of all launches since frame 0
+rtBuffer<float4,2> accum_buffer;
+rtDeclareVariable(int, frame, , );
+
+//tile and region launches, see TileLauncher: the image pixel of launch index 0, 0 for full
+//launches. The image is as large as accum_buffer whatever the size of the launch
+rtDeclareVariable(uint2, launchOffset, , );
+
+static __device__ __inline__ uint2 imagePixel(){
+    return launch_index+launchOffset;
+}
+
+//image smaller than the buffers, e.g. a server client's frame in their lower left corner;
+//0, 0 for the size of accum_buffer
+rtDeclareVariable(uint2, imageExtent, , );
+
+static __device__ __inline__ float2 imageSize(){
+    if(imageExtent.x>0 && imageExtent.y>0)
+        return make_float2(imageExtent.x, imageExtent.y);
+    size_t2 size = accum_buffer.size();
+    return make_float2(size.x, size.y);
+}
+
+//adaptive sampling: sum of squared luminance deviations and sample count per pixel, the tiles
+//to sample in this launch and the largest relative error of every tile, as float bits
+rtBuffer<float,2> variance_buffer;
+rtBuffer<unsigned int,2> sample_count;
+rtBuffer<uint2,1> active_tiles;
+rtBuffer<unsigned int,1> tile_error;
+rtDeclareVariable(unsigned int, tilesX, , );
+
+//exposure and extended Reinhard, 1 at whitePoint; NaN and negative values give 0
+static __device__ __inline__ float tonemap(float c){
+    float x=fmaxf(c*exposure, 0.0f);
+    return fminf(x*(1.0f+x/(whitePoint*whitePoint))/(1.0f+x), 1.0f);
+}
+
+static __device__ __inline__ unsigned int quantizeSrgb(float c){
+    float s = c<=0.0031308f ? c*12.92f : 1.055f*powf(c, 1.0f/2.4f)-0.055f;
+    return (unsigned int)(s*255.0f+0.5f);
+}
+
+static __device__ __inline__ unsigned short toHalf(float f){
+    unsigned short h;
+    asm("cvt.rn.f16.f32 %0, %1;" : "=h"(h) : "f"(f));
+    return h;
+}
+
+//only the buffer of outputFormat is written, so only 4 or 8 bytes per pixel are read back
+static __device__ __inline__ void writeOutput(uint2 index, float4 c){
+    if(outputFormat==OUTPUT_RGBA8){
+        unsigned int a=(unsigned int)(fminf(fmaxf(c.w, 0.0f), 1.0f)*255.0f+0.5f);
+        output_packed[index] = quantizeSrgb(tonemap(c.x)) | (quantizeSrgb(tonemap(c.y))<<8) | (quantizeSrgb(tonemap(c.z))<<16) | (a<<24);
+    }
+    else if(outputFormat==OUTPUT_RGB10A2){
+        unsigned int r=(unsigned int)(tonemap(c.x)*1023.0f+0.5f);
+        unsigned int g=(unsigned int)(tonemap(c.y)*1023.0f+0.5f);
+        unsigned int b=(unsigned int)(tonemap(c.z)*1023.0f+0.5f);
+        unsigned int a=(unsigned int)(fminf(fmaxf(c.w, 0.0f), 1.0f)*3.0f+0.5f);
+        output_packed[index] = r | (g<<10) | (b<<20) | (a<<30);
+    }
+    else if(outputFormat==OUTPUT_HALF4){
+        output_half[index] = make_ushort4(toHalf(c.x*exposure), toHalf(c.y*exposure), toHalf(c.z*exposure), toHalf(c.w));
+    }
+    else{
+        output0[index] = c;
+    }
+}
 
 RT_PROGRAM void pinhole_camera(){
-    float ratio=float(launch_dim.x)/float(launch_dim.y);
-    float2 d = make_float2(launch_index) / make_float2(launch_dim) * 2.f - 1.f;
+    uint2 pixel = imagePixel();
+    float2 size = imageSize();
+    float ratio=size.x/size.y;
+    float2 d = make_float2(pixel) / size * 2.f - 1.f;
 	float3 ray_origin = eye;
 	float3 ray_direction = normalize(d.x*V*fov*ratio + d.y*U*fov + W);
 
@@ -85,15 +183,17 @@ RT_PROGRAM void pinhole_camera(){
 
 	rtTrace(top_object, ray, rad_res);
 
-	output0[launch_index] = rad_res.color;
+	writeOutput(pixel, rad_res.color);
 	//output0[launch_index] = make_float4(1.f,0.f,0.f,0.f);
 }
 
 RT_PROGRAM void pinhole_camera_ms(){
 
     unsigned int seedi, seedj;
-    float ratio=float(launch_dim.x)/float(launch_dim.y);
-    float2 d = make_float2(launch_index) / make_float2(launch_dim) * 2.f - 1.f;
+    uint2 pixel = imagePixel();
+    float2 size = imageSize();
+    float ratio=size.x/size.y;
+    float2 d = make_float2(pixel) / size * 2.f - 1.f;
 	float3 ray_origin = eye;
 
 	PerRayDataRadiance rad_res;
@@ -102,13 +202,13 @@ RT_PROGRAM void pinhole_camera_ms(){
 
     int samples=SQRT_MS_SAMPLES*SQRT_MS_SAMPLES;
 
-    float2 scale = 1 / (make_float2(launch_dim) * SQRT_MS_SAMPLES) * 2.0f;
+    float2 scale = 1 / (size * SQRT_MS_SAMPLES) * 2.0f;
 
     for(int i=0; i<SQRT_MS_SAMPLES; i++){
         for(int j=0; j<SQRT_MS_SAMPLES; j++){
 
-            seedi = tea<16>(launch_dim.x*launch_index.y+launch_index.x,2*(i*SQRT_MS_SAMPLES+j));
-			seedj = tea<16>(launch_dim.x*launch_index.y+launch_index.x,2*(i*SQRT_MS_SAMPLES+j)+1);
+            seedi = tea<16>((unsigned int)size.x*pixel.y+pixel.x,2*(i*SQRT_MS_SAMPLES+j));
+			seedj = tea<16>((unsigned int)size.x*pixel.y+pixel.x,2*(i*SQRT_MS_SAMPLES+j)+1);
 
             float2 sample = d + make_float2((i+1)*rnd(seedi),(j+1)*rnd(seedj)) * scale;
 
@@ -125,14 +225,97 @@ RT_PROGRAM void pinhole_camera_ms(){
 
 
 
-	output0[launch_index] = res;
+	writeOutput(pixel, res);
 	//output0[launch_index] = make_float4(1.f,0.f,0.f,0.f);
 }
 
+//adds PROGRESSIVE_SAMPLES new samples to the pixel on every launch; the host sets frame to 0
+//whenever the camera or a variable changes and counts it up while the view stands still
+RT_PROGRAM void pinhole_camera_progressive(){
+
+    uint2 pixel = imagePixel();
+    float2 size = imageSize();
+    float ratio=size.x/size.y;
+    float2 d = make_float2(pixel) / size * 2.f - 1.f;
+    float2 pixel_size = 2.f / size;
+    unsigned int seed = tea<16>((unsigned int)size.x*pixel.y+pixel.x, frame);
+
+    PerRayDataRadiance rad_res;
+    float4 res=make_float4(0.0f,0.0f,0.0f,0.0f);
+
+    for(int s=0; s<PROGRESSIVE_SAMPLES; s++){
+        float2 sample = d + make_float2(rnd(seed),rnd(seed)) * pixel_size;
+
+        float3 ray_direction = normalize(sample.x*V*fov*ratio + sample.y*U*fov + W);
+        rad_res.color=make_float4(0.0f,0.0f,0.0f,0.0f);
+        optix::Ray ray = optix::make_Ray(eye, ray_direction, Phong, 0.00000000001, RT_DEFAULT_MAX);
+        rtTrace(top_object, ray, rad_res);
+        res+=rad_res.color;
+    }
+    res/=PROGRESSIVE_SAMPLES;
+
+    if(frame>0){
+        res=lerp(accum_buffer[pixel], res, 1.0f/(frame+1));
+    }
+    accum_buffer[pixel] = res;
+    writeOutput(pixel, res);
+}
+
+//one new sample for every pixel of the tiles in active_tiles, launched as
+//ADAPTIVE_TILE*ADAPTIVE_TILE by the number of active tiles; frame 0 starts every pixel over.
+//Mean and variance are updated with Welford's method, the relative standard error of the
+//luminance goes into tile_error so the host can drop tiles that are below its threshold
+RT_PROGRAM void pinhole_camera_adaptive(){
+
+    uint2 tile = active_tiles[launch_index.y];
+    uint2 pixel = tile*ADAPTIVE_TILE + make_uint2(launch_index.x%ADAPTIVE_TILE, launch_index.x/ADAPTIVE_TILE);
+    size_t2 size = accum_buffer.size();
+    if(pixel.x>=size.x || pixel.y>=size.y){
+        return;
+    }
+
+    float ratio=float(size.x)/float(size.y);
+    float2 d = make_float2(pixel) / make_float2(size) * 2.f - 1.f;
+    unsigned int n = frame==0 ? 0 : sample_count[pixel];
+    unsigned int seed = tea<16>(size.x*pixel.y+pixel.x, n);
+    float2 sample = d + make_float2(rnd(seed),rnd(seed)) * 2.f / make_float2(size);
+
+    PerRayDataRadiance rad_res;
+    rad_res.color=make_float4(0.0f,0.0f,0.0f,0.0f);
+    float3 ray_direction = normalize(sample.x*V*fov*ratio + sample.y*U*fov + W);
+    optix::Ray ray = optix::make_Ray(eye, ray_direction, Phong, 0.00000000001, RT_DEFAULT_MAX);
+    rtTrace(top_object, ray, rad_res);
+
+    float4 mean = n==0 ? make_float4(0.0f) : accum_buffer[pixel];
+    float m2 = n==0 ? 0.0f : variance_buffer[pixel];
+    const float3 weights = make_float3(0.2126f, 0.7152f, 0.0722f);
+    float old_lum = dot(make_float3(mean), weights);
+    n++;
+    mean += (rad_res.color-mean) / float(n);
+    float lum = dot(make_float3(rad_res.color), weights);
+    m2 += (lum-old_lum) * (lum-dot(make_float3(mean), weights));
+
+    accum_buffer[pixel] = mean;
+    variance_buffer[pixel] = m2;
+    sample_count[pixel] = n;
+    writeOutput(pixel, mean);
+
+    float error = 1e30f;
+    if(n>=ADAPTIVE_MAX_SAMPLES){
+        error = 0.0f;
+    }
+    else if(n>=ADAPTIVE_MIN_SAMPLES){
+        float standard_error = sqrtf(m2/(float(n-1)*n));
+        error = fminf(standard_error/(dot(make_float3(mean), weights)+1e-3f), 1e30f);
+    }
+    //positive floats order like their bits
+    atomicMax(&tile_error[tile.y*tilesX+tile.x], __float_as_uint(error));
+}
+
 RT_PROGRAM void exception(){
     int code = rtGetExceptionCode();
     if(code==RT_EXCEPTION_STACK_OVERFLOW){
-        output0[launch_index] = make_float4(1.f,0.f,0.f,0.f);
+        output0[imagePixel()] = make_float4(1.f,0.f,0.f,0.f);
     }
 }
 
@@ -156,7 +339,11 @@ RT_PROGRAM void closest_hit_radiance(){
 
     if(texCount>0)
     {
-        color=diffuse*tex2D(tex0,texCoord.x,texCoord.y);
+        //ray cone: footprint of one pixel at the hit, in texels
+        float spread=2.f*fov/imageSize().y;
+        float cos_angle=fmaxf(fabsf(dot(world_geo_normal,ray.direction)),0.01f);
+        float lod=0.5f*log2f(texelDensity*tex0Size.x*tex0Size.y)+log2f(t_hit*spread/cos_angle);
+        color=diffuse*tex2DLod(tex0,texCoord.x,texCoord.y,fmaxf(lod,0.f));
     }
     else
     {
@@ -222,9 +409,40 @@ RT_PROGRAM void miss_shadow(){
     shadow_res.hit=0;
 }
 
+static __device__ __inline__ int3 loadIndices(int primIdx){
+    if(packedIndices){
+        ushort3 id=index16_buffer[primIdx];
+        return make_int3(id.x,id.y,id.z);
+    }
+    return index_buffer[primIdx];
+}
+
+//octahedral snorm16x2, see VertexPacker::decodeOct
+static __device__ __inline__ float3 decodeOct(unsigned int bits){
+    float x=(short)(bits&0xFFFF)/32767.f;
+    float y=(short)(bits>>16)/32767.f;
+    float3 n=make_float3(x,y,1.f-fabsf(x)-fabsf(y));
+    if(n.z<0.f){
+        n.x=(1.f-fabsf(y))*(x>=0.f?1.f:-1.f);
+        n.y=(1.f-fabsf(x))*(y>=0.f?1.f:-1.f);
+    }
+    return normalize(n);
+}
+
+static __device__ __inline__ float2 decodeHalf2(unsigned int bits){
+    return make_float2(__half2float(bits&0xFFFF),__half2float(bits>>16));
+}
+
+//normal, tangent and bitangent of one packed vertex; the bitangent sign sits in bit 16 of the tangent
+static __device__ __inline__ void decodeFrame(uint3 packed, float3 &n, float3 &t, float3 &b){
+    n=decodeOct(packed.x);
+    t=decodeOct(packed.y&0xFFFEFFFF);
+    b=cross(n,t)*((packed.y&0x10000)?-1.f:1.f);
+}
+
 RT_PROGRAM void intersectMesh(int primIdx){
     //get indices
-    int3 id=index_buffer[primIdx];
+    int3 id=loadIndices(primIdx);
     //get vertices
     float3 v1=vertex_buffer[id.x];
     float3 v2=vertex_buffer[id.y];
@@ -236,39 +454,78 @@ RT_PROGRAM void intersectMesh(int primIdx){
     {
         if(rtPotentialIntersection(t))
         {
-            //loading normals
-            float3 n1=normal_buffer[id.x];
-            float3 n2=normal_buffer[id.y];
-            float3 n3=normal_buffer[id.z];
-
-            if(hasTangents){
-                float3 t1=tangent_buffer[id.x];
-                float3 t2=tangent_buffer[id.y];
-                float3 t3=tangent_buffer[id.z];
-
-                float3 b1=bitangent_buffer[id.x];
-                float3 b2=bitangent_buffer[id.y];
-                float3 b3=bitangent_buffer[id.z];
-
-                tangent=(1.0f-beta-gamma)*t1 + beta*t2 +gamma*t3;
-                bitangent=(1.0f-beta-gamma)*b1 + beta*b2 +gamma*b3;
+            float3 n1, n2, n3;
+            float2 t1, t2, t3;
+            if(packedVertices){
+                //one load per vertex for the whole frame and uv
+                uint3 p1=packed_buffer[id.x];
+                uint3 p2=packed_buffer[id.y];
+                uint3 p3=packed_buffer[id.z];
+                float3 tan1, tan2, tan3, bit1, bit2, bit3;
+                decodeFrame(p1,n1,tan1,bit1);
+                decodeFrame(p2,n2,tan2,bit2);
+                decodeFrame(p3,n3,tan3,bit3);
+                if(hasTangents){
+                    tangent=(1.0f-beta-gamma)*tan1 + beta*tan2 +gamma*tan3;
+                    bitangent=(1.0f-beta-gamma)*bit1 + beta*bit2 +gamma*bit3;
+                }
+                else{
+                    tangent=make_float3(0.f);
+                    bitangent=make_float3(0.f);
+                }
+                if(halfTexCoord){
+                    t1=decodeHalf2(p1.z);
+                    t2=decodeHalf2(p2.z);
+                    t3=decodeHalf2(p3.z);
+                }
+                else if(hasTexCoord){
+                    t1=texCoord_buffer[id.x];
+                    t2=texCoord_buffer[id.y];
+                    t3=texCoord_buffer[id.z];
+                }
             }
             else{
-                tangent=make_float3(0.f);
-                bitangent=make_float3(0.f);
+                //loading normals
+                n1=normal_buffer[id.x];
+                n2=normal_buffer[id.y];
+                n3=normal_buffer[id.z];
+
+                if(hasTangents){
+                    float3 tan1=tangent_buffer[id.x];
+                    float3 tan2=tangent_buffer[id.y];
+                    float3 tan3=tangent_buffer[id.z];
+
+                    float3 bit1=bitangent_buffer[id.x];
+                    float3 bit2=bitangent_buffer[id.y];
+                    float3 bit3=bitangent_buffer[id.z];
+
+                    tangent=(1.0f-beta-gamma)*tan1 + beta*tan2 +gamma*tan3;
+                    bitangent=(1.0f-beta-gamma)*bit1 + beta*bit2 +gamma*bit3;
+                }
+                else{
+                    tangent=make_float3(0.f);
+                    bitangent=make_float3(0.f);
+                }
+
+                //loading texCoords
+                if(hasTexCoord){
+                    t1=texCoord_buffer[id.x];
+                    t2=texCoord_buffer[id.y];
+                    t3=texCoord_buffer[id.z];
+                }
             }
 
-
-            //loading texCoords
             if(hasTexCoord){
-                float2 t1=texCoord_buffer[id.x];
-                float2 t2=texCoord_buffer[id.y];
-                float2 t3=texCoord_buffer[id.z];
                 texCoord=(1.0f-beta-gamma)*t1 + beta*t2 +gamma*t3;
+                //n is twice the triangle area, as is the cross product of the uv edges
+                float2 e1=t2-t1;
+                float2 e2=t3-t1;
+                texelDensity=fabsf(e1.x*e2.y-e1.y*e2.x)/fmaxf(length(n),1e-20f);
             }
             else
             {
                 texCoord=make_float2(1.0f,0.0f);
+                texelDensity=0.f;
             }
             //setting attributes
             shading_normal=(1.0f-beta-gamma)*n1 + beta*n2 +gamma*n3;
@@ -281,7 +538,7 @@ RT_PROGRAM void intersectMesh(int primIdx){
 
 RT_PROGRAM void boundingBoxMesh(int primIdx, float result[6]){
     //get indices
-    int3 id=index_buffer[primIdx];
+    int3 id=loadIndices(primIdx);
     //load vertices
     float3 v1=vertex_buffer[id.x];
     float3 v2=vertex_buffer[id.y];
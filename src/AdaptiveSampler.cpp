@@ -0,0 +1,139 @@
+#include "AdaptiveSampler.h"
+
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+using namespace optix;
+
+AdaptiveSampler::AdaptiveSampler() : entry(0), width(0), height(0), tiles_x(0), tiles_y(0), threshold(ADAPTIVE_THRESHOLD), frame(0), active(),
+    rays_traced(0), rays_saved(0), total_traced(0), total_saved(0)
+{
+    //ctor
+}
+
+AdaptiveSampler::~AdaptiveSampler()
+{
+    //dtor
+}
+
+void AdaptiveSampler::init(Context c, unsigned e, int w, int h){
+    context=c;
+    entry=e;
+    //running sums never leave the device, the tile lists go both ways every launch
+    variance=context->createBuffer(RT_BUFFER_INPUT_OUTPUT|RT_BUFFER_GPU_LOCAL, RT_FORMAT_FLOAT, w, h);
+    counts=context->createBuffer(RT_BUFFER_INPUT_OUTPUT|RT_BUFFER_GPU_LOCAL, RT_FORMAT_UNSIGNED_INT, w, h);
+    tiles=context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_UNSIGNED_INT2, 1);
+    errors=context->createBuffer(RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_UNSIGNED_INT, 1);
+    context["variance_buffer"]->set(variance);
+    context["sample_count"]->set(counts);
+    context["active_tiles"]->set(tiles);
+    context["tile_error"]->set(errors);
+    setSize(w, h);
+}
+
+void AdaptiveSampler::setSize(int w, int h){
+    width=w;
+    height=h;
+    tiles_x=(width+ADAPTIVE_TILE-1)/ADAPTIVE_TILE;
+    tiles_y=(height+ADAPTIVE_TILE-1)/ADAPTIVE_TILE;
+    variance->setSize(width, height);
+    counts->setSize(width, height);
+    tiles->setSize(max(tiles_x*tiles_y, 1));
+    errors->setSize(max(tiles_x*tiles_y, 1));
+    context["tilesX"]->setUint(tiles_x);
+    reset();
+}
+
+void AdaptiveSampler::setThreshold(float t){
+    threshold=t;
+}
+
+void AdaptiveSampler::reset(){
+    frame=0;
+    active.clear();
+    for(int y=0; y<tiles_y; y++){
+        for(int x=0; x<tiles_x; x++){
+            active.push_back(make_uint2(x, y));
+        }
+    }
+    rays_traced=rays_saved=0;
+    total_traced=total_saved=0;
+}
+
+bool AdaptiveSampler::launch(){
+    if(active.empty()){
+        return false;
+    }
+
+    //errors of the active tiles start at 0 for the atomicMax in rt.cu
+    uint2 *t=static_cast<uint2*>(tiles->map());
+    memcpy(t, &active[0], active.size()*sizeof(uint2));
+    tiles->unmap();
+    unsigned int *e=static_cast<unsigned int*>(errors->map());
+    for(size_t i=0; i<active.size(); i++){
+        e[active[i].y*tiles_x+active[i].x]=0;
+    }
+    errors->unmap();
+
+    context["frame"]->setInt(frame++);
+    context->launch(entry, ADAPTIVE_TILE*ADAPTIVE_TILE, active.size());
+
+    //tiles on the right and bottom edge are cut off by the image
+    rays_traced=0;
+    for(size_t i=0; i<active.size(); i++){
+        int w=min(ADAPTIVE_TILE, width-(int)active[i].x*ADAPTIVE_TILE);
+        int h=min(ADAPTIVE_TILE, height-(int)active[i].y*ADAPTIVE_TILE);
+        rays_traced+=w*h;
+    }
+    rays_saved=(long long)width*height-rays_traced;
+    total_traced+=rays_traced;
+    total_saved+=rays_saved;
+
+    updateTiles();
+    return true;
+}
+
+void AdaptiveSampler::updateTiles(){
+    const unsigned int *e=static_cast<const unsigned int*>(errors->map());
+    vector<uint2> remaining;
+    for(size_t i=0; i<active.size(); i++){
+        float error;
+        memcpy(&error, &e[active[i].y*tiles_x+active[i].x], sizeof(float));
+        if(error>threshold){
+            remaining.push_back(active[i]);
+        }
+    }
+    errors->unmap();
+    active.swap(remaining);
+}
+
+int AdaptiveSampler::getActiveTiles(){
+    return active.size();
+}
+
+int AdaptiveSampler::getTileCount(){
+    return tiles_x*tiles_y;
+}
+
+long long AdaptiveSampler::getRaysTraced(){
+    return rays_traced;
+}
+
+long long AdaptiveSampler::getRaysSaved(){
+    return rays_saved;
+}
+
+void AdaptiveSampler::report(){
+    long long pixels=(long long)width*height;
+    cout<<"Adaptive sampling: frame "<<frame<<", "<<active.size()<<'/'<<getTileCount()<<" tiles active, "
+        <<rays_traced<<" rays traced, "<<rays_saved<<" saved";
+    if(pixels>0){
+        cout<<" ("<<100.0*rays_saved/pixels<<"%)";
+    }
+    if(total_traced+total_saved>0){
+        cout<<", "<<100.0*total_saved/(total_traced+total_saved)<<"% saved since reset";
+    }
+    cout<<endl;
+}
@@ -0,0 +1,162 @@
+#include "AnimationPlayer.h"
+
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+AnimationPlayer::AnimationPlayer() : animation(NULL), editor(NULL), channels(), matrices(), costs()
+{
+    //ctor
+}
+
+AnimationPlayer::~AnimationPlayer()
+{
+    //dtor
+}
+
+bool AnimationPlayer::init(const aiScene *scene, int index, SceneEditor *e){
+    animation=NULL;
+    editor=e;
+    channels.clear();
+    costs.clear();
+    if(index<0 || index>=(int)scene->mNumAnimations){
+        cout<<"Scene has no animation "<<index<<", "<<scene->mNumAnimations<<" animations"<<endl;
+        return false;
+    }
+    animation=scene->mAnimations[index];
+    int skipped=0;
+    for(unsigned int c=0; c<animation->mNumChannels; c++){
+        const aiNodeAnim *anim=animation->mChannels[c];
+        int node=editor->findNode(anim->mNodeName.data);
+        if(node<0){
+            skipped++;
+            continue;
+        }
+        Channel channel;
+        channel.anim=anim;
+        channel.node=node;
+        channels.push_back(channel);
+    }
+    matrices.resize(channels.size());
+    cout<<"Animation "<<index<<" ("<<animation->mName.data<<"): "<<channels.size()<<" channels, "<<getDuration()<<" s";
+    if(skipped>0){
+        cout<<", "<<skipped<<" channels of unknown nodes skipped";
+    }
+    cout<<endl;
+    return true;
+}
+
+bool AnimationPlayer::hasAnimation(){
+    return animation!=NULL;
+}
+
+double AnimationPlayer::getDuration(){
+    if(!animation){
+        return 0.0;
+    }
+    double ticks=animation->mTicksPerSecond>0.0 ? animation->mTicksPerSecond : ANIMATION_DEFAULT_TICKS;
+    return animation->mDuration/ticks;
+}
+
+//last key at or before ticks, keys are sorted by time
+template<class Key> static unsigned int findKey(const Key *keys, unsigned int n, double ticks){
+    const Key *after=upper_bound(keys, keys+n, ticks, [](double t, const Key &k){ return t<k.mTime; });
+    return after==keys ? 0 : after-keys-1;
+}
+
+static aiVector3D interpolate(const aiVectorKey *keys, unsigned int n, double ticks){
+    unsigned int i=findKey(keys, n, ticks);
+    if(i+1>=n || ticks<=keys[i].mTime){
+        return keys[i].mValue;
+    }
+    float f=(float)((ticks-keys[i].mTime)/(keys[i+1].mTime-keys[i].mTime));
+    const aiVector3D &a=keys[i].mValue;
+    const aiVector3D &b=keys[i+1].mValue;
+    return aiVector3D(a.x+(b.x-a.x)*f, a.y+(b.y-a.y)*f, a.z+(b.z-a.z)*f);
+}
+
+static aiQuaternion interpolate(const aiQuatKey *keys, unsigned int n, double ticks){
+    unsigned int i=findKey(keys, n, ticks);
+    if(i+1>=n || ticks<=keys[i].mTime){
+        return keys[i].mValue;
+    }
+    float f=(float)((ticks-keys[i].mTime)/(keys[i+1].mTime-keys[i].mTime));
+    aiQuaternion q;
+    aiQuaternion::Interpolate(q, keys[i].mValue, keys[i+1].mValue, f);
+    return q.Normalize();
+}
+
+//assimp keeps at least one key of every kind in a channel
+aiMatrix4x4 AnimationPlayer::evaluate(const aiNodeAnim *channel, double ticks){
+    aiVector3D position=interpolate(channel->mPositionKeys, channel->mNumPositionKeys, ticks);
+    aiQuaternion rotation=interpolate(channel->mRotationKeys, channel->mNumRotationKeys, ticks);
+    aiVector3D scaling=interpolate(channel->mScalingKeys, channel->mNumScalingKeys, ticks);
+    return aiMatrix4x4(scaling, rotation, position);
+}
+
+int AnimationPlayer::update(double seconds){
+    current.channels=0;
+    current.evaluate_ms=current.transform_ms=current.refit_ms=current.launch_ms=0.0;
+    if(!animation){
+        return 0;
+    }
+    chrono::steady_clock::time_point start=chrono::steady_clock::now();
+    double tps=animation->mTicksPerSecond>0.0 ? animation->mTicksPerSecond : ANIMATION_DEFAULT_TICKS;
+    double ticks=seconds*tps;
+    if(animation->mDuration>0.0){
+        ticks=fmod(ticks, animation->mDuration);
+    }
+    for(size_t c=0; c<channels.size(); c++){
+        matrices[c]=evaluate(channels[c].anim, ticks);
+    }
+    chrono::steady_clock::time_point evaluated=chrono::steady_clock::now();
+    for(size_t c=0; c<channels.size(); c++){
+        editor->setTransform(channels[c].node, &matrices[c].a1);
+    }
+    chrono::steady_clock::time_point set=chrono::steady_clock::now();
+    current.channels=channels.size();
+    current.evaluate_ms=chrono::duration<double,milli>(evaluated-start).count();
+    current.transform_ms=chrono::duration<double,milli>(set-evaluated).count();
+    return channels.size();
+}
+
+void AnimationPlayer::setRefitTime(double ms){
+    current.refit_ms=ms;
+}
+
+void AnimationPlayer::endFrame(double launch_ms){
+    current.launch_ms=launch_ms;
+    costs.push_back(current);
+}
+
+void AnimationPlayer::report(){
+    if(costs.empty()){
+        cout<<"No animation frames played"<<endl;
+        return;
+    }
+    const char *names[]={"evaluate", "transform", "refit", "launch", "total"};
+    double sum[5]={0.0, 0.0, 0.0, 0.0, 0.0};
+    double worst[5]={0.0, 0.0, 0.0, 0.0, 0.0};
+    for(size_t i=0; i<costs.size(); i++){
+        const AnimationFrameCost &c=costs[i];
+        double parts[5]={c.evaluate_ms, c.transform_ms, c.refit_ms, c.launch_ms, 0.0};
+        parts[4]=parts[0]+parts[1]+parts[2]+parts[3];
+        for(int p=0; p<5; p++){
+            sum[p]+=parts[p];
+            worst[p]=max(worst[p], parts[p]);
+        }
+    }
+    int n=costs.size();
+    cout<<"Animation playback: "<<n<<" frames, "<<channels.size()<<" channels"<<endl;
+    for(int p=0; p<5; p++){
+        cout<<"    "<<names[p]<<": "<<sum[p]/n<<" ms mean, "<<worst[p]<<" ms max";
+        if(p<4 && sum[4]>0.0){
+            cout<<", "<<100.0*sum[p]/sum[4]<<"%";
+        }
+        cout<<endl;
+    }
+    cout<<"    "<<1000.0*n/sum[4]<<" fps mean, "<<1000.0/worst[4]<<" fps in the worst frame"<<endl;
+}
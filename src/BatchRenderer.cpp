@@ -0,0 +1,227 @@
+#include "BatchRenderer.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+#include <png.h>
+
+#include "FramePipeline.h"
+#include "Json.h"
+
+//frames between the launching thread and the png writer
+#define BATCH_BUFFERS 3
+
+using namespace std;
+using namespace optix;
+
+static double elapsedMs(chrono::steady_clock::time_point start){
+    return chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+}
+
+BatchRenderer::BatchRenderer() : keys(), frames(), setup_ms(0.0), wall_ms(0.0), width(0), height(0)
+{
+    //ctor
+}
+
+BatchRenderer::~BatchRenderer()
+{
+    //dtor
+}
+
+bool BatchRenderer::loadPath(string file){
+    ifstream in(file.c_str());
+    if(in.fail()){
+        cout<<"Error reading camera path: "<<file<<endl;
+        return false;
+    }
+    keys.clear();
+    string line;
+    int line_number=0;
+    while(getline(in,line)){
+        line_number++;
+        line=line.substr(0,line.find('#'));
+        istringstream tokens(line);
+        CameraKey key;
+        key.up=make_float3(0.f,1.f,0.f);
+        key.fov=1.f;
+        bool has_eye=false, has_look=false, ok=true;
+        string name;
+        while(ok && tokens>>name){
+            if(name=="eye"){
+                ok=static_cast<bool>(tokens>>key.eye.x>>key.eye.y>>key.eye.z);
+                has_eye=true;
+            }
+            else if(name=="lookDir"){
+                ok=static_cast<bool>(tokens>>key.look_dir.x>>key.look_dir.y>>key.look_dir.z);
+                has_look=true;
+            }
+            else if(name=="up"){
+                ok=static_cast<bool>(tokens>>key.up.x>>key.up.y>>key.up.z);
+            }
+            else if(name=="fov"){
+                ok=static_cast<bool>(tokens>>key.fov);
+            }
+            else{
+                ok=false;
+            }
+        }
+        if(!has_eye && !has_look && ok){
+            //blank or comment line
+            continue;
+        }
+        if(!ok || !has_eye || !has_look){
+            cout<<"Bad camera keyframe at "<<file<<':'<<line_number<<endl;
+            return false;
+        }
+        key.look_dir=normalize(key.look_dir);
+        keys.push_back(key);
+    }
+    cout<<"Camera path: "<<keys.size()<<" keyframes"<<endl;
+    return !keys.empty();
+}
+
+int BatchRenderer::getFrameCount(){
+    return keys.size();
+}
+
+//same basis as the viewer's keyboard()
+void BatchRenderer::setCamera(Context context, const CameraKey &key){
+    float3 V=normalize(cross(key.up,-key.look_dir));
+    float3 U=cross(-key.look_dir,V);
+
+    context["eye"]->setFloat(key.eye);
+    context["U"]->setFloat(U);
+    context["V"]->setFloat(V);
+    context["W"]->setFloat(key.look_dir);
+    context["fov"]->setFloat(key.fov);
+}
+
+bool BatchRenderer::render(Context context, Buffer output, unsigned entry, string dir){
+    frames.clear();
+    RTsize w, h;
+    output->getSize(w,h);
+    width=w;
+    height=h;
+
+    //empty launch: compiles the programs and builds the accelerations, so frame 0 times only the frame
+    chrono::steady_clock::time_point start=chrono::steady_clock::now();
+    setCamera(context,keys[0]);
+    context->launch(entry,0,0);
+    setup_ms=elapsedMs(start);
+
+    //png encode and write of frame i on the consumer thread while frame i+1 renders
+    frames.assign(keys.size(), FrameStats());
+    FramePipeline pipeline(BATCH_BUFFERS);
+    pipeline.startConsumer([this, &dir](PipelineFrame &frame){
+        FrameStats &stats=frames[frame.index];
+        chrono::steady_clock::time_point write_start=chrono::steady_clock::now();
+        if(!writePNG(dir+"/"+stats.image,reinterpret_cast<const float*>(&frame.pixels[0]),frame.width,frame.height)){
+            return false;
+        }
+        stats.write_ms=elapsedMs(write_start);
+        stats.total_ms=elapsedMs(frame.acquired);
+        cout<<"Frame "<<frame.index<<": launch "<<stats.launch_ms<<" ms, readback "<<stats.readback_ms<<" ms, write "<<stats.write_ms<<" ms"<<endl;
+        return true;
+    });
+
+    chrono::steady_clock::time_point wall_start=chrono::steady_clock::now();
+    for(size_t i=0; i<keys.size(); i++){
+        PipelineFrame *frame=pipeline.acquire();
+        if(!frame){
+            break;
+        }
+        FrameStats &stats=frames[i];
+        char name[32];
+        sprintf(name,"frame_%04d.png",(int)i);
+        stats.image=name;
+
+        start=chrono::steady_clock::now();
+        setCamera(context,keys[i]);
+        context->launch(entry,width,height);
+        stats.launch_ms=frame->render_ms=elapsedMs(start);
+
+        start=chrono::steady_clock::now();
+        frame->width=width;
+        frame->height=height;
+        frame->pixels.resize(4*sizeof(float)*width*height);
+        void *data=output->map();
+        memcpy(&frame->pixels[0],data,frame->pixels.size());
+        output->unmap();
+        stats.readback_ms=frame->readback_ms=elapsedMs(start);
+
+        pipeline.submit(frame);
+    }
+    pipeline.finish();
+    wall_ms=elapsedMs(wall_start);
+    pipeline.report();
+    return !pipeline.failed();
+}
+
+//the output buffer starts at the bottom row, as glDrawPixels expects
+bool BatchRenderer::writePNG(string file, const float *rgba, int w, int h){
+    vector<unsigned char> bytes(4*w*h);
+    for(size_t i=0; i<bytes.size(); i++){
+        float v=min(max(rgba[i],0.f),1.f);
+        bytes[i]=(unsigned char)(v*255.f+0.5f);
+    }
+
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version=PNG_IMAGE_VERSION;
+    image.width=w;
+    image.height=h;
+    image.format=PNG_FORMAT_RGBA;
+    if(!png_image_write_to_file(&image, file.c_str(), 0, &bytes[0], -4*w, NULL)){
+        cout<<"Error writing image: "<<file<<endl;
+        return false;
+    }
+    return true;
+}
+
+bool BatchRenderer::writeReport(string file, string scene, string entry_name){
+    ofstream out(file.c_str());
+    if(out.fail()){
+        cout<<"Error writing report: "<<file<<endl;
+        return false;
+    }
+
+    double launch_sum=0.0, total_sum=0.0;
+    vector<double> launches;
+    for(size_t i=0; i<frames.size(); i++){
+        launch_sum+=frames[i].launch_ms;
+        total_sum+=frames[i].total_ms;
+        launches.push_back(frames[i].launch_ms);
+    }
+    sort(launches.begin(),launches.end());
+    int n=frames.size();
+
+    out<<"{\n";
+    out<<"  \"scene\": \""<<escapeJson(scene)<<"\",\n";
+    out<<"  \"entry\": \""<<escapeJson(entry_name)<<"\",\n";
+    out<<"  \"width\": "<<width<<",\n";
+    out<<"  \"height\": "<<height<<",\n";
+    out<<"  \"setup_ms\": "<<setup_ms<<",\n";
+    out<<"  \"frames\": [\n";
+    for(int i=0; i<n; i++){
+        const FrameStats &f=frames[i];
+        out<<"    {\"index\": "<<i<<", \"image\": \""<<escapeJson(f.image)<<"\", \"launch_ms\": "<<f.launch_ms
+           <<", \"readback_ms\": "<<f.readback_ms<<", \"write_ms\": "<<f.write_ms<<", \"total_ms\": "<<f.total_ms<<'}'
+           <<(i+1<n?",":"")<<'\n';
+    }
+    out<<"  ],\n";
+    out<<"  \"summary\": {\"frames\": "<<n;
+    if(n>0){
+        out<<", \"launch_mean_ms\": "<<launch_sum/n<<", \"launch_median_ms\": "<<launches[n/2]
+           <<", \"launch_max_ms\": "<<launches[n-1]<<", \"total_mean_ms\": "<<total_sum/n
+           <<", \"launch_fps\": "<<1000.0*n/launch_sum<<", \"wall_ms\": "<<wall_ms<<", \"fps\": "<<1000.0*n/wall_ms;
+    }
+    out<<"}\n";
+    out<<"}\n";
+    cout<<"Report written to "<<file<<endl;
+    return true;
+}
@@ -0,0 +1,459 @@
+#include "BlockCompressor.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "MipGenerator.h"
+
+#define POWER_ITERATIONS 8
+
+using namespace std;
+
+static const char CACHE_MAGIC[4]={'O','R','B','C'};
+
+static uint16_t pack565(const float *c){
+    int r=min(max(int(c[0]*31.f/255.f+0.5f), 0), 31);
+    int g=min(max(int(c[1]*63.f/255.f+0.5f), 0), 63);
+    int b=min(max(int(c[2]*31.f/255.f+0.5f), 0), 31);
+    return (r<<11)|(g<<5)|b;
+}
+
+static void unpack565(uint16_t c, int *rgb){
+    int r=(c>>11)&31, g=(c>>5)&63, b=c&31;
+    rgb[0]=(r<<3)|(r>>2);
+    rgb[1]=(g<<2)|(g>>4);
+    rgb[2]=(b<<3)|(b>>2);
+}
+
+//four colour palette, also used for BC1 blocks whose first endpoint is the larger one
+static void colorPalette(uint16_t c0, uint16_t c1, int palette[4][3]){
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    for(int c=0; c<3; c++){
+        palette[2][c]=(2*palette[0][c]+palette[1][c])/3;
+        palette[3][c]=(palette[0][c]+2*palette[1][c])/3;
+    }
+}
+
+//nearest palette entry for each texel, returns the summed squared error
+static int chooseColorIndices(const unsigned char *rgba, uint16_t c0, uint16_t c1, unsigned char *indices){
+    int palette[4][3];
+    colorPalette(c0, c1, palette);
+    int total=0;
+    for(int i=0; i<16; i++){
+        int best=0, best_error=1<<30;
+        for(int p=0; p<4; p++){
+            int dr=rgba[4*i]-palette[p][0], dg=rgba[4*i+1]-palette[p][1], db=rgba[4*i+2]-palette[p][2];
+            int error=dr*dr+dg*dg+db*db;
+            if(error<best_error){
+                best=p;
+                best_error=error;
+            }
+        }
+        indices[i]=best;
+        total+=best_error;
+    }
+    return total;
+}
+
+//eight value palette with a0>a1, or six values plus 0 and 255 otherwise
+static void alphaPalette(int a0, int a1, int palette[8]){
+    palette[0]=a0;
+    palette[1]=a1;
+    if(a0>a1){
+        for(int k=1; k<7; k++){
+            palette[k+1]=((7-k)*a0+k*a1)/7;
+        }
+    }
+    else{
+        for(int k=1; k<5; k++){
+            palette[k+1]=((5-k)*a0+k*a1)/5;
+        }
+        palette[6]=0;
+        palette[7]=255;
+    }
+}
+
+BlockCompressor::BlockCompressor()
+{
+    //ctor
+}
+
+BlockCompressor::~BlockCompressor()
+{
+    //dtor
+}
+
+int BlockCompressor::blockBytes(BlockFormat format){
+    return format==BLOCK_BC3 ? 16 : 8;
+}
+
+size_t BlockCompressor::rawBytes(const DecodedTexture &tex){
+    size_t size=tex.pixels.size();
+    for(unsigned int l=0; l<tex.mips.size(); l++){
+        size+=tex.mips[l].size();
+    }
+    return size;
+}
+
+size_t BlockCompressor::compressedBytes(const DecodedTexture &tex){
+    size_t size=0;
+    for(unsigned int l=0; l<tex.blocks.size(); l++){
+        size+=tex.blocks[l].size();
+    }
+    return size;
+}
+
+string BlockCompressor::cachePath(string file, TextureFormat format){
+    return file+(format==TEXTURE_RGBA8 ? ".rgba" : ".l8")+BC_CACHE_EXTENSION;
+}
+
+//principal axis fit, one least squares refinement of the endpoints, then 565 quantization
+void BlockCompressor::encodeColor(const unsigned char *rgba, unsigned char *block){
+    float mean[3]={0.f, 0.f, 0.f};
+    for(int i=0; i<16; i++){
+        for(int c=0; c<3; c++){
+            mean[c]+=rgba[4*i+c];
+        }
+    }
+    for(int c=0; c<3; c++){
+        mean[c]/=16.f;
+    }
+
+    float cov[3][3]={{0.f}};
+    for(int i=0; i<16; i++){
+        float d[3]={rgba[4*i]-mean[0], rgba[4*i+1]-mean[1], rgba[4*i+2]-mean[2]};
+        for(int a=0; a<3; a++){
+            for(int b=0; b<3; b++){
+                cov[a][b]+=d[a]*d[b];
+            }
+        }
+    }
+    float axis[3]={1.f, 1.f, 1.f};
+    for(int it=0; it<POWER_ITERATIONS; it++){
+        float v[3];
+        for(int a=0; a<3; a++){
+            v[a]=cov[a][0]*axis[0]+cov[a][1]*axis[1]+cov[a][2]*axis[2];
+        }
+        float len=sqrtf(v[0]*v[0]+v[1]*v[1]+v[2]*v[2]);
+        if(len<1e-6f){
+            break;
+        }
+        for(int a=0; a<3; a++){
+            axis[a]=v[a]/len;
+        }
+    }
+
+    float tmin=1e30f, tmax=-1e30f;
+    for(int i=0; i<16; i++){
+        float t=(rgba[4*i]-mean[0])*axis[0]+(rgba[4*i+1]-mean[1])*axis[1]+(rgba[4*i+2]-mean[2])*axis[2];
+        tmin=min(tmin, t);
+        tmax=max(tmax, t);
+    }
+    float e0[3], e1[3];
+    for(int c=0; c<3; c++){
+        e0[c]=mean[c]+axis[c]*tmax;
+        e1[c]=mean[c]+axis[c]*tmin;
+    }
+    uint16_t c0=pack565(e0), c1=pack565(e1);
+    unsigned char indices[16];
+    int error=chooseColorIndices(rgba, c0, c1, indices);
+
+    //solve for the endpoints that best reproduce the chosen indices
+    static const float weights[4]={1.f, 0.f, 2.f/3.f, 1.f/3.f};
+    float aa=0.f, ab=0.f, bb=0.f, ap[3]={0.f, 0.f, 0.f}, bp[3]={0.f, 0.f, 0.f};
+    for(int i=0; i<16; i++){
+        float a=weights[indices[i]], b=1.f-a;
+        aa+=a*a;
+        ab+=a*b;
+        bb+=b*b;
+        for(int c=0; c<3; c++){
+            ap[c]+=a*rgba[4*i+c];
+            bp[c]+=b*rgba[4*i+c];
+        }
+    }
+    float det=aa*bb-ab*ab;
+    if(fabsf(det)>1e-6f){
+        for(int c=0; c<3; c++){
+            e0[c]=(ap[c]*bb-bp[c]*ab)/det;
+            e1[c]=(bp[c]*aa-ap[c]*ab)/det;
+        }
+        uint16_t r0=pack565(e0), r1=pack565(e1);
+        unsigned char refined[16];
+        int refined_error=chooseColorIndices(rgba, r0, r1, refined);
+        if(refined_error<error){
+            c0=r0;
+            c1=r1;
+            memcpy(indices, refined, 16);
+        }
+    }
+
+    //c0>c1 selects the four colour mode; swapping the endpoints swaps indices 0/1 and 2/3
+    if(c0<c1){
+        swap(c0, c1);
+        for(int i=0; i<16; i++){
+            indices[i]^=1;
+        }
+    }
+    else if(c0==c1){
+        memset(indices, 0, 16);
+    }
+
+    uint32_t bits=0;
+    for(int i=0; i<16; i++){
+        bits|=uint32_t(indices[i])<<(2*i);
+    }
+    memcpy(block, &c0, 2);
+    memcpy(block+2, &c1, 2);
+    memcpy(block+4, &bits, 4);
+}
+
+//range fit in the eight value mode
+void BlockCompressor::encodeAlpha(const unsigned char *values, int stride, unsigned char *block){
+    int lo=255, hi=0;
+    for(int i=0; i<16; i++){
+        lo=min(lo, int(values[i*stride]));
+        hi=max(hi, int(values[i*stride]));
+    }
+    block[0]=hi;
+    block[1]=lo;
+    uint64_t bits=0;
+    if(hi>lo){
+        int palette[8];
+        alphaPalette(hi, lo, palette);
+        for(int i=0; i<16; i++){
+            int v=values[i*stride];
+            int best=0, best_error=256;
+            for(int p=0; p<8; p++){
+                int error=abs(v-palette[p]);
+                if(error<best_error){
+                    best=p;
+                    best_error=error;
+                }
+            }
+            bits|=uint64_t(best)<<(3*i);
+        }
+    }
+    for(int b=0; b<6; b++){
+        block[2+b]=(bits>>(8*b))&0xFF;
+    }
+}
+
+void BlockCompressor::decodeColor(const unsigned char *block, unsigned char *rgba){
+    uint16_t c0, c1;
+    uint32_t bits;
+    memcpy(&c0, block, 2);
+    memcpy(&c1, block+2, 2);
+    memcpy(&bits, block+4, 4);
+    int palette[4][3];
+    colorPalette(c0, c1, palette);
+    bool transparent=c0<=c1;
+    if(transparent){
+        for(int c=0; c<3; c++){
+            palette[2][c]=(palette[0][c]+palette[1][c])/2;
+            palette[3][c]=0;
+        }
+    }
+    for(int i=0; i<16; i++){
+        int index=(bits>>(2*i))&3;
+        rgba[4*i]=palette[index][0];
+        rgba[4*i+1]=palette[index][1];
+        rgba[4*i+2]=palette[index][2];
+        rgba[4*i+3]=transparent && index==3 ? 0 : 255;
+    }
+}
+
+void BlockCompressor::decodeAlpha(const unsigned char *block, unsigned char *values, int stride){
+    int palette[8];
+    alphaPalette(block[0], block[1], palette);
+    uint64_t bits=0;
+    for(int b=0; b<6; b++){
+        bits|=uint64_t(block[2+b])<<(8*b);
+    }
+    for(int i=0; i<16; i++){
+        values[i*stride]=palette[(bits>>(3*i))&7];
+    }
+}
+
+//texels outside the level repeat the last row or column
+void BlockCompressor::encodeLevel(const unsigned char *pixels, int w, int h, BlockFormat format, vector<unsigned char> &blocks){
+    int bw=(w+3)/4, bh=(h+3)/4;
+    int channels=format==BLOCK_BC4 ? 1 : 4;
+    int size=blockBytes(format);
+    blocks.resize(bw*bh*size);
+    unsigned char texels[64];
+    for(int by=0; by<bh; by++){
+        for(int bx=0; bx<bw; bx++){
+            for(int i=0; i<16; i++){
+                int x=min(4*bx+i%4, w-1);
+                int y=min(4*by+i/4, h-1);
+                memcpy(texels+channels*i, pixels+(y*w+x)*channels, channels);
+            }
+            unsigned char *block=&blocks[(by*bw+bx)*size];
+            if(format==BLOCK_BC4){
+                encodeAlpha(texels, 1, block);
+            }
+            else if(format==BLOCK_BC3){
+                encodeAlpha(texels+3, 4, block);
+                encodeColor(texels, block+8);
+            }
+            else{
+                encodeColor(texels, block);
+            }
+        }
+    }
+}
+
+void BlockCompressor::decodeLevel(const vector<unsigned char> &blocks, int w, int h, BlockFormat format, unsigned char *pixels){
+    int bw=(w+3)/4, bh=(h+3)/4;
+    int channels=format==BLOCK_BC4 ? 1 : 4;
+    int size=blockBytes(format);
+    unsigned char texels[64];
+    for(int by=0; by<bh; by++){
+        for(int bx=0; bx<bw; bx++){
+            const unsigned char *block=&blocks[(by*bw+bx)*size];
+            if(format==BLOCK_BC4){
+                decodeAlpha(block, texels, 1);
+            }
+            else if(format==BLOCK_BC3){
+                decodeColor(block+8, texels);
+                decodeAlpha(block, texels+3, 4);
+            }
+            else{
+                decodeColor(block, texels);
+            }
+            for(int i=0; i<16; i++){
+                int x=4*bx+i%4;
+                int y=4*by+i/4;
+                if(x<w && y<h){
+                    memcpy(pixels+(y*w+x)*channels, texels+channels*i, channels);
+                }
+            }
+        }
+    }
+}
+
+void BlockCompressor::compress(DecodedTexture &tex){
+    if(!tex.ok){
+        return;
+    }
+    if(tex.format==TEXTURE_L8){
+        tex.block_format=BLOCK_BC4;
+    }
+    else{
+        tex.block_format=BLOCK_BC1;
+        for(size_t i=3; i<tex.pixels.size(); i+=4){
+            if(tex.pixels[i]<255){
+                tex.block_format=BLOCK_BC3;
+                break;
+            }
+        }
+    }
+
+    int levels=tex.mips.size()+1;
+    tex.blocks.resize(levels);
+    vector<unsigned char> original;
+    for(int l=0; l<levels; l++){
+        vector<unsigned char> &pixels=l==0 ? tex.pixels : tex.mips[l-1];
+        int w=MipGenerator::levelSize(tex.width, l);
+        int h=MipGenerator::levelSize(tex.height, l);
+        encodeLevel(&pixels[0], w, h, tex.block_format, tex.blocks[l]);
+        if(l==0){
+            original=pixels;
+        }
+        decodeLevel(tex.blocks[l], w, h, tex.block_format, &pixels[0]);
+    }
+
+    double error=0.0;
+    for(size_t i=0; i<original.size(); i++){
+        double d=double(original[i])-double(tex.pixels[i]);
+        error+=d*d;
+    }
+    double mse=error/original.size();
+    tex.psnr=mse>0.0 ? float(10.0*log10(255.0*255.0/mse)) : 99.f;
+}
+
+bool BlockCompressor::load(DecodedTexture &tex, bool mipmaps){
+    string path=cachePath(tex.file, tex.format);
+    FILE *f=fopen(path.c_str(), "rb");
+    if(!f){
+        return false;
+    }
+    Header header;
+    bool ok=fread(&header, sizeof(Header), 1, f)==1
+        && memcmp(header.magic, CACHE_MAGIC, 4)==0
+        && header.version==BC_CACHE_VERSION
+        && header.source_hash==tex.hash
+        && header.source_size==tex.size
+        && header.format==(uint32_t)tex.format
+        && header.levels==(uint32_t)(mipmaps ? MipGenerator::levelCount(header.width, header.height) : 1);
+    if(ok){
+        tex.width=header.width;
+        tex.height=header.height;
+        tex.block_format=(BlockFormat)header.block_format;
+        tex.psnr=header.psnr;
+        tex.blocks.resize(header.levels);
+        tex.mips.resize(header.levels-1);
+        int channels=tex.format==TEXTURE_RGBA8 ? 4 : 1;
+        for(unsigned int l=0; ok && l<header.levels; l++){
+            int w=MipGenerator::levelSize(tex.width, l);
+            int h=MipGenerator::levelSize(tex.height, l);
+            tex.blocks[l].resize(((w+3)/4)*((h+3)/4)*blockBytes(tex.block_format));
+            ok=fread(&tex.blocks[l][0], 1, tex.blocks[l].size(), f)==tex.blocks[l].size();
+            vector<unsigned char> &pixels=l==0 ? tex.pixels : tex.mips[l-1];
+            pixels.resize(w*h*channels);
+            if(ok){
+                decodeLevel(tex.blocks[l], w, h, tex.block_format, &pixels[0]);
+            }
+        }
+    }
+    fclose(f);
+    if(!ok){
+        tex.width=0;
+        tex.height=0;
+        tex.block_format=BLOCK_NONE;
+        tex.pixels.clear();
+        tex.mips.clear();
+        tex.blocks.clear();
+        return false;
+    }
+    tex.ok=true;
+    return true;
+}
+
+bool BlockCompressor::save(const DecodedTexture &tex){
+    if(!tex.ok || tex.blocks.empty()){
+        return false;
+    }
+    Header header;
+    memset(&header, 0, sizeof(Header));
+    memcpy(header.magic, CACHE_MAGIC, 4);
+    header.version=BC_CACHE_VERSION;
+    header.source_hash=tex.hash;
+    header.source_size=tex.size;
+    header.format=tex.format;
+    header.block_format=tex.block_format;
+    header.width=tex.width;
+    header.height=tex.height;
+    header.levels=tex.blocks.size();
+    header.psnr=tex.psnr;
+
+    string path=cachePath(tex.file, tex.format);
+    string tmp=path+".tmp";
+    FILE *f=fopen(tmp.c_str(), "wb");
+    if(!f){
+        return false;
+    }
+    bool ok=fwrite(&header, sizeof(Header), 1, f)==1;
+    for(unsigned int l=0; ok && l<tex.blocks.size(); l++){
+        ok=fwrite(&tex.blocks[l][0], 1, tex.blocks[l].size(), f)==tex.blocks[l].size();
+    }
+    fclose(f);
+    if(!ok || rename(tmp.c_str(), path.c_str())!=0){
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,749 @@
+#include "CpuRenderer.h"
+
+#include <iostream>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include <assimp/cimport.h>
+#include <assimp/postprocess.h>
+#include <assimp/material.h>
+
+#include <IL/il.h>
+
+#include "MipGenerator.h"
+#include "Hash.h"
+#include "RayTypes.h"
+
+#define TILE_SIZE 16
+#define SQRT_MS_SAMPLES 4
+#define PROGRESSIVE_SAMPLES 1
+
+using namespace std;
+using namespace optix;
+
+//same generators as random.h so pinhole_camera_ms picks identical sample positions
+template<unsigned int N>
+static inline unsigned int tea(unsigned int val0, unsigned int val1){
+    unsigned int v0=val0;
+    unsigned int v1=val1;
+    unsigned int s0=0;
+    for(unsigned int n=0; n<N; n++){
+        s0+=0x9e3779b9;
+        v0+=((v1<<4)+0xa341316c)^(v1+s0)^((v1>>5)+0xc8013ea4);
+        v1+=((v0<<4)+0xad90777d)^(v0+s0)^((v0>>5)+0x7e95761e);
+    }
+    return v0;
+}
+
+static inline float rnd(unsigned int &prev){
+    prev=1664525u*prev+1013904223u;
+    return float(prev & 0x00FFFFFF)/float(0x01000000);
+}
+
+static inline float3 toFloat3(const aiVector3D &v){
+    return make_float3(v.x, v.y, v.z);
+}
+
+CpuVariable::CpuVariable(){
+    value=make_float4(0.f);
+    ivalue=0;
+}
+
+CpuVariable* CpuVariable::operator->(){
+    return this;
+}
+
+void CpuVariable::setFloat(float x){
+    value=make_float4(x, 0.f, 0.f, 0.f);
+}
+
+void CpuVariable::setFloat(float x, float y, float z){
+    value=make_float4(x, y, z, 0.f);
+}
+
+void CpuVariable::setFloat(float x, float y, float z, float w){
+    value=make_float4(x, y, z, w);
+}
+
+void CpuVariable::setFloat(float3 v){
+    value=make_float4(v.x, v.y, v.z, 0.f);
+}
+
+void CpuVariable::setFloat(float4 v){
+    value=v;
+}
+
+void CpuVariable::setInt(int i){
+    ivalue=i;
+}
+
+float4 CpuVariable::getFloat4(){
+    return value;
+}
+
+float3 CpuVariable::getFloat3(){
+    return make_float3(value.x, value.y, value.z);
+}
+
+float CpuVariable::getFloat(){
+    return value.x;
+}
+
+int CpuVariable::getInt(){
+    return ivalue;
+}
+
+CpuRenderer::CpuRenderer(string path, string file, int nthreads) : scene(NULL), pool(nthreads), variables(), materials()
+{
+    //ctor
+    scene_path=path;
+    scene_file=file;
+    entry=PROGRAM_NONE;
+    compress_textures=false;
+    width=0;
+    height=0;
+    frame=0;
+    //rt.cu reads the ray type indices from these variables
+    variables["Phong"].setInt(Phong);
+    variables["Shadow"].setInt(Shadow);
+    variables["fov"].setFloat(1.f);
+}
+
+CpuRenderer::~CpuRenderer()
+{
+    //dtor
+}
+
+void CpuRenderer::init(){
+
+    //loading scene
+    scene=scene_cache.import(scene_path+scene_file, aiProcessPreset_TargetRealtime_MaxQuality | aiProcess_OptimizeGraph);
+    if(!scene){
+        cout<<"Failed to load scene: "<<aiGetErrorString()<<endl;
+        return;
+    }
+
+    ilInit();
+    loadMaterials();
+    loadGeometry();
+    buildBvh();
+
+    cout<<"CPU backend: "<<triangles.size()<<" triangles, "<<bvh.getNodeCount()<<" BVH nodes, "
+        <<pool.getThreadCount()<<" threads"<<endl;
+}
+
+int CpuRenderer::getThreadCount(){
+    return pool.getThreadCount();
+}
+
+CpuRenderer::HostProgram CpuRenderer::lookupProgram(string program){
+    if(program=="pinhole_camera") return PINHOLE_CAMERA;
+    if(program=="pinhole_camera_ms") return PINHOLE_CAMERA_MS;
+    if(program=="pinhole_camera_progressive") return PINHOLE_CAMERA_PROGRESSIVE;
+    if(program=="closest_hit_radiance") return CLOSEST_HIT_RADIANCE;
+    if(program=="any_hit_radiance") return ANY_HIT_RADIANCE;
+    if(program=="any_hit_shadow") return ANY_HIT_SHADOW;
+    if(program=="miss_radiance") return MISS_RADIANCE;
+    if(program=="miss_shadow") return MISS_SHADOW;
+    cout<<"CPU backend has no host version of program: "<<program<<endl;
+    return PROGRAM_NONE;
+}
+
+//decodes files that were not requested during loadMaterials, such as the sky
+int CpuRenderer::loadTexture(string file, bool luminance){
+    string key=file+(luminance?"#lum":"#rgba");
+    map<string, int>::iterator found=texture_files.find(key);
+    if(found!=texture_files.end()){
+        return found->second;
+    }
+
+    TextureLoader loader(pool);
+    DecodedTexture &tex=loader.get(loader.request(file, luminance?TEXTURE_L8:TEXTURE_RGBA8));
+    loader.decodeAll();
+    int res=addTexture(tex);
+    texture_files[key]=res;
+    return res;
+}
+
+int CpuRenderer::addTexture(DecodedTexture &tex){
+    if(!tex.ok){
+        cout<<"Error reading texture: "<<tex.file<<endl;
+        return -1;
+    }
+    textures.push_back(DecodedTexture());
+    textures.back().file=tex.file;
+    textures.back().format=tex.format;
+    textures.back().ok=true;
+    textures.back().width=tex.width;
+    textures.back().height=tex.height;
+    textures.back().pixels.swap(tex.pixels);
+    textures.back().mips.swap(tex.mips);
+    return textures.size()-1;
+}
+
+//bilinear lookup with repeat wrapping, like the samplers created by OptixRenderer
+float4 CpuRenderer::sampleLevel(const DecodedTexture &t, int level, float u, float v){
+    const unsigned char *pixels=level==0 ? &t.pixels[0] : &t.mips[level-1][0];
+    int w=MipGenerator::levelSize(t.width, level);
+    int h=MipGenerator::levelSize(t.height, level);
+    int channels=t.format==TEXTURE_RGBA8?4:1;
+    float x=u*w-0.5f;
+    float y=v*h-0.5f;
+    float fx=floorf(x);
+    float fy=floorf(y);
+    float ax=x-fx;
+    float ay=y-fy;
+    int x0=((int(fx)%w)+w)%w;
+    int y0=((int(fy)%h)+h)%h;
+    int x1=(x0+1)%w;
+    int y1=(y0+1)%h;
+
+    float4 texel[4];
+    int xs[4]={x0, x1, x0, x1};
+    int ys[4]={y0, y0, y1, y1};
+    for(int i=0; i<4; i++){
+        const unsigned char *p=&pixels[(ys[i]*w+xs[i])*channels];
+        if(channels==1){
+            texel[i]=make_float4(p[0]/255.f, 0.f, 0.f, 0.f);
+        }
+        else{
+            texel[i]=make_float4(p[0]/255.f, p[1]/255.f, p[2]/255.f, p[3]/255.f);
+        }
+    }
+    float4 bottom=texel[0]*(1.f-ax)+texel[1]*ax;
+    float4 top=texel[2]*(1.f-ax)+texel[3]*ax;
+    return bottom*(1.f-ay)+top*ay;
+}
+
+//trilinear between the two levels around lod
+float4 CpuRenderer::sampleTexture(int tex, float u, float v, float lod){
+    if(tex<0){
+        return make_float4(1.f);
+    }
+    const DecodedTexture &t=textures[tex];
+    int last=t.mips.size();
+    lod=fminf(fmaxf(lod, 0.f), float(last));
+    int level=int(lod);
+    float a=lod-level;
+    if(a==0.f || level==last){
+        return sampleLevel(t, level, u, v);
+    }
+    return sampleLevel(t, level, u, v)*(1.f-a)+sampleLevel(t, level+1, u, v)*a;
+}
+
+void CpuRenderer::setTexture(string name, string file){
+    texture_vars[name]=file;
+}
+
+void CpuRenderer::setTextureCompression(bool enabled){
+    compress_textures=enabled;
+}
+
+void CpuRenderer::loadMaterials(){
+    int nmat=scene->mNumMaterials;
+
+    //all textures are decoded together before the materials refer to them
+    TextureLoader loader(pool);
+    loader.setMipmaps(true);
+    loader.setCompression(compress_textures);
+    vector<int> diffuse_tex(nmat, -1), bump_tex(nmat, -1);
+    for(int i=0; i<nmat; i++){
+        aiMaterial * mat = scene->mMaterials[i];
+        aiString texPath;
+        if(AI_SUCCESS==mat->GetTexture(aiTextureType_DIFFUSE, 0, &texPath)){
+            diffuse_tex[i]=loader.request(scene_path+string(texPath.data), TEXTURE_RGBA8);
+        }
+        if(AI_SUCCESS==mat->GetTexture(aiTextureType_HEIGHT, 0, &texPath)){
+            bump_tex[i]=loader.request(scene_path+string(texPath.data), TEXTURE_L8);
+        }
+    }
+    loader.decodeAll();
+
+    vector<int> host_tex(loader.getTextureCount());
+    for(int t=0; t<loader.getTextureCount(); t++){
+        DecodedTexture &tex=loader.get(t);
+        //duplicates of an earlier file point at its host copy
+        int source=loader.resolve(t);
+        host_tex[t]=source==t ? addTexture(tex) : host_tex[source];
+        texture_files[tex.file+(tex.format==TEXTURE_L8?"#lum":"#rgba")]=host_tex[t];
+    }
+    loader.report();
+
+    for(int i=0; i<nmat; i++){
+
+        aiMaterial * mat = scene->mMaterials[i];
+        HostMaterial host_mat;
+
+        aiString mat_name;
+        aiGetMaterialString(mat, AI_MATKEY_NAME, &mat_name);
+
+        aiColor4D diffuse;
+        if(AI_SUCCESS==aiGetMaterialColor(mat, AI_MATKEY_COLOR_DIFFUSE, &diffuse)){
+            host_mat.diffuse=make_float4(diffuse.r, diffuse.g, diffuse.b, diffuse.a);
+        }
+        else{
+            host_mat.diffuse=make_float4(1.f);
+        }
+
+        host_mat.diffuse_tex=diffuse_tex[i]<0?-1:host_tex[diffuse_tex[i]];
+        host_mat.bump_tex=bump_tex[i]<0?-1:host_tex[bump_tex[i]];
+
+        material_index[mat_name.data]=materials.size();
+        materials.push_back(host_mat);
+    }
+}
+
+void CpuRenderer::loadGeometry(){
+    aiMatrix4x4 identity;
+    loadNode(scene->mRootNode, identity);
+}
+
+//flattens the node graph: every mesh reference is copied to world space
+void CpuRenderer::loadNode(aiNode *node, aiMatrix4x4 parent){
+    aiMatrix4x4 trans=parent*node->mTransformation;
+    aiMatrix3x3 normal_trans=aiMatrix3x3(aiMatrix4x4(trans).Inverse());
+    //inverse transpose, written out since aiMatrix3x3 is row major
+    aiMatrix3x3 nt;
+    nt.a1=normal_trans.a1; nt.a2=normal_trans.b1; nt.a3=normal_trans.c1;
+    nt.b1=normal_trans.a2; nt.b2=normal_trans.b2; nt.b3=normal_trans.c2;
+    nt.c1=normal_trans.a3; nt.c2=normal_trans.b3; nt.c3=normal_trans.c3;
+    aiMatrix3x3 vector_trans=aiMatrix3x3(trans);
+
+    for(unsigned int m=0; m<node->mNumMeshes; m++){
+        aiMesh *mesh=scene->mMeshes[node->mMeshes[m]];
+        int base=positions.size();
+        int flags=0;
+        if(mesh->HasTextureCoords(0)) flags|=HAS_TEXCOORD;
+        if(mesh->HasTangentsAndBitangents()) flags|=HAS_TANGENTS;
+
+        for(unsigned int v=0; v<mesh->mNumVertices; v++){
+            positions.push_back(toFloat3(trans*mesh->mVertices[v]));
+            normals.push_back(toFloat3(nt*mesh->mNormals[v]));
+            if(flags & HAS_TANGENTS){
+                tangents.push_back(toFloat3(vector_trans*mesh->mTangents[v]));
+                bitangents.push_back(toFloat3(vector_trans*mesh->mBitangents[v]));
+            }
+            else{
+                tangents.push_back(make_float3(0.f));
+                bitangents.push_back(make_float3(0.f));
+            }
+            if(flags & HAS_TEXCOORD){
+                texcoords.push_back(make_float2(mesh->mTextureCoords[0][v].x, mesh->mTextureCoords[0][v].y));
+            }
+            else{
+                texcoords.push_back(make_float2(1.f, 0.f));
+            }
+        }
+
+        aiString mat_name;
+        aiGetMaterialString(scene->mMaterials[mesh->mMaterialIndex], AI_MATKEY_NAME, &mat_name);
+        int mat=material_index[mat_name.data];
+
+        for(unsigned int f=0; f<mesh->mNumFaces; f++){
+            const aiFace &face=mesh->mFaces[f];
+            if(face.mNumIndices!=3){
+                continue;
+            }
+            triangles.push_back(make_int3(base+face.mIndices[0], base+face.mIndices[1], base+face.mIndices[2]));
+            triangle_material.push_back(mat);
+            triangle_flags.push_back(flags);
+        }
+    }
+
+    for(unsigned int i=0; i<node->mNumChildren; i++){
+        loadNode(node->mChildren[i], trans);
+    }
+}
+
+//reuses the tree saved next to the scene while the geometry is unchanged
+void CpuRenderer::buildBvh(){
+    uint64_t key=hashBytes(positions.empty() ? NULL : &positions[0], positions.size()*sizeof(float3));
+    key=hashBytes(triangles.empty() ? NULL : &triangles[0], triangles.size()*sizeof(int3), key);
+    string file=scene_path+scene_file+BVH_CACHE_EXTENSION;
+    if(!bvh.load(file, key, triangles.size())){
+        bvh.build(positions.empty() ? NULL : &positions[0], triangles.empty() ? NULL : &triangles[0], triangles.size(), pool);
+        if(!bvh.save(file, key)){
+            cout<<"Could not write BVH cache "<<file<<endl;
+        }
+    }
+    bvh.report(scene_file);
+}
+
+//same formulation as intersect_triangle in optixu_math
+bool CpuRenderer::intersectTriangle(int prim, float3 origin, float3 direction, float tmin, float tmax, Hit &hit){
+    int3 id=triangles[prim];
+    float3 p0=positions[id.x];
+    float3 p1=positions[id.y];
+    float3 p2=positions[id.z];
+    float3 e0=p1-p0;
+    float3 e1=p0-p2;
+    float3 n=cross(e1, e0);
+    float3 e2=(1.0f/dot(n, direction))*(p0-origin);
+    float3 i=cross(direction, e2);
+    float beta=dot(i, e1);
+    float gamma=dot(i, e0);
+    float t=dot(n, e2);
+    if(t<tmax && t>tmin && beta>=0.f && gamma>=0.f && beta+gamma<=1.f){
+        hit.t=t;
+        hit.beta=beta;
+        hit.gamma=gamma;
+        hit.prim=prim;
+        hit.n=n;
+        return true;
+    }
+    return false;
+}
+
+//runs the triangles of one leaf through anyHit, as the intersection program does
+struct CpuRenderer::LeafVisitor{
+    CpuRenderer *renderer;
+    const LaunchState &ls;
+    float3 origin, direction;
+    float tmin;
+    int ray_type;
+    Payload &payload;
+    Hit closest;
+    bool found;
+
+    bool operator()(const int *prims, int count, float &tmax){
+        bool terminate=false;
+        for(int i=0; i<count && !terminate; i++){
+            Hit hit;
+            if(renderer->intersectTriangle(prims[i], origin, direction, tmin, tmax, hit)){
+                if(renderer->anyHit(ls, hit, ray_type, payload, terminate)){
+                    closest=hit;
+                    tmax=hit.t;
+                    found=true;
+                }
+            }
+        }
+        return terminate;
+    }
+};
+
+void CpuRenderer::trace(const LaunchState &ls, float3 origin, float3 direction, int ray_type, float tmin, float tmax, Payload &payload){
+    LeafVisitor visit={this, ls, origin, direction, tmin, ray_type, payload, {0.f, 0.f, 0.f, -1, make_float3(0.f)}, false};
+    bvh.traverse(origin, direction, tmin, tmax, visit);
+
+    //a terminated ray still reports its last accepted hit, as rtTerminateRay does
+    if(visit.found){
+        closestHit(ls, visit.closest, origin, direction, ray_type, payload);
+    }
+    else{
+        miss(ls, direction, ray_type, payload);
+    }
+}
+
+float2 CpuRenderer::hitTexCoord(const Hit &hit){
+    int3 id=triangles[hit.prim];
+    if(triangle_flags[hit.prim] & HAS_TEXCOORD){
+        return (1.0f-hit.beta-hit.gamma)*texcoords[id.x] + hit.beta*texcoords[id.y] + hit.gamma*texcoords[id.z];
+    }
+    return make_float2(1.0f, 0.0f);
+}
+
+//texture coordinate area per unit of surface area
+float CpuRenderer::texelDensity(const Hit &hit){
+    if(!(triangle_flags[hit.prim] & HAS_TEXCOORD)){
+        return 0.f;
+    }
+    int3 id=triangles[hit.prim];
+    float2 e1=texcoords[id.y]-texcoords[id.x];
+    float2 e2=texcoords[id.z]-texcoords[id.x];
+    float3 n=cross(positions[id.y]-positions[id.x], positions[id.z]-positions[id.x]);
+    return fabsf(e1.x*e2.y-e1.y*e2.x)/fmaxf(length(n), 1e-20f);
+}
+
+float4 CpuRenderer::materialColor(const HostMaterial &mat, float2 uv){
+    if(mat.diffuse_tex>=0){
+        return mat.diffuse*sampleTexture(mat.diffuse_tex, uv.x, uv.y);
+    }
+    return mat.diffuse;
+}
+
+//returns false when the intersection is ignored
+bool CpuRenderer::anyHit(const LaunchState &ls, const Hit &hit, int ray_type, Payload &payload, bool &terminate){
+    const HostMaterial &mat=materials[triangle_material[hit.prim]];
+    HostProgram program=ray_type<(int)mat.any_hit.size()?mat.any_hit[ray_type]:PROGRAM_NONE;
+    switch(program){
+    case ANY_HIT_RADIANCE:
+        if(materialColor(mat, hitTexCoord(hit)).w==0.f) return false;
+        break;
+    case ANY_HIT_SHADOW:
+        if(materialColor(mat, hitTexCoord(hit)).w==0.f) return false;
+        payload.hit=1;
+        terminate=true;
+        break;
+    default:
+        break;
+    }
+    return true;
+}
+
+void CpuRenderer::closestHit(const LaunchState &ls, const Hit &hit, float3 origin, float3 direction, int ray_type, Payload &payload){
+    const HostMaterial &mat=materials[triangle_material[hit.prim]];
+    HostProgram program=ray_type<(int)mat.closest_hit.size()?mat.closest_hit[ray_type]:PROGRAM_NONE;
+    if(program!=CLOSEST_HIT_RADIANCE){
+        return;
+    }
+
+    int3 id=triangles[hit.prim];
+    float a=1.0f-hit.beta-hit.gamma;
+    float2 uv=hitTexCoord(hit);
+    float3 local_normal=a*normals[id.x] + hit.beta*normals[id.y] + hit.gamma*normals[id.z];
+
+    if(mat.bump_tex>=0){
+        float3 tangent=make_float3(0.f);
+        float3 bitangent=make_float3(0.f);
+        if(triangle_flags[hit.prim] & HAS_TANGENTS){
+            tangent=a*tangents[id.x] + hit.beta*tangents[id.y] + hit.gamma*tangents[id.z];
+            bitangent=a*bitangents[id.x] + hit.beta*bitangents[id.y] + hit.gamma*bitangents[id.z];
+        }
+        float delta_x=sampleTexture(mat.bump_tex, uv.x+0.001f, uv.y).x-sampleTexture(mat.bump_tex, uv.x-0.001f, uv.y).x;
+        float delta_y=sampleTexture(mat.bump_tex, uv.x, uv.y+0.001f).x-sampleTexture(mat.bump_tex, uv.x, uv.y-0.001f).x;
+        local_normal+=5*(delta_x*tangent+delta_y*bitangent);
+    }
+
+    //geometry is already in world space
+    float3 world_geo_normal=normalize(hit.n);
+    float3 world_shade_normal=normalize(local_normal);
+    float3 ffnormal=faceforward(world_shade_normal, -direction, world_geo_normal);
+
+    float3 pos=origin+direction*hit.t;
+
+    float intensity=fmaxf(dot(ffnormal, -ls.lightDir), 0.f);
+
+    //ray cone lod, as in rt.cu
+    float4 color=mat.diffuse;
+    if(mat.diffuse_tex>=0){
+        const DecodedTexture &t=textures[mat.diffuse_tex];
+        float cos_angle=fmaxf(fabsf(dot(world_geo_normal, direction)), 0.01f);
+        float lod=0.5f*log2f(texelDensity(hit)*t.width*t.height)+log2f(hit.t*ls.spread/cos_angle);
+        color=mat.diffuse*sampleTexture(mat.diffuse_tex, uv.x, uv.y, lod);
+    }
+
+    if(intensity>0){
+        Payload prds;
+        prds.hit=0;
+        trace(ls, pos, -ls.lightDir, ls.shadow, 0.1f, 1e30f, prds);
+        if(prds.hit){
+            intensity*=0.3f;
+        }
+    }
+    color*=fmaxf(intensity, 0.3f);
+    payload.color=color;
+}
+
+void CpuRenderer::miss(const LaunchState &ls, float3 direction, int ray_type, Payload &payload){
+    HostProgram program=ray_type<(int)miss_programs.size()?miss_programs[ray_type]:PROGRAM_NONE;
+    if(program==MISS_RADIANCE){
+        float3 projected=normalize(make_float3(direction.x, 0.f, direction.z));
+        float r=dot(direction, projected);
+        float cos_theta=dot(projected, make_float3(1.f, 0.f, 0.f));
+        float sin_theta=dot(projected, make_float3(0.f, 0.f, 1.f));
+
+        float tex_x=r*cos_theta*0.5f+0.5f;
+        float tex_y=r*sin_theta*0.5f+0.5f;
+
+        payload.color=ls.sky>=0?sampleTexture(ls.sky, tex_x, tex_y):make_float4(0.f);
+    }
+    else if(program==MISS_SHADOW){
+        payload.hit=0;
+    }
+}
+
+void CpuRenderer::renderTile(const LaunchState &ls, int tile){
+    int tiles_x=(width+TILE_SIZE-1)/TILE_SIZE;
+    int x0=(tile%tiles_x)*TILE_SIZE;
+    int y0=(tile/tiles_x)*TILE_SIZE;
+    int x1=min(x0+TILE_SIZE, width);
+    int y1=min(y0+TILE_SIZE, height);
+
+    float ratio=float(width)/float(height);
+    float2 dim=make_float2(float(width), float(height));
+
+    for(int y=y0; y<y1; y++){
+        for(int x=x0; x<x1; x++){
+            float2 d=make_float2(float(x), float(y))/dim*2.f-1.f;
+            float4 res=make_float4(0.f);
+
+            if(entry==PINHOLE_CAMERA){
+                float3 ray_direction=normalize(d.x*ls.V*ls.fov*ratio + d.y*ls.U*ls.fov + ls.W);
+                Payload rad_res;
+                rad_res.color=make_float4(0.f);
+                trace(ls, ls.eye, ray_direction, ls.phong, 0.00000000001f, 1e30f, rad_res);
+                res=rad_res.color;
+            }
+            else if(entry==PINHOLE_CAMERA_MS){
+                float2 scale=1.f/(dim*SQRT_MS_SAMPLES)*2.0f;
+                unsigned int pixel=width*y+x;
+                for(int i=0; i<SQRT_MS_SAMPLES; i++){
+                    for(int j=0; j<SQRT_MS_SAMPLES; j++){
+                        unsigned int seedi=tea<16>(pixel, 2*(i*SQRT_MS_SAMPLES+j));
+                        unsigned int seedj=tea<16>(pixel, 2*(i*SQRT_MS_SAMPLES+j)+1);
+                        float2 sample=d+make_float2((i+1)*rnd(seedi), (j+1)*rnd(seedj))*scale;
+
+                        float3 ray_direction=normalize(sample.x*ls.V*ls.fov*ratio + sample.y*ls.U*ls.fov + ls.W);
+                        Payload rad_res;
+                        rad_res.color=make_float4(0.f);
+                        trace(ls, ls.eye, ray_direction, ls.phong, 0.00000000001f, 1e30f, rad_res);
+                        res+=rad_res.color;
+                    }
+                }
+                res/=float(SQRT_MS_SAMPLES*SQRT_MS_SAMPLES);
+            }
+            else if(entry==PINHOLE_CAMERA_PROGRESSIVE){
+                float2 pixel=2.f/dim;
+                unsigned int seed=tea<16>(width*y+x, ls.frame);
+                for(int s=0; s<PROGRESSIVE_SAMPLES; s++){
+                    float2 sample=d+make_float2(rnd(seed), rnd(seed))*pixel;
+
+                    float3 ray_direction=normalize(sample.x*ls.V*ls.fov*ratio + sample.y*ls.U*ls.fov + ls.W);
+                    Payload rad_res;
+                    rad_res.color=make_float4(0.f);
+                    trace(ls, ls.eye, ray_direction, ls.phong, 0.00000000001f, 1e30f, rad_res);
+                    res+=rad_res.color;
+                }
+                res/=float(PROGRESSIVE_SAMPLES);
+                if(ls.frame>0){
+                    res=lerp(accum[y*width+x], res, 1.0f/(ls.frame+1));
+                }
+                accum[y*width+x]=res;
+            }
+
+            output[y*width+x]=res;
+        }
+    }
+}
+
+void CpuRenderer::run(){
+    if(width<=0 || height<=0){
+        return;
+    }
+
+    LaunchState ls;
+    ls.eye=variables["eye"].getFloat3();
+    ls.U=variables["U"].getFloat3();
+    ls.V=variables["V"].getFloat3();
+    ls.W=variables["W"].getFloat3();
+    ls.fov=variables["fov"].getFloat();
+    ls.spread=2.f*ls.fov/height;
+    ls.lightDir=variables["lightDir"].getFloat3();
+    ls.phong=variables["Phong"].getInt();
+    ls.shadow=variables["Shadow"].getInt();
+    ls.sky=-1;
+    ls.frame=frame++;
+    if(texture_vars.count("sky")){
+        ls.sky=loadTexture(texture_vars["sky"], false);
+    }
+
+    int tiles=((width+TILE_SIZE-1)/TILE_SIZE)*((height+TILE_SIZE-1)/TILE_SIZE);
+    pool.parallelFor(tiles, [this, &ls](int tile, int thread){
+        renderTile(ls, tile);
+    });
+}
+
+void CpuRenderer::setRayTypeCount(int n){
+    miss_programs.resize(n, PROGRAM_NONE);
+    for(unsigned int i=0; i<materials.size(); i++){
+        materials[i].closest_hit.resize(n, PROGRAM_NONE);
+        materials[i].any_hit.resize(n, PROGRAM_NONE);
+    }
+}
+
+void CpuRenderer::setOutputSize(int w, int h){
+    width=w;
+    height=h;
+    output.assign(width*height, make_float4(0.f));
+    accum.assign(width*height, make_float4(0.f));
+    frame=0;
+}
+
+void CpuRenderer::resetAccumulation(){
+    frame=0;
+}
+
+int CpuRenderer::getFrameIndex(){
+    return frame;
+}
+
+void CpuRenderer::setEntryProgram(string file, string program){
+    entry=lookupProgram(program);
+}
+
+void CpuRenderer::setExceptionProgram(string file, string program){
+    //host traversal has no stack to overflow
+}
+
+void CpuRenderer::setMissProgram(int ray_type, string file, string program){
+    if(ray_type>=(int)miss_programs.size()){
+        miss_programs.resize(ray_type+1, PROGRAM_NONE);
+    }
+    miss_programs[ray_type]=lookupProgram(program);
+}
+
+void CpuRenderer::setIntersectionProgram(string file, string program){
+    //triangles are intersected natively
+}
+
+void CpuRenderer::setBoundingBoxProgram(string file, string program){
+    //bounds come from the host BVH
+}
+
+void CpuRenderer::setDefaultClosestHitProgram(int ray_type, string file, string program){
+    HostProgram p=lookupProgram(program);
+    for(unsigned int i=0; i<materials.size(); i++){
+        if(ray_type>=(int)materials[i].closest_hit.size()){
+            materials[i].closest_hit.resize(ray_type+1, PROGRAM_NONE);
+        }
+        materials[i].closest_hit[ray_type]=p;
+    }
+}
+
+void CpuRenderer::setDefaultAnyHitProgram(int ray_type, string file, string program){
+    HostProgram p=lookupProgram(program);
+    for(unsigned int i=0; i<materials.size(); i++){
+        if(ray_type>=(int)materials[i].any_hit.size()){
+            materials[i].any_hit.resize(ray_type+1, PROGRAM_NONE);
+        }
+        materials[i].any_hit[ray_type]=p;
+    }
+}
+
+void CpuRenderer::setMaterialClosestHitProgram(string mat_name, int ray_type, string file, string program){
+    map<string, int>::iterator found=material_index.find(mat_name);
+    if(found==material_index.end()){
+        return;
+    }
+    HostMaterial &m=materials[found->second];
+    if(ray_type>=(int)m.closest_hit.size()){
+        m.closest_hit.resize(ray_type+1, PROGRAM_NONE);
+    }
+    m.closest_hit[ray_type]=lookupProgram(program);
+}
+
+void CpuRenderer::setMaterialAnyHitProgram(string mat_name, int ray_type, string file, string program){
+    map<string, int>::iterator found=material_index.find(mat_name);
+    if(found==material_index.end()){
+        return;
+    }
+    HostMaterial &m=materials[found->second];
+    if(ray_type>=(int)m.any_hit.size()){
+        m.any_hit.resize(ray_type+1, PROGRAM_NONE);
+    }
+    m.any_hit[ray_type]=lookupProgram(program);
+}
+
+void* CpuRenderer::mapOutputBuffer(){
+    return &output[0];
+}
+
+void CpuRenderer::unmapOutputBuffer(){
+}
+
+//the caller may change the image through the variable, so accumulation starts over
+CpuVariable& CpuRenderer::variable(const string& name){
+    frame=0;
+    return variables[name];
+}
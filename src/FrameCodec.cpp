@@ -0,0 +1,243 @@
+#include "FrameCodec.h"
+
+#include <iostream>
+#include <cstring>
+#include <csetjmp>
+#include <cstdlib>
+
+#include <stdint.h>
+#include <png.h>
+#include <jpeglib.h>
+
+using namespace std;
+
+static const char *ENCODING_NAMES[]={"raw", "delta", "png", "jpeg"};
+
+FrameCodec::FrameCodec()
+{
+    //ctor
+}
+
+FrameCodec::~FrameCodec()
+{
+    //dtor
+}
+
+const char* FrameCodec::name(FrameEncoding encoding){
+    if(encoding<0 || encoding>=FRAME_ENCODING_COUNT){
+        return "unknown";
+    }
+    return ENCODING_NAMES[encoding];
+}
+
+FrameEncoding FrameCodec::parse(const string &n){
+    for(int i=0; i<FRAME_ENCODING_COUNT; i++){
+        if(n==ENCODING_NAMES[i]){
+            return (FrameEncoding)i;
+        }
+    }
+    return FRAME_ENCODING_COUNT;
+}
+
+static void appendUint(vector<unsigned char> &data, uint32_t v){
+    unsigned char bytes[4];
+    memcpy(bytes, &v, 4);
+    data.insert(data.end(), bytes, bytes+4);
+}
+
+void FrameCodec::encodeDelta(const vector<unsigned char> &rgba, const vector<unsigned char> &previous, vector<unsigned char> &data){
+    data.clear();
+    if(rgba.empty()){
+        return;
+    }
+    const uint32_t *pixels=reinterpret_cast<const uint32_t*>(&rgba[0]);
+    const uint32_t *old=previous.size()==rgba.size() ? reinterpret_cast<const uint32_t*>(&previous[0]) : NULL;
+    size_t count=rgba.size()/4;
+    size_t i=0;
+    while(i<count){
+        size_t skip=i;
+        while(i<count && pixels[i]==(old ? old[i] : 0)){
+            i++;
+        }
+        size_t changed=i;
+        while(i<count && pixels[i]!=(old ? old[i] : 0)){
+            i++;
+        }
+        appendUint(data, changed-skip);
+        appendUint(data, i-changed);
+        data.insert(data.end(), rgba.begin()+4*changed, rgba.begin()+4*i);
+    }
+}
+
+bool FrameCodec::decodeDelta(const unsigned char *data, size_t size, vector<unsigned char> &rgba){
+    size_t pos=0, pixel=0, count=rgba.size()/4;
+    while(pos+8<=size){
+        uint32_t skip, changed;
+        memcpy(&skip, data+pos, 4);
+        memcpy(&changed, data+pos+4, 4);
+        pos+=8;
+        if(pixel+skip+changed>count || pos+4*(size_t)changed>size){
+            return false;
+        }
+        pixel+=skip;
+        memcpy(&rgba[4*pixel], data+pos, 4*changed);
+        pixel+=changed;
+        pos+=4*changed;
+    }
+    return pos==size;
+}
+
+struct FrameJpegError{
+    jpeg_error_mgr mgr;
+    jmp_buf jump;
+};
+
+static void frameJpegErrorExit(j_common_ptr cinfo){
+    longjmp(reinterpret_cast<FrameJpegError*>(cinfo->err)->jump, 1);
+}
+
+bool FrameCodec::encodeJpeg(const vector<unsigned char> &rgba, int width, int height, int quality, vector<unsigned char> &data){
+    jpeg_compress_struct cinfo;
+    FrameJpegError err;
+    unsigned char *out=NULL;
+    unsigned long out_size=0;
+    vector<unsigned char> row(3*width);
+    cinfo.err=jpeg_std_error(&err.mgr);
+    err.mgr.error_exit=frameJpegErrorExit;
+    if(setjmp(err.jump)){
+        jpeg_destroy_compress(&cinfo);
+        free(out);
+        return false;
+    }
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &out, &out_size);
+    cinfo.image_width=width;
+    cinfo.image_height=height;
+    cinfo.input_components=3;
+    cinfo.in_color_space=JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while(cinfo.next_scanline<cinfo.image_height){
+        const unsigned char *src=&rgba[4*width*(height-1-cinfo.next_scanline)];
+        for(int x=0; x<width; x++){
+            row[3*x]=src[4*x];
+            row[3*x+1]=src[4*x+1];
+            row[3*x+2]=src[4*x+2];
+        }
+        JSAMPROW rows[1]={&row[0]};
+        jpeg_write_scanlines(&cinfo, rows, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    data.assign(out, out+out_size);
+    jpeg_destroy_compress(&cinfo);
+    free(out);
+    return true;
+}
+
+bool FrameCodec::decodeJpeg(const unsigned char *data, size_t size, int width, int height, vector<unsigned char> &rgba){
+    jpeg_decompress_struct cinfo;
+    FrameJpegError err;
+    vector<unsigned char> row;
+    cinfo.err=jpeg_std_error(&err.mgr);
+    err.mgr.error_exit=frameJpegErrorExit;
+    if(setjmp(err.jump)){
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, const_cast<unsigned char*>(data), size);
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.out_color_space=JCS_RGB;
+    jpeg_start_decompress(&cinfo);
+    if((int)cinfo.output_width!=width || (int)cinfo.output_height!=height){
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    row.resize(3*width);
+    while(cinfo.output_scanline<cinfo.output_height){
+        unsigned char *dst=&rgba[4*width*(height-1-cinfo.output_scanline)];
+        JSAMPROW rows[1]={&row[0]};
+        jpeg_read_scanlines(&cinfo, rows, 1);
+        for(int x=0; x<width; x++){
+            dst[4*x]=row[3*x];
+            dst[4*x+1]=row[3*x+1];
+            dst[4*x+2]=row[3*x+2];
+            dst[4*x+3]=255;
+        }
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return true;
+}
+
+bool FrameCodec::encode(FrameEncoding encoding, const vector<unsigned char> &rgba, const vector<unsigned char> &previous,
+                        int width, int height, int quality, vector<unsigned char> &data){
+    if(rgba.size()!=4*(size_t)width*height){
+        return false;
+    }
+    if(encoding==FRAME_RAW){
+        data=rgba;
+        return true;
+    }
+    if(encoding==FRAME_DELTA){
+        encodeDelta(rgba, previous, data);
+        return true;
+    }
+    if(encoding==FRAME_JPEG){
+        return encodeJpeg(rgba, width, height, quality, data);
+    }
+    if(encoding==FRAME_PNG){
+        png_image image;
+        memset(&image, 0, sizeof(image));
+        image.version=PNG_IMAGE_VERSION;
+        image.width=width;
+        image.height=height;
+        image.format=PNG_FORMAT_RGBA;
+        png_alloc_size_t size=0;
+        //the first call only measures
+        if(!png_image_write_to_memory(&image, NULL, &size, 0, &rgba[0], -4*width, NULL)){
+            return false;
+        }
+        data.resize(size);
+        return png_image_write_to_memory(&image, &data[0], &size, 0, &rgba[0], -4*width, NULL)!=0;
+    }
+    return false;
+}
+
+bool FrameCodec::decode(FrameEncoding encoding, const unsigned char *data, size_t size, int width, int height, vector<unsigned char> &rgba){
+    size_t bytes=4*(size_t)width*height;
+    if(encoding==FRAME_RAW){
+        if(size!=bytes){
+            return false;
+        }
+        rgba.assign(data, data+size);
+        return true;
+    }
+    if(encoding==FRAME_DELTA){
+        //a new size is a key frame against black, as in encode
+        if(rgba.size()!=bytes){
+            rgba.assign(bytes, 0);
+        }
+        return decodeDelta(data, size, rgba);
+    }
+    rgba.resize(bytes);
+    if(encoding==FRAME_JPEG){
+        return decodeJpeg(data, size, width, height, rgba);
+    }
+    if(encoding==FRAME_PNG){
+        png_image image;
+        memset(&image, 0, sizeof(image));
+        image.version=PNG_IMAGE_VERSION;
+        if(!png_image_begin_read_from_memory(&image, data, size)){
+            return false;
+        }
+        image.format=PNG_FORMAT_RGBA;
+        if((int)image.width!=width || (int)image.height!=height){
+            png_image_free(&image);
+            return false;
+        }
+        return png_image_finish_read(&image, NULL, &rgba[0], -4*width, NULL)!=0;
+    }
+    return false;
+}
@@ -0,0 +1,176 @@
+#include "FramePipeline.h"
+
+#include <iostream>
+#include <algorithm>
+
+using namespace std;
+
+static const char *STAGE_NAMES[]={"acquire wait", "render", "readback", "queue", "consume", "latency"};
+
+static double elapsedMs(chrono::steady_clock::time_point start, chrono::steady_clock::time_point end){
+    return chrono::duration<double,milli>(end-start).count();
+}
+
+FramePipeline::FramePipeline(int nbuffers) : slots(max(nbuffers, 1)), free_slots(), ready(), finishing(false), stopped(false), failure(false),
+    woken(false), submitted(0), consumed(0)
+{
+    //ctor
+    for(size_t i=0; i<slots.size(); i++){
+        slots[i].width=slots[i].height=0;
+        slots[i].index=-1;
+        slots[i].render_ms=slots[i].readback_ms=0.0;
+        free_slots.push_back(&slots[i]);
+    }
+    for(int s=0; s<STAGE_COUNT; s++){
+        stage_sum[s]=stage_max[s]=0.0;
+    }
+}
+
+FramePipeline::~FramePipeline()
+{
+    //dtor
+    stop();
+    if(consumer.joinable()){
+        consumer.join();
+    }
+}
+
+int FramePipeline::getBufferCount(){
+    return slots.size();
+}
+
+PipelineFrame* FramePipeline::acquire(){
+    unique_lock<mutex> guard(lock);
+    chrono::steady_clock::time_point start=chrono::steady_clock::now();
+    changed.wait(guard, [this]{ return stopped || !free_slots.empty(); });
+    if(stopped){
+        return NULL;
+    }
+    PipelineFrame *frame=free_slots.front();
+    free_slots.pop_front();
+    frame->acquired=chrono::steady_clock::now();
+    frame->acquire_wait_ms=elapsedMs(start, frame->acquired);
+    frame->render_ms=frame->readback_ms=0.0;
+    return frame;
+}
+
+void FramePipeline::submit(PipelineFrame *frame){
+    lock_guard<mutex> guard(lock);
+    frame->submitted=chrono::steady_clock::now();
+    frame->index=submitted++;
+    ready.push_back(frame);
+    changed.notify_all();
+}
+
+void FramePipeline::cancel(PipelineFrame *frame){
+    lock_guard<mutex> guard(lock);
+    free_slots.push_front(frame);
+    changed.notify_all();
+}
+
+bool FramePipeline::idle(int timeout_ms){
+    unique_lock<mutex> guard(lock);
+    changed.wait_for(guard, chrono::milliseconds(timeout_ms), [this]{ return stopped || woken; });
+    woken=false;
+    return !stopped;
+}
+
+void FramePipeline::wake(){
+    lock_guard<mutex> guard(lock);
+    woken=true;
+    changed.notify_all();
+}
+
+PipelineFrame* FramePipeline::next(bool wait, int timeout_ms){
+    unique_lock<mutex> guard(lock);
+    auto done=[this]{ return stopped || finishing || !ready.empty(); };
+    if(wait && timeout_ms<0){
+        changed.wait(guard, done);
+    }
+    else if(wait){
+        changed.wait_for(guard, chrono::milliseconds(timeout_ms), done);
+    }
+    if(stopped || ready.empty()){
+        return NULL;
+    }
+    PipelineFrame *frame=ready.front();
+    ready.pop_front();
+    frame->taken=chrono::steady_clock::now();
+    frame->queue_ms=elapsedMs(frame->submitted, frame->taken);
+    return frame;
+}
+
+void FramePipeline::release(PipelineFrame *frame){
+    lock_guard<mutex> guard(lock);
+    chrono::steady_clock::time_point now=chrono::steady_clock::now();
+    frame->consume_ms=elapsedMs(frame->taken, now);
+    frame->latency_ms=elapsedMs(frame->acquired, now);
+
+    double times[STAGE_COUNT]={frame->acquire_wait_ms, frame->render_ms, frame->readback_ms, frame->queue_ms, frame->consume_ms, frame->latency_ms};
+    for(int s=0; s<STAGE_COUNT; s++){
+        stage_sum[s]+=times[s];
+        stage_max[s]=max(stage_max[s], times[s]);
+    }
+    consumed++;
+
+    free_slots.push_back(frame);
+    changed.notify_all();
+}
+
+void FramePipeline::consumerLoop(Consumer consume){
+    PipelineFrame *frame;
+    while((frame=next(true))){
+        bool ok=consume(*frame);
+        release(frame);
+        if(!ok){
+            lock_guard<mutex> guard(lock);
+            failure=true;
+            stopped=true;
+            changed.notify_all();
+            return;
+        }
+    }
+}
+
+void FramePipeline::startConsumer(Consumer consume){
+    consumer=thread(&FramePipeline::consumerLoop, this, consume);
+}
+
+void FramePipeline::finish(){
+    {
+        lock_guard<mutex> guard(lock);
+        finishing=true;
+        changed.notify_all();
+    }
+    if(consumer.joinable()){
+        consumer.join();
+    }
+    stop();
+}
+
+void FramePipeline::stop(){
+    lock_guard<mutex> guard(lock);
+    stopped=true;
+    changed.notify_all();
+}
+
+bool FramePipeline::failed(){
+    lock_guard<mutex> guard(lock);
+    return failure;
+}
+
+int FramePipeline::getConsumedCount(){
+    lock_guard<mutex> guard(lock);
+    return consumed;
+}
+
+void FramePipeline::report(){
+    lock_guard<mutex> guard(lock);
+    cout<<"Frame pipeline, "<<slots.size()<<" buffers, "<<consumed<<" frames (mean / max ms):"<<endl;
+    if(consumed==0){
+        return;
+    }
+    for(int s=0; s<STAGE_COUNT; s++){
+        cout<<"    "<<STAGE_NAMES[s]<<": "<<stage_sum[s]/consumed<<" / "<<stage_max[s]<<endl;
+    }
+}
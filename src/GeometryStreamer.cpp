@@ -0,0 +1,718 @@
+#include "GeometryStreamer.h"
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <map>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <assimp/material.h>
+
+#include "SceneCache.h"
+
+using namespace std;
+using namespace optix;
+
+static const char STREAM_MAGIC[4]={'O','R','C','K'};
+//textures of a material kept in the chunk file, the ones OptixRenderer loads
+static const aiTextureType STREAM_TEXTURES[3]={aiTextureType_DIFFUSE, aiTextureType_SPECULAR, aiTextureType_HEIGHT};
+
+GeometryStreamer::GeometryStreamer() : fd(-1), source(), material_count(0), material_offset(0), material_bytes(0), materials(), chunks(), budget(STREAM_DEFAULT_BUDGET), resident_bytes(0), updates(0)
+{
+    //ctor
+    memset(&stats, 0, sizeof(stats));
+}
+
+GeometryStreamer::~GeometryStreamer()
+{
+    //dtor
+    close();
+}
+
+//one mesh of one node in world space
+struct Placement{
+    aiMatrix4x4 world;
+    unsigned int mesh;
+    ChunkBounds bounds;
+};
+
+static void collectPlacements(const aiNode *node, aiMatrix4x4 parent, const vector<ChunkBounds> &local, vector<Placement> &placements){
+    aiMatrix4x4 world=parent*node->mTransformation;
+    for(unsigned int i=0; i<node->mNumMeshes; i++){
+        Placement p;
+        p.world=world;
+        p.mesh=node->mMeshes[i];
+        //the corners of the local box, so the world box may be loose under rotation
+        const ChunkBounds &b=local[p.mesh];
+        for(int a=0; a<3; a++){
+            p.bounds.min[a]=INFINITY;
+            p.bounds.max[a]=-INFINITY;
+        }
+        for(int c=0; c<8; c++){
+            float x=(c&1) ? b.max[0] : b.min[0];
+            float y=(c&2) ? b.max[1] : b.min[1];
+            float z=(c&4) ? b.max[2] : b.min[2];
+            float w[3]={world.a1*x+world.a2*y+world.a3*z+world.a4,
+                        world.b1*x+world.b2*y+world.b3*z+world.b4,
+                        world.c1*x+world.c2*y+world.c3*z+world.c4};
+            for(int a=0; a<3; a++){
+                p.bounds.min[a]=min(p.bounds.min[a], w[a]);
+                p.bounds.max[a]=max(p.bounds.max[a], w[a]);
+            }
+        }
+        placements.push_back(p);
+    }
+    for(unsigned int c=0; c<node->mNumChildren; c++){
+        collectPlacements(node->mChildren[c], world, local, placements);
+    }
+}
+
+static void grow(ChunkBounds &a, const ChunkBounds &b){
+    for(int i=0; i<3; i++){
+        a.min[i]=min(a.min[i], b.min[i]);
+        a.max[i]=max(a.max[i], b.max[i]);
+    }
+}
+
+static ChunkBounds emptyBounds(){
+    ChunkBounds b;
+    for(int i=0; i<3; i++){
+        b.min[i]=INFINITY;
+        b.max[i]=-INFINITY;
+    }
+    return b;
+}
+
+static void appendBytes(vector<char> &blob, const void *data, size_t size){
+    const char *bytes=static_cast<const char*>(data);
+    blob.insert(blob.end(), bytes, bytes+size);
+}
+
+//directions: by the matrix for tangents, by its inverse transposed for normals; unit length again
+static void appendDirections(vector<char> &blob, const aiVector3D *v, unsigned int n, const float *m){
+    if(!v){
+        blob.resize(blob.size()+3*n*sizeof(float), 0);
+        return;
+    }
+    for(unsigned int i=0; i<n; i++){
+        float d[3]={m[0]*v[i].x+m[1]*v[i].y+m[2]*v[i].z,
+                    m[3]*v[i].x+m[4]*v[i].y+m[5]*v[i].z,
+                    m[6]*v[i].x+m[7]*v[i].y+m[8]*v[i].z};
+        float l=sqrtf(d[0]*d[0]+d[1]*d[1]+d[2]*d[2]);
+        if(l>0.f){
+            d[0]/=l;
+            d[1]/=l;
+            d[2]/=l;
+        }
+        appendBytes(blob, d, sizeof(d));
+    }
+}
+
+bool GeometryStreamer::write(const string &path, const aiScene *scene, uint64_t hash, uint64_t size, unsigned int flags){
+    vector<ChunkBounds> local(scene->mNumMeshes);
+    for(unsigned int m=0; m<scene->mNumMeshes; m++){
+        const aiMesh *mesh=scene->mMeshes[m];
+        local[m]=emptyBounds();
+        for(unsigned int v=0; v<mesh->mNumVertices; v++){
+            ChunkBounds p;
+            memcpy(p.min, &mesh->mVertices[v].x, sizeof(p.min));
+            memcpy(p.max, &mesh->mVertices[v].x, sizeof(p.max));
+            grow(local[m], p);
+        }
+    }
+    vector<Placement> placements;
+    collectPlacements(scene->mRootNode, aiMatrix4x4(), local, placements);
+
+    //cubic cells, STREAM_GRID along the longest side; a placement goes to the cell of its center
+    ChunkBounds all=emptyBounds();
+    for(size_t i=0; i<placements.size(); i++){
+        grow(all, placements[i].bounds);
+    }
+    float longest=0.f;
+    for(int a=0; a<3; a++){
+        longest=max(longest, all.max[a]-all.min[a]);
+    }
+    float cell=longest>0.f ? longest/STREAM_GRID : 1.f;
+    map<int, vector<int> > cells;
+    for(size_t i=0; i<placements.size(); i++){
+        int key=0;
+        for(int a=0; a<3; a++){
+            float center=0.5f*(placements[i].bounds.min[a]+placements[i].bounds.max[a]);
+            int c=min(STREAM_GRID-1, max(0, (int)((center-all.min[a])/cell)));
+            key=key*STREAM_GRID+c;
+        }
+        cells[key].push_back(i);
+    }
+
+    //written under a temporary name so a crash never leaves a truncated file behind
+    string tmp=path+".tmp";
+    FILE *f=fopen(tmp.c_str(), "wb");
+    if(!f){
+        return false;
+    }
+    Header header;
+    memset(&header, 0, sizeof(header));
+    bool ok=fwrite(&header, sizeof(header), 1, f)==1;
+    uint64_t offset=sizeof(header);
+    vector<ChunkEntry> entries;
+    vector<char> blob;
+    for(map<int, vector<int> >::iterator c=cells.begin(); ok && c!=cells.end(); c++){
+        ChunkEntry entry;
+        entry.bounds=emptyBounds();
+        entry.offset=offset;
+        entry.meshes=c->second.size();
+        entry.triangles=0;
+        blob.clear();
+        for(size_t i=0; i<c->second.size(); i++){
+            const Placement &p=placements[c->second[i]];
+            const aiMesh *mesh=scene->mMeshes[p.mesh];
+            grow(entry.bounds, p.bounds);
+            entry.triangles+=mesh->mNumFaces;
+
+            MeshRecord record;
+            record.nvertex=mesh->mNumVertices;
+            record.nface=mesh->mNumFaces;
+            record.material=mesh->mMaterialIndex;
+            record.flags=0;
+            if(mesh->mTangents && mesh->mBitangents){
+                record.flags|=STREAM_TANGENTS;
+            }
+            if(mesh->HasTextureCoords(0)){
+                record.flags|=STREAM_TEXCOORDS;
+            }
+            appendBytes(blob, &record, sizeof(record));
+
+            const aiMatrix4x4 &w=p.world;
+            for(unsigned int v=0; v<mesh->mNumVertices; v++){
+                const aiVector3D &x=mesh->mVertices[v];
+                float world[3]={w.a1*x.x+w.a2*x.y+w.a3*x.z+w.a4,
+                                w.b1*x.x+w.b2*x.y+w.b3*x.z+w.b4,
+                                w.c1*x.x+w.c2*x.y+w.c3*x.z+w.c4};
+                appendBytes(blob, world, sizeof(world));
+            }
+            aiMatrix4x4 inverse=w;
+            inverse.Inverse();
+            float normal_matrix[9]={inverse.a1, inverse.b1, inverse.c1,
+                                    inverse.a2, inverse.b2, inverse.c2,
+                                    inverse.a3, inverse.b3, inverse.c3};
+            float direction_matrix[9]={w.a1, w.a2, w.a3, w.b1, w.b2, w.b3, w.c1, w.c2, w.c3};
+            appendDirections(blob, mesh->mNormals, mesh->mNumVertices, normal_matrix);
+            if(record.flags & STREAM_TANGENTS){
+                appendDirections(blob, mesh->mTangents, mesh->mNumVertices, direction_matrix);
+                appendDirections(blob, mesh->mBitangents, mesh->mNumVertices, direction_matrix);
+            }
+            if(record.flags & STREAM_TEXCOORDS){
+                for(unsigned int v=0; v<mesh->mNumVertices; v++){
+                    float uv[2]={mesh->mTextureCoords[0][v].x, mesh->mTextureCoords[0][v].y};
+                    appendBytes(blob, uv, sizeof(uv));
+                }
+            }
+            for(unsigned int t=0; t<mesh->mNumFaces; t++){
+                appendBytes(blob, mesh->mFaces[t].mIndices, 3*sizeof(unsigned int));
+            }
+        }
+        entry.size=blob.size();
+        ok=fwrite(&blob[0], 1, blob.size(), f)==blob.size();
+        offset+=blob.size();
+        entries.push_back(entry);
+    }
+
+    //the materials after the chunk entries, so a valid file needs no import of the scene
+    blob.clear();
+    for(unsigned int i=0; i<scene->mNumMaterials; i++){
+        const aiMaterial *mat=scene->mMaterials[i];
+        MaterialRecord record;
+        memset(&record, 0, sizeof(record));
+        aiColor4D diffuse;
+        if(AI_SUCCESS==aiGetMaterialColor(mat, AI_MATKEY_COLOR_DIFFUSE, &diffuse)){
+            record.flags|=STREAM_DIFFUSE;
+            record.diffuse[0]=diffuse.r; record.diffuse[1]=diffuse.g; record.diffuse[2]=diffuse.b; record.diffuse[3]=diffuse.a;
+        }
+        if(AI_SUCCESS==aiGetMaterialFloat(mat, AI_MATKEY_SHININESS, &record.shininess)){
+            record.flags|=STREAM_SHININESS;
+        }
+        aiString strings[4];
+        aiGetMaterialString(mat, AI_MATKEY_NAME, &strings[0]);
+        for(int t=0; t<3; t++){
+            mat->GetTexture(STREAM_TEXTURES[t], 0, &strings[t+1]);
+        }
+        for(int s=0; s<4; s++){
+            record.lengths[s]=strings[s].length;
+        }
+        appendBytes(blob, &record, sizeof(record));
+        for(int s=0; s<4; s++){
+            appendBytes(blob, strings[s].data, strings[s].length);
+        }
+    }
+
+    memcpy(header.magic, STREAM_MAGIC, 4);
+    header.version=STREAM_VERSION;
+    header.source_hash=hash;
+    header.source_size=size;
+    header.flags=flags;
+    header.nchunks=entries.size();
+    header.chunks=offset;
+    header.nmaterials=scene->mNumMaterials;
+    header.materials=offset+entries.size()*sizeof(ChunkEntry);
+    header.material_bytes=blob.size();
+    if(ok && !entries.empty()){
+        ok=fwrite(&entries[0], sizeof(ChunkEntry), entries.size(), f)==entries.size();
+    }
+    if(ok && !blob.empty()){
+        ok=fwrite(&blob[0], 1, blob.size(), f)==blob.size();
+    }
+    ok=ok && fseek(f, 0, SEEK_SET)==0 && fwrite(&header, sizeof(header), 1, f)==1;
+    ok=(fclose(f)==0) && ok;
+    if(!ok || rename(tmp.c_str(), path.c_str())!=0){
+        remove(tmp.c_str());
+        return false;
+    }
+    cout<<"Stream chunks written: "<<path<<", "<<placements.size()<<" meshes in "<<entries.size()<<" chunks, "
+        <<offset/(1<<20)<<" MB"<<endl;
+    return true;
+}
+
+bool GeometryStreamer::readIndex(const string &path, uint64_t hash, uint64_t size, unsigned int flags){
+    fd=::open(path.c_str(), O_RDONLY);
+    if(fd<0){
+        return false;
+    }
+    struct stat st;
+    Header header;
+    vector<ChunkEntry> entries;
+    bool ok=fstat(fd, &st)==0 && pread(fd, &header, sizeof(header), 0)==(ssize_t)sizeof(header) &&
+            memcmp(header.magic, STREAM_MAGIC, 4)==0 && header.version==STREAM_VERSION &&
+            header.source_hash==hash && header.source_size==size && header.flags==flags;
+    //every part inside the file, in the order write puts them, so a damaged file is written again
+    uint64_t file_size=st.st_size;
+    ok=ok && header.chunks<=file_size && header.nchunks<=(file_size-header.chunks)/sizeof(ChunkEntry) &&
+       header.materials==header.chunks+header.nchunks*sizeof(ChunkEntry) && header.material_bytes<=file_size-header.materials;
+    if(ok){
+        entries.resize(header.nchunks);
+        ssize_t bytes=header.nchunks*sizeof(ChunkEntry);
+        ok=bytes==0 || pread(fd, &entries[0], bytes, header.chunks)==bytes;
+    }
+    for(size_t i=0; ok && i<entries.size(); i++){
+        ok=entries[i].offset>=sizeof(header) && entries[i].offset<=header.chunks && entries[i].size<=header.chunks-entries[i].offset;
+    }
+    if(!ok){
+        ::close(fd);
+        fd=-1;
+        return false;
+    }
+    chunks.assign(entries.size(), StreamChunk());
+    for(size_t i=0; i<entries.size(); i++){
+        StreamChunk &c=chunks[i];
+        c.bounds=entries[i].bounds;
+        c.offset=entries[i].offset;
+        c.size=entries[i].size;
+        c.meshes=entries[i].meshes;
+        c.triangles=entries[i].triangles;
+        c.last_used=0;
+        c.visible=false;
+    }
+    material_count=header.nmaterials;
+    material_offset=header.materials;
+    material_bytes=header.material_bytes;
+    return true;
+}
+
+bool GeometryStreamer::find(const string &file, unsigned int flags){
+    close();
+    uint64_t size=0;
+    uint64_t hash=SceneCache::hashSource(file, size);
+    if(!readIndex(file+STREAM_EXTENSION, hash, size, flags)){
+        return false;
+    }
+    source=file;
+    return true;
+}
+
+aiScene* GeometryStreamer::readMaterials(){
+    if(fd<0){
+        return NULL;
+    }
+    vector<char> blob(material_bytes);
+    if(!blob.empty() && pread(fd, &blob[0], blob.size(), material_offset)!=(ssize_t)blob.size()){
+        return NULL;
+    }
+    aiScene *scene=new aiScene();
+    scene->mMaterials=new aiMaterial*[material_count];
+    size_t at=0;
+    for(uint32_t i=0; i<material_count; i++){
+        MaterialRecord record;
+        bool ok=blob.size()-at>=sizeof(record);
+        if(ok){
+            memcpy(&record, &blob[at], sizeof(record));
+            at+=sizeof(record);
+        }
+        string strings[4];
+        for(int s=0; ok && s<4; s++){
+            ok=record.lengths[s]<MAXLEN && blob.size()-at>=record.lengths[s];
+            if(ok){
+                strings[s].assign(&blob[at], record.lengths[s]);
+                at+=record.lengths[s];
+            }
+        }
+        if(!ok){
+            cout<<"Stream chunk materials are damaged"<<endl;
+            delete scene;
+            return NULL;
+        }
+        aiMaterial *mat=new aiMaterial();
+        aiString name(strings[0]);
+        mat->AddProperty(&name, AI_MATKEY_NAME);
+        if(record.flags & STREAM_DIFFUSE){
+            aiColor4D color(record.diffuse[0], record.diffuse[1], record.diffuse[2], record.diffuse[3]);
+            mat->AddProperty(&color, 1, AI_MATKEY_COLOR_DIFFUSE);
+        }
+        if(record.flags & STREAM_SHININESS){
+            mat->AddProperty(&record.shininess, 1, AI_MATKEY_SHININESS);
+        }
+        for(int t=0; t<3; t++){
+            if(!strings[t+1].empty()){
+                aiString path(strings[t+1]);
+                mat->AddProperty(&path, AI_MATKEY_TEXTURE(STREAM_TEXTURES[t], 0));
+            }
+        }
+        scene->mMaterials[scene->mNumMaterials++]=mat;
+    }
+    return scene;
+}
+
+bool GeometryStreamer::open(Context c, const string &file, const aiScene *scene, unsigned int flags,
+                            const vector<Material> &mats, AccelerationFunction acceleration, Acceleration top_acceleration){
+    //the index find opened for the same file is kept
+    bool found=fd>=0 && source==file;
+    if(!found){
+        close();
+    }
+    context=c;
+    materials=mats;
+    mesh_acceleration=acceleration;
+    top=context->createGroup();
+    top->setAcceleration(top_acceleration);
+    top->setChildCount(0);
+
+    string path=file+STREAM_EXTENSION;
+    if(!found){
+        uint64_t size=0;
+        uint64_t hash=SceneCache::hashSource(file, size);
+        found=readIndex(path, hash, size, flags);
+        if(!found && (!scene || !write(path, scene, hash, size, flags) || !readIndex(path, hash, size, flags))){
+            cout<<"Failed to write stream chunks: "<<path<<endl;
+            return false;
+        }
+    }
+    if(found){
+        cout<<"Stream chunks: "<<path<<", "<<chunks.size()<<" chunks"<<endl;
+    }
+    source=file;
+    return true;
+}
+
+void GeometryStreamer::close(){
+    for(size_t i=0; i<chunks.size(); i++){
+        if(chunks[i].group.get()){
+            evict(i);
+        }
+    }
+    chunks.clear();
+    if(fd>=0){
+        ::close(fd);
+        fd=-1;
+    }
+    source.clear();
+    material_count=0;
+    material_offset=material_bytes=0;
+    resident_bytes=0;
+    updates=0;
+    memset(&stats, 0, sizeof(stats));
+}
+
+void GeometryStreamer::setBudget(uint64_t bytes){
+    budget=bytes;
+}
+
+void GeometryStreamer::setPrograms(Program b, Program i){
+    bounding_box=b;
+    intersect=i;
+    for(size_t c=0; c<chunks.size(); c++){
+        for(size_t m=0; m<chunks[c].instances.size(); m++){
+            Geometry g=chunks[c].instances[m]->getGeometry();
+            g->setBoundingBoxProgram(bounding_box);
+            g->setIntersectionProgram(intersect);
+        }
+    }
+}
+
+//a device buffer of count elements filled from the chunk, data moves past them
+static Buffer uploadArray(Context context, RTformat format, size_t count, size_t element, const char *&data){
+    Buffer buffer=context->createBuffer(RT_BUFFER_INPUT, format, count);
+    memcpy(buffer->map(), data, count*element);
+    buffer->unmap();
+    buffer->validate();
+    data+=count*element;
+    return buffer;
+}
+
+bool GeometryStreamer::load(int chunk){
+    StreamChunk &c=chunks[chunk];
+    chrono::steady_clock::time_point start=chrono::steady_clock::now();
+    vector<char> blob(c.size);
+    if(pread(fd, &blob[0], c.size, c.offset)!=(ssize_t)c.size){
+        cout<<"Failed to read stream chunk "<<chunk<<endl;
+        return false;
+    }
+    chrono::steady_clock::time_point read=chrono::steady_clock::now();
+
+    c.group=context->createGeometryGroup();
+    c.group->setAcceleration(mesh_acceleration());
+    c.group->setChildCount(c.meshes);
+    const char *data=&blob[0];
+    for(uint32_t m=0; m<c.meshes; m++){
+        MeshRecord record;
+        memcpy(&record, data, sizeof(record));
+        data+=sizeof(record);
+
+        Geometry geometry=context->createGeometry();
+        geometry->setPrimitiveCount(record.nface);
+        Buffer vertices=uploadArray(context, RT_FORMAT_FLOAT3, record.nvertex, 3*sizeof(float), data);
+        Buffer normals=uploadArray(context, RT_FORMAT_FLOAT3, record.nvertex, 3*sizeof(float), data);
+        geometry["vertex_buffer"]->set(vertices);
+        geometry["normal_buffer"]->set(normals);
+        c.buffers.push_back(vertices);
+        c.buffers.push_back(normals);
+        if(record.flags & STREAM_TANGENTS){
+            Buffer tangents=uploadArray(context, RT_FORMAT_FLOAT3, record.nvertex, 3*sizeof(float), data);
+            Buffer bitangents=uploadArray(context, RT_FORMAT_FLOAT3, record.nvertex, 3*sizeof(float), data);
+            geometry["tangent_buffer"]->set(tangents);
+            geometry["bitangent_buffer"]->set(bitangents);
+            geometry["hasTangents"]->setInt(1);
+            c.buffers.push_back(tangents);
+            c.buffers.push_back(bitangents);
+        }
+        else{
+            geometry["hasTangents"]->setInt(0);
+        }
+        if(record.flags & STREAM_TEXCOORDS){
+            Buffer uvs=uploadArray(context, RT_FORMAT_FLOAT2, record.nvertex, 2*sizeof(float), data);
+            geometry["texCoord_buffer"]->set(uvs);
+            geometry["hasTexCoord"]->setInt(1);
+            c.buffers.push_back(uvs);
+        }
+        else{
+            geometry["hasTexCoord"]->setInt(0);
+        }
+        Buffer indices=uploadArray(context, RT_FORMAT_INT3, record.nface, 3*sizeof(int), data);
+        geometry["index_buffer"]->set(indices);
+        c.buffers.push_back(indices);
+
+        geometry->setBoundingBoxProgram(bounding_box);
+        geometry->setIntersectionProgram(intersect);
+        geometry->validate();
+
+        GeometryInstance instance=context->createGeometryInstance();
+        instance->setGeometry(geometry);
+        instance->setMaterialCount(1);
+        instance->setMaterial(0, materials[record.material<materials.size() ? record.material : 0]);
+        instance->validate();
+        c.group->setChild(m, instance);
+        c.instances.push_back(instance);
+    }
+    c.group->validate();
+    chrono::steady_clock::time_point uploaded=chrono::steady_clock::now();
+
+    resident_bytes+=c.size;
+    stats.peak_bytes=max(stats.peak_bytes, resident_bytes);
+    stats.loads++;
+    stats.bytes_read+=c.size;
+    stats.read_ms+=chrono::duration<double,milli>(read-start).count();
+    stats.upload_ms+=chrono::duration<double,milli>(uploaded-read).count();
+    return true;
+}
+
+void GeometryStreamer::evict(int chunk){
+    StreamChunk &c=chunks[chunk];
+    //OptiX objects live until destroyed, dropping the handles would keep the device memory
+    for(size_t m=0; m<c.instances.size(); m++){
+        c.instances[m]->getGeometry()->destroy();
+        c.instances[m]->destroy();
+    }
+    for(size_t b=0; b<c.buffers.size(); b++){
+        c.buffers[b]->destroy();
+    }
+    c.group->getAcceleration()->destroy();
+    c.group->destroy();
+    c.group=GeometryGroup();
+    c.instances.clear();
+    c.buffers.clear();
+    resident_bytes-=c.size;
+    stats.evictions++;
+}
+
+void GeometryStreamer::setTop(){
+    int n=0;
+    for(size_t i=0; i<chunks.size(); i++){
+        if(chunks[i].group.get()){
+            n++;
+        }
+    }
+    top->setChildCount(n);
+    n=0;
+    for(size_t i=0; i<chunks.size(); i++){
+        if(chunks[i].group.get()){
+            top->setChild(n++, chunks[i].group);
+        }
+    }
+    top->getAcceleration()->markDirty();
+}
+
+void GeometryStreamer::markVisible(int chunk){
+    if(chunk>=0 && chunk<(int)chunks.size()){
+        chunks[chunk].visible=true;
+    }
+}
+
+static float distance2(const ChunkBounds &b, const float *p){
+    float d2=0.f;
+    for(int a=0; a<3; a++){
+        float d=max(0.f, max(b.min[a]-p[a], p[a]-b.max[a]));
+        d2+=d*d;
+    }
+    return d2;
+}
+
+int GeometryStreamer::update(const float *eye){
+    updates++;
+    //visible chunks first, then by distance
+    vector<pair<float, int> > order;
+    for(size_t i=0; i<chunks.size(); i++){
+        float d=chunks[i].visible ? -1.f : distance2(chunks[i].bounds, eye);
+        order.push_back(make_pair(d, (int)i));
+        chunks[i].visible=false;
+    }
+    sort(order.begin(), order.end());
+
+    //the nearest chunks that fit the budget together, a chunk too big for what is left is passed over
+    vector<int> wanted;
+    uint64_t wanted_bytes=0;
+    int oversized=0;
+    for(size_t i=0; i<order.size(); i++){
+        StreamChunk &c=chunks[order[i].second];
+        if(c.size>budget){
+            oversized++;
+            continue;
+        }
+        if(wanted_bytes+c.size>budget){
+            continue;
+        }
+        wanted_bytes+=c.size;
+        c.last_used=updates;
+        wanted.push_back(order[i].second);
+    }
+
+    //said again only when the budget changes the count
+    if(oversized!=stats.oversized){
+        stats.oversized=oversized;
+        if(oversized>0){
+            cout<<"Streaming: "<<oversized<<" chunks are larger than the budget of "<<budget/1024<<" KB and are never loaded"<<endl;
+        }
+    }
+
+    int changed=0, loads=0;
+    for(size_t i=0; i<wanted.size(); i++){
+        StreamChunk &c=chunks[wanted[i]];
+        if(c.group.get()){
+            stats.hits++;
+            continue;
+        }
+        if(loads==STREAM_LOADS_PER_UPDATE){
+            stats.deferred++;
+            continue;
+        }
+        //least recently wanted first, never one wanted by this update
+        while(resident_bytes+c.size>budget){
+            int lru=-1;
+            for(size_t r=0; r<chunks.size(); r++){
+                if(chunks[r].group.get() && chunks[r].last_used<updates && (lru<0 || chunks[r].last_used<chunks[lru].last_used)){
+                    lru=r;
+                }
+            }
+            if(lru<0){
+                break;
+            }
+            evict(lru);
+            changed++;
+        }
+        if(resident_bytes+c.size>budget || !load(wanted[i])){
+            stats.deferred++;
+            continue;
+        }
+        loads++;
+        changed++;
+    }
+    if(changed>0){
+        setTop();
+    }
+    return changed;
+}
+
+Group GeometryStreamer::getTop(){
+    return top;
+}
+
+int GeometryStreamer::getChunkCount(){
+    return chunks.size();
+}
+
+const StreamChunk& GeometryStreamer::getChunk(int chunk){
+    return chunks[chunk];
+}
+
+ChunkBounds GeometryStreamer::getSceneBounds(){
+    ChunkBounds all=emptyBounds();
+    for(size_t i=0; i<chunks.size(); i++){
+        grow(all, chunks[i].bounds);
+    }
+    return all;
+}
+
+int GeometryStreamer::getResidentCount(){
+    int n=0;
+    for(size_t i=0; i<chunks.size(); i++){
+        if(chunks[i].group.get()){
+            n++;
+        }
+    }
+    return n;
+}
+
+uint64_t GeometryStreamer::getResidentBytes(){
+    return resident_bytes;
+}
+
+const StreamStats& GeometryStreamer::getStats(){
+    return stats;
+}
+
+void GeometryStreamer::report(){
+    uint64_t total=0;
+    for(size_t i=0; i<chunks.size(); i++){
+        total+=chunks[i].size;
+    }
+    cout<<"Streaming: "<<getResidentCount()<<" of "<<chunks.size()<<" chunks resident, "<<resident_bytes/1024<<" KB of "
+        <<total/1024<<" KB, budget "<<budget/1024<<" KB, peak "<<stats.peak_bytes/1024<<" KB"<<endl;
+    cout<<"    "<<updates<<" updates: "<<stats.hits<<" hits, "<<stats.loads<<" loads, "<<stats.evictions<<" evictions, "
+        <<stats.deferred<<" deferred, "<<stats.oversized<<" over the budget; "<<stats.bytes_read/1024<<" KB read in "<<stats.read_ms<<" ms";
+    if(stats.read_ms>0.0){
+        cout<<" ("<<stats.bytes_read/1048.576/stats.read_ms<<" MB/s)";
+    }
+    cout<<", upload "<<stats.upload_ms<<" ms"<<endl;
+}
@@ -0,0 +1,106 @@
+#include "InputRecorder.h"
+
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+InputRecorder::InputRecorder() : file(NULL), count(0)
+{
+    //ctor
+}
+
+InputRecorder::~InputRecorder()
+{
+    //dtor
+    if(file){
+        fclose(file);
+    }
+}
+
+bool InputRecorder::start(const string &p, const InputHeader &header){
+    if(file){
+        fclose(file);
+    }
+    path=p;
+    file=fopen(path.c_str(), "wb");
+    if(!file){
+        cout<<"Cannot write input log "<<path<<endl;
+        return false;
+    }
+    InputHeader h=header;
+    memcpy(h.magic, "ORIN", 4);
+    h.version=INPUT_LOG_VERSION;
+    fwrite(&h, sizeof(h), 1, file);
+    fflush(file);
+    count=0;
+    started=chrono::steady_clock::now();
+    cout<<"Recording input to "<<path<<endl;
+    return true;
+}
+
+void InputRecorder::record(uint32_t frame, InputEventType type, int a, int b, const float *eye, const float *look_dir){
+    if(!file){
+        return;
+    }
+    InputEvent e;
+    e.frame=frame;
+    e.time_ms=chrono::duration<float,milli>(chrono::steady_clock::now()-started).count();
+    e.type=type;
+    e.a=a;
+    e.b=b;
+    memcpy(e.eye, eye, sizeof(e.eye));
+    memcpy(e.look_dir, look_dir, sizeof(e.look_dir));
+    fwrite(&e, sizeof(e), 1, file);
+    fflush(file);
+    count++;
+}
+
+void InputRecorder::stop(uint32_t frame){
+    if(!file){
+        return;
+    }
+    float zero[3]={0.f, 0.f, 0.f};
+    record(frame, INPUT_END, 0, 0, zero, zero);
+    fclose(file);
+    file=NULL;
+    cout<<"Recorded "<<count-1<<" input events over "<<frame<<" frames to "<<path<<endl;
+}
+
+bool InputRecorder::isRecording(){
+    return file!=NULL;
+}
+
+bool InputRecorder::load(const string &path, InputHeader &header, vector<InputEvent> &events, uint32_t &frames){
+    FILE *in=fopen(path.c_str(), "rb");
+    if(!in){
+        cout<<"Cannot read input log "<<path<<endl;
+        return false;
+    }
+    if(fread(&header, sizeof(header), 1, in)!=1 || memcmp(header.magic, "ORIN", 4)!=0 || header.version!=INPUT_LOG_VERSION){
+        cout<<path<<" is not an input log of version "<<INPUT_LOG_VERSION<<endl;
+        fclose(in);
+        return false;
+    }
+    events.clear();
+    frames=0;
+    bool ended=false;
+    InputEvent e;
+    while(fread(&e, sizeof(e), 1, in)==1){
+        if(e.type==INPUT_END){
+            frames=e.frame;
+            ended=true;
+            break;
+        }
+        events.push_back(e);
+        frames=max(frames, e.frame+1);
+    }
+    fclose(in);
+    //frames only count up while recording, this is for logs put together by hand
+    stable_sort(events.begin(), events.end(), [](const InputEvent &a, const InputEvent &b){ return a.frame<b.frame; });
+    if(!ended){
+        cout<<path<<" has no end, it is replayed up to its last event"<<endl;
+    }
+    return true;
+}
@@ -0,0 +1,149 @@
+#include "InputReplay.h"
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+
+#include "Hash.h"
+#include "Json.h"
+
+using namespace std;
+
+//largest difference of a replayed camera component from the recorded one
+#define REPLAY_TOLERANCE 1e-5f
+
+InputReplay::InputReplay() : events(), frame_count(0), frames(), hashed(false), diverged(0), wall_ms(0.0)
+{
+    //ctor
+}
+
+InputReplay::~InputReplay()
+{
+    //dtor
+}
+
+bool InputReplay::load(const string &path){
+    log=path;
+    return InputRecorder::load(path, header, events, frame_count);
+}
+
+const InputHeader& InputReplay::getHeader(){
+    return header;
+}
+
+static bool sameCamera(const float *a, const float *b){
+    for(int i=0; i<3; i++){
+        if(fabs(a[i]-b[i])>REPLAY_TOLERANCE){
+            return false;
+        }
+    }
+    return true;
+}
+
+bool InputReplay::run(EventFunction apply, FrameFunction frame, bool hashes){
+    hashed=hashes;
+    diverged=0;
+    frames.assign(frame_count, FrameStats());
+    size_t next=0;
+    chrono::steady_clock::time_point start=chrono::steady_clock::now();
+    for(uint32_t f=0; f<frame_count; f++){
+        FrameStats &stats=frames[f];
+        stats.events=0;
+        for(; next<events.size() && events[next].frame==f; next++){
+            const InputEvent &e=events[next];
+            float eye[3], look_dir[3];
+            apply(e, eye, look_dir);
+            if(!sameCamera(eye, e.eye) || !sameCamera(look_dir, e.look_dir)){
+                if(diverged==0){
+                    cout<<"Replay diverged at frame "<<f<<": eye "<<eye[0]<<' '<<eye[1]<<' '<<eye[2]<<" instead of "
+                        <<e.eye[0]<<' '<<e.eye[1]<<' '<<e.eye[2]<<endl;
+                }
+                diverged++;
+            }
+            stats.events++;
+        }
+        stats.hash=0;
+        if(!frame(stats.launch_ms, stats.readback_ms, hashes ? &stats.hash : NULL)){
+            cout<<"Replay failed at frame "<<f<<endl;
+            frames.resize(f);
+            return false;
+        }
+    }
+    wall_ms=chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+    return true;
+}
+
+bool InputReplay::writeReport(const string &file, const string &scene){
+    ofstream out(file.c_str());
+    if(out.fail()){
+        cout<<"Error writing report: "<<file<<endl;
+        return false;
+    }
+
+    vector<double> launches;
+    double launch_sum=0.0;
+    for(size_t i=0; i<frames.size(); i++){
+        launch_sum+=frames[i].launch_ms;
+        launches.push_back(frames[i].launch_ms);
+    }
+    sort(launches.begin(), launches.end());
+    int n=frames.size();
+
+    out<<"{\n";
+    out<<"  \"log\": \""<<escapeJson(log)<<"\",\n";
+    out<<"  \"scene\": \""<<escapeJson(scene)<<"\",\n";
+    out<<"  \"config\": "<<header.config<<",\n";
+    out<<"  \"width\": "<<header.width<<",\n";
+    out<<"  \"height\": "<<header.height<<",\n";
+    out<<"  \"diverged_events\": "<<diverged<<",\n";
+    out<<"  \"frames\": [\n";
+    for(int i=0; i<n; i++){
+        const FrameStats &f=frames[i];
+        out<<"    {\"index\": "<<i<<", \"events\": "<<f.events<<", \"launch_ms\": "<<f.launch_ms<<", \"readback_ms\": "<<f.readback_ms;
+        if(hashed){
+            char hex[17];
+            sprintf(hex, "%016llx", (unsigned long long)f.hash);
+            out<<", \"hash\": \""<<hex<<'"';
+        }
+        out<<'}'<<(i+1<n?",":"")<<'\n';
+    }
+    out<<"  ],\n";
+    out<<"  \"summary\": {\"frames\": "<<n;
+    if(n>0){
+        out<<", \"launch_mean_ms\": "<<launch_sum/n<<", \"launch_median_ms\": "<<launches[n/2]
+           <<", \"launch_p95_ms\": "<<launches[min(n-1, (int)(0.95*n))]<<", \"launch_max_ms\": "<<launches[n-1]
+           <<", \"wall_ms\": "<<wall_ms<<", \"fps\": "<<1000.0*n/wall_ms;
+    }
+    out<<"}\n";
+    out<<"}\n";
+    cout<<"Report written to "<<file<<endl;
+    return true;
+}
+
+void InputReplay::report(){
+    cout<<"Replayed "<<events.size()<<" events over "<<frames.size()<<" frames";
+    if(!frames.empty()){
+        double launch_sum=0.0;
+        for(size_t i=0; i<frames.size(); i++){
+            launch_sum+=frames[i].launch_ms;
+        }
+        cout<<", launch "<<launch_sum/frames.size()<<" ms mean, "<<wall_ms<<" ms in total";
+    }
+    if(hashed && !frames.empty()){
+        //one hash over all frames for a quick check of two runs
+        uint64_t all=HASH_SEED;
+        for(size_t i=0; i<frames.size(); i++){
+            all=hashBytes(&frames[i].hash, sizeof(uint64_t), all);
+        }
+        char hex[17];
+        sprintf(hex, "%016llx", (unsigned long long)all);
+        cout<<", image hash "<<hex;
+    }
+    if(diverged>0){
+        cout<<", "<<diverged<<" events left a different camera than recorded";
+    }
+    cout<<endl;
+}
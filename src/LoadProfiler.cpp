@@ -0,0 +1,151 @@
+#include "LoadProfiler.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+static double elapsedMs(chrono::steady_clock::time_point start){
+    return chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+}
+
+LoadProfiler::LoadProfiler(string name) : name(name), stages(), runs(), totals(), peak_rss(), current()
+{
+    //ctor
+}
+
+LoadProfiler::~LoadProfiler()
+{
+    //dtor
+}
+
+void LoadProfiler::beginRun(){
+    resetPeakRSS();
+    runs.push_back(map<string, double>());
+    current.clear();
+    run_start=chrono::steady_clock::now();
+}
+
+void LoadProfiler::stage(string stage_name){
+    endStage();
+    if(find(stages.begin(), stages.end(), stage_name)==stages.end()){
+        stages.push_back(stage_name);
+    }
+    current=stage_name;
+    stage_start=chrono::steady_clock::now();
+}
+
+void LoadProfiler::endStage(){
+    if(current.empty() || runs.empty()){
+        return;
+    }
+    runs.back()[current]+=elapsedMs(stage_start);
+    current.clear();
+}
+
+void LoadProfiler::endRun(){
+    endStage();
+    totals.push_back(elapsedMs(run_start));
+    peak_rss.push_back(peakRSS());
+}
+
+int LoadProfiler::getRunCount(){
+    return totals.size();
+}
+
+size_t LoadProfiler::peakRSS(){
+    ifstream status("/proc/self/status");
+    string line;
+    while(getline(status, line)){
+        if(line.compare(0, 6, "VmHWM:")==0){
+            istringstream value(line.substr(6));
+            size_t kb=0;
+            value>>kb;
+            return kb;
+        }
+    }
+    return 0;
+}
+
+bool LoadProfiler::resetPeakRSS(){
+    //5 resets the peak resident set size, Linux 4.0 and later
+    ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs<<"5";
+    clear_refs.close();
+    return !clear_refs.fail();
+}
+
+//nearest rank percentiles
+LoadProfiler::Stats LoadProfiler::statistics(vector<double> values){
+    Stats s={0.0, 0.0, 0.0, 0.0};
+    if(values.empty()){
+        return s;
+    }
+    sort(values.begin(), values.end());
+    int n=values.size();
+    s.median=n%2 ? values[n/2] : 0.5*(values[n/2-1]+values[n/2]);
+    s.p95=values[max(0, (int)ceil(0.95*n)-1)];
+    s.min=values[0];
+    s.max=values[n-1];
+    return s;
+}
+
+vector<double> LoadProfiler::samples(string stage_name){
+    vector<double> res;
+    for(size_t r=0; r<runs.size(); r++){
+        map<string, double>::iterator i=runs[r].find(stage_name);
+        if(i!=runs[r].end()){
+            res.push_back(i->second);
+        }
+    }
+    return res;
+}
+
+void LoadProfiler::report(){
+    cout<<"Load benchmark "<<name<<", "<<totals.size()<<" runs (median / p95 ms):"<<endl;
+    for(size_t i=0; i<stages.size(); i++){
+        vector<double> values=samples(stages[i]);
+        Stats s=statistics(values);
+        cout<<"    "<<stages[i]<<": "<<s.median<<" / "<<s.p95;
+        if(values.size()!=totals.size()){
+            cout<<" ("<<values.size()<<" runs)";
+        }
+        cout<<endl;
+    }
+    Stats total=statistics(totals);
+    Stats rss=statistics(peak_rss);
+    cout<<"    total: "<<total.median<<" / "<<total.p95<<endl;
+    cout<<"    peak RSS: "<<rss.median/1024<<" / "<<rss.p95/1024<<" MB"<<endl;
+}
+
+static void writeStats(ostream &out, const char *key, double median, double p95, double min, double max, const vector<double> &values){
+    out<<"\""<<key<<"\": {\"median\": "<<median<<", \"p95\": "<<p95<<", \"min\": "<<min<<", \"max\": "<<max<<", \"samples\": [";
+    for(size_t i=0; i<values.size(); i++){
+        out<<(i?", ":"")<<values[i];
+    }
+    out<<"]}";
+}
+
+void LoadProfiler::writeJson(ostream &out){
+    out<<"{\"name\": \""<<name<<"\", \"runs\": "<<totals.size()<<",\n";
+    out<<"     \"stages_ms\": [\n";
+    for(size_t i=0; i<stages.size(); i++){
+        vector<double> values=samples(stages[i]);
+        Stats s=statistics(values);
+        out<<"        {\"stage\": \""<<stages[i]<<"\", ";
+        writeStats(out, "ms", s.median, s.p95, s.min, s.max, values);
+        out<<'}'<<(i+1<stages.size()?",":"")<<'\n';
+    }
+    out<<"     ],\n";
+    Stats total=statistics(totals);
+    out<<"     ";
+    writeStats(out, "total_ms", total.median, total.p95, total.min, total.max, totals);
+    out<<",\n";
+    Stats rss=statistics(peak_rss);
+    out<<"     ";
+    writeStats(out, "peak_rss_kb", rss.median, rss.p95, rss.min, rss.max, peak_rss);
+    out<<"}";
+}
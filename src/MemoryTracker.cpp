@@ -0,0 +1,300 @@
+#include "MemoryTracker.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+#include "Json.h"
+
+using namespace std;
+using namespace optix;
+
+MemoryTracker::MemoryTracker() : records(), index(), material_names(), device_budget(0), device_warned(false)
+{
+    //ctor
+    memset(totals, 0, sizeof(totals));
+    memset(budgets, 0, sizeof(budgets));
+    memset(warned, 0, sizeof(warned));
+}
+
+MemoryTracker::~MemoryTracker()
+{
+    //dtor
+}
+
+bool MemoryTracker::Key::operator<(const Key &k) const{
+    if(category!=k.category) return category<k.category;
+    if(mesh!=k.mesh) return mesh<k.mesh;
+    if(material!=k.material) return material<k.material;
+    return name<k.name;
+}
+
+const char* MemoryTracker::categoryName(MemoryCategory category){
+    const char *names[MEMORY_CATEGORY_COUNT]={"geometry", "texture", "acceleration", "output", "placeholder", "scene (host)"};
+    return category<MEMORY_CATEGORY_COUNT ? names[category] : "unknown";
+}
+
+uint64_t MemoryTracker::bufferBytes(Buffer buffer){
+    if(!buffer.get()){
+        return 0;
+    }
+    RTsize width=1, height=1, depth=1;
+    switch(buffer->getDimensionality()){
+    case 1:
+        buffer->getSize(width);
+        break;
+    case 2:
+        buffer->getSize(width, height);
+        break;
+    default:
+        buffer->getSize(width, height, depth);
+        break;
+    }
+    return (uint64_t)buffer->getElementSize()*width*height*depth;
+}
+
+uint64_t MemoryTracker::sceneBytes(const aiScene *scene){
+    if(!scene){
+        return 0;
+    }
+    uint64_t bytes=0;
+    for(unsigned int m=0; m<scene->mNumMeshes; m++){
+        const aiMesh *mesh=scene->mMeshes[m];
+        int arrays=(mesh->mVertices!=NULL)+(mesh->mNormals!=NULL)+2*(mesh->mTangents!=NULL);
+        for(int t=0; t<AI_MAX_NUMBER_OF_TEXTURECOORDS; t++){
+            arrays+=mesh->mTextureCoords[t]!=NULL;
+        }
+        bytes+=sizeof(aiMesh)+(uint64_t)arrays*mesh->mNumVertices*sizeof(aiVector3D);
+        for(int c=0; c<AI_MAX_NUMBER_OF_COLOR_SETS; c++){
+            bytes+=mesh->mColors[c] ? (uint64_t)mesh->mNumVertices*sizeof(aiColor4D) : 0;
+        }
+        bytes+=(uint64_t)mesh->mNumFaces*sizeof(aiFace);
+        for(unsigned int f=0; f<mesh->mNumFaces; f++){
+            bytes+=mesh->mFaces[f].mNumIndices*sizeof(unsigned int);
+        }
+    }
+    return bytes;
+}
+
+void MemoryTracker::track(MemoryCategory category, const string &name, uint64_t bytes, int mesh, int material){
+    Key key;
+    key.category=category;
+    key.name=name;
+    key.mesh=mesh;
+    key.material=material;
+    map<Key, int>::iterator found=index.find(key);
+    if(found==index.end()){
+        MemoryRecord record;
+        record.category=category;
+        record.name=name;
+        record.mesh=mesh;
+        record.material=material;
+        record.bytes=0;
+        found=index.insert(make_pair(key, (int)records.size())).first;
+        records.push_back(record);
+    }
+    MemoryRecord &record=records[found->second];
+    totals[category]+=bytes-record.bytes;
+    record.bytes=bytes;
+
+    if(overBudget(category)){
+        if(!warned[category]){
+            warn(categoryName(category), totals[category], budgets[category]);
+        }
+        warned[category]=true;
+    }
+    else{
+        warned[category]=false;
+    }
+    if(overDeviceBudget()){
+        if(!device_warned){
+            warn("device total", getDeviceBytes(), device_budget);
+        }
+        device_warned=true;
+    }
+    else{
+        device_warned=false;
+    }
+}
+
+void MemoryTracker::trackBuffer(Buffer buffer, MemoryCategory category, const string &name, int mesh, int material){
+    track(category, name, bufferBytes(buffer), mesh, material);
+}
+
+void MemoryTracker::trackSampler(TextureSampler sampler, MemoryCategory category, const string &name, int material){
+    unsigned int nlevels=sampler->getMipLevelCount();
+    for(unsigned int l=0; l<nlevels; l++){
+        trackBuffer(sampler->getBuffer(0, l), category, name+" mip "+to_string(l), -1, material);
+    }
+}
+
+void MemoryTracker::setMaterialName(int material, const string &name){
+    if(material<0){
+        return;
+    }
+    if(material>=(int)material_names.size()){
+        material_names.resize(material+1);
+    }
+    material_names[material]=name;
+}
+
+void MemoryTracker::clear(){
+    records.clear();
+    index.clear();
+    material_names.clear();
+    memset(totals, 0, sizeof(totals));
+    memset(warned, 0, sizeof(warned));
+    device_warned=false;
+}
+
+void MemoryTracker::setBudget(MemoryCategory category, uint64_t bytes){
+    budgets[category]=bytes;
+    warned[category]=false;
+}
+
+void MemoryTracker::setDeviceBudget(uint64_t bytes){
+    device_budget=bytes;
+    device_warned=false;
+}
+
+bool MemoryTracker::overBudget(MemoryCategory category){
+    return budgets[category]>0 && totals[category]>budgets[category];
+}
+
+bool MemoryTracker::overDeviceBudget(){
+    return device_budget>0 && getDeviceBytes()>device_budget;
+}
+
+void MemoryTracker::warn(const char *what, uint64_t bytes, uint64_t budget){
+    cout<<"Memory budget exceeded: "<<what<<" "<<bytes/1024<<" KB of "<<budget/1024<<" KB"<<endl;
+}
+
+bool MemoryTracker::checkBudgets(){
+    bool within=true;
+    for(int c=0; c<MEMORY_CATEGORY_COUNT; c++){
+        if(overBudget((MemoryCategory)c)){
+            warn(categoryName((MemoryCategory)c), totals[c], budgets[c]);
+            within=false;
+        }
+    }
+    if(overDeviceBudget()){
+        warn("device total", getDeviceBytes(), device_budget);
+        within=false;
+    }
+    return within;
+}
+
+uint64_t MemoryTracker::getBytes(MemoryCategory category){
+    return totals[category];
+}
+
+uint64_t MemoryTracker::getMeshBytes(int mesh){
+    uint64_t bytes=0;
+    for(size_t i=0; i<records.size(); i++){
+        bytes+=records[i].mesh==mesh ? records[i].bytes : 0;
+    }
+    return bytes;
+}
+
+uint64_t MemoryTracker::getMaterialBytes(int material){
+    uint64_t bytes=0;
+    for(size_t i=0; i<records.size(); i++){
+        bytes+=records[i].material==material ? records[i].bytes : 0;
+    }
+    return bytes;
+}
+
+uint64_t MemoryTracker::getDeviceBytes(){
+    uint64_t bytes=0;
+    for(int c=0; c<MEMORY_CATEGORY_COUNT; c++){
+        bytes+=c!=MEMORY_SCENE ? totals[c] : 0;
+    }
+    return bytes;
+}
+
+uint64_t MemoryTracker::getHostBytes(){
+    return totals[MEMORY_SCENE];
+}
+
+const vector<MemoryRecord>& MemoryTracker::getRecords(){
+    return records;
+}
+
+string MemoryTracker::materialLabel(int material){
+    string label="material "+to_string(material);
+    if(material>=0 && material<(int)material_names.size() && !material_names[material].empty()){
+        label+=" ("+material_names[material]+")";
+    }
+    return label;
+}
+
+//the n largest of the byte sums per mesh or material, skipping -1
+static vector<pair<uint64_t, int> > largest(const map<int, uint64_t> &sums, size_t n){
+    vector<pair<uint64_t, int> > sorted;
+    for(map<int, uint64_t>::const_iterator i=sums.begin(); i!=sums.end(); i++){
+        if(i->first>=0){
+            sorted.push_back(make_pair(i->second, i->first));
+        }
+    }
+    sort(sorted.rbegin(), sorted.rend());
+    if(sorted.size()>n){
+        sorted.resize(n);
+    }
+    return sorted;
+}
+
+void MemoryTracker::report(){
+    int counts[MEMORY_CATEGORY_COUNT]={0};
+    map<int, uint64_t> meshes, materials;
+    for(size_t i=0; i<records.size(); i++){
+        const MemoryRecord &r=records[i];
+        counts[r.category]+=r.bytes>0;
+        meshes[r.mesh]+=r.bytes;
+        materials[r.material]+=r.bytes;
+    }
+    cout<<"Memory: "<<getDeviceBytes()/1024<<" KB on the device";
+    if(device_budget>0){
+        cout<<" of a "<<device_budget/1024<<" KB budget";
+    }
+    cout<<", "<<getHostBytes()/1024<<" KB of scene on the host"<<endl;
+    for(int c=0; c<MEMORY_CATEGORY_COUNT; c++){
+        cout<<"    "<<categoryName((MemoryCategory)c)<<": "<<totals[c]/1024<<" KB in "<<counts[c]<<" allocations";
+        if(budgets[c]>0){
+            cout<<", "<<100.0*totals[c]/budgets[c]<<"% of "<<budgets[c]/1024<<" KB"<<(overBudget((MemoryCategory)c) ? " EXCEEDED" : "");
+        }
+        cout<<endl;
+    }
+    vector<pair<uint64_t, int> > top=largest(meshes, MEMORY_REPORT_TOP);
+    if(!top.empty()){
+        cout<<"  largest meshes:";
+        for(size_t i=0; i<top.size(); i++){
+            cout<<(i>0 ? "," : "")<<" mesh "<<top[i].second<<" "<<top[i].first/1024<<" KB";
+        }
+        cout<<endl;
+    }
+    top=largest(materials, MEMORY_REPORT_TOP);
+    if(!top.empty()){
+        cout<<"  largest materials:";
+        for(size_t i=0; i<top.size(); i++){
+            cout<<(i>0 ? "," : "")<<" "<<materialLabel(top[i].second)<<" "<<top[i].first/1024<<" KB";
+        }
+        cout<<endl;
+    }
+}
+
+void MemoryTracker::writeJson(ostream &out){
+    out<<"{\"device_bytes\": "<<getDeviceBytes()<<", \"device_budget\": "<<device_budget<<", \"host_bytes\": "<<getHostBytes()<<",\n";
+    out<<"     \"categories\": [\n";
+    for(int c=0; c<MEMORY_CATEGORY_COUNT; c++){
+        out<<"        {\"category\": \""<<categoryName((MemoryCategory)c)<<"\", \"bytes\": "<<totals[c]<<", \"budget\": "<<budgets[c]<<'}'
+           <<(c+1<MEMORY_CATEGORY_COUNT ? "," : "")<<'\n';
+    }
+    out<<"     ],\n";
+    out<<"     \"records\": [\n";
+    for(size_t i=0; i<records.size(); i++){
+        const MemoryRecord &r=records[i];
+        out<<"        {\"category\": \""<<categoryName(r.category)<<"\", \"name\": \""<<escapeJson(r.name)<<"\", \"mesh\": "<<r.mesh
+           <<", \"material\": "<<r.material<<", \"bytes\": "<<r.bytes<<'}'<<(i+1<records.size() ? "," : "")<<'\n';
+    }
+    out<<"     ]}";
+}
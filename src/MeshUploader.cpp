@@ -0,0 +1,327 @@
+#include "MeshUploader.h"
+
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "VertexPacker.h"
+
+using namespace std;
+using namespace optix;
+
+MeshUploader::MeshUploader(ThreadPool &pool) : pool(pool), memory(NULL)
+{
+    //ctor
+    memset(&stats, 0, sizeof(stats));
+}
+
+MeshUploader::~MeshUploader()
+{
+    //dtor
+}
+
+void MeshUploader::setMemoryTracker(MemoryTracker *m){
+    memory=m;
+}
+
+void MeshUploader::track(Buffer buffer, const char *name, const aiMesh *mesh, int index){
+    if(memory){
+        memory->trackBuffer(buffer, MEMORY_GEOMETRY, name, index, mesh->mMaterialIndex);
+    }
+}
+
+void MeshUploader::copyIndices(const aiFace *faces, int nface, int *out){
+    //every face has its own index array, so this stays a gather
+    for(int f=0; f<nface; f++){
+        const unsigned int *index=faces[f].mIndices;
+        out[3*f]=index[0];
+        out[3*f+1]=index[1];
+        out[3*f+2]=index[2];
+    }
+}
+
+void MeshUploader::narrowTexCoordsScalar(const aiVector3D *uvs, int nvertex, float *out){
+    for(int v=0; v<nvertex; v++){
+        out[2*v]=uvs[v].x;
+        out[2*v+1]=uvs[v].y;
+    }
+}
+
+void MeshUploader::narrowTexCoords(const aiVector3D *uvs, int nvertex, float *out){
+    int v=0;
+#if defined(__SSE2__)
+    //4 uvs are 3 registers in, x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3, and 2 out
+    const float *in=&uvs[0].x;
+    for(; v+4<=nvertex; v+=4, in+=12, out+=8){
+        __m128 a=_mm_loadu_ps(in);
+        __m128 b=_mm_loadu_ps(in+4);
+        __m128 c=_mm_loadu_ps(in+8);
+        __m128 x1y1=_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 3, 3));
+        _mm_storeu_ps(out, _mm_shuffle_ps(a, x1y1, _MM_SHUFFLE(2, 0, 1, 0)));
+        _mm_storeu_ps(out+4, _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2)));
+    }
+#endif
+    narrowTexCoordsScalar(uvs+v, nvertex-v, out);
+}
+
+void MeshUploader::addTasks(vector<FillTask> &tasks, FillKind kind, const void *source, void *target, int count){
+    for(int begin=0; begin<count; begin+=UPLOAD_SLICE){
+        FillTask task;
+        task.kind=kind;
+        task.source=source;
+        task.target=target;
+        task.begin=begin;
+        task.count=min(UPLOAD_SLICE, count-begin);
+        tasks.push_back(task);
+    }
+}
+
+void MeshUploader::fill(const FillTask &task){
+    switch(task.kind){
+    case FILL_COPY:
+        memcpy(static_cast<float*>(task.target)+3*task.begin, static_cast<const float*>(task.source)+3*task.begin,
+               task.count*3*sizeof(float));
+        break;
+    case FILL_INDICES:
+        copyIndices(static_cast<const aiFace*>(task.source)+task.begin, task.count, static_cast<int*>(task.target)+3*task.begin);
+        break;
+    case FILL_TEXCOORDS:
+        narrowTexCoords(static_cast<const aiVector3D*>(task.source)+task.begin, task.count,
+                        static_cast<float*>(task.target)+2*task.begin);
+        break;
+    }
+}
+
+void MeshUploader::fillAll(const vector<FillTask> &tasks){
+    pool.parallelFor(tasks.size(), [&tasks](int index, int thread){
+        fill(tasks[index]);
+    });
+}
+
+void MeshUploader::upload(Context context, const aiScene *scene, const vector<int> &meshes, const vector<Geometry> &geometries){
+    memset(&stats, 0, sizeof(stats));
+    stats.meshes=meshes.size();
+    stats.threads=pool.getThreadCount();
+
+    //create and map everything, the tasks only touch host memory
+    chrono::steady_clock::time_point start=chrono::steady_clock::now();
+    vector<Buffer> mapped;
+    vector<FillTask> tasks;
+    for(size_t i=0; i<meshes.size(); i++){
+        const aiMesh *mesh=scene->mMeshes[meshes[i]];
+        Geometry geometry=geometries[i];
+        int nface=mesh->mNumFaces;
+        int nvertex=mesh->mNumVertices;
+
+        Buffer index_buffer=context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_INT3, nface);
+        addTasks(tasks, FILL_INDICES, mesh->mFaces, index_buffer->map(), nface);
+        geometry["index_buffer"]->set(index_buffer);
+        mapped.push_back(index_buffer);
+        track(index_buffer, "index_buffer", mesh, meshes[i]);
+
+        Buffer vertex_buffer=context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT3, nvertex);
+        addTasks(tasks, FILL_COPY, mesh->mVertices, vertex_buffer->map(), nvertex);
+        geometry["vertex_buffer"]->set(vertex_buffer);
+        mapped.push_back(vertex_buffer);
+        track(vertex_buffer, "vertex_buffer", mesh, meshes[i]);
+        stats.bytes+=(uint64_t)nface*3*sizeof(int)+(uint64_t)nvertex*3*sizeof(float);
+
+        if(mesh->mNormals){
+            Buffer normal_buffer=context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT3, nvertex);
+            addTasks(tasks, FILL_COPY, mesh->mNormals, normal_buffer->map(), nvertex);
+            geometry["normal_buffer"]->set(normal_buffer);
+            mapped.push_back(normal_buffer);
+            track(normal_buffer, "normal_buffer", mesh, meshes[i]);
+            stats.bytes+=(uint64_t)nvertex*3*sizeof(float);
+        }
+
+        if(mesh->HasTangentsAndBitangents()){
+            Buffer tangent_buffer=context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT3, nvertex);
+            addTasks(tasks, FILL_COPY, mesh->mTangents, tangent_buffer->map(), nvertex);
+            geometry["tangent_buffer"]->set(tangent_buffer);
+            mapped.push_back(tangent_buffer);
+            track(tangent_buffer, "tangent_buffer", mesh, meshes[i]);
+
+            Buffer bitangent_buffer=context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT3, nvertex);
+            addTasks(tasks, FILL_COPY, mesh->mBitangents, bitangent_buffer->map(), nvertex);
+            geometry["bitangent_buffer"]->set(bitangent_buffer);
+            mapped.push_back(bitangent_buffer);
+            track(bitangent_buffer, "bitangent_buffer", mesh, meshes[i]);
+            stats.bytes+=(uint64_t)nvertex*6*sizeof(float);
+        }
+        geometry["hasTangents"]->setInt(mesh->HasTangentsAndBitangents() ? 1 : 0);
+
+        if(mesh->HasTextureCoords(0)){
+            Buffer texCoord_buffer=context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT2, nvertex);
+            addTasks(tasks, FILL_TEXCOORDS, mesh->mTextureCoords[0], texCoord_buffer->map(), nvertex);
+            geometry["texCoord_buffer"]->set(texCoord_buffer);
+            mapped.push_back(texCoord_buffer);
+            track(texCoord_buffer, "texCoord_buffer", mesh, meshes[i]);
+            stats.bytes+=(uint64_t)nvertex*2*sizeof(float);
+        }
+        geometry["hasTexCoord"]->setInt(mesh->HasTextureCoords(0) ? 1 : 0);
+    }
+    chrono::steady_clock::time_point created=chrono::steady_clock::now();
+
+    fillAll(tasks);
+    chrono::steady_clock::time_point filled=chrono::steady_clock::now();
+
+    for(size_t b=0; b<mapped.size(); b++){
+        mapped[b]->unmap();
+        mapped[b]->validate();
+    }
+    chrono::steady_clock::time_point finished=chrono::steady_clock::now();
+
+    stats.buffers=mapped.size();
+    stats.tasks=tasks.size();
+    stats.create_ms=chrono::duration<double,milli>(created-start).count();
+    stats.fill_ms=chrono::duration<double,milli>(filled-created).count();
+    stats.finish_ms=chrono::duration<double,milli>(finished-filled).count();
+}
+
+void MeshUploader::pack(Context context, const aiScene *scene, const vector<int> &meshes, const vector<Geometry> &geometries){
+    memset(&stats, 0, sizeof(stats));
+    stats.meshes=meshes.size();
+    stats.threads=pool.getThreadCount();
+
+    //packing is the costly part and needs no context
+    chrono::steady_clock::time_point start=chrono::steady_clock::now();
+    vector<PackedMesh> packed(meshes.size());
+    pool.parallelFor(meshes.size(), [&](int i, int thread){
+        VertexPacker::pack(scene->mMeshes[meshes[i]], packed[i]);
+    });
+    chrono::steady_clock::time_point filled=chrono::steady_clock::now();
+
+    for(size_t i=0; i<meshes.size(); i++){
+        const aiMesh *mesh=scene->mMeshes[meshes[i]];
+        VertexPacker::upload(context, geometries[i], mesh, packed[i], memory, meshes[i]);
+        stats.float_bytes+=packed[i].float_bytes;
+        stats.packed_bytes+=packed[i].packed_bytes;
+    }
+    chrono::steady_clock::time_point finished=chrono::steady_clock::now();
+
+    stats.bytes=stats.packed_bytes;
+    stats.tasks=meshes.size();
+    stats.fill_ms=chrono::duration<double,milli>(filled-start).count();
+    stats.finish_ms=chrono::duration<double,milli>(finished-filled).count();
+}
+
+const UploadStats& MeshUploader::getStats(){
+    return stats;
+}
+
+void MeshUploader::report(){
+    cout<<"Mesh upload: "<<stats.meshes<<" meshes, "<<stats.bytes/1024<<" KB";
+    if(stats.packed_bytes>0){
+        cout<<" packed from "<<stats.float_bytes/1024<<" KB";
+    }
+    else{
+        cout<<" in "<<stats.buffers<<" buffers";
+    }
+    cout<<"; create "<<stats.create_ms<<" ms, fill "<<stats.fill_ms<<" ms as "<<stats.tasks<<" tasks on "
+        <<stats.threads<<" threads, finish "<<stats.finish_ms<<" ms"<<endl;
+}
+
+bool MeshUploader::check(const aiScene *scene){
+    vector<PackedMesh> packed(scene->mNumMeshes);
+    pool.parallelFor(scene->mNumMeshes, [&](int i, int thread){
+        VertexPacker::pack(scene->mMeshes[i], packed[i]);
+    });
+    int failed=0;
+    size_t float_bytes=0, packed_bytes=0;
+    for(unsigned int i=0; i<scene->mNumMeshes; i++){
+        failed+=!VertexPacker::check(scene->mMeshes[i], packed[i], i);
+        float_bytes+=packed[i].float_bytes;
+        packed_bytes+=packed[i].packed_bytes;
+    }
+    cout<<"Packed layout: "<<scene->mNumMeshes<<" meshes, "<<float_bytes/1024<<" KB -> "<<packed_bytes/1024<<" KB, "
+        <<failed<<" failed"<<endl;
+    return failed==0;
+}
+
+bool MeshUploader::benchmark(int nmeshes, int nvertex){
+#if defined(__SSE2__)
+    const char *simd="SSE2";
+#else
+    const char *simd="none";
+#endif
+    //a triangle strip per mesh, every attribute of the float layout
+    int nface=max(nvertex-2, 1);
+    vector<unsigned int> indices(3*nface);
+    for(int f=0; f<nface; f++){
+        indices[3*f]=f%nvertex;
+        indices[3*f+1]=(f+1+f%2)%nvertex;
+        indices[3*f+2]=(f+2-f%2)%nvertex;
+    }
+    vector<aiFace> faces(nface);
+    for(int f=0; f<nface; f++){
+        faces[f].mNumIndices=3;
+        faces[f].mIndices=&indices[3*f];
+    }
+    vector<vector<aiVector3D> > attributes(nmeshes);
+    unsigned int seed=12345u;
+    for(int m=0; m<nmeshes; m++){
+        attributes[m].resize(nvertex);
+        for(int v=0; v<nvertex; v++){
+            seed=seed*1664525u+1013904223u;
+            attributes[m][v]=aiVector3D(v*0.25f+m, (seed>>8)/65536.f, -(float)v);
+        }
+    }
+
+    //each mesh fills an index, a float3 and a uv array
+    vector<vector<int> > serial_index(nmeshes, vector<int>(3*nface)), pool_index(serial_index);
+    vector<vector<float> > serial_float(nmeshes, vector<float>(3*nvertex)), pool_float(serial_float);
+    vector<vector<float> > serial_uv(nmeshes, vector<float>(2*nvertex)), pool_uv(serial_uv);
+    vector<FillTask> serial_tasks, pool_tasks;
+    for(int m=0; m<nmeshes; m++){
+        addTasks(serial_tasks, FILL_INDICES, &faces[0], &serial_index[m][0], nface);
+        addTasks(serial_tasks, FILL_COPY, &attributes[m][0], &serial_float[m][0], nvertex);
+        addTasks(serial_tasks, FILL_TEXCOORDS, &attributes[m][0], &serial_uv[m][0], nvertex);
+        addTasks(pool_tasks, FILL_INDICES, &faces[0], &pool_index[m][0], nface);
+        addTasks(pool_tasks, FILL_COPY, &attributes[m][0], &pool_float[m][0], nvertex);
+        addTasks(pool_tasks, FILL_TEXCOORDS, &attributes[m][0], &pool_uv[m][0], nvertex);
+    }
+
+    chrono::steady_clock::time_point start=chrono::steady_clock::now();
+    for(size_t t=0; t<serial_tasks.size(); t++){
+        fill(serial_tasks[t]);
+    }
+    double serial_ms=chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+    start=chrono::steady_clock::now();
+    fillAll(pool_tasks);
+    double pool_ms=chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+
+    bool pass=serial_index==pool_index && serial_float==pool_float && serial_uv==pool_uv;
+    for(int m=0; m<nmeshes && pass; m++){
+        pass=memcmp(&serial_float[m][0], &attributes[m][0], nvertex*3*sizeof(float))==0;
+    }
+
+    //narrowing alone, over all meshes at once
+    vector<aiVector3D> uvs;
+    for(int m=0; m<nmeshes; m++){
+        uvs.insert(uvs.end(), attributes[m].begin(), attributes[m].end());
+    }
+    vector<float> scalar(2*uvs.size()), fast(2*uvs.size());
+    start=chrono::steady_clock::now();
+    narrowTexCoordsScalar(&uvs[0], uvs.size(), &scalar[0]);
+    double scalar_ms=chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+    start=chrono::steady_clock::now();
+    narrowTexCoords(&uvs[0], uvs.size(), &fast[0]);
+    double fast_ms=chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+    pass=pass && scalar==fast;
+
+    //the indices belong to the vector, not to the faces
+    for(int f=0; f<nface; f++){
+        faces[f].mIndices=NULL;
+    }
+
+    double mb=(double)nmeshes*(nface*3*sizeof(int)+nvertex*5*sizeof(float))/1e6;
+    cout<<"Mesh fill "<<nmeshes<<" meshes of "<<nvertex<<" vertices, "<<mb<<" MB: serial "<<serial_ms<<" ms, "
+        <<pool.getThreadCount()<<" threads "<<pool_ms<<" ms ("<<mb/(pool_ms/1000.0)/1000.0<<" GB/s), "<<serial_ms/pool_ms<<"x"<<endl;
+    cout<<"UV narrowing of "<<uvs.size()<<" uvs: scalar "<<scalar_ms<<" ms, "<<simd<<' '<<fast_ms<<" ms, "<<scalar_ms/fast_ms<<"x"<<endl;
+    cout<<"Mesh fill check "<<(pass ? "passed" : "FAILED")<<endl;
+    return pass;
+}
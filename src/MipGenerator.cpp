@@ -0,0 +1,315 @@
+#include "MipGenerator.h"
+
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <chrono>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+//the AVX2 colour kernel is picked at run time, the build does not need -mavx2
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MIP_AVX2_DISPATCH
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+static double srgbToLinear(double c){
+    return c<=0.04045 ? c/12.92 : pow((c+0.055)/1.055, 2.4);
+}
+
+static double linearToSrgb(double l){
+    return l<=0.0031308 ? l*12.92 : 1.055*pow(l, 1.0/2.4)-0.055;
+}
+
+//one RGBA texel from the 2x2 block a0 a1 (upper row) b0 b1, in the same order of operations as the SIMD paths
+static inline void averageRGBA(const float *decode, const int *encode, const unsigned char *a0, const unsigned char *a1,
+                               const unsigned char *b0, const unsigned char *b1, unsigned char *dst){
+    for(int c=0; c<4; c++){
+        int off=c==3 ? 256 : 0;
+        float v=((decode[off+a0[c]]+decode[off+a1[c]])+(decode[off+b0[c]]+decode[off+b1[c]]))*0.25f;
+        int index=c==3 ? (int)(v*255.f+0.5f)+SRGB_TABLE_SIZE : (int)(v*(SRGB_TABLE_SIZE-1)+0.5f);
+        dst[c]=encode[index];
+    }
+}
+
+MipGenerator::MipGenerator() : avx2(false)
+{
+    //ctor
+#if defined(MIP_AVX2_DISPATCH)
+    avx2=__builtin_cpu_supports("avx2");
+#endif
+    for(int i=0; i<256; i++){
+        decode[i]=(float)srgbToLinear(i/255.0);
+        decode[256+i]=i/255.f;
+    }
+    for(int i=0; i<SRGB_TABLE_SIZE; i++){
+        encode[i]=(int)floor(linearToSrgb(i/double(SRGB_TABLE_SIZE-1))*255.0+0.5);
+    }
+    for(int i=0; i<256; i++){
+        encode[SRGB_TABLE_SIZE+i]=i;
+    }
+}
+
+MipGenerator::~MipGenerator()
+{
+    //dtor
+}
+
+int MipGenerator::levelCount(int width, int height){
+    int levels=1;
+    while(width>1 || height>1){
+        width=max(1, width/2);
+        height=max(1, height/2);
+        levels++;
+    }
+    return levels;
+}
+
+int MipGenerator::levelSize(int size, int level){
+    return max(1, size>>level);
+}
+
+void MipGenerator::build(DecodedTexture &tex){
+    tex.mips.clear();
+    if(!tex.ok){
+        return;
+    }
+    int levels=levelCount(tex.width, tex.height);
+    int channels=tex.format==TEXTURE_RGBA8 ? 4 : 1;
+    tex.mips.resize(levels-1);
+
+    const unsigned char *src=&tex.pixels[0];
+    int sw=tex.width, sh=tex.height;
+    for(int l=1; l<levels; l++){
+        int dw=levelSize(tex.width, l);
+        int dh=levelSize(tex.height, l);
+        tex.mips[l-1].resize(dw*dh*channels);
+        downsample(src, sw, sh, tex.format, &tex.mips[l-1][0]);
+        src=&tex.mips[l-1][0];
+        sw=dw;
+        sh=dh;
+    }
+}
+
+void MipGenerator::downsampleScalar(const unsigned char *src, int sw, int sh, TextureFormat format, unsigned char *dst){
+    int dw=max(1, sw/2);
+    int dh=max(1, sh/2);
+    int channels=format==TEXTURE_RGBA8 ? 4 : 1;
+    for(int y=0; y<dh; y++){
+        const unsigned char *row0=src+min(2*y, sh-1)*sw*channels;
+        const unsigned char *row1=src+min(2*y+1, sh-1)*sw*channels;
+        for(int x=0; x<dw; x++){
+            int x0=min(2*x, sw-1);
+            int x1=min(2*x+1, sw-1);
+            if(channels==1){
+                dst[y*dw+x]=(row0[x0]+row0[x1]+row1[x0]+row1[x1]+2)>>2;
+            }
+            else{
+                averageRGBA(decode, encode, row0+4*x0, row0+4*x1, row1+4*x0, row1+4*x1, dst+4*(y*dw+x));
+            }
+        }
+    }
+}
+
+void MipGenerator::downsample(const unsigned char *src, int sw, int sh, TextureFormat format, unsigned char *dst){
+    //the row kernels read two full texels per output, which only holds for even widths
+    if(sw%2!=0){
+        downsampleScalar(src, sw, sh, format, dst);
+        return;
+    }
+    int dw=sw/2;
+    int dh=max(1, sh/2);
+    int channels=format==TEXTURE_RGBA8 ? 4 : 1;
+    for(int y=0; y<dh; y++){
+        const unsigned char *row0=src+min(2*y, sh-1)*sw*channels;
+        const unsigned char *row1=src+min(2*y+1, sh-1)*sw*channels;
+        if(channels==1){
+            downsampleRowL8(row0, row1, dw, dst+y*dw);
+        }
+        else{
+            downsampleRowRGBA(row0, row1, dw, dst+4*y*dw);
+        }
+    }
+}
+
+//the colour kernel is compiled for AVX2 whatever the target flags and only called where the CPU
+//has it; SSE2 has no gather, its table lookups would stay scalar
+#if defined(MIP_AVX2_DISPATCH)
+//two output texels per step, table lookups through gathers; returns the texels done
+__attribute__((target("avx2")))
+static int downsampleRowRGBAAVX2(const float *decode, const int *encode, const unsigned char *row0, const unsigned char *row1,
+                                 int dw, unsigned char *dst){
+    const __m256i offset=_mm256_setr_epi32(0, 0, 0, 256, 0, 0, 0, 256);
+    const __m256i encode_offset=_mm256_setr_epi32(0, 0, 0, SRGB_TABLE_SIZE, 0, 0, 0, SRGB_TABLE_SIZE);
+    const __m256 scale=_mm256_setr_ps(SRGB_TABLE_SIZE-1, SRGB_TABLE_SIZE-1, SRGB_TABLE_SIZE-1, 255.f,
+                                      SRGB_TABLE_SIZE-1, SRGB_TABLE_SIZE-1, SRGB_TABLE_SIZE-1, 255.f);
+    const __m256 quarter=_mm256_set1_ps(0.25f);
+    const __m256 half=_mm256_set1_ps(0.5f);
+    int x=0;
+    for(; x+2<=dw; x+=2){
+        __m128i r0=_mm_loadu_si128(reinterpret_cast<const __m128i*>(row0+8*x));
+        __m128i r1=_mm_loadu_si128(reinterpret_cast<const __m128i*>(row1+8*x));
+        //texels 0,1 and 2,3 of each row, linear
+        __m256 a0=_mm256_i32gather_ps(decode, _mm256_add_epi32(_mm256_cvtepu8_epi32(r0), offset), 4);
+        __m256 b0=_mm256_i32gather_ps(decode, _mm256_add_epi32(_mm256_cvtepu8_epi32(_mm_srli_si128(r0, 8)), offset), 4);
+        __m256 a1=_mm256_i32gather_ps(decode, _mm256_add_epi32(_mm256_cvtepu8_epi32(r1), offset), 4);
+        __m256 b1=_mm256_i32gather_ps(decode, _mm256_add_epi32(_mm256_cvtepu8_epi32(_mm_srli_si128(r1, 8)), offset), 4);
+        //pair up horizontally: (0+1, 2+3)
+        __m256 s0=_mm256_add_ps(_mm256_permute2f128_ps(a0, b0, 0x20), _mm256_permute2f128_ps(a0, b0, 0x31));
+        __m256 s1=_mm256_add_ps(_mm256_permute2f128_ps(a1, b1, 0x20), _mm256_permute2f128_ps(a1, b1, 0x31));
+        __m256 v=_mm256_mul_ps(_mm256_add_ps(s0, s1), quarter);
+        __m256i index=_mm256_add_epi32(_mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(v, scale), half)), encode_offset);
+        __m256i out=_mm256_i32gather_epi32(encode, index, 4);
+        __m128i words=_mm_packs_epi32(_mm256_castsi256_si128(out), _mm256_extracti128_si256(out, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst+4*x), _mm_packus_epi16(words, words));
+    }
+    return x;
+}
+#endif
+
+void MipGenerator::downsampleRowRGBA(const unsigned char *row0, const unsigned char *row1, int dw, unsigned char *dst){
+    int x=0;
+#if defined(MIP_AVX2_DISPATCH)
+    if(avx2){
+        x=downsampleRowRGBAAVX2(decode, encode, row0, row1, dw, dst);
+    }
+#endif
+    for(; x<dw; x++){
+        averageRGBA(decode, encode, row0+8*x, row0+8*x+4, row1+8*x, row1+8*x+4, dst+4*x);
+    }
+}
+
+void MipGenerator::downsampleRowL8(const unsigned char *row0, const unsigned char *row1, int dw, unsigned char *dst){
+    int x=0;
+#if defined(__SSE2__)
+    //eight output texels per step in 16 bit lanes
+    const __m128i zero=_mm_setzero_si128();
+    const __m128i low=_mm_set1_epi32(0xFFFF);
+    const __m128i two=_mm_set1_epi16(2);
+    for(; x+8<=dw; x+=8){
+        __m128i a=_mm_loadu_si128(reinterpret_cast<const __m128i*>(row0+2*x));
+        __m128i b=_mm_loadu_si128(reinterpret_cast<const __m128i*>(row1+2*x));
+        __m128i lo=_mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+        __m128i hi=_mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+        __m128i pairs_lo=_mm_add_epi32(_mm_and_si128(lo, low), _mm_srli_epi32(lo, 16));
+        __m128i pairs_hi=_mm_add_epi32(_mm_and_si128(hi, low), _mm_srli_epi32(hi, 16));
+        __m128i sums=_mm_srli_epi16(_mm_add_epi16(_mm_packs_epi32(pairs_lo, pairs_hi), two), 2);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst+x), _mm_packus_epi16(sums, sums));
+    }
+#endif
+    for(; x<dw; x++){
+        dst[x]=(row0[2*x]+row0[2*x+1]+row1[2*x]+row1[2*x+1]+2)>>2;
+    }
+}
+
+//largest per channel difference between two images of the same size
+static int maxDifference(const vector<unsigned char> &a, const vector<unsigned char> &b){
+    int diff=0;
+    for(size_t i=0; i<a.size(); i++){
+        diff=max(diff, abs(int(a[i])-int(b[i])));
+    }
+    return diff;
+}
+
+//unquantized reference for one level, with the same edge handling as downsample
+static void downsampleExact(const unsigned char *src, int sw, int sh, TextureFormat format, unsigned char *dst){
+    int dw=max(1, sw/2);
+    int dh=max(1, sh/2);
+    int channels=format==TEXTURE_RGBA8 ? 4 : 1;
+    for(int y=0; y<dh; y++){
+        int y0=min(2*y, sh-1), y1=min(2*y+1, sh-1);
+        for(int x=0; x<dw; x++){
+            int x0=min(2*x, sw-1), x1=min(2*x+1, sw-1);
+            const unsigned char *t[4]={src+(y0*sw+x0)*channels, src+(y0*sw+x1)*channels, src+(y1*sw+x0)*channels, src+(y1*sw+x1)*channels};
+            for(int c=0; c<channels; c++){
+                bool srgb=channels==4 && c<3;
+                double v=0.0;
+                for(int i=0; i<4; i++){
+                    v+=srgb ? srgbToLinear(t[i][c]/255.0) : t[i][c]/255.0;
+                }
+                v*=0.25;
+                dst[(y*dw+x)*channels+c]=(unsigned char)floor((srgb ? linearToSrgb(v) : v)*255.0+0.5);
+            }
+        }
+    }
+}
+
+bool MipGenerator::benchmark(int size, int repeats){
+    const char *simd_rgba=avx2 ? "AVX2" : "none";
+#if defined(__SSE2__)
+    const char *simd_l8="SSE2";
+#else
+    const char *simd_l8="none";
+#endif
+    bool pass=true;
+    TextureFormat formats[2]={TEXTURE_RGBA8, TEXTURE_L8};
+    for(int f=0; f<2; f++){
+        TextureFormat format=formats[f];
+        int channels=format==TEXTURE_RGBA8 ? 4 : 1;
+        int levels=levelCount(size, size);
+        const char *simd=format==TEXTURE_RGBA8 ? simd_rgba : simd_l8;
+
+        //gradients with a checker and some noise, so every level has content
+        vector<unsigned char> base(size*size*channels);
+        unsigned int seed=12345u;
+        for(int y=0; y<size; y++){
+            for(int x=0; x<size; x++){
+                for(int c=0; c<channels; c++){
+                    seed=seed*1664525u+1013904223u;
+                    int checker=((x/8+y/8)%2)*96;
+                    int v=(x*255/size+c*y*255/size)/(c+1)/2+checker+(int)(seed>>28);
+                    base[(y*size+x)*channels+c]=(unsigned char)min(v, 255);
+                }
+            }
+        }
+
+        vector<vector<unsigned char> > scalar(levels), fast(levels);
+        scalar[0]=base;
+        fast[0]=base;
+        for(int l=1; l<levels; l++){
+            int n=levelSize(size, l);
+            scalar[l].resize(n*n*channels);
+            fast[l].resize(n*n*channels);
+        }
+
+        double scalar_ms=0.0, fast_ms=0.0;
+        for(int r=0; r<repeats; r++){
+            chrono::steady_clock::time_point start=chrono::steady_clock::now();
+            for(int l=1; l<levels; l++){
+                int n=levelSize(size, l-1);
+                downsampleScalar(&scalar[l-1][0], n, n, format, &scalar[l][0]);
+            }
+            scalar_ms+=chrono::duration<double, milli>(chrono::steady_clock::now()-start).count();
+
+            start=chrono::steady_clock::now();
+            for(int l=1; l<levels; l++){
+                int n=levelSize(size, l-1);
+                downsample(&fast[l-1][0], n, n, format, &fast[l][0]);
+            }
+            fast_ms+=chrono::duration<double, milli>(chrono::steady_clock::now()-start).count();
+        }
+
+        //each level against the scalar chain and against an exact downsample of the same input
+        int diff_scalar=0, diff_exact=0;
+        for(int l=1; l<levels; l++){
+            int n=levelSize(size, l-1);
+            vector<unsigned char> exact(fast[l].size());
+            downsampleExact(&fast[l-1][0], n, n, format, &exact[0]);
+            diff_scalar=max(diff_scalar, maxDifference(fast[l], scalar[l]));
+            diff_exact=max(diff_exact, maxDifference(fast[l], exact));
+        }
+        pass=pass && diff_scalar<=1 && diff_exact<=1;
+
+        double mpix=double(size)*size/1e6;
+        cout<<"Mip chain "<<(format==TEXTURE_RGBA8 ? "RGBA8 sRGB " : "L8 ")<<size<<'x'<<size<<", "<<levels<<" levels: scalar "
+            <<scalar_ms/repeats<<" ms ("<<mpix*repeats/(scalar_ms/1000.0)<<" MPix/s), "<<simd<<' '<<fast_ms/repeats<<" ms ("
+            <<mpix*repeats/(fast_ms/1000.0)<<" MPix/s), "<<scalar_ms/fast_ms<<"x"<<endl;
+        cout<<"  max difference to scalar "<<diff_scalar<<", to exact "<<diff_exact<<endl;
+    }
+    cout<<"Mip chain check "<<(pass ? "passed" : "FAILED")<<endl;
+    return pass;
+}
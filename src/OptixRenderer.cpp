@@ -5,17 +5,21 @@
 #include <assimp/postprocess.h>
 #include <assimp/material.h>
 
-#include <IL/il.h>
-#include <IL/ilu.h>
+#include <chrono>
+#include <iostream>
 
+#include "MeshUploader.h"
+#include "MipGenerator.h"
+#include "VertexPacker.h"
 
-#define ANISOTROPY 1.f
-#define MIPMAPS 1
+
+#define ANISOTROPY 16.f
+#define IMPORT_FLAGS (aiProcessPreset_TargetRealtime_MaxQuality | aiProcess_OptimizeGraph)
 
 using namespace std;
 using namespace optix;
 
-OptixRenderer::OptixRenderer(string path, string file) : materials(), meshes()
+OptixRenderer::OptixRenderer(string path, string file) : release_scene(false), materials(), texture_cache(), texture_hits(0), texture_misses(0), texture_bytes_saved(0), compress_textures(false), pack_vertices(false), flatten_scene(true), scene_edits(false), animation_index(-1), stream_budget(0), stream_materials(NULL), profiler(NULL), meshes()
 {
     //ctor
     scene_path=path;
@@ -25,30 +29,154 @@ OptixRenderer::OptixRenderer(string path, string file) : materials(), meshes()
     width=0;
     height=0;
     output=context->createBuffer(RT_BUFFER_OUTPUT, RT_FORMAT_FLOAT4, width, height);
-    context["output"]->set(output);
+    output_format=OUTPUT_FLOAT4;
+    display=OutputConverter::bind(context, output_format, output);
+    OutputConverter::setTonemap(context, 1.f, 1.f);
+    accum=context->createBuffer(RT_BUFFER_INPUT_OUTPUT|RT_BUFFER_GPU_LOCAL, RT_FORMAT_FLOAT4, width, height);
+    context["accum_buffer"]->set(accum);
+    trackOutput();
+    frame=0;
+    tiles.init(context, width, height);
+    programs.init(context);
 }
 
 void OptixRenderer::init(){
 
     //loading scene
-    scene=aiImportFile((scene_path+scene_file).c_str(), aiProcessPreset_TargetRealtime_MaxQuality | aiProcess_OptimizeGraph);
+    scene_cache.setProfiler(profiler);
+    //an up to date chunk file has the geometry and the materials, the scene is not imported
+    if(stream_budget>0){
+        stage("stream index");
+        if(streamer.find(scene_path+scene_file, IMPORT_FLAGS)){
+            stream_materials=streamer.readMaterials();
+        }
+        endStage();
+    }
+    scene=stream_materials ? stream_materials : scene_cache.import(scene_path+scene_file, IMPORT_FLAGS);
+    memory.track(MEMORY_SCENE, "aiScene", MemoryTracker::sceneBytes(scene));
 
     loadMaterials();
+    if(stream_budget>0){
+        stage("stream chunks");
+        loadStreaming();
+        endStage();
+        return;
+    }
+    if(flatten_scene){
+        stage("flatten");
+        flattener.flatten(scene, flat);
+        flattener.report();
+    }
+    stage("loadGeometry");
     loadGeometry();
+    stage("loadSceneGraph");
     loadSceneGraph();
+    if(animation_index>=0){
+        player.init(scene, animation_index, &editor);
+        editor.setTimed(false);
+    }
+    endStage();
+    if(release_scene){
+        releaseScene();
+    }
+}
+
+void OptixRenderer::releaseScene(){
+    //the channels of the player point into the scene
+    if(player.hasAnimation()){
+        cout<<"Scene kept for the animation"<<endl;
+        return;
+    }
+    scene_cache.release();
+    scene=NULL;
+    memory.track(MEMORY_SCENE, "aiScene", 0);
+}
 
+void OptixRenderer::compile(){
+    stage("acceleration build");
+    context->validate();
+    //an empty launch compiles the programs and builds every acceleration without tracing a ray
+    context->launch(0, 0, 0);
+    endStage();
+    programs.report();
+    trackAccelerations();
+    reportMemory();
+}
+
+void OptixRenderer::setLoadProfiler(LoadProfiler *p){
+    profiler=p;
+}
+
+void OptixRenderer::setSceneCache(bool enabled){
+    scene_cache.setEnabled(enabled);
+}
+
+void OptixRenderer::setFlattenScene(bool enabled){
+    flatten_scene=enabled;
+}
+
+void OptixRenderer::setSceneEdits(bool enabled){
+    scene_edits=enabled;
+    //edits address the nodes of the scene, which the flat graph merges
+    if(enabled){
+        flatten_scene=false;
+    }
+}
+
+void OptixRenderer::stage(const char *name){
+    if(profiler){
+        profiler->stage(name);
+    }
+}
+
+void OptixRenderer::endStage(){
+    if(profiler){
+        profiler->endStage();
+    }
+}
 
+void OptixRenderer::setTextureCompression(bool enabled){
+    compress_textures=enabled;
+}
+
+void OptixRenderer::setPackedVertices(bool enabled){
+    pack_vertices=enabled;
 }
 
 OptixRenderer::~OptixRenderer()
 {
     //dtor
+    delete stream_materials;
     context->destroy();
 }
 
 
 void OptixRenderer::loadMaterials(){
     int nmat=scene->mNumMaterials;
+
+    //decode stage: every referenced texture at once on the pool
+    stage("texture decode");
+    TextureLoader loader(pool);
+    loader.setMipmaps(true);
+    loader.setCompression(compress_textures);
+    vector<int> diffuse_tex(nmat,-1), specular_tex(nmat,-1), bump_tex(nmat,-1);
+    for(int i=0; i<nmat; i++){
+        aiMaterial * mat = scene->mMaterials[i];
+        aiString texPath;
+        if(AI_SUCCESS==mat->GetTexture(aiTextureType_DIFFUSE, 0, &texPath)){
+            diffuse_tex[i]=loader.request(scene_path+string(texPath.data), TEXTURE_RGBA8);
+        }
+        if(AI_SUCCESS==mat->GetTexture(aiTextureType_SPECULAR, 0, &texPath)){
+            specular_tex[i]=loader.request(scene_path+string(texPath.data), TEXTURE_RGBA8);
+        }
+        if(AI_SUCCESS==mat->GetTexture(aiTextureType_HEIGHT, 0, &texPath)){
+            bump_tex[i]=loader.request(scene_path+string(texPath.data), TEXTURE_L8);
+        }
+    }
+    loader.decodeAll();
+
+    //upload stage, in material order
+    stage("loadMaterials");
     for(int i=0; i<nmat; i++){
 
         aiMaterial * mat = scene->mMaterials[i];
@@ -69,116 +197,82 @@ void OptixRenderer::loadMaterials(){
         aiGetMaterialFloat(mat, AI_MATKEY_SHININESS, &shininess);
         optix_mat["Ns"]->setFloat(shininess);
 
-        aiString diffTexPath;
-        if(AI_SUCCESS==mat->GetTexture(aiTextureType_DIFFUSE, 0, &diffTexPath)){
-            TextureSampler diffTex = createTextureRGBA(scene_path+string(diffTexPath.data));
-            optix_mat["map_Kd"]->setTextureSampler(diffTex);
-
-        }
-        else{
-            optix_mat["map_Kd"]->setTextureSampler(createTextureRGBA(""));
-        }
-
-        aiString specTexPath;
-        if(AI_SUCCESS==mat->GetTexture(aiTextureType_SPECULAR, 0, &specTexPath)){
-            TextureSampler specTex = createTextureRGBA(scene_path+string(specTexPath.data));
-            optix_mat["map_Ks"]->setTextureSampler(specTex);
-        }
-        else{
-            optix_mat["map_Ks"]->setTextureSampler(createTextureRGBA(""));
-        }
-
-        aiString bumpTexPath;
-        if(AI_SUCCESS==mat->GetTexture(aiTextureType_HEIGHT, 0, &bumpTexPath)){
-            TextureSampler bumpTex = createTextureLum(scene_path+string(bumpTexPath.data));
-            optix_mat["map_bump"]->setTextureSampler(bumpTex);
-        }
-        else{
-            optix_mat["map_bump"]->setTextureSampler(createTextureLum(""));
-        }
+        optix_mat["map_Kd"]->setTextureSampler(getTexture(loader, diffuse_tex[i], TEXTURE_RGBA8, i));
+        optix_mat["map_Ks"]->setTextureSampler(getTexture(loader, specular_tex[i], TEXTURE_RGBA8, i));
+        optix_mat["map_bump"]->setTextureSampler(getTexture(loader, bump_tex[i], TEXTURE_L8, i));
+        memory.setMaterialName(i, mat_name.data);
 
         optix_mat->validate();
         materials[mat_name.data]=optix_mat;
     }
+
+    loader.report();
+    cout<<"Texture cache: "<<texture_hits<<" hits, "<<texture_misses<<" misses, "
+        <<texture_cache.size()<<" samplers, "<<texture_bytes_saved/1024<<" KB not uploaded"<<endl;
 }
 
 void OptixRenderer::setIntersectionProgram(string file, string program){
-    intersect=context->createProgramFromPTXFile(file,program);
+    programs.bind("intersection", file, program, [this](Program p){
+        intersect=p;
+        for(size_t i=0; i<meshes.size(); i++){
+            meshes[i]->getGeometry()->setIntersectionProgram(p);
+        }
+        streamer.setPrograms(bounding_box, intersect);
+    });
 }
 
 void OptixRenderer::setBoundingBoxProgram(string file, string program){
-    bounding_box=context->createProgramFromPTXFile(file,program);
+    programs.bind("bounding box", file, program, [this](Program p){
+        bounding_box=p;
+        for(size_t i=0; i<meshes.size(); i++){
+            meshes[i]->getGeometry()->setBoundingBoxProgram(p);
+        }
+        streamer.setPrograms(bounding_box, intersect);
+    });
 }
 
 void OptixRenderer::loadGeometry(){
 
     int nmeshes = scene->mNumMeshes;
+    //placeholders for the buffers of the layout a mesh does not use
+    VertexPacker::setDefaults(context, &memory);
 
+    //every buffer of every distinct mesh at once, filled on the pool
+    vector<int> unique;
+    vector<Geometry> geometries;
     for(int i=0; i<nmeshes; i++){
-
-        aiMesh * mesh = scene->mMeshes[i];
-        int nprimitive = mesh->mNumFaces;
-        int nvertex = mesh->mNumVertices;
-
+        if(flatten_scene && flat.canonical[i]!=i){
+            continue;
+        }
         Geometry optix_mesh = context->createGeometry();
-        optix_mesh->setPrimitiveCount(nprimitive);
+        optix_mesh->setPrimitiveCount(scene->mMeshes[i]->mNumFaces);
+        unique.push_back(i);
+        geometries.push_back(optix_mesh);
+    }
+    MeshUploader uploader(pool);
+    uploader.setMemoryTracker(&memory);
+    if(pack_vertices){
+        uploader.pack(context, scene, unique, geometries);
+    }
+    else{
+        uploader.upload(context, scene, unique, geometries);
+    }
+    uploader.report();
 
-        Buffer index_buffer = context->createBuffer(RT_BUFFER_INPUT,RT_FORMAT_INT3,nprimitive);
-        int *tmp_index = static_cast<int * >(index_buffer->map());
-        for(int p=0; p<nprimitive; p++){
-            memcpy(tmp_index+3*p,mesh->mFaces[p].mIndices,3*sizeof(int));
-        }
-        index_buffer->unmap();
-        index_buffer->validate();
-        optix_mesh["index_buffer"]->set(index_buffer);
-
-        Buffer vertex_buffer = context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT3, nvertex);
-        void *tmp_vertex = vertex_buffer->map();
-        memcpy(tmp_vertex, mesh->mVertices, nvertex*3*sizeof(float));
-        vertex_buffer->unmap();
-        vertex_buffer->validate();
-        optix_mesh["vertex_buffer"]->set(vertex_buffer);
-
-        Buffer normal_buffer = context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT3, nvertex);
-        void *tmp_normal = normal_buffer->map();
-        memcpy(tmp_normal, mesh->mNormals, nvertex*3*sizeof(float));
-        normal_buffer->unmap();
-        normal_buffer->validate();
-        optix_mesh["normal_buffer"]->set(normal_buffer);
-
-        Buffer tangent_buffer = context->createBuffer(RT_BUFFER_INPUT,RT_FORMAT_FLOAT3, nvertex);
-        void *tmp_tangent = tangent_buffer->map();
-        memcpy(tmp_tangent, mesh->mTangents, nvertex*3*sizeof(float));
-        tangent_buffer->unmap();
-        tangent_buffer->validate();
-        optix_mesh["tangent_buffer"]->set(tangent_buffer);
-
-        Buffer bitangent_buffer = context->createBuffer(RT_BUFFER_INPUT,RT_FORMAT_FLOAT3, nvertex);
-        void *tmp_bitangent = bitangent_buffer->map();
-        memcpy(tmp_bitangent, mesh->mBitangents, nvertex*3*sizeof(float));
-        bitangent_buffer->unmap();
-        bitangent_buffer->validate();
-        optix_mesh["bitangent_buffer"]->set(bitangent_buffer);
-
-        if(mesh->HasTextureCoords(0)){
-            Buffer texCoord_buffer = context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT2, nvertex);
-            float *tmp_texCoord = static_cast<float * >(texCoord_buffer->map());
-            for(int tc=0; tc<nvertex; tc++){
-                tmp_texCoord[2*tc] = mesh->mTextureCoords[0][tc].x;
-                tmp_texCoord[2*tc+1] = mesh->mTextureCoords[0][tc].y;
-            }
-            texCoord_buffer->unmap();
-            texCoord_buffer->validate();
-            optix_mesh["texCoord_buffer"]->set(texCoord_buffer);
-            optix_mesh["hasTexCoord"]->setInt(1);
-        }
-        else{
-            optix_mesh["texCoord_buffer"]->set(context->createBuffer(RT_BUFFER_INPUT,RT_FORMAT_FLOAT2, 1));
-            optix_mesh["hasTexCoord"]->setInt(0);
-        }
+    size_t next=0;
+    for(int i=0; i<nmeshes; i++){
 
+        //identical meshes share the instance of the first one
+        if(flatten_scene && flat.canonical[i]!=i){
+            meshes.push_back(meshes[flat.canonical[i]]);
+            continue;
+        }
 
+        aiMesh * mesh = scene->mMeshes[i];
+        Geometry optix_mesh = geometries[next++];
 
+        optix_mesh->setBoundingBoxProgram(bounding_box);
+        optix_mesh->setIntersectionProgram(intersect);
         optix_mesh->validate();
 
         GeometryInstance instance = context->createGeometryInstance();
@@ -195,21 +289,72 @@ void OptixRenderer::loadGeometry(){
     }
 }
 
+void OptixRenderer::loadStreaming(){
+    //placeholders for the buffers of the layout a mesh does not use
+    VertexPacker::setDefaults(context, &memory);
+    vector<Material> by_index(scene->mNumMaterials);
+    for(unsigned int i=0; i<scene->mNumMaterials; i++){
+        aiString mat_name;
+        aiGetMaterialString(scene->mMaterials[i], AI_MATKEY_NAME, &mat_name);
+        by_index[i]=materials[mat_name.data];
+    }
+    streamer.setBudget(stream_budget);
+    streamer.setPrograms(bounding_box, intersect);
+    if(!streamer.open(context, scene_path+scene_file, scene, IMPORT_FLAGS, by_index,
+                      [this](){ return createAccelerationMeshes(); }, createAccelerationGroups())){
+        return;
+    }
+    //the device reads everything else from the chunk file from now on
+    scene_cache.release();
+    delete stream_materials;
+    stream_materials=NULL;
+    scene=NULL;
+    memory.track(MEMORY_SCENE, "aiScene", 0);
+    context["top_object"]->set(streamer.getTop());
+}
+
 Acceleration OptixRenderer::createAccelerationMeshes(){
     Acceleration acc = context->createAcceleration("Sbvh","Bvh");
-    acc->setProperty("vertex_buffer_name","vertex_buffer");
-    acc->setProperty("vertex_buffer_stride","0");
-    acc->setProperty("index_buffer_name","index_buffer");
-    acc->setProperty("index_buffer_stride","0");
+    //the chunk accelerations of streaming go with their chunks, GeometryStreamer counts those
+    if(stream_budget==0){
+        mesh_accelerations.push_back(acc);
+    }
+    //Sbvh only reads int3 indices; packed meshes may have 16 bit ones and build from the bounding box program
+    if(!pack_vertices){
+        acc->setProperty("vertex_buffer_name","vertex_buffer");
+        acc->setProperty("vertex_buffer_stride","0");
+        acc->setProperty("index_buffer_name","index_buffer");
+        acc->setProperty("index_buffer_stride","0");
+    }
     return acc;
 }
 
 Acceleration OptixRenderer::createAccelerationGroups(){
+    //Sbvh can't refit, a moved node would rebuild every Group above it
+    if(scene_edits){
+        Acceleration acc = context->createAcceleration("Bvh","Bvh");
+        acc->setProperty("refit","1");
+        group_accelerations.push_back(acc);
+        return acc;
+    }
     Acceleration acc = context->createAcceleration("Sbvh","Bvh");
-
+    group_accelerations.push_back(acc);
     return acc;
 }
 
+//the serialized size of a built acceleration is the nearest the API has to its footprint
+void OptixRenderer::trackAccelerations(){
+    uint64_t mesh_bytes=0, group_bytes=0;
+    for(size_t i=0; i<mesh_accelerations.size(); i++){
+        mesh_bytes+=mesh_accelerations[i]->getDataSize();
+    }
+    for(size_t i=0; i<group_accelerations.size(); i++){
+        group_bytes+=group_accelerations[i]->getDataSize();
+    }
+    memory.track(MEMORY_ACCELERATION, "mesh accelerations", mesh_bytes);
+    memory.track(MEMORY_ACCELERATION, "group accelerations", group_bytes);
+}
+
 GeometryGroup OptixRenderer::loadGeometryGroup(aiNode * node){
     GeometryGroup res = context->createGeometryGroup();
     res->setChildCount(node->mNumMeshes);
@@ -222,27 +367,30 @@ GeometryGroup OptixRenderer::loadGeometryGroup(aiNode * node){
     return res;
 }
 
-Transform OptixRenderer::loadNode(aiNode *node){
+Transform OptixRenderer::loadNode(aiNode *node, int parent){
     Transform t = context->createTransform();
     GeometryGroup geom = loadGeometryGroup(node);
 
-    aiMatrix4x4 trans = node->mTransformation;
-    float mat_arr[16]={trans.a1, trans.b1, trans.c1, trans.d1,
-                       trans.a2, trans.b2, trans.c2, trans.d2,
-                       trans.a3, trans.b3, trans.c3, trans.d3,
-                       trans.a4, trans.b4, trans.c4, trans.d4};
-    Matrix4x4 mat(mat_arr);
-    Matrix4x4 mat_inv=mat.inverse();
-
-    t->setMatrix(false, mat.getData(), mat_inv.getData());
+    //aiMatrix4x4 is row major, as setMatrix expects without transposing
+    aiMatrix4x4 inverse = node->mTransformation;
+    inverse.Inverse();
+    t->setMatrix(false, &node->mTransformation.a1, &inverse.a1);
 
+    int index=-1;
+    if(scene_edits){
+        vector<int> node_meshes(node->mMeshes, node->mMeshes+node->mNumMeshes);
+        index=editor.addNode(node->mName.data, parent, t, &node->mTransformation.a1, geom, node_meshes);
+    }
 
     if(node->mNumChildren>0){
         Group child = context->createGroup();
         child->setAcceleration(createAccelerationGroups());
         child->setChildCount(node->mNumChildren+1);
         for(unsigned int i=0; i<node->mNumChildren; i++){
-            child->setChild(i, loadNode(node->mChildren[i]));
+            child->setChild(i, loadNode(node->mChildren[i], index));
+        }
+        if(scene_edits){
+            editor.setChildren(index, child);
         }
         child->setChild(node->mNumChildren, geom);
         child->validate();
@@ -257,82 +405,129 @@ Transform OptixRenderer::loadNode(aiNode *node){
 }
 
 void OptixRenderer::loadSceneGraph(){
-    top=loadNode(scene->mRootNode);
+    if(flatten_scene){
+        flat_top=loadFlatScene();
+        context["top_object"]->set(flat_top);
+        return;
+    }
+    editor.clear();
+    top=loadNode(scene->mRootNode, -1);
+    context["top_object"]->set(top);
 }
 
-TextureSampler OptixRenderer::createTextureRGBA(string file){
-
-    ILuint image=iluGenImage();
-    ilBindImage(image);
-    ilEnable(IL_ORIGIN_SET);
-    ilOriginFunc(IL_ORIGIN_LOWER_LEFT);
-    iluBuildMipmaps();
+Group OptixRenderer::loadFlatScene(){
+    vector<GeometryGroup> groups;
+    for(size_t g=0; g<flat.groups.size(); g++){
+        GeometryGroup geom = context->createGeometryGroup();
+        geom->setChildCount(flat.groups[g].size());
+        geom->setAcceleration(createAccelerationMeshes());
+        for(size_t m=0; m<flat.groups[g].size(); m++){
+            geom->setChild(m, meshes[flat.groups[g][m]]);
+        }
+        geom->validate();
+        groups.push_back(geom);
+    }
 
-    TextureSampler res=context->createTextureSampler();;
-    res->setArraySize(1);
-    res->setWrapMode(0,RT_WRAP_REPEAT);
-    res->setWrapMode(1,RT_WRAP_REPEAT);
-    res->setReadMode(RT_TEXTURE_READ_NORMALIZED_FLOAT);
-    res->setIndexingMode(RT_TEXTURE_INDEX_NORMALIZED_COORDINATES);
-    res->setMaxAnisotropy(ANISOTROPY);
-    res->setFilteringModes(RT_FILTER_LINEAR,RT_FILTER_LINEAR,RT_FILTER_NONE);
-
-    ILboolean success=ilLoadImage((ILstring) file.c_str());
-    if(success){
-        ilConvertImage(IL_RGBA,IL_UNSIGNED_BYTE);
-        std::vector<Buffer> mipmaps;
-        int nmipmap=0;
-        while(ilActiveMipmap(nmipmap)&&nmipmap<MIPMAPS){
-            int w=ilGetInteger(IL_IMAGE_WIDTH);
-            int h=ilGetInteger(IL_IMAGE_HEIGHT);
-
-            void * data= (void*)ilGetData();
-            mipmaps.push_back(context->createBuffer(RT_BUFFER_INPUT,RT_FORMAT_UNSIGNED_BYTE4,w,h));
-            void * dataMap = mipmaps[nmipmap]->map();
-            ILint size = ilGetInteger(IL_IMAGE_SIZE_OF_DATA);
-
-            memcpy(dataMap,data,size);
-            mipmaps[nmipmap]->unmap();
-            mipmaps[nmipmap]->validate();
-            nmipmap++;
-            ilBindImage(image);
-            iluBuildMipmaps();
+    Group res = context->createGroup();
+    res->setAcceleration(createAccelerationGroups());
+    res->setChildCount(flat.instances.size());
+    for(size_t i=0; i<flat.instances.size(); i++){
+        const FlatInstance &instance = flat.instances[i];
+        if(instance.identity){
+            res->setChild(i, groups[instance.group]);
+            continue;
         }
+        //aiMatrix4x4 is row major, as setMatrix expects without transposing
+        aiMatrix4x4 inverse = instance.transform;
+        inverse.Inverse();
+        Transform t = context->createTransform();
+        t->setMatrix(false, &instance.transform.a1, &inverse.a1);
+        t->setChild(groups[instance.group]);
+        t->validate();
+        res->setChild(i, t);
+    }
+    res->validate();
+    return res;
+}
 
-        res->setMipLevelCount(nmipmap);
-        for(int i=0; i<nmipmap; i++){
-            res->setBuffer(0,i,mipmaps[i]);
+TextureSampler OptixRenderer::getTexture(TextureLoader &loader, int index, TextureFormat format, int material){
+    bool rgba=format==TEXTURE_RGBA8;
+    if(index<0 || !loader.get(index).ok){
+        TextureSampler &white=rgba ? white_rgba : white_lum;
+        if(white.get()){
+            texture_hits++;
+            texture_bytes_saved+=rgba ? 4 : 1;
+        }
+        else{
+            texture_misses++;
+            white=rgba ? createTextureRGBA(NULL) : createTextureLum(NULL);
+            memory.trackSampler(white, MEMORY_PLACEHOLDER, rgba ? "white rgba" : "white lum");
         }
+        return white;
+    }
+
+    DecodedTexture &tex=loader.get(loader.resolve(index));
+    TextureKey key(tex, format);
+    map<TextureKey, TextureSampler>::iterator found=texture_cache.find(key);
+    if(found!=texture_cache.end()){
+        texture_hits++;
+        texture_bytes_saved+=TextureLoader::levelBytes(tex);
+        return found->second;
+    }
+    texture_misses++;
+    TextureSampler res=rgba ? createTextureRGBA(&tex) : createTextureLum(&tex);
+    texture_cache[key]=res;
+    memory.trackSampler(res, MEMORY_TEXTURE, tex.file+(rgba ? " rgba" : " lum"), material);
+    return res;
+}
 
+//uploads level 0 and every mip of tex, or a single white texel when there is no texture
+void OptixRenderer::setTextureLevels(TextureSampler res, DecodedTexture *tex, RTformat format, int channels){
+    if(tex && tex->ok){
+        chrono::steady_clock::time_point start=chrono::steady_clock::now();
+        int nlevels=tex->mips.size()+1;
+        res->setMipLevelCount(nlevels);
+        res->setFilteringModes(RT_FILTER_LINEAR,RT_FILTER_LINEAR,nlevels>1?RT_FILTER_LINEAR:RT_FILTER_NONE);
+        for(int l=0; l<nlevels; l++){
+            const vector<unsigned char> &level=l==0?tex->pixels:tex->mips[l-1];
+            Buffer image = context->createBuffer(RT_BUFFER_INPUT,format,MipGenerator::levelSize(tex->width,l),MipGenerator::levelSize(tex->height,l));
+            void * dataMap = image->map();
+            memcpy(dataMap,&level[0],level.size());
+            image->unmap();
+            image->validate();
+            res->setBuffer(0,l,image);
+        }
+        tex->upload_ms=chrono::duration<double, milli>(chrono::steady_clock::now()-start).count();
     }
     else{
         res->setMipLevelCount(1u);
-        Buffer white = context->createBuffer(RT_BUFFER_INPUT,RT_FORMAT_UNSIGNED_BYTE4,1,1);
+        res->setFilteringModes(RT_FILTER_LINEAR,RT_FILTER_LINEAR,RT_FILTER_NONE);
+        Buffer white = context->createBuffer(RT_BUFFER_INPUT,format,1,1);
         unsigned char * bytes = static_cast<unsigned char *>(white->map());
-        bytes[0]=255;
-        bytes[1]=255;
-        bytes[2]=255;
-        bytes[3]=255;
+        memset(bytes,255,channels);
         white->unmap();
         white->validate();
         res->setBuffer(0,0,white);
     }
+}
 
-    res->validate();
+TextureSampler OptixRenderer::createTextureRGBA(DecodedTexture *tex){
+
+    TextureSampler res=context->createTextureSampler();;
+    res->setArraySize(1);
+    res->setWrapMode(0,RT_WRAP_REPEAT);
+    res->setWrapMode(1,RT_WRAP_REPEAT);
+    res->setReadMode(RT_TEXTURE_READ_NORMALIZED_FLOAT);
+    res->setIndexingMode(RT_TEXTURE_INDEX_NORMALIZED_COORDINATES);
+    res->setMaxAnisotropy(ANISOTROPY);
+    setTextureLevels(res, tex, RT_FORMAT_UNSIGNED_BYTE4, 4);
 
-    ilBindImage(0);
-    ilDeleteImage(image);
+    res->validate();
     return res;
 }
 
-TextureSampler OptixRenderer::createTextureLum(string file)
+TextureSampler OptixRenderer::createTextureLum(DecodedTexture *tex)
 {
-    ILuint image=iluGenImage();
-    ilBindImage(image);
-    ilEnable(IL_ORIGIN_SET);
-    ilOriginFunc(IL_ORIGIN_LOWER_LEFT);
-    iluBuildMipmaps();
-
     TextureSampler res=context->createTextureSampler();
     res->setArraySize(1);
 
@@ -341,45 +536,8 @@ TextureSampler OptixRenderer::createTextureLum(string file)
     res->setReadMode(RT_TEXTURE_READ_NORMALIZED_FLOAT);
     res->setIndexingMode(RT_TEXTURE_INDEX_NORMALIZED_COORDINATES);
     res->setMaxAnisotropy(ANISOTROPY);
-    res->setFilteringModes(RT_FILTER_LINEAR,RT_FILTER_LINEAR,RT_FILTER_NONE);
-
-    ILboolean success=ilLoadImage((ILstring) file.c_str());
-    if(success){
-        ilConvertImage(IL_LUMINANCE,IL_UNSIGNED_BYTE);
-        std::vector<Buffer> mipmaps;
-        int nmipmap=0;
-        while(ilActiveMipmap(nmipmap)&&nmipmap<MIPMAPS){
-            int w=ilGetInteger(IL_IMAGE_WIDTH);
-            int h=ilGetInteger(IL_IMAGE_HEIGHT);
-            //std::cout<<w<<'x'<<h<<std::endl;
-            void * data= (void*)ilGetData();
-            mipmaps.push_back(context->createBuffer(RT_BUFFER_INPUT,RT_FORMAT_UNSIGNED_BYTE,w,h));
-            void * dataMap = mipmaps[nmipmap]->map();
-            ILint size = ilGetInteger(IL_IMAGE_SIZE_OF_DATA);
-            //std::cout<<size<<std::endl;
-            memcpy(dataMap,data,size);
-            mipmaps[nmipmap]->unmap();
-            mipmaps[nmipmap]->validate();
-            nmipmap++;
-            ilBindImage(image);
-            iluBuildMipmaps();
-        }
-        res->setMipLevelCount(nmipmap);
-        for(int i=0; i<nmipmap; i++){
-            res->setBuffer(0,i,mipmaps[i]);
-        }
-    }
-    else{
-        res->setMipLevelCount(1u);
-        Buffer white = context->createBuffer(RT_BUFFER_INPUT,RT_FORMAT_UNSIGNED_BYTE,1,1);
-        unsigned char * bytes = static_cast<unsigned char *>(white->map());
-        bytes[0]=255;
-        white->unmap();
-        white->validate();
-        res->setBuffer(0,0,white);
-    }
-    ilBindImage(0);
-    ilDeleteImage(image);
+    setTextureLevels(res, tex, RT_FORMAT_UNSIGNED_BYTE, 1);
+
     res->validate();
     return res;
 }
@@ -392,66 +550,296 @@ void OptixRenderer::setOutputSize(int w, int h){
     width=w;
     height=h;
     output->setSize(width, height);
+    if(output_format!=OUTPUT_FLOAT4){
+        display->setSize(width, height);
+    }
+    accum->setSize(width, height);
+    trackOutput();
+    frame=0;
+    tiles.setSize(width, height);
+}
+
+void OptixRenderer::trackOutput(){
+    memory.trackBuffer(output, MEMORY_OUTPUT, "output");
+    //float4 is read from output itself
+    memory.track(MEMORY_OUTPUT, "display", display.get()!=output.get() ? MemoryTracker::bufferBytes(display) : 0);
+    memory.trackBuffer(accum, MEMORY_OUTPUT, "accumulation");
+}
+
+void OptixRenderer::setOutputFormat(OutputFormat format){
+    output_format=format;
+    display=OutputConverter::bind(context, output_format, output);
+    trackOutput();
+}
+
+void OptixRenderer::setTonemap(float exposure, float white){
+    OutputConverter::setTonemap(context, exposure, white);
 }
 
 void OptixRenderer::setEntryProgram(string file, string program){
     context->setEntryPointCount(1);
-    Program entry = context->createProgramFromPTXFile(file, program);
-    context->setRayGenerationProgram(0, entry);
+    programs.bind("entry", file, program, [this](Program p){
+        context->setRayGenerationProgram(0, p);
+    });
 }
 
 void OptixRenderer::setExceptionProgram(string file, string program){
     context->setEntryPointCount(1);
-    Program e = context->createProgramFromPTXFile(file, program);
-    context->setExceptionProgram(0, e);
+    programs.bind("exception", file, program, [this](Program p){
+        context->setExceptionProgram(0, p);
+    });
+}
+
+//targets of materials and ray types, a material program replaces the default one for its material
+static string programTarget(const char *kind, const string &mat_name, int ray_type){
+    return string(kind)+" "+to_string(ray_type)+" "+mat_name;
 }
 
 void OptixRenderer::setMissProgram(int ray_type, string file, string program){
-    Program p = context->createProgramFromPTXFile(file, program);
-    context->setMissProgram(ray_type, p);
+    programs.bind("miss "+to_string(ray_type), file, program, [this, ray_type](Program p){
+        context->setMissProgram(ray_type, p);
+    });
 }
 
 void OptixRenderer::setDefaultClosestHitProgram(int ray_type, string file, string program){
-    Program p = context->createProgramFromPTXFile(file, program);
     for(map<string, Material>::iterator i=materials.begin(); i!=materials.end(); i++){
-        Material m = i->second;
-        m->setClosestHitProgram(ray_type,p);
+        setMaterialClosestHitProgram(i->first, ray_type, file, program);
     }
 }
 
 void OptixRenderer::setDefaultAnyHitProgram(int ray_type, string file, string program){
-    Program p = context->createProgramFromPTXFile(file, program);
     for(map<string, Material>::iterator i=materials.begin(); i!=materials.end(); i++){
-        Material m = i->second;
-        m->setAnyHitProgram(ray_type,p);
+        setMaterialAnyHitProgram(i->first, ray_type, file, program);
     }
 }
 
 void OptixRenderer::setMaterialClosestHitProgram(string mat_name, int ray_type, string file, string program){
     Material m = materials[mat_name];
-    Program p = context->createProgramFromPTXFile(file, program);
-    m->setClosestHitProgram(ray_type, p);
+    programs.bind(programTarget("closest hit", mat_name, ray_type), file, program, [m, ray_type](Program p){
+        m->setClosestHitProgram(ray_type, p);
+    });
 }
 
 void OptixRenderer::setMaterialAnyHitProgram(string mat_name, int ray_type, string file, string program){
     Material m = materials[mat_name];
-    Program p = context->createProgramFromPTXFile(file, program);
-    m->setAnyHitProgram(ray_type, p);
+    programs.bind(programTarget("any hit", mat_name, ray_type), file, program, [m, ray_type](Program p){
+        m->setAnyHitProgram(ray_type, p);
+    });
+}
+
+bool OptixRenderer::canEdit(){
+    if(!scene_edits){
+        cout<<"Scene edits are off, see setSceneEdits"<<endl;
+    }
+    return scene_edits;
+}
+
+int OptixRenderer::findNode(const string &name){
+    return editor.findNode(name);
+}
+
+bool OptixRenderer::setNodeTransform(int node, const float *matrix){
+    if(!canEdit() || !editor.setTransform(node, matrix)){
+        return false;
+    }
+    resetAccumulation();
+    return true;
+}
+
+bool OptixRenderer::insertMesh(int node, int mesh){
+    if(!canEdit()){
+        return false;
+    }
+    if(mesh<0 || mesh>=(int)meshes.size()){
+        cout<<"No mesh "<<mesh<<endl;
+        return false;
+    }
+    if(!editor.insertMesh(node, mesh, meshes[mesh])){
+        return false;
+    }
+    resetAccumulation();
+    return true;
+}
+
+bool OptixRenderer::removeMesh(int node, int mesh){
+    if(!canEdit() || !editor.removeMesh(node, mesh)){
+        return false;
+    }
+    resetAccumulation();
+    return true;
+}
+
+bool OptixRenderer::setMeshMaterial(int mesh, const string &mat_name){
+    if(!canEdit()){
+        return false;
+    }
+    map<string, Material>::iterator found=materials.find(mat_name);
+    if(mesh<0 || mesh>=(int)meshes.size() || found==materials.end()){
+        cout<<"No mesh "<<mesh<<" or material "<<mat_name<<endl;
+        return false;
+    }
+    editor.setMaterial(mesh, meshes[mesh], found->second);
+    resetAccumulation();
+    return true;
+}
+
+double OptixRenderer::commitEdits(){
+    return editor.commit(context);
+}
+
+SceneEditor& OptixRenderer::getSceneEditor(){
+    return editor;
+}
+
+int OptixRenderer::reloadPrograms(){
+    int set=programs.reloadChanged();
+    if(set>0){
+        resetAccumulation();
+    }
+    return set;
+}
+
+void OptixRenderer::setStreaming(uint64_t budget_bytes){
+    stream_budget=budget_bytes;
+}
+
+//false only when all eight corners of b are outside one of the planes through eye bounding the
+//view of a pinhole camera, rays eye+t*(x*U+y*V+W) with x and y in [-1,1]
+static bool inView(const ChunkBounds &b, const float *eye, const float *U, const float *V, const float *W){
+    float u2=U[0]*U[0]+U[1]*U[1]+U[2]*U[2], v2=V[0]*V[0]+V[1]*V[1]+V[2]*V[2], w2=W[0]*W[0]+W[1]*W[1]+W[2]*W[2];
+    //outward normals: a point p is inside when dot(p-eye, n)<=0 for all of them
+    float planes[5][3];
+    for(int a=0; a<3; a++){
+        planes[0][a]=U[a]/u2-W[a]/w2;
+        planes[1][a]=-U[a]/u2-W[a]/w2;
+        planes[2][a]=V[a]/v2-W[a]/w2;
+        planes[3][a]=-V[a]/v2-W[a]/w2;
+        planes[4][a]=-W[a];
+    }
+    for(int p=0; p<5; p++){
+        bool outside=true;
+        for(int c=0; outside && c<8; c++){
+            float d=((c&1 ? b.max[0] : b.min[0])-eye[0])*planes[p][0]+
+              ((c&2 ? b.max[1] : b.min[1])-eye[1])*planes[p][1]+
+              ((c&4 ? b.max[2] : b.min[2])-eye[2])*planes[p][2];
+            outside=d>0.f;
+        }
+        if(outside){
+            return false;
+        }
+    }
+    return true;
+}
+
+int OptixRenderer::updateStreaming(const float *eye, const float *U, const float *V, const float *W){
+    for(int i=0; i<streamer.getChunkCount(); i++){
+        if(inView(streamer.getChunk(i).bounds, eye, U, V, W)){
+            streamer.markVisible(i);
+        }
+    }
+    int changed=streamer.update(eye);
+    memory.track(MEMORY_GEOMETRY, "stream chunks", streamer.getResidentBytes());
+    if(changed>0){
+        resetAccumulation();
+    }
+    return changed;
+}
+
+GeometryStreamer& OptixRenderer::getStreamer(){
+    return streamer;
+}
+
+void OptixRenderer::setAnimation(int index){
+    animation_index=index;
+    if(index>=0){
+        setSceneEdits(true);
+    }
+}
+
+double OptixRenderer::updateAnimation(double seconds){
+    if(!player.hasAnimation()){
+        return -1.0;
+    }
+    player.update(seconds);
+    double ms=commitEdits();
+    player.setRefitTime(ms);
+    resetAccumulation();
+    return ms;
+}
+
+AnimationPlayer& OptixRenderer::getAnimationPlayer(){
+    return player;
+}
+
+ProgramCache& OptixRenderer::getProgramCache(){
+    return programs;
 }
 
 
 inline void OptixRenderer::run(){
+    context["frame"]->setInt(frame++);
     context->launch(0, width, height);
 }
 
+void OptixRenderer::resetAccumulation(){
+    frame=0;
+    tiles.markAllDirty();
+}
+
+int OptixRenderer::getFrameIndex(){
+    return frame;
+}
+
+void OptixRenderer::markDirty(const TileRect &rect){
+    tiles.markDirty(rect);
+}
+
+int OptixRenderer::runDirty(){
+    if(!tiles.isDirty()){
+        return 0;
+    }
+    context["frame"]->setInt(frame++);
+    return tiles.launchDirty(0);
+}
+
+void OptixRenderer::runTiles(const vector<TileRect> &rects){
+    context["frame"]->setInt(frame++);
+    tiles.launchTiles(0, rects);
+}
+
+TileLauncher& OptixRenderer::getTileLauncher(){
+    return tiles;
+}
+
 void* OptixRenderer::mapOutputBuffer(){
-    return output->map();
+    return display->map();
 }
 
 void OptixRenderer::unmapOutputBuffer(){
-    output->unmap();
+    display->unmap();
 }
 
+//the caller may change the image through the variable, so accumulation starts over
 Variable OptixRenderer::variable(const string& name){
+    frame=0;
+    tiles.markAllDirty();
     return context[name];
 }
+
+void OptixRenderer::setReleaseScene(bool enabled){
+    release_scene=enabled;
+}
+
+MemoryTracker& OptixRenderer::getMemoryTracker(){
+    return memory;
+}
+
+void OptixRenderer::reportMemory(){
+    memory.report();
+    cout<<"OptiX host memory: "<<context->getUsedHostMemory()/1024<<" KB, free device memory: "
+        <<context->getAvailableDeviceMemory(0)/1024<<" KB"<<endl;
+}
+
+Context OptixRenderer::getContext(){
+    return context;
+}
@@ -0,0 +1,305 @@
+#include "OutputConverter.h"
+
+#include <iostream>
+#include <cmath>
+#include <cstring>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "VertexPacker.h"
+
+using namespace std;
+using namespace optix;
+
+static double linearToSrgb(double l){
+    return l<=0.0031308 ? l*12.92 : 1.055*pow(l, 1.0/2.4)-0.055;
+}
+
+//NaN and negative values end up as 0, in the same order of operations as the SSE path
+static inline float tonemap(float c, float exposure, float inv_white2){
+    float x=c*exposure;
+    x=x>0.f ? x : 0.f;
+    float y=x*(1.f+x*inv_white2)/(1.f+x);
+    return y<1.f ? y : 1.f;
+}
+
+static inline float clampAlpha(float a){
+    a=a>0.f ? a : 0.f;
+    return a<1.f ? a : 1.f;
+}
+
+OutputConverter::OutputConverter()
+{
+    //ctor
+    for(int i=0; i<OUTPUT_SRGB_TABLE_SIZE; i++){
+        encode[i]=(uint8_t)floor(linearToSrgb(i/double(OUTPUT_SRGB_TABLE_SIZE-1))*255.0+0.5);
+    }
+}
+
+OutputConverter::~OutputConverter()
+{
+    //dtor
+}
+
+size_t OutputConverter::pixelSize(OutputFormat format){
+    switch(format){
+    case OUTPUT_RGBA8:
+    case OUTPUT_RGB10A2:
+        return 4;
+    case OUTPUT_HALF4:
+        return 8;
+    default:
+        return 16;
+    }
+}
+
+const char* OutputConverter::name(OutputFormat format){
+    switch(format){
+    case OUTPUT_RGBA8:
+        return "RGBA8 sRGB";
+    case OUTPUT_RGB10A2:
+        return "RGB10A2";
+    case OUTPUT_HALF4:
+        return "half4";
+    default:
+        return "float4";
+    }
+}
+
+Buffer OutputConverter::bind(Context context, OutputFormat format, Buffer output0){
+    RTsize w, h;
+    output0->getSize(w, h);
+    bool packed_format=format==OUTPUT_RGBA8 || format==OUTPUT_RGB10A2;
+    Buffer packed=context->createBuffer(RT_BUFFER_OUTPUT, RT_FORMAT_UNSIGNED_INT, packed_format ? w : 1, packed_format ? h : 1);
+    Buffer half=context->createBuffer(RT_BUFFER_OUTPUT, RT_FORMAT_UNSIGNED_SHORT4, format==OUTPUT_HALF4 ? w : 1, format==OUTPUT_HALF4 ? h : 1);
+    context["output0"]->set(output0);
+    context["output_packed"]->set(packed);
+    context["output_half"]->set(half);
+    context["outputFormat"]->setInt(format);
+    if(packed_format){
+        return packed;
+    }
+    return format==OUTPUT_HALF4 ? half : output0;
+}
+
+void OutputConverter::setTonemap(Context context, float exposure, float white){
+    context["exposure"]->setFloat(exposure);
+    context["whitePoint"]->setFloat(white);
+}
+
+void OutputConverter::convertPixel(const float *rgba, void *dst, OutputFormat format, float exposure, float inv_white2){
+    if(format==OUTPUT_RGBA8){
+        uint32_t r=encode[(int)(tonemap(rgba[0], exposure, inv_white2)*(OUTPUT_SRGB_TABLE_SIZE-1)+0.5f)];
+        uint32_t g=encode[(int)(tonemap(rgba[1], exposure, inv_white2)*(OUTPUT_SRGB_TABLE_SIZE-1)+0.5f)];
+        uint32_t b=encode[(int)(tonemap(rgba[2], exposure, inv_white2)*(OUTPUT_SRGB_TABLE_SIZE-1)+0.5f)];
+        uint32_t a=(uint32_t)(clampAlpha(rgba[3])*255.f+0.5f);
+        *static_cast<uint32_t*>(dst)=r|(g<<8)|(b<<16)|(a<<24);
+    }
+    else if(format==OUTPUT_RGB10A2){
+        uint32_t r=(uint32_t)(tonemap(rgba[0], exposure, inv_white2)*1023.f+0.5f);
+        uint32_t g=(uint32_t)(tonemap(rgba[1], exposure, inv_white2)*1023.f+0.5f);
+        uint32_t b=(uint32_t)(tonemap(rgba[2], exposure, inv_white2)*1023.f+0.5f);
+        uint32_t a=(uint32_t)(clampAlpha(rgba[3])*3.f+0.5f);
+        *static_cast<uint32_t*>(dst)=r|(g<<10)|(b<<20)|(a<<30);
+    }
+    else if(format==OUTPUT_HALF4){
+        uint16_t *h=static_cast<uint16_t*>(dst);
+        h[0]=VertexPacker::floatToHalf(rgba[0]*exposure);
+        h[1]=VertexPacker::floatToHalf(rgba[1]*exposure);
+        h[2]=VertexPacker::floatToHalf(rgba[2]*exposure);
+        h[3]=VertexPacker::floatToHalf(rgba[3]);
+    }
+    else{
+        memcpy(dst, rgba, 16);
+    }
+}
+
+void OutputConverter::convertScalar(const float *rgba, void *dst, size_t count, OutputFormat format, float exposure, float white){
+    float inv_white2=1.f/(white*white);
+    size_t bytes=pixelSize(format);
+    for(size_t i=0; i<count; i++){
+        convertPixel(rgba+4*i, static_cast<uint8_t*>(dst)+i*bytes, format, exposure, inv_white2);
+    }
+}
+
+#if defined(__SSE2__)
+//round to nearest even like VertexPacker::floatToHalf, after ryg's float_to_half_fast3_rtne;
+//the halves are in the low 16 bits of each lane
+static inline __m128i floatToHalf4(__m128 f){
+    const __m128i f16max=_mm_set1_epi32((127+16)<<23);
+    const __m128i min_normal=_mm_set1_epi32((127-14)<<23);
+    const __m128i subnorm_magic=_mm_set1_epi32(((127-15)+(23-10)+1)<<23);
+    const __m128i normal_bias=_mm_set1_epi32(0xfff-((127-15)<<23));
+
+    __m128 sign=_mm_and_ps(_mm_castsi128_ps(_mm_set1_epi32(0x80000000)), f);
+    __m128 absf=_mm_xor_ps(f, sign);
+    __m128i absi=_mm_castps_si128(absf);
+    __m128i nan=_mm_castps_si128(_mm_cmpunord_ps(absf, absf));
+    __m128i regular=_mm_cmpgt_epi32(f16max, absi);
+    __m128i special=_mm_or_si128(_mm_and_si128(nan, _mm_set1_epi32(0x200)), _mm_set1_epi32(0x7c00));
+
+    //subnormal results round through a float add, normal ones with a bias and the odd bit
+    __m128i subnormal=_mm_cmpgt_epi32(min_normal, absi);
+    __m128i sub=_mm_sub_epi32(_mm_castps_si128(_mm_add_ps(absf, _mm_castsi128_ps(subnorm_magic))), subnorm_magic);
+    __m128i odd=_mm_srai_epi32(_mm_slli_epi32(absi, 31-13), 31);
+    __m128i normal=_mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(absi, normal_bias), odd), 13);
+
+    __m128i finite=_mm_or_si128(_mm_and_si128(subnormal, sub), _mm_andnot_si128(subnormal, normal));
+    __m128i joined=_mm_or_si128(_mm_and_si128(regular, finite), _mm_andnot_si128(regular, special));
+    return _mm_or_si128(joined, _mm_srli_epi32(_mm_castps_si128(sign), 16));
+}
+
+static inline __m128 tonemap4(__m128 c, __m128 exposure, __m128 inv_white2){
+    const __m128 one=_mm_set1_ps(1.f);
+    __m128 x=_mm_max_ps(_mm_mul_ps(c, exposure), _mm_setzero_ps());
+    __m128 y=_mm_div_ps(_mm_mul_ps(x, _mm_add_ps(one, _mm_mul_ps(x, inv_white2))), _mm_add_ps(one, x));
+    return _mm_min_ps(y, one);
+}
+
+static inline __m128i quantize4(__m128 v, float scale){
+    return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(scale)), _mm_set1_ps(0.5f)));
+}
+#endif
+
+//four pixels are transposed to one register per channel, so tonemap and packing run on whole registers
+void OutputConverter::convert(const float *rgba, void *dst, size_t count, OutputFormat format, float exposure, float white){
+    float inv_white2=1.f/(white*white);
+    size_t i=0;
+    if(format==OUTPUT_FLOAT4){
+        memcpy(dst, rgba, count*16);
+        return;
+    }
+#if defined(__SSE2__)
+    if(format==OUTPUT_HALF4){
+        __m128 scale=_mm_setr_ps(exposure, exposure, exposure, 1.f);
+        uint16_t *out=static_cast<uint16_t*>(dst);
+        for(; i+2<=count; i+=2){
+            __m128i h0=floatToHalf4(_mm_mul_ps(_mm_loadu_ps(rgba+4*i), scale));
+            __m128i h1=floatToHalf4(_mm_mul_ps(_mm_loadu_ps(rgba+4*i+4), scale));
+            //sign extended, so the saturating pack keeps the bits
+            h0=_mm_srai_epi32(_mm_slli_epi32(h0, 16), 16);
+            h1=_mm_srai_epi32(_mm_slli_epi32(h1, 16), 16);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out+4*i), _mm_packs_epi32(h0, h1));
+        }
+    }
+    else{
+        __m128 e=_mm_set1_ps(exposure);
+        __m128 w=_mm_set1_ps(inv_white2);
+        uint32_t *out=static_cast<uint32_t*>(dst);
+        for(; i+4<=count; i+=4){
+            __m128 r=_mm_loadu_ps(rgba+4*i);
+            __m128 g=_mm_loadu_ps(rgba+4*i+4);
+            __m128 b=_mm_loadu_ps(rgba+4*i+8);
+            __m128 a=_mm_loadu_ps(rgba+4*i+12);
+            _MM_TRANSPOSE4_PS(r, g, b, a);
+            r=tonemap4(r, e, w);
+            g=tonemap4(g, e, w);
+            b=tonemap4(b, e, w);
+            a=_mm_min_ps(_mm_max_ps(a, _mm_setzero_ps()), _mm_set1_ps(1.f));
+            if(format==OUTPUT_RGB10A2){
+                __m128i packed=_mm_or_si128(_mm_or_si128(quantize4(r, 1023.f), _mm_slli_epi32(quantize4(g, 1023.f), 10)),
+                                            _mm_or_si128(_mm_slli_epi32(quantize4(b, 1023.f), 20), _mm_slli_epi32(quantize4(a, 3.f), 30)));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out+i), packed);
+            }
+            else{
+                //the sRGB table has no gather before AVX2
+                int32_t ri[4], gi[4], bi[4];
+                uint32_t ai[4];
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(ri), quantize4(r, OUTPUT_SRGB_TABLE_SIZE-1));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(gi), quantize4(g, OUTPUT_SRGB_TABLE_SIZE-1));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(bi), quantize4(b, OUTPUT_SRGB_TABLE_SIZE-1));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(ai), _mm_slli_epi32(quantize4(a, 255.f), 24));
+                for(int k=0; k<4; k++){
+                    out[i+k]=encode[ri[k]]|(encode[gi[k]]<<8)|(encode[bi[k]]<<16)|ai[k];
+                }
+            }
+        }
+    }
+#endif
+    size_t bytes=pixelSize(format);
+    for(; i<count; i++){
+        convertPixel(rgba+4*i, static_cast<uint8_t*>(dst)+i*bytes, format, exposure, inv_white2);
+    }
+}
+
+bool OutputConverter::benchmark(int width, int height, int repeats){
+#if defined(__SSE2__)
+    const char *simd="SSE2";
+#else
+    const char *simd="none";
+#endif
+    size_t count=(size_t)width*height;
+    const float exposure=1.f, white=4.f;
+
+    //gradients up to 4 with noise, a few negative, NaN and infinite values
+    vector<float> image(4*count);
+    unsigned int seed=12345u;
+    for(size_t p=0; p<count; p++){
+        int x=p%width, y=p/width;
+        for(int c=0; c<4; c++){
+            seed=seed*1664525u+1013904223u;
+            float v=4.f*(x+c*y)/float(width+c*height)+(seed>>20)/4096.f-0.05f;
+            image[4*p+c]=c==3 ? v*0.5f : v;
+        }
+        if(p%9973==0){
+            image[4*p]=NAN;
+            image[4*p+1]=INFINITY;
+            image[4*p+2]=-INFINITY;
+        }
+    }
+
+    bool pass=true;
+    OutputFormat formats[3]={OUTPUT_RGBA8, OUTPUT_RGB10A2, OUTPUT_HALF4};
+    for(int f=0; f<3; f++){
+        OutputFormat format=formats[f];
+        size_t bytes=pixelSize(format);
+        vector<uint8_t> scalar(count*bytes), fast(count*bytes);
+
+        double scalar_ms=0.0, fast_ms=0.0;
+        for(int r=0; r<repeats; r++){
+            chrono::steady_clock::time_point start=chrono::steady_clock::now();
+            convertScalar(&image[0], &scalar[0], count, format, exposure, white);
+            scalar_ms+=chrono::duration<double, milli>(chrono::steady_clock::now()-start).count();
+
+            start=chrono::steady_clock::now();
+            convert(&image[0], &fast[0], count, format, exposure, white);
+            fast_ms+=chrono::duration<double, milli>(chrono::steady_clock::now()-start).count();
+        }
+
+        size_t differ=0;
+        for(size_t p=0; p<count; p++){
+            differ+=memcmp(&scalar[p*bytes], &fast[p*bytes], bytes)!=0;
+        }
+        //the 12 bit table against an exact encode of the same tonemap
+        int diff_exact=0;
+        if(format==OUTPUT_RGBA8){
+            for(size_t p=0; p<count; p++){
+                for(int c=0; c<3; c++){
+                    double x=max(double(image[4*p+c])*exposure, 0.0);
+                    double t=isnan(x) ? 0.0 : (isinf(x) ? 1.0 : min(x*(1.0+x/(white*white))/(1.0+x), 1.0));
+                    int exact=(int)floor(linearToSrgb(t)*255.0+0.5);
+                    diff_exact=max(diff_exact, abs(exact-(int)fast[p*4+c]));
+                }
+            }
+        }
+        pass=pass && differ==0 && diff_exact<=1;
+
+        double mpix=count/1e6;
+        cout<<"Output conversion "<<name(format)<<' '<<width<<'x'<<height<<": scalar "<<scalar_ms/repeats<<" ms ("
+            <<mpix*repeats/(scalar_ms/1000.0)<<" MPix/s), "<<simd<<' '<<fast_ms/repeats<<" ms ("<<mpix*repeats/(fast_ms/1000.0)
+            <<" MPix/s, "<<count*16*repeats/(fast_ms/1000.0)/1e9<<" GB/s read), "<<scalar_ms/fast_ms<<"x"<<endl;
+        cout<<"  "<<bytes<<" bytes per pixel instead of 16, "<<count*bytes/1e6<<" MB instead of "<<count*16/1e6
+            <<" MB per frame; "<<differ<<" pixels differ from scalar";
+        if(format==OUTPUT_RGBA8){
+            cout<<", max difference to exact "<<diff_exact;
+        }
+        cout<<endl;
+    }
+    cout<<"Output conversion check "<<(pass ? "passed" : "FAILED")<<endl;
+    return pass;
+}
@@ -0,0 +1,171 @@
+#include "ProgramCache.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include <sys/stat.h>
+
+#include "Hash.h"
+
+using namespace std;
+using namespace optix;
+
+ProgramCache::ProgramCache() : hits(0), misses(0), file_reads(0), reloads(0)
+{
+    //ctor
+}
+
+ProgramCache::~ProgramCache()
+{
+    //dtor
+}
+
+void ProgramCache::init(Context c){
+    context=c;
+    files.clear();
+    programs.clear();
+    bindings.clear();
+    hits=misses=file_reads=reloads=0;
+}
+
+bool ProgramCache::readFile(const string &file, PtxFile &f){
+    struct stat st;
+    if(stat(file.c_str(), &st)!=0){
+        return false;
+    }
+    ifstream in(file.c_str(), ios::binary);
+    if(in.fail()){
+        return false;
+    }
+    stringstream text;
+    text<<in.rdbuf();
+    f.ptx=text.str();
+    f.mtime=st.st_mtime;
+    f.size=st.st_size;
+    f.hash=hashBytes(f.ptx.data(), f.ptx.size());
+    file_reads++;
+    return true;
+}
+
+ProgramCache::PtxFile* ProgramCache::findFile(const string &file){
+    map<string, PtxFile>::iterator i=files.find(file);
+    if(i!=files.end()){
+        return &i->second;
+    }
+    PtxFile f;
+    if(!readFile(file, f)){
+        return NULL;
+    }
+    return &(files[file]=f);
+}
+
+Program ProgramCache::get(const string &file, const string &program){
+    pair<string, string> key(file, program);
+    map<pair<string, string>, Program>::iterator i=programs.find(key);
+    if(i!=programs.end()){
+        hits++;
+        return i->second;
+    }
+    misses++;
+    PtxFile *f=findFile(file);
+    if(!f){
+        //not cached, OptiX reports the missing file as before
+        return context->createProgramFromPTXFile(file, program);
+    }
+    Program p=context->createProgramFromPTXString(f->ptx, program);
+    programs[key]=p;
+    return p;
+}
+
+Program ProgramCache::bind(const string &target, const string &file, const string &program, Setter setter){
+    Program p=get(file, program);
+    setter(p);
+    Binding &b=bindings[target];
+    b.file=file;
+    b.program=program;
+    b.setter=setter;
+    return p;
+}
+
+int ProgramCache::reloadChanged(){
+    int set=0;
+    for(map<string, PtxFile>::iterator i=files.begin(); i!=files.end(); i++){
+        const string &file=i->first;
+        PtxFile &old=i->second;
+        struct stat st;
+        if(stat(file.c_str(), &st)!=0 || (st.st_mtime==old.mtime && st.st_size==old.size)){
+            continue;
+        }
+        PtxFile f;
+        if(!readFile(file, f)){
+            cout<<"Cannot reload "<<file<<endl;
+            continue;
+        }
+        if(f.hash==old.hash && f.ptx==old.ptx){
+            //touched but the same, no need to compile again
+            old.mtime=f.mtime;
+            old.size=f.size;
+            continue;
+        }
+        //every program of the file is created from the new contents before anything is replaced, a
+        //PTX that does not compile leaves the old contents and programs as they were
+        map<string, Program> fresh;
+        for(map<pair<string, string>, Program>::iterator p=programs.begin(); p!=programs.end(); p++){
+            if(p->first.first==file){
+                fresh[p->first.second]=Program();
+            }
+        }
+        for(map<string, Binding>::iterator b=bindings.begin(); b!=bindings.end(); b++){
+            if(b->second.file==file){
+                fresh[b->second.program]=Program();
+            }
+        }
+        try{
+            for(map<string, Program>::iterator p=fresh.begin(); p!=fresh.end(); p++){
+                p->second=context->createProgramFromPTXString(f.ptx, p->first);
+            }
+        }
+        catch(const Exception &e){
+            cout<<"Cannot reload "<<file<<", keeping the old programs: "<<e.getErrorString()<<endl;
+            continue;
+        }
+        old=f;
+        //programs of the old contents that are not bound stay with whoever got them
+        for(map<pair<string, string>, Program>::iterator p=programs.begin(); p!=programs.end();){
+            if(p->first.first==file){
+                programs.erase(p++);
+            }
+            else{
+                p++;
+            }
+        }
+        for(map<string, Program>::iterator p=fresh.begin(); p!=fresh.end(); p++){
+            programs[make_pair(file, p->first)]=p->second;
+        }
+        int file_set=0;
+        for(map<string, Binding>::iterator b=bindings.begin(); b!=bindings.end(); b++){
+            if(b->second.file==file){
+                b->second.setter(fresh[b->second.program]);
+                file_set++;
+            }
+        }
+        reloads++;
+        set+=file_set;
+        cout<<"Reloaded "<<file<<", "<<file_set<<" programs set again"<<endl;
+    }
+    return set;
+}
+
+int ProgramCache::getHits(){
+    return hits;
+}
+
+int ProgramCache::getMisses(){
+    return misses;
+}
+
+void ProgramCache::report(){
+    cout<<"Program cache: "<<hits<<" hits, "<<misses<<" misses, "<<programs.size()<<" programs from "
+        <<file_reads<<" PTX reads, "<<reloads<<" reloads"<<endl;
+}
@@ -0,0 +1,132 @@
+#include "RenderClient.h"
+
+#include <iostream>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+#include <unistd.h>
+
+//eye movement per camera update of runTest, along V
+#define CLIENT_STEP 0.05f
+
+using namespace std;
+using namespace optix;
+
+static double elapsedMs(chrono::steady_clock::time_point start){
+    return chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+}
+
+RenderClient::RenderClient() : fd(-1), last(), payload()
+{
+    //ctor
+}
+
+RenderClient::~RenderClient()
+{
+    //dtor
+    if(fd>=0){
+        close(fd);
+    }
+}
+
+bool RenderClient::connect(const string &address){
+    fd=RenderServer::connectTo(address);
+    return fd>=0;
+}
+
+bool RenderClient::setEncoding(FrameEncoding encoding, int quality){
+    uint32_t values[2]={(uint32_t)encoding, (uint32_t)quality};
+    return RenderServer::sendMessage(fd, MSG_ENCODING, values, sizeof(values));
+}
+
+bool RenderClient::resize(int width, int height){
+    uint32_t values[2]={(uint32_t)width, (uint32_t)height};
+    return RenderServer::sendMessage(fd, MSG_RESIZE, values, sizeof(values));
+}
+
+bool RenderClient::sendCamera(uint32_t id, const ServerCamera &camera){
+    float values[12]={camera.eye.x, camera.eye.y, camera.eye.z, camera.U.x, camera.U.y, camera.U.z,
+                      camera.V.x, camera.V.y, camera.V.z, camera.W.x, camera.W.y, camera.W.z};
+    return RenderServer::sendMessage(fd, MSG_CAMERA, &id, sizeof(id), values, sizeof(values));
+}
+
+bool RenderClient::shutdownServer(){
+    return RenderServer::sendMessage(fd, MSG_SHUTDOWN, NULL, 0);
+}
+
+bool RenderClient::receiveFrame(FrameHeader &header, vector<unsigned char> &rgba){
+    uint32_t type;
+    if(!RenderServer::receiveMessage(fd, type, payload)){
+        cout<<"Connection to the render server closed"<<endl;
+        return false;
+    }
+    if(type!=MSG_FRAME || payload.size()<sizeof(header)){
+        cout<<"Unexpected message of type "<<type<<" from the render server"<<endl;
+        return false;
+    }
+    memcpy(&header, &payload[0], sizeof(header));
+    if(header.key){
+        last.clear();
+    }
+    if(!FrameCodec::decode((FrameEncoding)header.encoding, &payload[0]+sizeof(header), payload.size()-sizeof(header), header.width, header.height, last)){
+        cout<<"Cannot decode a "<<header.width<<'x'<<header.height<<" frame as "<<FrameCodec::name((FrameEncoding)header.encoding)<<endl;
+        return false;
+    }
+    rgba=last;
+    return true;
+}
+
+bool RenderClient::runTest(const ServerCamera &start, int frames, FrameEncoding encoding, int width, int height){
+    if(!setEncoding(encoding) || !resize(width, height)){
+        return false;
+    }
+    vector<chrono::steady_clock::time_point> sent(1);
+    FrameHeader header;
+    vector<unsigned char> rgba;
+    uint32_t id=0, first_unanswered=1;
+    int received=0;
+    long long bytes=0;
+    double latency_sum=0.0, latency_max=0.0, render_sum=0.0, encode_sum=0.0;
+
+    for(int i=0; i<frames; i++){
+        //every fourth frame three updates at once, the server renders only the last
+        int burst=i%4==3 ? 3 : 1;
+        for(int b=0; b<burst; b++){
+            id++;
+            ServerCamera camera=start;
+            camera.eye=start.eye+start.V*(CLIENT_STEP*id);
+            sent.push_back(chrono::steady_clock::now());
+            if(!sendCamera(id, camera)){
+                return false;
+            }
+        }
+        //frames for older views and the default size may still be on the way
+        do{
+            if(!receiveFrame(header, rgba)){
+                return false;
+            }
+            if(header.camera_id==id && ((int)header.width!=width || (int)header.height!=height)){
+                cout<<"Got a "<<header.width<<'x'<<header.height<<" frame instead of "<<width<<'x'<<height<<endl;
+                return false;
+            }
+            received++;
+            bytes+=payload.size();
+            render_sum+=header.render_ms;
+            encode_sum+=header.encode_ms;
+        }while(header.camera_id!=id);
+
+        double latency=elapsedMs(sent[first_unanswered]);
+        latency_sum+=latency;
+        latency_max=max(latency_max, latency);
+        first_unanswered=id+1;
+    }
+
+    cout<<"Render client: "<<id<<" camera updates, "<<received<<" frames as "<<FrameCodec::name(encoding)<<", "
+        <<(received>0 ? bytes/received : 0)<<" bytes per frame ("<<100.0*bytes/max(4LL*width*height*received, 1LL)<<"% of raw)"<<endl;
+    if(frames>0){
+        cout<<"    latency "<<latency_sum/frames<<" ms mean, "<<latency_max<<" ms max; server render "<<render_sum/max(received, 1)
+            <<" ms, encode "<<encode_sum/max(received, 1)<<" ms per frame"<<endl;
+    }
+    return true;
+}
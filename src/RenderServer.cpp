@@ -0,0 +1,439 @@
+#include "RenderServer.h"
+
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <algorithm>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+using namespace std;
+
+//small camera updates and frame tails must not wait for more data to coalesce
+static void setNoDelay(int fd){
+    int on=1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+
+static double elapsedMs(chrono::steady_clock::time_point start){
+    return chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+}
+
+//fills a sockaddr for unix:<path> or tcp:<port>; returns its size, 0 for a bad address
+static socklen_t parseAddress(const string &address, sockaddr_storage &storage){
+    memset(&storage, 0, sizeof(storage));
+    if(address.compare(0, 5, "unix:")==0){
+        string path=address.substr(5);
+        sockaddr_un *un=reinterpret_cast<sockaddr_un*>(&storage);
+        if(path.empty() || path.size()>=sizeof(un->sun_path)){
+            return 0;
+        }
+        un->sun_family=AF_UNIX;
+        strcpy(un->sun_path, path.c_str());
+        return sizeof(sockaddr_un);
+    }
+    if(address.compare(0, 4, "tcp:")==0){
+        int port=atoi(address.c_str()+4);
+        if(port<=0 || port>65535){
+            return 0;
+        }
+        sockaddr_in *in=reinterpret_cast<sockaddr_in*>(&storage);
+        in->sin_family=AF_INET;
+        in->sin_port=htons(port);
+        in->sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+        return sizeof(sockaddr_in);
+    }
+    return 0;
+}
+
+RenderServer::RenderServer() : listener(-1), clients(), default_width(720), default_height(720), next_id(0), stopping(false)
+{
+    //ctor
+    memset(&default_camera, 0, sizeof(default_camera));
+}
+
+RenderServer::~RenderServer()
+{
+    //dtor
+    for(size_t i=0; i<clients.size(); i++){
+        close(clients[i].fd);
+    }
+    if(listener>=0){
+        close(listener);
+    }
+    if(!unix_path.empty()){
+        unlink(unix_path.c_str());
+    }
+}
+
+bool RenderServer::listen(const string &address){
+    sockaddr_storage storage;
+    socklen_t size=parseAddress(address, storage);
+    if(size==0){
+        cout<<"Bad server address "<<address<<", expected unix:<path> or tcp:<port>"<<endl;
+        return false;
+    }
+    listener=socket(storage.ss_family, SOCK_STREAM, 0);
+    if(storage.ss_family==AF_UNIX){
+        //a socket file left behind by a server that did not exit cleanly
+        unix_path=reinterpret_cast<sockaddr_un*>(&storage)->sun_path;
+        unlink(unix_path.c_str());
+    }
+    else{
+        int on=1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    }
+    if(listener<0 || bind(listener, reinterpret_cast<sockaddr*>(&storage), size)<0 || ::listen(listener, 8)<0){
+        cout<<"Cannot listen on "<<address<<": "<<strerror(errno)<<endl;
+        return false;
+    }
+    fcntl(listener, F_SETFL, O_NONBLOCK);
+    cout<<"Render server listening on "<<address<<endl;
+    return true;
+}
+
+void RenderServer::setDefaults(const ServerCamera &camera, int width, int height){
+    default_camera=camera;
+    default_width=width;
+    default_height=height;
+}
+
+int RenderServer::connectTo(const string &address){
+    sockaddr_storage storage;
+    socklen_t size=parseAddress(address, storage);
+    if(size==0){
+        cout<<"Bad server address "<<address<<", expected unix:<path> or tcp:<port>"<<endl;
+        return -1;
+    }
+    int fd=socket(storage.ss_family, SOCK_STREAM, 0);
+    if(fd<0 || connect(fd, reinterpret_cast<sockaddr*>(&storage), size)<0){
+        cout<<"Cannot connect to "<<address<<": "<<strerror(errno)<<endl;
+        if(fd>=0){
+            close(fd);
+        }
+        return -1;
+    }
+    if(storage.ss_family==AF_INET){
+        setNoDelay(fd);
+    }
+    return fd;
+}
+
+//waits for room in the socket buffer instead of failing on non-blocking sockets, but no longer
+//than SERVER_SEND_TIMEOUT_MS at a time; the stream is cut mid message then, so the caller drops it
+static bool sendAll(int fd, const void *data, size_t size){
+    const char *p=static_cast<const char*>(data);
+    while(size>0){
+        ssize_t n=send(fd, p, size, MSG_NOSIGNAL);
+        if(n<0){
+            if(errno==EAGAIN || errno==EWOULDBLOCK){
+                pollfd pfd={fd, POLLOUT, 0};
+                int ready=poll(&pfd, 1, SERVER_SEND_TIMEOUT_MS);
+                if(ready==0){
+                    cout<<"Send timed out after "<<SERVER_SEND_TIMEOUT_MS<<" ms"<<endl;
+                    return false;
+                }
+                if(ready<0 && errno!=EINTR){
+                    return false;
+                }
+                continue;
+            }
+            if(errno==EINTR){
+                continue;
+            }
+            return false;
+        }
+        p+=n;
+        size-=n;
+    }
+    return true;
+}
+
+bool RenderServer::sendMessage(int fd, uint32_t type, const void *a, size_t a_size, const void *b, size_t b_size){
+    uint32_t header[2]={type, (uint32_t)(a_size+b_size)};
+    return sendAll(fd, header, sizeof(header)) && (a_size==0 || sendAll(fd, a, a_size)) && (b_size==0 || sendAll(fd, b, b_size));
+}
+
+static bool receiveAll(int fd, void *data, size_t size){
+    char *p=static_cast<char*>(data);
+    while(size>0){
+        ssize_t n=recv(fd, p, size, 0);
+        if(n<0 && errno==EINTR){
+            continue;
+        }
+        if(n<=0){
+            return false;
+        }
+        p+=n;
+        size-=n;
+    }
+    return true;
+}
+
+bool RenderServer::receiveMessage(int fd, uint32_t &type, vector<unsigned char> &payload){
+    uint32_t header[2];
+    if(!receiveAll(fd, header, sizeof(header))){
+        return false;
+    }
+    type=header[0];
+    if(header[1]>SERVER_MAX_PAYLOAD){
+        cout<<"Message of type "<<type<<" with "<<header[1]<<" bytes is too large"<<endl;
+        return false;
+    }
+    payload.resize(header[1]);
+    return header[1]==0 || receiveAll(fd, &payload[0], header[1]);
+}
+
+void RenderServer::acceptClient(){
+    int fd;
+    while((fd=accept(listener, NULL, NULL))>=0){
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        if(unix_path.empty()){
+            setNoDelay(fd);
+        }
+        Client c;
+        c.fd=fd;
+        c.id=next_id++;
+        c.camera=default_camera;
+        c.camera_id=0;
+        c.width=default_width;
+        c.height=default_height;
+        c.encoding=FRAME_DELTA;
+        c.quality=FRAME_JPEG_QUALITY;
+        c.frames=c.updates=c.merged=0;
+        c.bytes=c.raw_bytes=0;
+        c.latency_sum=c.latency_max=c.render_sum=c.encode_sum=0.0;
+        //the first frame is owed right away
+        c.dirty=false;
+        markDirty(c);
+        clients.push_back(c);
+        cout<<"Client "<<c.id<<" connected"<<endl;
+    }
+}
+
+void RenderServer::markDirty(Client &c){
+    if(!c.dirty){
+        c.dirty=true;
+        c.pending_since=chrono::steady_clock::now();
+    }
+}
+
+bool RenderServer::handle(Client &c, uint32_t type, const unsigned char *payload, uint32_t size){
+    uint32_t values[2];
+    switch(type){
+    case MSG_CAMERA:
+        if(size!=sizeof(uint32_t)+12*sizeof(float)){
+            break;
+        }
+        c.updates++;
+        //several updates before the next frame: only the newest is rendered
+        if(c.dirty){
+            c.merged++;
+        }
+        memcpy(&c.camera_id, payload, sizeof(uint32_t));
+        memcpy(&c.camera.eye, payload+4, sizeof(float3));
+        memcpy(&c.camera.U, payload+16, sizeof(float3));
+        memcpy(&c.camera.V, payload+28, sizeof(float3));
+        memcpy(&c.camera.W, payload+40, sizeof(float3));
+        markDirty(c);
+        return true;
+    case MSG_RESIZE:
+        if(size!=sizeof(values)){
+            break;
+        }
+        memcpy(values, payload, sizeof(values));
+        if(values[0]<1 || values[1]<1 || values[0]>SERVER_MAX_SIZE || values[1]>SERVER_MAX_SIZE){
+            break;
+        }
+        c.width=values[0];
+        c.height=values[1];
+        markDirty(c);
+        return true;
+    case MSG_ENCODING:
+        if(size!=sizeof(values)){
+            break;
+        }
+        memcpy(values, payload, sizeof(values));
+        if(values[0]>=FRAME_ENCODING_COUNT){
+            break;
+        }
+        c.encoding=(FrameEncoding)values[0];
+        c.quality=min(max((int)values[1], 1), 100);
+        return true;
+    case MSG_SHUTDOWN:
+        cout<<"Client "<<c.id<<" stops the server"<<endl;
+        stopping=true;
+        return true;
+    }
+    cout<<"Client "<<c.id<<" sent a bad message of type "<<type<<" and "<<size<<" bytes"<<endl;
+    return false;
+}
+
+bool RenderServer::receive(Client &c){
+    unsigned char buffer[4096];
+    while(true){
+        ssize_t n=recv(c.fd, buffer, sizeof(buffer), 0);
+        if(n>0){
+            c.inbox.insert(c.inbox.end(), buffer, buffer+n);
+            continue;
+        }
+        if(n<0 && (errno==EAGAIN || errno==EWOULDBLOCK)){
+            break;
+        }
+        if(n<0 && errno==EINTR){
+            continue;
+        }
+        //closed by the client
+        return false;
+    }
+
+    size_t pos=0;
+    while(c.inbox.size()-pos>=2*sizeof(uint32_t)){
+        uint32_t header[2];
+        memcpy(header, &c.inbox[pos], sizeof(header));
+        //checked before waiting for the payload, so a bad size cannot make the inbox grow
+        if(header[1]>SERVER_MAX_REQUEST){
+            cout<<"Client "<<c.id<<" sent a message of type "<<header[0]<<" with "<<header[1]<<" bytes, more than "
+                <<SERVER_MAX_REQUEST<<endl;
+            return false;
+        }
+        if(c.inbox.size()-pos-sizeof(header)<header[1]){
+            break;
+        }
+        if(!handle(c, header[0], &c.inbox[pos+sizeof(header)], header[1])){
+            return false;
+        }
+        pos+=sizeof(header)+header[1];
+    }
+    c.inbox.erase(c.inbox.begin(), c.inbox.begin()+pos);
+    return true;
+}
+
+bool RenderServer::serve(Client &c, RenderFunction &render){
+    FrameHeader header;
+    header.camera_id=c.camera_id;
+    header.width=c.width;
+    header.height=c.height;
+    header.encoding=c.encoding;
+
+    chrono::steady_clock::time_point start=chrono::steady_clock::now();
+    if(!render(c.camera, c.width, c.height, rgba)){
+        return false;
+    }
+    header.render_ms=elapsedMs(start);
+
+    start=chrono::steady_clock::now();
+    header.key=c.previous.size()!=rgba.size();
+    if(!FrameCodec::encode(c.encoding, rgba, c.previous, c.width, c.height, c.quality, encoded)){
+        cout<<"Cannot encode a frame as "<<FrameCodec::name(c.encoding)<<endl;
+        return false;
+    }
+    header.encode_ms=elapsedMs(start);
+    //the client holds a lossy copy after JPEG, so the next delta starts from black
+    if(c.encoding==FRAME_JPEG){
+        c.previous.clear();
+    }
+    else{
+        c.previous.swap(rgba);
+    }
+
+    if(!sendMessage(c.fd, MSG_FRAME, &header, sizeof(header), encoded.empty() ? NULL : &encoded[0], encoded.size())){
+        return false;
+    }
+    double latency=elapsedMs(c.pending_since);
+    c.dirty=false;
+    c.frames++;
+    c.bytes+=encoded.size()+sizeof(header);
+    c.raw_bytes+=4LL*c.width*c.height;
+    c.latency_sum+=latency;
+    c.latency_max=max(c.latency_max, latency);
+    c.render_sum+=header.render_ms;
+    c.encode_sum+=header.encode_ms;
+    return true;
+}
+
+void RenderServer::reportClient(const Client &c){
+    cout<<"Client "<<c.id<<": "<<c.frames<<" frames as "<<FrameCodec::name(c.encoding)<<", "<<c.updates<<" camera updates, "
+        <<c.merged<<" merged";
+    if(c.frames>0){
+        cout<<", "<<c.bytes/c.frames<<" bytes per frame ("<<100.0*c.bytes/max(c.raw_bytes, 1LL)<<"% of raw), latency "
+            <<c.latency_sum/c.frames<<" ms mean, "<<c.latency_max<<" ms max, render "<<c.render_sum/c.frames
+            <<" ms, encode "<<c.encode_sum/c.frames<<" ms";
+    }
+    cout<<endl;
+}
+
+void RenderServer::closeClient(Client &c){
+    cout<<"Client "<<c.id<<" disconnected"<<endl;
+    reportClient(c);
+    close(c.fd);
+    c.fd=-1;
+}
+
+bool RenderServer::run(RenderFunction render){
+    stopping=false;
+    while(!stopping){
+        vector<pollfd> fds(1);
+        fds[0].fd=listener;
+        fds[0].events=POLLIN;
+        //a client owed a frame also waits for room to send it; one with room wakes the poll at once
+        for(size_t i=0; i<clients.size(); i++){
+            pollfd pfd={clients[i].fd, (short)(POLLIN|(clients[i].dirty ? POLLOUT : 0)), 0};
+            fds.push_back(pfd);
+        }
+        if(poll(&fds[0], fds.size(), SERVER_POLL_MS)<0 && errno!=EINTR){
+            cout<<"Render server poll failed: "<<strerror(errno)<<endl;
+            return false;
+        }
+        size_t polled=clients.size();
+        for(size_t i=0; i<polled; i++){
+            if((fds[i+1].revents & ~POLLOUT) && !receive(clients[i])){
+                closeClient(clients[i]);
+            }
+        }
+        if(fds[0].revents & POLLIN){
+            acceptClient();
+        }
+        for(size_t i=0; i<polled; i++){
+            Client &c=clients[i];
+            if(c.fd<0 || !c.dirty){
+                continue;
+            }
+            //a full socket buffer skips the frame, the updates merge into the next one
+            if(!(fds[i+1].revents & POLLOUT)){
+                if(elapsedMs(c.pending_since)>SERVER_SEND_TIMEOUT_MS){
+                    cout<<"Client "<<c.id<<" stopped reading"<<endl;
+                    closeClient(c);
+                }
+                continue;
+            }
+            if(!serve(c, render)){
+                closeClient(c);
+            }
+        }
+        for(size_t i=0; i<clients.size(); ){
+            if(clients[i].fd<0){
+                clients.erase(clients.begin()+i);
+            }
+            else{
+                i++;
+            }
+        }
+    }
+    return true;
+}
+
+void RenderServer::report(){
+    cout<<"Render server: "<<next_id<<" clients served, "<<clients.size()<<" still connected"<<endl;
+    for(size_t i=0; i<clients.size(); i++){
+        reportClient(clients[i]);
+    }
+}
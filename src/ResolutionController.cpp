@@ -0,0 +1,210 @@
+#include "ResolutionController.h"
+
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+ResolutionController::ResolutionController() : budget(0.0), min_scale(0.25f), max_scale(1.f), scale(1.f), cost(0.0), frames(0), over(0), under(0),
+    settle(0), changes(0), history(), history_next(0)
+{
+    //ctor
+    history.reserve(RESOLUTION_HISTORY);
+}
+
+ResolutionController::~ResolutionController()
+{
+    //dtor
+}
+
+void ResolutionController::setBudget(double ms){
+    budget=ms;
+    if(budget<=0.0){
+        scale=max_scale;
+    }
+    reset();
+}
+
+void ResolutionController::setScaleLimits(float min_s, float max_s){
+    min_scale=max(min_s, RESOLUTION_STEP);
+    max_scale=max(max_s, min_scale);
+    scale=min(max(scale, min_scale), max_scale);
+}
+
+void ResolutionController::reset(){
+    cost=0.0;
+    frames=0;
+    over=under=0;
+    settle=0;
+}
+
+//multiples of RESOLUTION_STEP, rounded down so a new scale does not overshoot the budget
+float ResolutionController::quantize(float s){
+    s=floor(s/RESOLUTION_STEP+1e-3f)*RESOLUTION_STEP;
+    return min(max(s, min_scale), max_scale);
+}
+
+void ResolutionController::change(float next, const char *reason){
+    cout<<"Resolution scale "<<scale<<" -> "<<next<<": "<<reason<<", "<<cost<<" ms per frame against a budget of "<<budget<<" ms"<<endl;
+    //the running cost is predicted at the new scale until real frames come in
+    cost*=(next*next)/(scale*scale);
+    scale=next;
+    over=under=0;
+    settle=RESOLUTION_SETTLE_FRAMES;
+    changes++;
+}
+
+bool ResolutionController::update(double launch_ms, double fraction){
+    if(budget<=0.0 || fraction<=0.0){
+        return false;
+    }
+    ResolutionSample s;
+    s.launch_ms=launch_ms;
+    s.fraction=fraction;
+    s.scale=scale;
+    if(history.size()<RESOLUTION_HISTORY){
+        history.push_back(s);
+    }
+    else{
+        history[history_next]=s;
+        history_next=(history_next+1)%RESOLUTION_HISTORY;
+    }
+    if(settle>0){
+        settle--;
+        return false;
+    }
+
+    double frame_ms=launch_ms/min(fraction, 1.0);
+    cost=frames==0 ? frame_ms : cost+RESOLUTION_SMOOTHING*(frame_ms-cost);
+    frames++;
+
+    float next=quantize(scale*sqrt(budget*RESOLUTION_AIM/cost));
+    over=cost>budget*(1.0+RESOLUTION_HIGH) ? over+1 : 0;
+    float up=scale+RESOLUTION_STEP;
+    under=scale<max_scale && cost*(up*up)/(scale*scale)<budget*(1.0-RESOLUTION_LOW) ? under+1 : 0;
+
+    if(over>=RESOLUTION_DOWN_FRAMES && next<scale){
+        change(next, "over budget");
+        return true;
+    }
+    if(under>=RESOLUTION_UP_FRAMES && next>scale){
+        change(next, "under budget");
+        return true;
+    }
+    return false;
+}
+
+float ResolutionController::getScale(){
+    return scale;
+}
+
+void ResolutionController::getRenderSize(int window_width, int window_height, int &width, int &height){
+    width=max((int)(window_width*scale+0.5f), 1);
+    height=max((int)(window_height*scale+0.5f), 1);
+}
+
+bool ResolutionController::writeTrace(const string &path){
+    ofstream file(path.c_str());
+    if(!file){
+        cout<<"Cannot write resolution trace "<<path<<endl;
+        return false;
+    }
+    for(size_t i=0; i<history.size(); i++){
+        const ResolutionSample &s=history[(history_next+i)%history.size()];
+        file<<s.launch_ms<<' '<<s.fraction<<' '<<s.scale<<'\n';
+    }
+    cout<<"Wrote "<<history.size()<<" frames to "<<path<<endl;
+    return true;
+}
+
+bool ResolutionController::readTrace(const string &path, vector<ResolutionSample> &trace){
+    ifstream file(path.c_str());
+    if(!file){
+        cout<<"Cannot read resolution trace "<<path<<endl;
+        return false;
+    }
+    trace.clear();
+    ResolutionSample s;
+    while(file>>s.launch_ms>>s.fraction>>s.scale){
+        if(s.scale<=0.f){
+            cout<<"Bad scale "<<s.scale<<" in line "<<trace.size()+1<<" of "<<path<<endl;
+            return false;
+        }
+        trace.push_back(s);
+    }
+    if(!file.eof()){
+        cout<<"Cannot parse line "<<trace.size()+1<<" of "<<path<<endl;
+        return false;
+    }
+    return true;
+}
+
+bool ResolutionController::replay(const vector<ResolutionSample> &trace, double budget_ms, int max_changes){
+    ResolutionController controller;
+    controller.setBudget(budget_ms);
+    int recorded_over=0, controlled_over=0;
+    double scale_sum=0.0;
+    size_t tail=trace.size()>RESOLUTION_REPLAY_TAIL ? trace.size()-RESOLUTION_REPLAY_TAIL : 0;
+    int tail_over=0, tail_changes=0, oscillations=0;
+    //frame each scale was last left at
+    vector<float> left_scale;
+    vector<size_t> left_frame;
+    for(size_t i=0; i<trace.size(); i++){
+        const ResolutionSample &s=trace[i];
+        double fraction=max(s.fraction, 1e-6);
+        float c=controller.getScale();
+        double launch_ms=s.launch_ms*(c*c)/(s.scale*s.scale);
+        if(s.launch_ms/fraction>budget_ms){
+            recorded_over++;
+        }
+        if(launch_ms/fraction>budget_ms){
+            controlled_over++;
+        }
+        if(i>=tail && launch_ms/fraction>budget_ms*(1.0+RESOLUTION_HIGH)){
+            tail_over++;
+        }
+        scale_sum+=c;
+        if(!controller.update(launch_ms, s.fraction)){
+            continue;
+        }
+        tail_changes+=i>=tail;
+        float next=controller.getScale();
+        for(size_t j=0; j<left_scale.size(); j++){
+            if(fabs(left_scale[j]-next)<RESOLUTION_STEP*0.5f && i-left_frame[j]<RESOLUTION_REPLAY_OSCILLATION){
+                cout<<"Oscillation: back to scale "<<next<<" at frame "<<i<<", left at frame "<<left_frame[j]<<endl;
+                oscillations++;
+            }
+        }
+        left_scale.push_back(c);
+        left_frame.push_back(i);
+    }
+    cout<<"Replayed "<<trace.size()<<" frames against "<<budget_ms<<" ms: "<<controller.changes<<" scale changes, "
+        <<recorded_over<<" frames over budget as recorded, "<<controlled_over<<" with the controller";
+    if(!trace.empty()){
+        cout<<", mean scale "<<scale_sum/trace.size();
+    }
+    cout<<endl;
+
+    bool ok=true;
+    if(controller.changes>max_changes){
+        cout<<"FAIL: "<<controller.changes<<" scale changes, at most "<<max_changes<<" allowed"<<endl;
+        ok=false;
+    }
+    if(tail_changes>0){
+        cout<<"FAIL: not settled, "<<tail_changes<<" scale changes in the last "<<trace.size()-tail<<" frames"<<endl;
+        ok=false;
+    }
+    //the smallest scale is as far as the controller can go
+    if(tail_over>0 && controller.getScale()>controller.min_scale){
+        cout<<"FAIL: "<<tail_over<<" of the last "<<trace.size()-tail<<" frames over the budget band at scale "
+            <<controller.getScale()<<endl;
+        ok=false;
+    }
+    if(oscillations>0){
+        cout<<"FAIL: "<<oscillations<<" returns to a scale within "<<RESOLUTION_REPLAY_OSCILLATION<<" frames"<<endl;
+        ok=false;
+    }
+    return ok;
+}
@@ -0,0 +1,598 @@
+#include "SceneCache.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <assimp/cimport.h>
+#include <assimp/material.h>
+#include <assimp/postprocess.h>
+
+#include "Hash.h"
+
+#define CACHE_ALIGNMENT 16
+#define HASH_CHUNK (1<<20)
+
+using namespace std;
+
+static const char CACHE_MAGIC[4]={'O','R','S','C'};
+
+//texture slots read by the loaders
+static const aiTextureType CACHED_TEXTURES[]={aiTextureType_DIFFUSE, aiTextureType_SPECULAR, aiTextureType_HEIGHT};
+
+SceneCache::SceneCache() : scene(NULL), cached(false), enabled(true), profiler(NULL), mapping(NULL), mapping_size(0)
+{
+    //ctor
+}
+
+SceneCache::~SceneCache()
+{
+    //dtor
+    release();
+}
+
+bool SceneCache::fromCache(){
+    return cached;
+}
+
+string SceneCache::cachePath(string file){
+    return file+SCENE_CACHE_EXTENSION;
+}
+
+uint64_t SceneCache::hashFile(string file, uint64_t &size){
+    uint64_t hash=HASH_SEED;
+    size=0;
+    FILE *f=fopen(file.c_str(), "rb");
+    if(!f){
+        return 0;
+    }
+    vector<unsigned char> chunk(HASH_CHUNK);
+    size_t read;
+    while((read=fread(&chunk[0], 1, HASH_CHUNK, f))>0){
+        hash=hashBytes(&chunk[0], read, hash);
+        size+=read;
+    }
+    fclose(f);
+    return hash;
+}
+
+uint64_t SceneCache::hashSource(string file, uint64_t &size){
+    uint64_t hash=hashFile(file, size);
+    if(size==0){
+        return hash;
+    }
+    vector<string> dependencies=findDependencies(file);
+    for(size_t i=0; i<dependencies.size(); i++){
+        //the name too, so a missing file that turns up later changes the hash
+        uint64_t dependency_size=0;
+        uint64_t dependency_hash=hashFile(dependencies[i], dependency_size);
+        hash=hashBytes(dependencies[i].c_str(), dependencies[i].size(), hash);
+        hash=hashBytes(&dependency_hash, sizeof(dependency_hash), hash);
+        hash=hashBytes(&dependency_size, sizeof(dependency_size), hash);
+    }
+    return hash;
+}
+
+vector<string> SceneCache::findDependencies(string file){
+    vector<string> dependencies;
+    size_t dot=file.find_last_of('.');
+    string extension=dot==string::npos ? "" : file.substr(dot);
+    for(size_t i=0; i<extension.size(); i++){
+        extension[i]=tolower(extension[i]);
+    }
+    if(extension!=".obj"){
+        return dependencies;
+    }
+    size_t slash=file.find_last_of('/');
+    string directory=slash==string::npos ? "" : file.substr(0, slash+1);
+
+    //as the OBJ importer reads it, the rest of the line is one file name relative to the OBJ
+    ifstream in(file.c_str());
+    string line;
+    while(getline(in, line)){
+        size_t start=line.find_first_not_of(" \t");
+        if(start==string::npos || line.compare(start, 6, "mtllib")!=0 || start+6>=line.size() ||
+           !isspace((unsigned char)line[start+6])){
+            continue;
+        }
+        size_t first=line.find_first_not_of(" \t", start+6);
+        size_t last=line.find_last_not_of(" \t\r");
+        if(first!=string::npos && last!=string::npos && last>=first){
+            dependencies.push_back(directory+line.substr(first, last-first+1));
+        }
+    }
+    return dependencies;
+}
+
+const aiScene* SceneCache::import(string file, unsigned int flags, unsigned int post_flags){
+    release();
+
+    uint64_t size=0;
+    uint64_t hash=0;
+    string path=cachePath(file);
+
+    if(enabled){
+        stage("scene hash");
+        hash=hashSource(file, size);
+
+        stage("scene cache map");
+        if(size>0 && mapFile(path, hash, size, flags, post_flags)){
+            scene=buildScene();
+            cached=true;
+            endStage();
+            cout<<"Scene cache hit: "<<path<<endl;
+            return scene;
+        }
+    }
+
+    //reading and post-processing apart, so each can be timed
+    stage("import");
+    const aiScene *s=aiImportFile(file.c_str(), flags & aiProcess_ValidateDataStructure);
+    stage("postprocess");
+    if(s){
+        s=aiApplyPostProcessing(s, flags & ~aiProcess_ValidateDataStructure);
+    }
+    for(unsigned int step=1; s && step!=0 && step<=post_flags; step<<=1){
+        if(post_flags & step){
+            s=aiApplyPostProcessing(s, step);
+        }
+    }
+    endStage();
+    if(!s){
+        return NULL;
+    }
+    scene=s;
+    cached=false;
+    if(!enabled){
+        return scene;
+    }
+    if(s->mNumAnimations>0){
+        cout<<"Scene has animations, not cached: "<<path<<endl;
+        return scene;
+    }
+
+    stage("scene cache write");
+    bool written=write(path, s, hash, size, flags, post_flags);
+    endStage();
+    if(written){
+        cout<<"Scene cache written: "<<path<<endl;
+    }
+    else{
+        cout<<"Failed to write scene cache: "<<path<<endl;
+    }
+    return scene;
+}
+
+void SceneCache::setEnabled(bool enable){
+    enabled=enable;
+}
+
+void SceneCache::setProfiler(LoadProfiler *p){
+    profiler=p;
+}
+
+void SceneCache::stage(const char *name){
+    if(profiler){
+        profiler->stage(name);
+    }
+}
+
+void SceneCache::endStage(){
+    if(profiler){
+        profiler->endStage();
+    }
+}
+
+void SceneCache::release(){
+    if(!scene){
+        return;
+    }
+    if(cached){
+        //arrays borrowed from the mapping must not reach the aiScene destructors
+        aiScene *s=const_cast<aiScene*>(scene);
+        for(unsigned int m=0; m<s->mNumMeshes; m++){
+            aiMesh *mesh=s->mMeshes[m];
+            for(unsigned int f=0; f<mesh->mNumFaces; f++){
+                mesh->mFaces[f].mIndices=NULL;
+                mesh->mFaces[f].mNumIndices=0;
+            }
+            mesh->mVertices=NULL;
+            mesh->mNormals=NULL;
+            mesh->mTangents=NULL;
+            mesh->mBitangents=NULL;
+            mesh->mTextureCoords[0]=NULL;
+        }
+        delete s;
+        unmap();
+    }
+    else{
+        aiReleaseImport(scene);
+    }
+    scene=NULL;
+    cached=false;
+}
+
+uint64_t SceneCache::append(vector<char> &blob, const void *data, size_t size){
+    size_t aligned=(blob.size()+CACHE_ALIGNMENT-1)/CACHE_ALIGNMENT*CACHE_ALIGNMENT;
+    blob.resize(aligned+size);
+    if(size>0){
+        memcpy(&blob[aligned], data, size);
+    }
+    return aligned;
+}
+
+uint64_t SceneCache::appendString(vector<char> &blob, const char *str){
+    uint64_t offset=blob.size();
+    blob.insert(blob.end(), str, str+strlen(str)+1);
+    return offset;
+}
+
+const char* SceneCache::getString(uint64_t offset){
+    return mapping+offset;
+}
+
+bool SceneCache::write(string path, const aiScene *s, uint64_t hash, uint64_t size, unsigned int flags, unsigned int post_flags){
+    vector<char> blob(sizeof(Header));
+
+    vector<Mesh> meshes(s->mNumMeshes);
+    for(unsigned int m=0; m<s->mNumMeshes; m++){
+        aiMesh *mesh=s->mMeshes[m];
+        Mesh &out=meshes[m];
+        memset(&out, 0, sizeof(Mesh));
+        out.nvertex=mesh->mNumVertices;
+        out.nface=mesh->mNumFaces;
+        out.material=mesh->mMaterialIndex;
+        out.primitive_types=mesh->mPrimitiveTypes;
+        out.name=appendString(blob, mesh->mName.data);
+
+        size_t vsize=mesh->mNumVertices*sizeof(aiVector3D);
+        out.vertices=append(blob, mesh->mVertices, vsize);
+        if(mesh->mNormals){
+            out.flags|=MESH_NORMALS;
+            out.normals=append(blob, mesh->mNormals, vsize);
+        }
+        if(mesh->HasTangentsAndBitangents()){
+            out.flags|=MESH_TANGENTS;
+            out.tangents=append(blob, mesh->mTangents, vsize);
+            out.bitangents=append(blob, mesh->mBitangents, vsize);
+        }
+        if(mesh->HasTextureCoords(0)){
+            out.flags|=MESH_TEXCOORDS;
+            out.texcoords=append(blob, mesh->mTextureCoords[0], vsize);
+        }
+
+        vector<uint32_t> indices;
+        vector<uint32_t> counts(mesh->mNumFaces);
+        out.face_size=mesh->mNumFaces>0?mesh->mFaces[0].mNumIndices:0;
+        for(unsigned int f=0; f<mesh->mNumFaces; f++){
+            const aiFace &face=mesh->mFaces[f];
+            counts[f]=face.mNumIndices;
+            if(face.mNumIndices!=out.face_size){
+                out.face_size=0;
+            }
+            indices.insert(indices.end(), face.mIndices, face.mIndices+face.mNumIndices);
+        }
+        out.indices=append(blob, indices.empty()?NULL:&indices[0], indices.size()*sizeof(uint32_t));
+        if(out.face_size==0 && !counts.empty()){
+            out.face_counts=append(blob, &counts[0], counts.size()*sizeof(uint32_t));
+        }
+    }
+
+    vector<Material> materials(s->mNumMaterials);
+    for(unsigned int i=0; i<s->mNumMaterials; i++){
+        aiMaterial *mat=s->mMaterials[i];
+        Material &out=materials[i];
+        memset(&out, 0, sizeof(Material));
+
+        aiString name;
+        aiGetMaterialString(mat, AI_MATKEY_NAME, &name);
+        out.name=appendString(blob, name.data);
+
+        aiColor4D color;
+        if(AI_SUCCESS==aiGetMaterialColor(mat, AI_MATKEY_COLOR_DIFFUSE, &color)){
+            out.flags|=MATERIAL_DIFFUSE;
+            out.diffuse[0]=color.r; out.diffuse[1]=color.g; out.diffuse[2]=color.b; out.diffuse[3]=color.a;
+        }
+        if(AI_SUCCESS==aiGetMaterialColor(mat, AI_MATKEY_COLOR_SPECULAR, &color)){
+            out.flags|=MATERIAL_SPECULAR;
+            out.specular[0]=color.r; out.specular[1]=color.g; out.specular[2]=color.b; out.specular[3]=color.a;
+        }
+        if(AI_SUCCESS==aiGetMaterialFloat(mat, AI_MATKEY_SHININESS, &out.shininess)){
+            out.flags|=MATERIAL_SHININESS;
+        }
+        if(AI_SUCCESS==aiGetMaterialFloat(mat, AI_MATKEY_REFRACTI, &out.refracti)){
+            out.flags|=MATERIAL_REFRACTI;
+        }
+
+        vector<Texture> textures;
+        for(unsigned int t=0; t<sizeof(CACHED_TEXTURES)/sizeof(CACHED_TEXTURES[0]); t++){
+            aiString texPath;
+            for(unsigned int n=0; AI_SUCCESS==mat->GetTexture(CACHED_TEXTURES[t], n, &texPath); n++){
+                Texture tex;
+                tex.type=CACHED_TEXTURES[t];
+                tex.index=n;
+                tex.path=appendString(blob, texPath.data);
+                textures.push_back(tex);
+            }
+        }
+        out.ntextures=textures.size();
+        out.textures=append(blob, textures.empty()?NULL:&textures[0], textures.size()*sizeof(Texture));
+    }
+
+    //breadth first numbering keeps siblings next to each other
+    vector<aiNode*> order;
+    order.push_back(s->mRootNode);
+    for(unsigned int i=0; i<order.size(); i++){
+        for(unsigned int c=0; c<order[i]->mNumChildren; c++){
+            order.push_back(order[i]->mChildren[c]);
+        }
+    }
+    vector<Node> nodes(order.size());
+    unsigned int next_child=1;
+    for(unsigned int i=0; i<order.size(); i++){
+        aiNode *node=order[i];
+        Node &out=nodes[i];
+        memset(&out, 0, sizeof(Node));
+        out.name=appendString(blob, node->mName.data);
+        memcpy(out.transform, &node->mTransformation, sizeof(out.transform));
+        out.nchildren=node->mNumChildren;
+        out.first_child=next_child;
+        next_child+=node->mNumChildren;
+        out.nmeshes=node->mNumMeshes;
+        out.meshes=append(blob, node->mMeshes, node->mNumMeshes*sizeof(unsigned int));
+    }
+
+    Header header;
+    memset(&header, 0, sizeof(Header));
+    memcpy(header.magic, CACHE_MAGIC, 4);
+    header.version=SCENE_CACHE_VERSION;
+    header.source_hash=hash;
+    header.source_size=size;
+    header.import_flags=flags;
+    header.post_flags=post_flags;
+    header.nmeshes=meshes.size();
+    header.nmaterials=materials.size();
+    header.nnodes=nodes.size();
+    header.meshes=append(blob, meshes.empty()?NULL:&meshes[0], meshes.size()*sizeof(Mesh));
+    header.materials=append(blob, materials.empty()?NULL:&materials[0], materials.size()*sizeof(Material));
+    header.nodes=append(blob, &nodes[0], nodes.size()*sizeof(Node));
+    memcpy(&blob[0], &header, sizeof(Header));
+
+    //written under a temporary name so a crash never leaves a truncated cache behind
+    string tmp=path+".tmp";
+    FILE *f=fopen(tmp.c_str(), "wb");
+    if(!f){
+        return false;
+    }
+    bool ok=fwrite(&blob[0], 1, blob.size(), f)==blob.size();
+    ok=(fclose(f)==0) && ok;
+    if(!ok || rename(tmp.c_str(), path.c_str())!=0){
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool SceneCache::mapFile(string path, uint64_t hash, uint64_t size, unsigned int flags, unsigned int post_flags){
+    int fd=open(path.c_str(), O_RDONLY);
+    if(fd<0){
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st)!=0 || (size_t)st.st_size<sizeof(Header)){
+        close(fd);
+        return false;
+    }
+    void *data=mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data==MAP_FAILED){
+        return false;
+    }
+    mapping=static_cast<char*>(data);
+    mapping_size=st.st_size;
+
+    const Header *header=reinterpret_cast<const Header*>(mapping);
+    if(memcmp(header->magic, CACHE_MAGIC, 4)!=0 || header->version!=SCENE_CACHE_VERSION ||
+       header->source_hash!=hash || header->source_size!=size ||
+       header->import_flags!=flags || header->post_flags!=post_flags || !validate()){
+        unmap();
+        return false;
+    }
+    return true;
+}
+
+bool SceneCache::inMapping(uint64_t offset, uint64_t count, size_t size){
+    return offset<=mapping_size && count<=(mapping_size-offset)/size;
+}
+
+bool SceneCache::isString(uint64_t offset){
+    return offset<mapping_size && memchr(mapping+offset, 0, mapping_size-offset)!=NULL;
+}
+
+bool SceneCache::validate(){
+    const Header *header=reinterpret_cast<const Header*>(mapping);
+    if(header->nnodes==0 || !inMapping(header->meshes, header->nmeshes, sizeof(Mesh)) ||
+       !inMapping(header->materials, header->nmaterials, sizeof(Material)) ||
+       !inMapping(header->nodes, header->nnodes, sizeof(Node))){
+        return false;
+    }
+
+    const Mesh *meshes=reinterpret_cast<const Mesh*>(mapping+header->meshes);
+    for(unsigned int m=0; m<header->nmeshes; m++){
+        const Mesh &in=meshes[m];
+        if(!isString(in.name) || in.material>=header->nmaterials ||
+           !inMapping(in.vertices, in.nvertex, sizeof(aiVector3D))){
+            return false;
+        }
+        if(((in.flags & MESH_NORMALS) && !inMapping(in.normals, in.nvertex, sizeof(aiVector3D))) ||
+           ((in.flags & MESH_TANGENTS) && (!inMapping(in.tangents, in.nvertex, sizeof(aiVector3D)) ||
+                                          !inMapping(in.bitangents, in.nvertex, sizeof(aiVector3D)))) ||
+           ((in.flags & MESH_TEXCOORDS) && !inMapping(in.texcoords, in.nvertex, sizeof(aiVector3D)))){
+            return false;
+        }
+        uint64_t nindex=(uint64_t)in.nface*in.face_size;
+        if(in.face_size==0 && in.nface>0){
+            if(!inMapping(in.face_counts, in.nface, sizeof(uint32_t))){
+                return false;
+            }
+            const uint32_t *counts=reinterpret_cast<const uint32_t*>(mapping+in.face_counts);
+            for(unsigned int f=0; f<in.nface; f++){
+                nindex+=counts[f];
+            }
+        }
+        if(!inMapping(in.indices, nindex, sizeof(uint32_t))){
+            return false;
+        }
+    }
+
+    const Material *materials=reinterpret_cast<const Material*>(mapping+header->materials);
+    for(unsigned int i=0; i<header->nmaterials; i++){
+        const Material &in=materials[i];
+        if(!isString(in.name) || !inMapping(in.textures, in.ntextures, sizeof(Texture))){
+            return false;
+        }
+        const Texture *textures=reinterpret_cast<const Texture*>(mapping+in.textures);
+        for(unsigned int t=0; t<in.ntextures; t++){
+            if(!isString(textures[t].path)){
+                return false;
+            }
+        }
+    }
+
+    //numbered breadth first as write does, so every node but the root has exactly one parent
+    const Node *nodes=reinterpret_cast<const Node*>(mapping+header->nodes);
+    uint64_t next_child=1;
+    for(unsigned int i=0; i<header->nnodes; i++){
+        const Node &in=nodes[i];
+        if(!isString(in.name) || !inMapping(in.meshes, in.nmeshes, sizeof(unsigned int))){
+            return false;
+        }
+        if(in.first_child!=next_child || next_child+in.nchildren>header->nnodes){
+            return false;
+        }
+        next_child+=in.nchildren;
+        const unsigned int *node_meshes=reinterpret_cast<const unsigned int*>(mapping+in.meshes);
+        for(unsigned int m=0; m<in.nmeshes; m++){
+            if(node_meshes[m]>=header->nmeshes){
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void SceneCache::unmap(){
+    if(mapping){
+        munmap(mapping, mapping_size);
+    }
+    mapping=NULL;
+    mapping_size=0;
+}
+
+aiScene* SceneCache::buildScene(){
+    const Header *header=reinterpret_cast<const Header*>(mapping);
+    aiScene *s=new aiScene();
+
+    const Mesh *meshes=reinterpret_cast<const Mesh*>(mapping+header->meshes);
+    s->mNumMeshes=header->nmeshes;
+    s->mMeshes=new aiMesh*[s->mNumMeshes];
+    for(unsigned int m=0; m<s->mNumMeshes; m++){
+        const Mesh &in=meshes[m];
+        aiMesh *mesh=new aiMesh();
+        mesh->mName.Set(getString(in.name));
+        mesh->mPrimitiveTypes=in.primitive_types;
+        mesh->mMaterialIndex=in.material;
+        mesh->mNumVertices=in.nvertex;
+        mesh->mVertices=reinterpret_cast<aiVector3D*>(mapping+in.vertices);
+        if(in.flags & MESH_NORMALS){
+            mesh->mNormals=reinterpret_cast<aiVector3D*>(mapping+in.normals);
+        }
+        if(in.flags & MESH_TANGENTS){
+            mesh->mTangents=reinterpret_cast<aiVector3D*>(mapping+in.tangents);
+            mesh->mBitangents=reinterpret_cast<aiVector3D*>(mapping+in.bitangents);
+        }
+        if(in.flags & MESH_TEXCOORDS){
+            mesh->mTextureCoords[0]=reinterpret_cast<aiVector3D*>(mapping+in.texcoords);
+            mesh->mNumUVComponents[0]=2;
+        }
+
+        unsigned int *indices=reinterpret_cast<unsigned int*>(mapping+in.indices);
+        const uint32_t *counts=reinterpret_cast<const uint32_t*>(mapping+in.face_counts);
+        mesh->mNumFaces=in.nface;
+        mesh->mFaces=new aiFace[in.nface];
+        for(unsigned int f=0; f<in.nface; f++){
+            unsigned int n=in.face_size?in.face_size:counts[f];
+            mesh->mFaces[f].mNumIndices=n;
+            mesh->mFaces[f].mIndices=indices;
+            indices+=n;
+        }
+        s->mMeshes[m]=mesh;
+    }
+
+    const Material *materials=reinterpret_cast<const Material*>(mapping+header->materials);
+    s->mNumMaterials=header->nmaterials;
+    s->mMaterials=new aiMaterial*[s->mNumMaterials];
+    for(unsigned int i=0; i<s->mNumMaterials; i++){
+        const Material &in=materials[i];
+        aiMaterial *mat=new aiMaterial();
+
+        aiString name(getString(in.name));
+        mat->AddProperty(&name, AI_MATKEY_NAME);
+        if(in.flags & MATERIAL_DIFFUSE){
+            aiColor4D color(in.diffuse[0], in.diffuse[1], in.diffuse[2], in.diffuse[3]);
+            mat->AddProperty(&color, 1, AI_MATKEY_COLOR_DIFFUSE);
+        }
+        if(in.flags & MATERIAL_SPECULAR){
+            aiColor4D color(in.specular[0], in.specular[1], in.specular[2], in.specular[3]);
+            mat->AddProperty(&color, 1, AI_MATKEY_COLOR_SPECULAR);
+        }
+        if(in.flags & MATERIAL_SHININESS){
+            mat->AddProperty(&in.shininess, 1, AI_MATKEY_SHININESS);
+        }
+        if(in.flags & MATERIAL_REFRACTI){
+            mat->AddProperty(&in.refracti, 1, AI_MATKEY_REFRACTI);
+        }
+
+        const Texture *textures=reinterpret_cast<const Texture*>(mapping+in.textures);
+        for(unsigned int t=0; t<in.ntextures; t++){
+            aiString path(getString(textures[t].path));
+            mat->AddProperty(&path, AI_MATKEY_TEXTURE(textures[t].type, textures[t].index));
+        }
+        s->mMaterials[i]=mat;
+    }
+
+    const Node *nodes=reinterpret_cast<const Node*>(mapping+header->nodes);
+    vector<aiNode*> built(header->nnodes);
+    for(unsigned int i=0; i<header->nnodes; i++){
+        built[i]=new aiNode();
+    }
+    for(unsigned int i=0; i<header->nnodes; i++){
+        const Node &in=nodes[i];
+        aiNode *node=built[i];
+        node->mName.Set(getString(in.name));
+        memcpy(&node->mTransformation, in.transform, sizeof(in.transform));
+        node->mNumChildren=in.nchildren;
+        if(in.nchildren>0){
+            node->mChildren=new aiNode*[in.nchildren];
+            for(unsigned int c=0; c<in.nchildren; c++){
+                node->mChildren[c]=built[in.first_child+c];
+                built[in.first_child+c]->mParent=node;
+            }
+        }
+        node->mNumMeshes=in.nmeshes;
+        if(in.nmeshes>0){
+            node->mMeshes=new unsigned int[in.nmeshes];
+            memcpy(node->mMeshes, mapping+in.meshes, in.nmeshes*sizeof(unsigned int));
+        }
+    }
+    s->mRootNode=built[0];
+
+    return s;
+}
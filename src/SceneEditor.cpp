@@ -0,0 +1,242 @@
+#include "SceneEditor.h"
+
+#include <iostream>
+#include <chrono>
+#include <cstring>
+
+#include <assimp/scene.h>
+
+using namespace std;
+using namespace optix;
+
+#define MARK_GEOMETRY 0
+#define MARK_CHILDREN 1
+
+SceneEditor::SceneEditor() : nodes(), marked(), timings(), committed(0), commits(0), build_ms(0.0), timed(true)
+{
+    //ctor
+}
+
+SceneEditor::~SceneEditor()
+{
+    //dtor
+}
+
+void SceneEditor::clear(){
+    nodes.clear();
+    marked.clear();
+    timings.clear();
+    committed=0;
+    commits=0;
+    build_ms=0.0;
+}
+
+int SceneEditor::addNode(const string &name, int parent, Transform transform, const float *matrix, GeometryGroup geometry, const vector<int> &meshes){
+    SceneNode n;
+    n.name=name;
+    n.parent=parent;
+    n.transform=transform;
+    memcpy(n.matrix, matrix, sizeof(n.matrix));
+    n.geometry=geometry;
+    n.meshes=meshes;
+    nodes.push_back(n);
+    return nodes.size()-1;
+}
+
+void SceneEditor::setChildren(int node, Group children){
+    nodes[node].children=children;
+}
+
+int SceneEditor::findNode(const string &name){
+    for(size_t i=0; i<nodes.size(); i++){
+        if(nodes[i].name==name){
+            return i;
+        }
+    }
+    return -1;
+}
+
+void SceneEditor::setTimed(bool enabled){
+    timed=enabled;
+}
+
+int SceneEditor::getNodeCount(){
+    return nodes.size();
+}
+
+const SceneNode& SceneEditor::getNode(int node){
+    return nodes[node];
+}
+
+bool SceneEditor::validNode(int node){
+    if(node<0 || node>=(int)nodes.size()){
+        cout<<"No scene node "<<node<<endl;
+        return false;
+    }
+    return true;
+}
+
+void SceneEditor::markGeometry(int node, EditTiming &timing){
+    if(marked.insert(make_pair(node, MARK_GEOMETRY)).second){
+        nodes[node].geometry->getAcceleration()->markDirty();
+        timing.rebuilt++;
+    }
+    //the GeometryGroup of a node with children sits in its Group
+    if(nodes[node].children.get()){
+        markChildren(node, timing);
+    }
+    markPath(node, timing);
+}
+
+void SceneEditor::markChildren(int node, EditTiming &timing){
+    if(marked.insert(make_pair(node, MARK_CHILDREN)).second){
+        nodes[node].children->getAcceleration()->markDirty();
+        timing.refit++;
+    }
+}
+
+//the Transform of node sits in the Group of its parent, whose bounds may change in turn
+void SceneEditor::markPath(int node, EditTiming &timing){
+    for(int p=nodes[node].parent; p>=0; p=nodes[p].parent){
+        markChildren(p, timing);
+    }
+}
+
+static EditTiming newTiming(const char *edit, int node, int mesh){
+    EditTiming t;
+    t.edit=edit;
+    t.node=node;
+    t.mesh=mesh;
+    t.rebuilt=0;
+    t.refit=0;
+    t.edit_ms=0.0;
+    t.build_ms=0.0;
+    return t;
+}
+
+bool SceneEditor::setTransform(int node, const float *matrix){
+    if(!validNode(node)){
+        return false;
+    }
+    chrono::steady_clock::time_point start=chrono::steady_clock::now();
+    EditTiming timing=newTiming("transform", node, -1);
+    aiMatrix4x4 m;
+    memcpy(&m.a1, matrix, 16*sizeof(float));
+    aiMatrix4x4 inverse=m;
+    inverse.Inverse();
+    nodes[node].transform->setMatrix(false, &m.a1, &inverse.a1);
+    memcpy(nodes[node].matrix, matrix, sizeof(nodes[node].matrix));
+    markPath(node, timing);
+    timing.edit_ms=chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+    if(timed){
+        timings.push_back(timing);
+    }
+    return true;
+}
+
+bool SceneEditor::insertMesh(int node, int mesh, GeometryInstance instance){
+    if(!validNode(node)){
+        return false;
+    }
+    chrono::steady_clock::time_point start=chrono::steady_clock::now();
+    EditTiming timing=newTiming("insert", node, mesh);
+    SceneNode &n=nodes[node];
+    n.geometry->setChildCount(n.meshes.size()+1);
+    n.geometry->setChild(n.meshes.size(), instance);
+    n.meshes.push_back(mesh);
+    markGeometry(node, timing);
+    timing.edit_ms=chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+    if(timed){
+        timings.push_back(timing);
+    }
+    return true;
+}
+
+bool SceneEditor::removeMesh(int node, int mesh){
+    if(!validNode(node)){
+        return false;
+    }
+    SceneNode &n=nodes[node];
+    size_t index=0;
+    while(index<n.meshes.size() && n.meshes[index]!=mesh){
+        index++;
+    }
+    if(index==n.meshes.size()){
+        cout<<"Scene node "<<node<<" has no mesh "<<mesh<<endl;
+        return false;
+    }
+    chrono::steady_clock::time_point start=chrono::steady_clock::now();
+    EditTiming timing=newTiming("remove", node, mesh);
+    //the last child takes the place of the removed one
+    size_t last=n.meshes.size()-1;
+    if(index!=last){
+        n.geometry->setChild(index, n.geometry->getChild(last));
+        n.meshes[index]=n.meshes[last];
+    }
+    n.geometry->setChildCount(last);
+    n.meshes.pop_back();
+    markGeometry(node, timing);
+    timing.edit_ms=chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+    if(timed){
+        timings.push_back(timing);
+    }
+    return true;
+}
+
+void SceneEditor::setMaterial(int mesh, GeometryInstance instance, Material material){
+    chrono::steady_clock::time_point start=chrono::steady_clock::now();
+    EditTiming timing=newTiming("material", -1, mesh);
+    instance->setMaterial(0, material);
+    timing.edit_ms=chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+    if(timed){
+        timings.push_back(timing);
+    }
+}
+
+double SceneEditor::commit(Context context){
+    chrono::steady_clock::time_point start=chrono::steady_clock::now();
+    //an empty launch builds the dirty accelerations without tracing a ray
+    context->launch(0, 0, 0);
+    double ms=chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+    for(size_t i=committed; i<timings.size(); i++){
+        timings[i].build_ms=ms;
+    }
+    committed=timings.size();
+    marked.clear();
+    commits++;
+    build_ms+=ms;
+    return ms;
+}
+
+int SceneEditor::getPendingCount(){
+    return timings.size()-committed;
+}
+
+const vector<EditTiming>& SceneEditor::getTimings(){
+    return timings;
+}
+
+void SceneEditor::report(){
+    double edit_ms=0.0;
+    int rebuilt=0, refit=0;
+    for(size_t i=0; i<timings.size(); i++){
+        const EditTiming &t=timings[i];
+        cout<<"    "<<t.edit;
+        if(t.node>=0){
+            cout<<" node "<<t.node<<" ("<<nodes[t.node].name<<")";
+        }
+        if(t.mesh>=0){
+            cout<<" mesh "<<t.mesh;
+        }
+        cout<<": "<<t.edit_ms<<" ms, "<<t.rebuilt<<" rebuilt "<<t.refit<<" refit";
+        if(i<committed){
+            cout<<", built in "<<t.build_ms<<" ms";
+        }
+        cout<<endl;
+        edit_ms+=t.edit_ms;
+        rebuilt+=t.rebuilt;
+        refit+=t.refit;
+    }
+    cout<<"Scene edits: "<<timings.size()<<" edits of "<<nodes.size()<<" nodes in "<<edit_ms<<" ms, "
+        <<rebuilt<<" accelerations rebuilt and "<<refit<<" refit in "<<commits<<" commits of "<<build_ms<<" ms"<<endl;
+}
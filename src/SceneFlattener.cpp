@@ -0,0 +1,190 @@
+#include "SceneFlattener.h"
+
+#include <iostream>
+#include <map>
+#include <algorithm>
+#include <cstring>
+
+#include "Hash.h"
+
+using namespace std;
+
+SceneFlattener::SceneFlattener() : nodes(0), mesh_nodes(0), mesh_refs(0), meshes(0), unique_meshes(0), max_depth_before(0), mesh_depth_before(0.0),
+    transforms_after(0), max_depth_after(0), mesh_depth_after(0.0), groups_after(0), instances_after(0)
+{
+    //ctor
+}
+
+SceneFlattener::~SceneFlattener()
+{
+    //dtor
+}
+
+//a missing array hashes as one zero byte, so it differs from an empty one
+static uint64_t hashArray(const aiVector3D *v, unsigned int n, uint64_t hash){
+    if(!v){
+        unsigned char missing=0;
+        return hashBytes(&missing, 1, hash);
+    }
+    return hashBytes(v, n*sizeof(aiVector3D), hash);
+}
+
+uint64_t SceneFlattener::hashMesh(const aiMesh *mesh){
+    unsigned int header[3]={mesh->mNumVertices, mesh->mNumFaces, mesh->mMaterialIndex};
+    uint64_t hash=hashBytes(header, sizeof(header));
+    hash=hashArray(mesh->mVertices, mesh->mNumVertices, hash);
+    hash=hashArray(mesh->mNormals, mesh->mNumVertices, hash);
+    hash=hashArray(mesh->mTangents, mesh->mNumVertices, hash);
+    hash=hashArray(mesh->mTextureCoords[0], mesh->mNumVertices, hash);
+    for(unsigned int f=0; f<mesh->mNumFaces; f++){
+        hash=hashBytes(mesh->mFaces[f].mIndices, mesh->mFaces[f].mNumIndices*sizeof(unsigned int), hash);
+    }
+    return hash;
+}
+
+static bool sameArray(const aiVector3D *a, const aiVector3D *b, unsigned int n){
+    if(!a || !b){
+        return a==b;
+    }
+    return memcmp(a, b, n*sizeof(aiVector3D))==0;
+}
+
+bool SceneFlattener::sameMesh(const aiMesh *a, const aiMesh *b){
+    if(a->mNumVertices!=b->mNumVertices || a->mNumFaces!=b->mNumFaces || a->mMaterialIndex!=b->mMaterialIndex){
+        return false;
+    }
+    unsigned int n=a->mNumVertices;
+    if(!sameArray(a->mVertices, b->mVertices, n) || !sameArray(a->mNormals, b->mNormals, n) ||
+       !sameArray(a->mTangents, b->mTangents, n) || !sameArray(a->mBitangents, b->mBitangents, n) ||
+       !sameArray(a->mTextureCoords[0], b->mTextureCoords[0], n)){
+        return false;
+    }
+    for(unsigned int f=0; f<a->mNumFaces; f++){
+        const aiFace &fa=a->mFaces[f];
+        const aiFace &fb=b->mFaces[f];
+        if(fa.mNumIndices!=fb.mNumIndices || memcmp(fa.mIndices, fb.mIndices, fa.mNumIndices*sizeof(unsigned int))!=0){
+            return false;
+        }
+    }
+    return true;
+}
+
+//the per-node graph puts a Transform and a Group on every level and a GeometryGroup under them
+void SceneFlattener::collect(const aiNode *node, aiMatrix4x4 parent, int depth, const FlatScene &flat, vector<Placement> &placements){
+    aiMatrix4x4 world=parent*node->mTransformation;
+    nodes++;
+    if(node->mNumMeshes>0){
+        mesh_nodes++;
+        int levels=2*(depth+1)+1;
+        max_depth_before=max(max_depth_before, levels);
+        mesh_depth_before+=levels*(double)node->mNumMeshes;
+        mesh_refs+=node->mNumMeshes;
+
+        Placement p;
+        p.transform=world;
+        for(unsigned int m=0; m<node->mNumMeshes; m++){
+            p.meshes.push_back(flat.canonical[node->mMeshes[m]]);
+        }
+        placements.push_back(p);
+    }
+    for(unsigned int c=0; c<node->mNumChildren; c++){
+        collect(node->mChildren[c], world, depth+1, flat, placements);
+    }
+}
+
+void SceneFlattener::flatten(const aiScene *scene, FlatScene &flat){
+    flat.canonical.clear();
+    flat.groups.clear();
+    flat.instances.clear();
+    nodes=mesh_nodes=mesh_refs=0;
+    max_depth_before=max_depth_after=0;
+    mesh_depth_before=mesh_depth_after=0.0;
+    transforms_after=0;
+
+    //identical meshes, by hash and then by contents
+    meshes=scene->mNumMeshes;
+    unique_meshes=0;
+    map<uint64_t, vector<int> > by_hash;
+    for(int m=0; m<meshes; m++){
+        const aiMesh *mesh=scene->mMeshes[m];
+        vector<int> &candidates=by_hash[hashMesh(mesh)];
+        int canonical=m;
+        for(size_t c=0; c<candidates.size(); c++){
+            if(sameMesh(scene->mMeshes[candidates[c]], mesh)){
+                canonical=candidates[c];
+                break;
+            }
+        }
+        if(canonical==m){
+            candidates.push_back(m);
+            unique_meshes++;
+        }
+        flat.canonical.push_back(canonical);
+    }
+
+    vector<Placement> placements;
+    collect(scene->mRootNode, aiMatrix4x4(), 0, flat, placements);
+
+    //nodes that end up at the same world matrix share one GeometryGroup
+    map<vector<float>, int> by_transform;
+    vector<Placement> merged;
+    for(size_t i=0; i<placements.size(); i++){
+        const float *m=&placements[i].transform.a1;
+        vector<float> key(m, m+16);
+        map<vector<float>, int>::iterator it=by_transform.find(key);
+        if(it==by_transform.end()){
+            by_transform[key]=merged.size();
+            merged.push_back(placements[i]);
+        }
+        else{
+            vector<int> &dst=merged[it->second].meshes;
+            dst.insert(dst.end(), placements[i].meshes.begin(), placements[i].meshes.end());
+        }
+    }
+
+    //and GeometryGroups holding the same meshes are one group placed several times
+    map<vector<int>, int> by_meshes;
+    for(size_t i=0; i<merged.size(); i++){
+        vector<int> key=merged[i].meshes;
+        sort(key.begin(), key.end());
+        FlatInstance instance;
+        instance.transform=merged[i].transform;
+        instance.identity=merged[i].transform.IsIdentity();
+        map<vector<int>, int>::iterator it=by_meshes.find(key);
+        if(it==by_meshes.end()){
+            instance.group=flat.groups.size();
+            by_meshes[key]=instance.group;
+            flat.groups.push_back(key);
+        }
+        else{
+            instance.group=it->second;
+        }
+        flat.instances.push_back(instance);
+
+        //top Group, Transform, GeometryGroup
+        int levels=instance.identity ? 2 : 3;
+        if(!instance.identity){
+            transforms_after++;
+        }
+        max_depth_after=max(max_depth_after, levels);
+        mesh_depth_after+=levels*(double)key.size();
+    }
+    groups_after=flat.groups.size();
+    instances_after=flat.instances.size();
+}
+
+void SceneFlattener::report(){
+    cout<<"Scene graph: "<<nodes<<" nodes, "<<mesh_nodes<<" with meshes, "<<meshes<<" meshes ("<<unique_meshes<<" unique)"<<endl;
+    cout<<"    per node: "<<nodes<<" Transforms, "<<nodes<<" Groups, "<<nodes<<" GeometryGroups, "
+        <<2*nodes<<" accelerations, depth max "<<max_depth_before;
+    if(mesh_refs>0){
+        cout<<", mean "<<mesh_depth_before/mesh_refs;
+    }
+    cout<<endl;
+    cout<<"    flat: "<<transforms_after<<" Transforms, 1 Group, "<<groups_after<<" GeometryGroups placed "
+        <<instances_after<<" times, "<<groups_after+1<<" accelerations, depth max "<<max_depth_after;
+    if(mesh_refs>0){
+        cout<<", mean "<<mesh_depth_after/mesh_refs;
+    }
+    cout<<endl;
+}
@@ -0,0 +1,416 @@
+#include "TextureLoader.h"
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <csetjmp>
+#include <chrono>
+#include <mutex>
+#include <algorithm>
+
+#include <png.h>
+#include <jpeglib.h>
+
+#include <IL/il.h>
+#include <IL/ilu.h>
+
+#include "BlockCompressor.h"
+#include "Hash.h"
+#include "MipGenerator.h"
+
+using namespace std;
+
+//DevIL works on one global bound image, so only one thread may use it at a time
+static mutex devil_lock;
+
+//only holds lookup tables, shared by all decode threads
+static MipGenerator mip_generator;
+static BlockCompressor block_compressor;
+
+static double elapsedMs(chrono::steady_clock::time_point since){
+    return chrono::duration<double, milli>(chrono::steady_clock::now()-since).count();
+}
+
+static string extension(string file){
+    size_t dot=file.find_last_of('.');
+    if(dot==string::npos){
+        return "";
+    }
+    string ext=file.substr(dot+1);
+    transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext;
+}
+
+static bool readFile(string file, vector<unsigned char> &data){
+    FILE *f=fopen(file.c_str(), "rb");
+    if(!f){
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long size=ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if(size<=0){
+        fclose(f);
+        return false;
+    }
+    data.resize(size);
+    bool ok=fread(&data[0], 1, size, f)==(size_t)size;
+    fclose(f);
+    return ok;
+}
+
+static bool decodePng(const vector<unsigned char> &data, DecodedTexture &tex){
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version=PNG_IMAGE_VERSION;
+    if(!png_image_begin_read_from_memory(&image, &data[0], data.size())){
+        return false;
+    }
+    //gray is read with alpha so libpng does not composite it onto black; IL_LUMINANCE ignores alpha as well
+    bool luminance=tex.format==TEXTURE_L8;
+    image.format=luminance?PNG_FORMAT_GA:PNG_FORMAT_RGBA;
+    tex.width=image.width;
+    tex.height=image.height;
+    tex.pixels.resize(PNG_IMAGE_SIZE(image));
+    //a negative stride stores the rows bottom up
+    int stride=PNG_IMAGE_ROW_STRIDE(image);
+    if(!png_image_finish_read(&image, NULL, &tex.pixels[0], -stride, NULL)){
+        png_image_free(&image);
+        return false;
+    }
+    if(luminance){
+        int npixels=tex.width*tex.height;
+        for(int i=0; i<npixels; i++){
+            tex.pixels[i]=tex.pixels[2*i];
+        }
+        tex.pixels.resize(npixels);
+    }
+    return true;
+}
+
+struct JpegError{
+    jpeg_error_mgr mgr;
+    jmp_buf jump;
+};
+
+static void jpegErrorExit(j_common_ptr cinfo){
+    longjmp(reinterpret_cast<JpegError*>(cinfo->err)->jump, 1);
+}
+
+static bool decodeJpeg(const vector<unsigned char> &data, DecodedTexture &tex){
+    jpeg_decompress_struct cinfo;
+    JpegError err;
+    vector<unsigned char> row;
+    cinfo.err=jpeg_std_error(&err.mgr);
+    err.mgr.error_exit=jpegErrorExit;
+    if(setjmp(err.jump)){
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, const_cast<unsigned char*>(&data[0]), data.size());
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.out_color_space=tex.format==TEXTURE_RGBA8?JCS_RGB:JCS_GRAYSCALE;
+    jpeg_start_decompress(&cinfo);
+
+    int w=cinfo.output_width;
+    int h=cinfo.output_height;
+    int channels=tex.format==TEXTURE_RGBA8?4:1;
+    tex.width=w;
+    tex.height=h;
+    tex.pixels.resize(w*h*channels);
+    row.resize(w*cinfo.output_components);
+    while(cinfo.output_scanline<cinfo.output_height){
+        int y=h-1-cinfo.output_scanline;
+        JSAMPROW rows[1]={&row[0]};
+        jpeg_read_scanlines(&cinfo, rows, 1);
+        unsigned char *dst=&tex.pixels[y*w*channels];
+        if(channels==1){
+            memcpy(dst, &row[0], w);
+        }
+        else{
+            for(int x=0; x<w; x++){
+                dst[4*x]=row[3*x];
+                dst[4*x+1]=row[3*x+1];
+                dst[4*x+2]=row[3*x+2];
+                dst[4*x+3]=255;
+            }
+        }
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return true;
+}
+
+static bool decodeDevIL(const vector<unsigned char> &data, DecodedTexture &tex){
+    lock_guard<mutex> lock(devil_lock);
+
+    ILuint image=iluGenImage();
+    ilBindImage(image);
+    ilEnable(IL_ORIGIN_SET);
+    ilOriginFunc(IL_ORIGIN_LOWER_LEFT);
+
+    ILboolean success=ilLoadL(ilTypeFromExt((ILstring) tex.file.c_str()), &data[0], data.size());
+    if(!success){
+        success=ilLoadL(IL_TYPE_UNKNOWN, &data[0], data.size());
+    }
+    if(success){
+        ilConvertImage(tex.format==TEXTURE_RGBA8?IL_RGBA:IL_LUMINANCE, IL_UNSIGNED_BYTE);
+        tex.width=ilGetInteger(IL_IMAGE_WIDTH);
+        tex.height=ilGetInteger(IL_IMAGE_HEIGHT);
+        ILint size=ilGetInteger(IL_IMAGE_SIZE_OF_DATA);
+        ILubyte *pixels=ilGetData();
+        tex.pixels.assign(pixels, pixels+size);
+    }
+
+    ilBindImage(0);
+    ilDeleteImage(image);
+    return success;
+}
+
+TextureKey::TextureKey(const DecodedTexture &tex, int format) : hash(tex.hash), size(tex.size), format(format)
+{
+}
+
+bool TextureKey::operator<(const TextureKey &k) const{
+    if(hash!=k.hash) return hash<k.hash;
+    if(size!=k.size) return size<k.size;
+    return format<k.format;
+}
+
+TextureLoader::TextureLoader(ThreadPool &pool) : pool(pool), textures(), requested(), contents(), decoded(0), mipmaps(false), compression(false), decode_wall_ms(0.0)
+{
+    //ctor
+}
+
+TextureLoader::~TextureLoader()
+{
+    //dtor
+}
+
+int TextureLoader::request(string file, TextureFormat format){
+    string key=file+(format==TEXTURE_RGBA8?"#rgba":"#lum");
+    map<string, int>::iterator found=requested.find(key);
+    if(found!=requested.end()){
+        return found->second;
+    }
+    DecodedTexture tex;
+    tex.file=file;
+    tex.format=format;
+    tex.ok=false;
+    tex.width=0;
+    tex.height=0;
+    tex.hash=0;
+    tex.size=0;
+    tex.source=textures.size();
+    tex.read_ms=0.0;
+    tex.decode_ms=0.0;
+    tex.mip_ms=0.0;
+    tex.compress_ms=0.0;
+    tex.block_format=BLOCK_NONE;
+    tex.psnr=0.f;
+    tex.block_cache_hit=false;
+    tex.upload_ms=0.0;
+    int index=textures.size();
+    textures.push_back(tex);
+    requested[key]=index;
+    return index;
+}
+
+void TextureLoader::read(DecodedTexture &tex, vector<unsigned char> &data){
+    chrono::steady_clock::time_point start=chrono::steady_clock::now();
+    if(readFile(tex.file, data)){
+        tex.hash=hashBytes(&data[0], data.size());
+        tex.size=data.size();
+    }
+    tex.read_ms=elapsedMs(start);
+}
+
+void TextureLoader::decode(DecodedTexture &tex, const vector<unsigned char> &data){
+    chrono::steady_clock::time_point start=chrono::steady_clock::now();
+    //a valid block cache replaces image decode, mips and encode
+    if(compression && block_compressor.load(tex, mipmaps)){
+        tex.block_cache_hit=true;
+        tex.decode_ms=elapsedMs(start);
+        return;
+    }
+
+    string ext=extension(tex.file);
+    if(ext=="png"){
+        tex.ok=decodePng(data, tex);
+    }
+    else if(ext=="jpg" || ext=="jpeg"){
+        tex.ok=decodeJpeg(data, tex);
+    }
+    if(!tex.ok){
+        tex.ok=decodeDevIL(data, tex);
+    }
+    if(!tex.ok){
+        tex.pixels.clear();
+        tex.width=0;
+        tex.height=0;
+    }
+    tex.decode_ms=elapsedMs(start);
+
+    if(mipmaps){
+        start=chrono::steady_clock::now();
+        mip_generator.build(tex);
+        tex.mip_ms=elapsedMs(start);
+    }
+
+    if(compression && tex.ok){
+        start=chrono::steady_clock::now();
+        block_compressor.compress(tex);
+        block_compressor.save(tex);
+        tex.compress_ms=elapsedMs(start);
+    }
+}
+
+void TextureLoader::setMipmaps(bool enabled){
+    mipmaps=enabled;
+}
+
+void TextureLoader::setCompression(bool enabled){
+    compression=enabled;
+}
+
+void TextureLoader::decodeAll(){
+    chrono::steady_clock::time_point start=chrono::steady_clock::now();
+    int first=decoded;
+    int count=textures.size()-first;
+    vector<vector<unsigned char> > files(count);
+    pool.parallelFor(count, [this, first, &files](int index, int thread){
+        read(textures[first+index], files[index]);
+    });
+
+    //only the first file with given contents is decoded, later ones point at it
+    vector<int> unique;
+    for(int i=first; i<(int)textures.size(); i++){
+        DecodedTexture &tex=textures[i];
+        if(files[i-first].empty()){
+            unique.push_back(i);
+            continue;
+        }
+        TextureKey key(tex, tex.format);
+        map<TextureKey, int>::iterator found=contents.find(key);
+        //files of this batch are still in memory, so their contents are compared too
+        int source=found!=contents.end() ? found->second : -1;
+        if(source>=first && files[source-first]!=files[i-first]){
+            cout<<"Hash collision between "<<textures[source].file<<" and "<<tex.file<<endl;
+            unique.push_back(i);
+        }
+        else if(source>=0){
+            tex.source=source;
+        }
+        else{
+            contents[key]=i;
+            unique.push_back(i);
+        }
+    }
+
+    pool.parallelFor(unique.size(), [this, first, &files, &unique](int index, int thread){
+        int i=unique[index];
+        if(!files[i-first].empty()){
+            decode(textures[i], files[i-first]);
+        }
+    });
+
+    for(int i=first; i<(int)textures.size(); i++){
+        DecodedTexture &tex=textures[i];
+        if(tex.source!=i){
+            DecodedTexture &src=textures[tex.source];
+            tex.ok=src.ok;
+            tex.width=src.width;
+            tex.height=src.height;
+        }
+    }
+    decoded=textures.size();
+    decode_wall_ms+=elapsedMs(start);
+}
+
+int TextureLoader::getTextureCount(){
+    return textures.size();
+}
+
+DecodedTexture& TextureLoader::get(int index){
+    return textures[index];
+}
+
+int TextureLoader::resolve(int index){
+    return textures[index].source;
+}
+
+int TextureLoader::getDuplicateCount(){
+    int count=0;
+    for(unsigned int i=0; i<textures.size(); i++){
+        if(textures[i].source!=(int)i){
+            count++;
+        }
+    }
+    return count;
+}
+
+size_t TextureLoader::levelBytes(const DecodedTexture &tex){
+    size_t size=tex.pixels.size();
+    for(unsigned int l=0; l<tex.mips.size(); l++){
+        size+=tex.mips[l].size();
+    }
+    return size;
+}
+
+void TextureLoader::report(){
+    double read=0.0, decode=0.0, mip=0.0, compress=0.0, upload=0.0;
+    size_t raw_bytes=0, block_bytes=0;
+    for(unsigned int i=0; i<textures.size(); i++){
+        DecodedTexture &tex=textures[i];
+        cout<<"Texture "<<tex.file<<": ";
+        if(tex.ok){
+            cout<<tex.width<<'x'<<tex.height<<(tex.format==TEXTURE_RGBA8?" RGBA8":" L8");
+        }
+        else{
+            cout<<"failed";
+        }
+        if(tex.source!=(int)i){
+            cout<<" (same contents as "<<textures[tex.source].file<<")";
+        }
+        if(!tex.mips.empty()){
+            cout<<", "<<tex.mips.size()+1<<" levels";
+        }
+        cout<<" read "<<tex.read_ms<<" ms, decode "<<tex.decode_ms<<" ms, mips "<<tex.mip_ms<<" ms, ";
+        if(compression){
+            cout<<"compress "<<tex.compress_ms<<" ms, ";
+        }
+        cout<<"upload "<<tex.upload_ms<<" ms"<<endl;
+        if(tex.block_format!=BLOCK_NONE){
+            static const char *names[]={"none", "BC1", "BC3", "BC4"};
+            size_t before=BlockCompressor::rawBytes(tex), after=BlockCompressor::compressedBytes(tex);
+            //the blocks are expanded on upload, they only shrink the cache file
+            cout<<"    "<<names[tex.block_format]<<" cache "<<before/1024<<" KB -> "<<after/1024<<" KB on disk, "
+                <<before/1024<<" KB on the device as before, PSNR "<<tex.psnr<<" dB"
+                <<(tex.block_cache_hit ? " (from cache)" : "")<<endl;
+            raw_bytes+=before;
+            block_bytes+=after;
+        }
+        read+=tex.read_ms;
+        decode+=tex.decode_ms;
+        mip+=tex.mip_ms;
+        compress+=tex.compress_ms;
+        upload+=tex.upload_ms;
+    }
+    int duplicates=getDuplicateCount();
+    cout<<textures.size()-duplicates<<" textures decoded in "<<decode_wall_ms<<" ms on "<<pool.getThreadCount()<<" threads, "
+        <<duplicates<<" skipped as duplicate contents"<<endl;
+    cout<<"Summed over textures: read "<<read<<" ms, decode "<<decode<<" ms, mips "<<mip<<" ms, compress "<<compress<<" ms, upload "<<upload<<" ms"<<endl;
+    if(compression){
+        cout<<"Block compressed cache: "<<raw_bytes/1024<<" KB -> "<<block_bytes/1024<<" KB on disk; device size unchanged at "
+            <<raw_bytes/1024<<" KB, blocks are expanded to RGBA8/L8 on upload"<<endl;
+    }
+}
+
+void TextureLoader::clear(){
+    textures.clear();
+    requested.clear();
+    contents.clear();
+    decoded=0;
+    decode_wall_ms=0.0;
+}
@@ -0,0 +1,132 @@
+#include "ThreadPool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(int nthreads) : generation(0), stopping(false), active(0), remaining(0), steals(0)
+{
+    //ctor
+    if(nthreads<=0){
+        nthreads=thread::hardware_concurrency();
+    }
+    if(nthreads<=0){
+        nthreads=1;
+    }
+    for(int i=0; i<nthreads; i++){
+        queues.push_back(new WorkQueue());
+    }
+    for(int i=0; i<nthreads; i++){
+        workers.push_back(thread(&ThreadPool::workerLoop, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    //dtor
+    {
+        unique_lock<mutex> lock(state_lock);
+        stopping=true;
+    }
+    work_ready.notify_all();
+    for(unsigned int i=0; i<workers.size(); i++){
+        workers[i].join();
+    }
+    for(unsigned int i=0; i<queues.size(); i++){
+        delete queues[i];
+    }
+}
+
+int ThreadPool::getThreadCount(){
+    return workers.size();
+}
+
+int ThreadPool::getStealCount(){
+    return steals;
+}
+
+void ThreadPool::parallelFor(int count, Task task){
+    if(count<=0){
+        return;
+    }
+    unique_lock<mutex> submit(submit_lock);
+
+    //contiguous blocks per worker so neighbouring indices start on the same thread
+    int nqueues=queues.size();
+    for(int q=0; q<nqueues; q++){
+        int begin=(long long)count*q/nqueues;
+        int end=(long long)count*(q+1)/nqueues;
+        unique_lock<mutex> lock(queues[q]->lock);
+        for(int i=begin; i<end; i++){
+            queues[q]->items.push_back(i);
+        }
+    }
+
+    unique_lock<mutex> lock(state_lock);
+    current=task;
+    steals=0;
+    remaining=count;
+    generation++;
+    work_ready.notify_all();
+    //workers still draining must be idle before the queues are refilled
+    while(remaining>0 || active>0){
+        work_done.wait(lock);
+    }
+    current=Task();
+}
+
+bool ThreadPool::popLocal(int thread, int &index){
+    WorkQueue *q=queues[thread];
+    unique_lock<mutex> lock(q->lock);
+    if(q->items.empty()){
+        return false;
+    }
+    index=q->items.front();
+    q->items.pop_front();
+    return true;
+}
+
+bool ThreadPool::steal(int thread, int &index){
+    int nqueues=queues.size();
+    for(int i=1; i<nqueues; i++){
+        WorkQueue *q=queues[(thread+i)%nqueues];
+        unique_lock<mutex> lock(q->lock);
+        if(!q->items.empty()){
+            index=q->items.back();
+            q->items.pop_back();
+            steals++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(int thread){
+    unsigned int seen=0;
+    while(true){
+        Task task;
+        {
+            unique_lock<mutex> lock(state_lock);
+            while(!stopping && seen==generation){
+                work_ready.wait(lock);
+            }
+            if(stopping){
+                return;
+            }
+            seen=generation;
+            if(!current){
+                continue;
+            }
+            task=current;
+            active++;
+        }
+
+        int index;
+        while(popLocal(thread, index) || steal(thread, index)){
+            task(index, thread);
+            remaining--;
+        }
+
+        unique_lock<mutex> lock(state_lock);
+        active--;
+        work_done.notify_all();
+    }
+}
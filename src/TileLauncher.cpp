@@ -0,0 +1,184 @@
+#include "TileLauncher.h"
+
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+
+using namespace std;
+using namespace optix;
+
+TileLauncher::TileLauncher() : width(0), height(0), tiles_x(0), tiles_y(0), dirty(), cost(), timings()
+{
+    //ctor
+}
+
+TileLauncher::~TileLauncher()
+{
+    //dtor
+}
+
+void TileLauncher::init(Context c, int w, int h){
+    context=c;
+    context["launchOffset"]->setUint(0, 0);
+    context["imageExtent"]->setUint(0, 0);
+    setSize(w, h);
+}
+
+void TileLauncher::setSize(int w, int h){
+    width=w;
+    height=h;
+    tiles_x=(width+TILE_LAUNCH_SIZE-1)/TILE_LAUNCH_SIZE;
+    tiles_y=(height+TILE_LAUNCH_SIZE-1)/TILE_LAUNCH_SIZE;
+    cost.assign(tiles_x*tiles_y, 0.0);
+    timings.clear();
+    markAllDirty();
+}
+
+TileRect TileLauncher::clip(const TileRect &rect){
+    TileRect r;
+    r.x=max(rect.x, 0);
+    r.y=max(rect.y, 0);
+    r.width=max(min(rect.x+rect.width, width)-r.x, 0);
+    r.height=max(min(rect.y+rect.height, height)-r.y, 0);
+    return r;
+}
+
+void TileLauncher::markDirty(const TileRect &rect){
+    TileRect r=clip(rect);
+    if(r.width==0 || r.height==0){
+        return;
+    }
+    for(int ty=r.y/TILE_LAUNCH_SIZE; ty<=(r.y+r.height-1)/TILE_LAUNCH_SIZE; ty++){
+        for(int tx=r.x/TILE_LAUNCH_SIZE; tx<=(r.x+r.width-1)/TILE_LAUNCH_SIZE; tx++){
+            dirty[ty*tiles_x+tx]=1;
+        }
+    }
+}
+
+void TileLauncher::markAllDirty(){
+    dirty.assign(tiles_x*tiles_y, 1);
+}
+
+bool TileLauncher::isDirty(){
+    return find(dirty.begin(), dirty.end(), 1)!=dirty.end();
+}
+
+//squares on the right and bottom edge count as covered when the rectangle reaches the image edge
+void TileLauncher::markClean(const TileRect &rect){
+    int x0=(rect.x+TILE_LAUNCH_SIZE-1)/TILE_LAUNCH_SIZE;
+    int y0=(rect.y+TILE_LAUNCH_SIZE-1)/TILE_LAUNCH_SIZE;
+    int x1=rect.x+rect.width==width ? tiles_x : (rect.x+rect.width)/TILE_LAUNCH_SIZE;
+    int y1=rect.y+rect.height==height ? tiles_y : (rect.y+rect.height)/TILE_LAUNCH_SIZE;
+    for(int ty=y0; ty<y1; ty++){
+        for(int tx=x0; tx<x1; tx++){
+            dirty[ty*tiles_x+tx]=0;
+        }
+    }
+}
+
+void TileLauncher::launchRect(unsigned entry, const TileRect &rect){
+    context["launchOffset"]->setUint(rect.x, rect.y);
+    chrono::steady_clock::time_point start=chrono::steady_clock::now();
+    context->launch(entry, rect.width, rect.height);
+    double ms=chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+    //full launches elsewhere rely on the default
+    context["launchOffset"]->setUint(0, 0);
+
+    TileTiming t;
+    t.rect=rect;
+    t.ms=ms;
+    timings.push_back(t);
+
+    double per_pixel=ms*1e6/((double)rect.width*rect.height);
+    for(int ty=rect.y/TILE_LAUNCH_SIZE; ty<=(rect.y+rect.height-1)/TILE_LAUNCH_SIZE; ty++){
+        for(int tx=rect.x/TILE_LAUNCH_SIZE; tx<=(rect.x+rect.width-1)/TILE_LAUNCH_SIZE; tx++){
+            cost[ty*tiles_x+tx]=per_pixel;
+        }
+    }
+}
+
+int TileLauncher::launchDirty(unsigned entry){
+    timings.clear();
+    for(int ty=0; ty<tiles_y; ty++){
+        int tx=0;
+        while(tx<tiles_x){
+            if(!dirty[ty*tiles_x+tx]){
+                tx++;
+                continue;
+            }
+            int run=tx;
+            while(run<tiles_x && dirty[ty*tiles_x+run]){
+                dirty[ty*tiles_x+run]=0;
+                run++;
+            }
+            TileRect r={tx*TILE_LAUNCH_SIZE, ty*TILE_LAUNCH_SIZE, (run-tx)*TILE_LAUNCH_SIZE, TILE_LAUNCH_SIZE};
+            launchRect(entry, clip(r));
+            tx=run;
+        }
+    }
+    return timings.size();
+}
+
+void TileLauncher::launchTiles(unsigned entry, const vector<TileRect> &rects){
+    timings.clear();
+    for(size_t i=0; i<rects.size(); i++){
+        TileRect r=clip(rects[i]);
+        if(r.width==0 || r.height==0){
+            continue;
+        }
+        launchRect(entry, r);
+        markClean(r);
+    }
+}
+
+void TileLauncher::launchRegion(unsigned entry, const TileRect &rect){
+    launchTiles(entry, vector<TileRect>(1, rect));
+}
+
+const vector<TileTiming>& TileLauncher::getTimings(){
+    return timings;
+}
+
+double TileLauncher::getTileCost(int tx, int ty){
+    return cost[ty*tiles_x+tx];
+}
+
+int TileLauncher::getTilesX(){
+    return tiles_x;
+}
+
+int TileLauncher::getTilesY(){
+    return tiles_y;
+}
+
+void TileLauncher::report(){
+    long long pixels=0;
+    double ms=0.0;
+    for(size_t i=0; i<timings.size(); i++){
+        pixels+=(long long)timings[i].rect.width*timings[i].rect.height;
+        ms+=timings[i].ms;
+    }
+    cout<<"Tile launches: "<<timings.size()<<" launches, "<<pixels<<" pixels";
+    if(width>0 && height>0){
+        cout<<" ("<<100.0*pixels/((long long)width*height)<<"% of the image)";
+    }
+    cout<<", "<<ms<<" ms";
+
+    int cheapest=-1, dearest=-1;
+    for(size_t i=0; i<cost.size(); i++){
+        if(cost[i]==0.0){
+            continue;
+        }
+        if(cheapest<0 || cost[i]<cost[cheapest]){
+            cheapest=i;
+        }
+        if(dearest<0 || cost[i]>cost[dearest]){
+            dearest=i;
+        }
+    }
+    if(cheapest>=0){
+        cout<<", square cost "<<cost[cheapest]<<" to "<<cost[dearest]<<" ms per megapixel, most at ("
+            <<dearest%tiles_x<<", "<<dearest/tiles_x<<")";
+    }
+    cout<<endl;
+}
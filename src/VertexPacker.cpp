@@ -0,0 +1,298 @@
+#include "VertexPacker.h"
+
+#include <iostream>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+//worst case angle of a 16 bit octahedral vector is about 0.006 degrees
+#define MAX_ANGLE_ERROR 0.05f
+
+using namespace std;
+using namespace optix;
+
+static float3 toFloat3(aiVector3D v){
+    return make_float3(v.x, v.y, v.z);
+}
+
+static float angleDegrees(float3 a, float3 b){
+    float d=dot(normalize(a), normalize(b));
+    return acosf(fminf(fmaxf(d, -1.f), 1.f))*180.f/M_PI;
+}
+
+VertexPacker::VertexPacker()
+{
+    //ctor
+}
+
+VertexPacker::~VertexPacker()
+{
+    //dtor
+}
+
+uint32_t VertexPacker::encodeOct(aiVector3D v){
+    float3 n=toFloat3(v);
+    float l1=fabsf(n.x)+fabsf(n.y)+fabsf(n.z);
+    if(l1==0.f){
+        return 0;
+    }
+    float x=n.x/l1, y=n.y/l1;
+    //fold the lower hemisphere over the diagonals
+    if(n.z<0.f){
+        float fx=(1.f-fabsf(y))*(x>=0.f ? 1.f : -1.f);
+        float fy=(1.f-fabsf(x))*(y>=0.f ? 1.f : -1.f);
+        x=fx;
+        y=fy;
+    }
+    int16_t qx=(int16_t)lrintf(fminf(fmaxf(x, -1.f), 1.f)*32767.f);
+    int16_t qy=(int16_t)lrintf(fminf(fmaxf(y, -1.f), 1.f)*32767.f);
+    return uint32_t(uint16_t(qx))|(uint32_t(uint16_t(qy))<<16);
+}
+
+float3 VertexPacker::decodeOct(uint32_t bits){
+    float x=int16_t(bits&0xFFFF)/32767.f;
+    float y=int16_t(bits>>16)/32767.f;
+    float3 n=make_float3(x, y, 1.f-fabsf(x)-fabsf(y));
+    if(n.z<0.f){
+        n.x=(1.f-fabsf(y))*(x>=0.f ? 1.f : -1.f);
+        n.y=(1.f-fabsf(x))*(y>=0.f ? 1.f : -1.f);
+    }
+    return normalize(n);
+}
+
+//round to nearest even, overflow goes to infinity
+uint16_t VertexPacker::floatToHalf(float f){
+    uint32_t x;
+    memcpy(&x, &f, 4);
+    uint32_t sign=(x>>16)&0x8000;
+    int exp=int((x>>23)&0xFF)-127+15;
+    uint32_t mant=x&0x7FFFFF;
+    if(((x>>23)&0xFF)==0xFF){
+        return sign|0x7C00|(mant ? 0x200 : 0);
+    }
+    if(exp>=31){
+        return sign|0x7C00;
+    }
+    if(exp<=0){
+        if(exp<-10){
+            return sign;
+        }
+        mant|=0x800000;
+        int shift=14-exp;
+        uint32_t h=mant>>shift;
+        uint32_t rem=mant&((1u<<shift)-1);
+        uint32_t half=1u<<(shift-1);
+        if(rem>half || (rem==half && (h&1))){
+            h++;
+        }
+        return sign|h;
+    }
+    uint32_t h=sign|(exp<<10)|(mant>>13);
+    uint32_t rem=mant&0x1FFF;
+    if(rem>0x1000 || (rem==0x1000 && (h&1))){
+        h++;
+    }
+    return h;
+}
+
+float VertexPacker::halfToFloat(uint16_t h){
+    uint32_t sign=uint32_t(h&0x8000)<<16;
+    int exp=(h>>10)&0x1F;
+    uint32_t mant=h&0x3FF;
+    uint32_t bits;
+    if(exp==0){
+        float f=ldexpf(float(mant), -24);
+        return sign ? -f : f;
+    }
+    else if(exp==31){
+        bits=sign|0x7F800000|(mant<<13);
+    }
+    else{
+        bits=sign|(uint32_t(exp-15+127)<<23)|(mant<<13);
+    }
+    float f;
+    memcpy(&f, &bits, 4);
+    return f;
+}
+
+void VertexPacker::pack(const aiMesh *mesh, PackedMesh &packed){
+    int nvertex=mesh->mNumVertices;
+    int nface=mesh->mNumFaces;
+    packed.has_tangents=mesh->HasTangentsAndBitangents();
+    packed.has_texcoords=mesh->HasTextureCoords(0);
+    packed.half_texcoords=packed.has_texcoords;
+    for(int v=0; packed.has_texcoords && v<nvertex; v++){
+        aiVector3D uv=mesh->mTextureCoords[0][v];
+        if(fabsf(uv.x)>HALF_UV_RANGE || fabsf(uv.y)>HALF_UV_RANGE){
+            packed.half_texcoords=false;
+        }
+    }
+
+    packed.attributes.assign(3*nvertex, 0);
+    packed.texcoords.clear();
+    for(int v=0; v<nvertex; v++){
+        aiVector3D n=mesh->mNormals ? mesh->mNormals[v] : aiVector3D(0.f, 0.f, 1.f);
+        packed.attributes[3*v]=encodeOct(n);
+        if(packed.has_tangents){
+            float3 t=toFloat3(mesh->mTangents[v]);
+            float3 b=toFloat3(mesh->mBitangents[v]);
+            bool flip=dot(cross(toFloat3(n), t), b)<0.f;
+            packed.attributes[3*v+1]=(encodeOct(mesh->mTangents[v])&0xFFFEFFFF)|(flip ? 0x10000 : 0);
+        }
+        if(packed.has_texcoords){
+            aiVector3D uv=mesh->mTextureCoords[0][v];
+            if(packed.half_texcoords){
+                packed.attributes[3*v+2]=uint32_t(floatToHalf(uv.x))|(uint32_t(floatToHalf(uv.y))<<16);
+            }
+            else{
+                packed.texcoords.push_back(uv.x);
+                packed.texcoords.push_back(uv.y);
+            }
+        }
+    }
+
+    packed.index16.clear();
+    packed.index32.clear();
+    bool small=nvertex<=65536;
+    for(int f=0; f<nface; f++){
+        for(int i=0; i<3; i++){
+            unsigned int index=mesh->mFaces[f].mIndices[i];
+            if(small){
+                packed.index16.push_back(index);
+            }
+            else{
+                packed.index32.push_back(index);
+            }
+        }
+    }
+
+    //what the float path allocates for the same mesh
+    packed.float_bytes=nface*3*sizeof(int)+nvertex*2*sizeof(float3);
+    if(packed.has_tangents){
+        packed.float_bytes+=nvertex*2*sizeof(float3);
+    }
+    if(packed.has_texcoords){
+        packed.float_bytes+=nvertex*sizeof(float2);
+    }
+    packed.packed_bytes=packed.index16.size()*sizeof(uint16_t)+packed.index32.size()*sizeof(int)
+        +nvertex*sizeof(float3)+packed.attributes.size()*sizeof(uint32_t)+packed.texcoords.size()*sizeof(float);
+}
+
+//records buffer as the attribute name of mesh index
+static void track(MemoryTracker *memory, Buffer buffer, const char *name, const aiMesh *mesh, int index){
+    if(memory){
+        memory->trackBuffer(buffer, MEMORY_GEOMETRY, name, index, mesh->mMaterialIndex);
+    }
+}
+
+void VertexPacker::upload(Context context, Geometry geometry, const aiMesh *mesh, const PackedMesh &packed, MemoryTracker *memory, int index){
+    int nvertex=mesh->mNumVertices;
+    int nface=mesh->mNumFaces;
+
+    Buffer vertex_buffer = context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT3, nvertex);
+    memcpy(vertex_buffer->map(), mesh->mVertices, nvertex*sizeof(float3));
+    vertex_buffer->unmap();
+    geometry["vertex_buffer"]->set(vertex_buffer);
+    track(memory, vertex_buffer, "vertex_buffer", mesh, index);
+
+    if(!packed.index16.empty()){
+        Buffer index_buffer = context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_UNSIGNED_SHORT3, nface);
+        memcpy(index_buffer->map(), &packed.index16[0], packed.index16.size()*sizeof(uint16_t));
+        index_buffer->unmap();
+        geometry["index16_buffer"]->set(index_buffer);
+        geometry["packedIndices"]->setInt(1);
+        track(memory, index_buffer, "index16_buffer", mesh, index);
+    }
+    else{
+        Buffer index_buffer = context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_INT3, nface);
+        memcpy(index_buffer->map(), &packed.index32[0], packed.index32.size()*sizeof(int));
+        index_buffer->unmap();
+        geometry["index_buffer"]->set(index_buffer);
+        geometry["packedIndices"]->setInt(0);
+        track(memory, index_buffer, "index_buffer", mesh, index);
+    }
+
+    Buffer packed_buffer = context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_UNSIGNED_INT3, nvertex);
+    memcpy(packed_buffer->map(), &packed.attributes[0], packed.attributes.size()*sizeof(uint32_t));
+    packed_buffer->unmap();
+    geometry["packed_buffer"]->set(packed_buffer);
+    geometry["packedVertices"]->setInt(1);
+    geometry["hasTangents"]->setInt(packed.has_tangents ? 1 : 0);
+    track(memory, packed_buffer, "packed_buffer", mesh, index);
+
+    geometry["hasTexCoord"]->setInt(packed.has_texcoords ? 1 : 0);
+    geometry["halfTexCoord"]->setInt(packed.half_texcoords ? 1 : 0);
+    if(packed.has_texcoords && !packed.half_texcoords){
+        Buffer texCoord_buffer = context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT2, nvertex);
+        memcpy(texCoord_buffer->map(), &packed.texcoords[0], packed.texcoords.size()*sizeof(float));
+        texCoord_buffer->unmap();
+        geometry["texCoord_buffer"]->set(texCoord_buffer);
+        track(memory, texCoord_buffer, "texCoord_buffer", mesh, index);
+    }
+}
+
+void VertexPacker::setDefaults(Context context, MemoryTracker *memory){
+    const char *names[7]={"index_buffer", "index16_buffer", "normal_buffer", "tangent_buffer", "bitangent_buffer", "texCoord_buffer", "packed_buffer"};
+    RTformat formats[7]={RT_FORMAT_INT3, RT_FORMAT_UNSIGNED_SHORT3, RT_FORMAT_FLOAT3, RT_FORMAT_FLOAT3, RT_FORMAT_FLOAT3, RT_FORMAT_FLOAT2, RT_FORMAT_UNSIGNED_INT3};
+    for(int i=0; i<7; i++){
+        Buffer placeholder=context->createBuffer(RT_BUFFER_INPUT, formats[i], 1);
+        context[names[i]]->set(placeholder);
+        if(memory){
+            memory->trackBuffer(placeholder, MEMORY_PLACEHOLDER, names[i]);
+        }
+    }
+    context["packedVertices"]->setInt(0);
+    context["packedIndices"]->setInt(0);
+    context["halfTexCoord"]->setInt(0);
+}
+
+bool VertexPacker::check(const aiMesh *mesh, const PackedMesh &packed, int index){
+    int nvertex=mesh->mNumVertices;
+    int nface=mesh->mNumFaces;
+
+    bool indices_match=true;
+    for(int f=0; f<nface; f++){
+        for(int i=0; i<3; i++){
+            int stored=packed.index16.empty() ? packed.index32[3*f+i] : packed.index16[3*f+i];
+            indices_match=indices_match && stored==(int)mesh->mFaces[f].mIndices[i];
+        }
+    }
+
+    float normal_error=0.f, tangent_error=0.f, bitangent_error=0.f, uv_error=0.f;
+    bool uv_ok=true;
+    for(int v=0; v<nvertex; v++){
+        float3 n=decodeOct(packed.attributes[3*v]);
+        if(mesh->mNormals && length(toFloat3(mesh->mNormals[v]))>0.f){
+            normal_error=max(normal_error, angleDegrees(toFloat3(mesh->mNormals[v]), n));
+        }
+        if(packed.has_tangents && length(toFloat3(mesh->mTangents[v]))>0.f){
+            uint32_t word=packed.attributes[3*v+1];
+            float3 t=decodeOct(word&0xFFFEFFFF);
+            float3 b=cross(n, t)*((word&0x10000) ? -1.f : 1.f);
+            tangent_error=max(tangent_error, angleDegrees(toFloat3(mesh->mTangents[v]), t));
+            if(length(toFloat3(mesh->mBitangents[v]))>0.f){
+                bitangent_error=max(bitangent_error, angleDegrees(toFloat3(mesh->mBitangents[v]), b));
+            }
+        }
+        if(packed.has_texcoords && packed.half_texcoords){
+            aiVector3D uv=mesh->mTextureCoords[0][v];
+            uint32_t word=packed.attributes[3*v+2];
+            float du=fabsf(halfToFloat(word&0xFFFF)-uv.x);
+            float dv=fabsf(halfToFloat(word>>16)-uv.y);
+            uv_error=max(uv_error, max(du, dv));
+            //half of one half float ulp, plus the subnormal step
+            uv_ok=uv_ok && du<=fabsf(uv.x)/2048.f+ldexpf(1.f, -25) && dv<=fabsf(uv.y)/2048.f+ldexpf(1.f, -25);
+        }
+    }
+
+    //the bitangent is rebuilt as cross(n,t) with the stored sign, a source frame that is not
+    //orthogonal cannot be stored and fails here
+    bool ok=indices_match && uv_ok && normal_error<=MAX_ANGLE_ERROR && tangent_error<=MAX_ANGLE_ERROR &&
+            bitangent_error<=MAX_ANGLE_ERROR;
+    cout<<"Packed mesh "<<index<<": "<<nvertex<<" vertices, "<<nface<<" faces, "<<packed.float_bytes/1024<<" KB -> "
+        <<packed.packed_bytes/1024<<" KB ("<<(packed.index16.empty() ? "32" : "16")<<" bit indices"
+        <<(packed.has_texcoords ? (packed.half_texcoords ? ", half uvs" : ", float uvs") : "")<<")"<<endl;
+    cout<<"    max error: normal "<<normal_error<<" deg, tangent "<<tangent_error<<" deg, bitangent "<<bitangent_error
+        <<" deg, uv "<<uv_error<<(indices_match ? "" : ", INDEX MISMATCH")<<(ok ? "" : " FAILED")<<endl;
+    return ok;
+}
@@ -0,0 +1,595 @@
+#include "WideBvh.h"
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cfloat>
+#include <chrono>
+#include <algorithm>
+
+//subtrees are handed to the pool once they are at most this large, or smaller when there are many threads
+#define BVH_MIN_TASK 4096
+//nodes with more primitives than this are binned on the pool
+#define BVH_PARALLEL_BINNING 65536
+#define BVH_ALIGNMENT 64
+
+using namespace std;
+using namespace optix;
+
+static const char BVH_MAGIC[4]={'O','R','B','V'};
+
+struct BvhHeader{
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t node_size;
+    uint64_t key;
+    uint32_t triangle_count;
+    uint32_t node_count;
+    uint32_t prim_count;
+};
+
+static inline float axisOf(float3 v, int axis){
+    return axis==0 ? v.x : (axis==1 ? v.y : v.z);
+}
+
+static inline float area(float3 bmin, float3 bmax){
+    float3 d=bmax-bmin;
+    if(d.x<0.f || d.y<0.f || d.z<0.f){
+        return 0.f;
+    }
+    return 2.f*(d.x*d.y+d.y*d.z+d.z*d.x);
+}
+
+WideBvh::WideBvh() : refs(), binary(), nodes(NULL), node_count(0), node_capacity(0), prims(), triangle_count(0), stack_size(1)
+{
+    //ctor
+    memset(&stats, 0, sizeof(stats));
+}
+
+WideBvh::~WideBvh()
+{
+    //dtor
+    release();
+}
+
+void WideBvh::allocate(int count){
+    release();
+    nodes=static_cast<WideBvhNode*>(_mm_malloc(max(count,1)*sizeof(WideBvhNode), BVH_ALIGNMENT));
+    node_capacity=max(count,1);
+    node_count=0;
+}
+
+void WideBvh::release(){
+    if(nodes){
+        _mm_free(nodes);
+    }
+    nodes=NULL;
+    node_count=0;
+    node_capacity=0;
+}
+
+int WideBvh::getNodeCount(){
+    return node_count;
+}
+
+const WideBvhNode* WideBvh::getNodes(){
+    return nodes;
+}
+
+const int* WideBvh::getPrims(){
+    return prims.empty() ? NULL : &prims[0];
+}
+
+const BvhStats& WideBvh::getStats(){
+    return stats;
+}
+
+void WideBvh::build(const float3 *vertices, const int3 *indices, int ntriangles, ThreadPool &pool){
+    chrono::steady_clock::time_point start=chrono::steady_clock::now();
+    triangle_count=ntriangles;
+
+    //boxes and centroids on the pool, then zero area triangles are dropped in order
+    vector<PrimRef> all(ntriangles);
+    vector<char> keep(ntriangles);
+    int nchunks=pool.getThreadCount()*4;
+    int chunk=(ntriangles+nchunks-1)/nchunks;
+    pool.parallelFor(nchunks, [&](int c, int){
+        int end=min(ntriangles, (c+1)*chunk);
+        for(int p=c*chunk; p<end; p++){
+            float3 v1=vertices[indices[p].x];
+            float3 v2=vertices[indices[p].y];
+            float3 v3=vertices[indices[p].z];
+            PrimRef &r=all[p];
+            r.bmin=fminf(fminf(v1, v2), v3);
+            r.bmax=fmaxf(fmaxf(v1, v2), v3);
+            r.centroid=(v1+v2+v3)/3.f;
+            r.index=p;
+            keep[p]=length(cross(v2-v1, v3-v1))>0.f;
+        }
+    });
+    refs.clear();
+    refs.reserve(ntriangles);
+    for(int p=0; p<ntriangles; p++){
+        if(keep[p]){
+            refs.push_back(all[p]);
+        }
+    }
+    int n=refs.size();
+
+    binary.clear();
+    prims.clear();
+    if(n==0){
+        allocate(1);
+        WideBvhNode &root=nodes[node_count++];
+        for(int i=0; i<BVH_WIDTH; i++){
+            root.bmin_x[i]=root.bmin_y[i]=root.bmin_z[i]=FLT_MAX;
+            root.bmax_x[i]=root.bmax_y[i]=root.bmax_z[i]=-FLT_MAX;
+            root.child[i]=-1;
+            root.count[i]=0;
+        }
+        computeStats();
+        stats.build_ms=chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+        return;
+    }
+
+    //the upper levels here, their subtrees concurrently
+    binary.reserve(2*n/BVH_MAX_LEAF+1);
+    int task_size=max(BVH_MIN_TASK, n/(4*pool.getThreadCount()));
+    vector<Task> tasks;
+    int root=buildTop(0, n, task_size, pool, tasks);
+
+    vector<vector<BuildNode> > subtrees(tasks.size());
+    pool.parallelFor(tasks.size(), [&](int t, int){
+        subtrees[t].reserve(2*(tasks[t].end-tasks[t].begin)/BVH_MAX_LEAF+1);
+        buildRecursive(subtrees[t], tasks[t].begin, tasks[t].end);
+    });
+
+    //subtree roots replace their placeholders, the rest is appended
+    for(size_t t=0; t<tasks.size(); t++){
+        int offset=binary.size()-1;
+        const vector<BuildNode> &sub=subtrees[t];
+        for(size_t i=0; i<sub.size(); i++){
+            BuildNode node=sub[i];
+            if(node.count==0){
+                node.left+=offset;
+                node.right+=offset;
+            }
+            if(i==0){
+                binary[tasks[t].node]=node;
+            }
+            else{
+                binary.push_back(node);
+            }
+        }
+    }
+
+    int inner=0;
+    for(size_t i=0; i<binary.size(); i++){
+        inner+=binary[i].count==0;
+    }
+    allocate(inner+1);
+    collapse(binary, root);
+
+    prims.resize(n);
+    for(int i=0; i<n; i++){
+        prims[i]=refs[i].index;
+    }
+    vector<PrimRef>().swap(refs);
+    vector<BuildNode>().swap(binary);
+
+    computeStats();
+    stats.build_ms=chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+}
+
+void WideBvh::makeNode(BuildNode &node, int begin, int end, float3 &cmin, float3 &cmax){
+    float3 bmin=make_float3(FLT_MAX);
+    float3 bmax=make_float3(-FLT_MAX);
+    cmin=make_float3(FLT_MAX);
+    cmax=make_float3(-FLT_MAX);
+    for(int i=begin; i<end; i++){
+        bmin=fminf(bmin, refs[i].bmin);
+        bmax=fmaxf(bmax, refs[i].bmax);
+        cmin=fminf(cmin, refs[i].centroid);
+        cmax=fmaxf(cmax, refs[i].centroid);
+    }
+    node.bmin=bmin;
+    node.bmax=bmax;
+    node.left=node.right=-1;
+    node.first=begin;
+    node.count=end-begin;
+}
+
+static inline int binIndex(float c, float cmin, float scale){
+    int b=(int)((c-cmin)*scale);
+    return min(max(b, 0), BVH_BINS-1);
+}
+
+WideBvh::Split WideBvh::findSplit(int begin, int end, float3 cmin, float3 cmax, ThreadPool *pool){
+    Split best;
+    best.axis=-1;
+    best.bin=0;
+    best.cost=FLT_MAX;
+    best.cmin=cmin;
+    best.scale=0.f;
+
+    float3 extent=cmax-cmin;
+    float scale[3];
+    for(int a=0; a<3; a++){
+        float e=axisOf(extent, a);
+        scale[a]=e>0.f ? BVH_BINS*(1.f-1e-5f)/e : 0.f;
+    }
+
+    Bin empty;
+    empty.bmin=make_float3(FLT_MAX);
+    empty.bmax=make_float3(-FLT_MAX);
+    empty.count=0;
+
+    int nchunks=1;
+    if(pool && end-begin>BVH_PARALLEL_BINNING){
+        nchunks=pool->getThreadCount();
+    }
+    vector<Bin> bins(nchunks*3*BVH_BINS, empty);
+    int chunk=(end-begin+nchunks-1)/nchunks;
+    ThreadPool::Task binning=[&](int c, int){
+        Bin *local=&bins[c*3*BVH_BINS];
+        int chunk_end=min(end, begin+(c+1)*chunk);
+        for(int i=begin+c*chunk; i<chunk_end; i++){
+            const PrimRef &r=refs[i];
+            for(int a=0; a<3; a++){
+                if(scale[a]==0.f){
+                    continue;
+                }
+                Bin &b=local[a*BVH_BINS+binIndex(axisOf(r.centroid, a), axisOf(cmin, a), scale[a])];
+                b.bmin=fminf(b.bmin, r.bmin);
+                b.bmax=fmaxf(b.bmax, r.bmax);
+                b.count++;
+            }
+        }
+    };
+    if(nchunks>1){
+        pool->parallelFor(nchunks, binning);
+        for(int c=1; c<nchunks; c++){
+            for(int i=0; i<3*BVH_BINS; i++){
+                Bin &dst=bins[i];
+                const Bin &src=bins[c*3*BVH_BINS+i];
+                dst.bmin=fminf(dst.bmin, src.bmin);
+                dst.bmax=fmaxf(dst.bmax, src.bmax);
+                dst.count+=src.count;
+            }
+        }
+    }
+    else{
+        binning(0, 0);
+    }
+
+    //sweep: areas and counts left of every boundary, then from the right
+    for(int a=0; a<3; a++){
+        if(scale[a]==0.f){
+            continue;
+        }
+        const Bin *axis_bins=&bins[a*BVH_BINS];
+        float left_area[BVH_BINS];
+        int left_count[BVH_BINS];
+        float3 bmin=make_float3(FLT_MAX), bmax=make_float3(-FLT_MAX);
+        int count=0;
+        for(int i=0; i<BVH_BINS-1; i++){
+            bmin=fminf(bmin, axis_bins[i].bmin);
+            bmax=fmaxf(bmax, axis_bins[i].bmax);
+            count+=axis_bins[i].count;
+            left_area[i]=area(bmin, bmax);
+            left_count[i]=count;
+        }
+        bmin=make_float3(FLT_MAX);
+        bmax=make_float3(-FLT_MAX);
+        count=0;
+        for(int i=BVH_BINS-1; i>0; i--){
+            bmin=fminf(bmin, axis_bins[i].bmin);
+            bmax=fmaxf(bmax, axis_bins[i].bmax);
+            count+=axis_bins[i].count;
+            if(count==0 || left_count[i-1]==0){
+                continue;
+            }
+            float cost=left_area[i-1]*left_count[i-1]+area(bmin, bmax)*count;
+            if(cost<best.cost){
+                best.cost=cost;
+                best.axis=a;
+                best.bin=i-1;
+                best.scale=scale[a];
+            }
+        }
+    }
+    return best;
+}
+
+int WideBvh::partition(int begin, int end, const Split &split){
+    int axis=split.axis;
+    float cmin=axisOf(split.cmin, axis);
+    PrimRef *mid=std::partition(&refs[begin], &refs[0]+end, [&](const PrimRef &r){
+        return binIndex(axisOf(r.centroid, axis), cmin, split.scale)<=split.bin;
+    });
+    return mid-&refs[0];
+}
+
+//cost of the split relative to the node against intersecting all its triangles
+static bool makeLeaf(int count, float split_cost, float node_area){
+    if(count<=1){
+        return true;
+    }
+    if(count>BVH_MAX_LEAF){
+        return false;
+    }
+    float leaf=BVH_INTERSECT_COST*count;
+    float split=BVH_TRAVERSAL_COST+BVH_INTERSECT_COST*split_cost/max(node_area, 1e-30f);
+    return leaf<=split;
+}
+
+int WideBvh::buildRecursive(vector<BuildNode> &out, int begin, int end){
+    int index=out.size();
+    out.push_back(BuildNode());
+    float3 cmin, cmax;
+    makeNode(out[index], begin, end, cmin, cmax);
+
+    Split split=findSplit(begin, end, cmin, cmax, NULL);
+    if(makeLeaf(end-begin, split.cost, area(out[index].bmin, out[index].bmax))){
+        return index;
+    }
+    //all centroids in one point: halves in any order
+    int mid=split.axis>=0 ? partition(begin, end, split) : (begin+end)/2;
+    if(mid==begin || mid==end){
+        mid=(begin+end)/2;
+    }
+    int left=buildRecursive(out, begin, mid);
+    int right=buildRecursive(out, mid, end);
+    out[index].left=left;
+    out[index].right=right;
+    out[index].count=0;
+    return index;
+}
+
+int WideBvh::buildTop(int begin, int end, int task_size, ThreadPool &pool, vector<Task> &tasks){
+    int index=binary.size();
+    binary.push_back(BuildNode());
+    if(end-begin<=task_size){
+        Task task={index, begin, end};
+        tasks.push_back(task);
+        return index;
+    }
+    float3 cmin, cmax;
+    makeNode(binary[index], begin, end, cmin, cmax);
+
+    Split split=findSplit(begin, end, cmin, cmax, &pool);
+    int mid=split.axis>=0 ? partition(begin, end, split) : (begin+end)/2;
+    if(mid==begin || mid==end){
+        mid=(begin+end)/2;
+    }
+    int left=buildTop(begin, mid, task_size, pool, tasks);
+    int right=buildTop(mid, end, task_size, pool, tasks);
+    binary[index].left=left;
+    binary[index].right=right;
+    binary[index].count=0;
+    return index;
+}
+
+//a binary leaf at the root becomes a node with one leaf slot
+int WideBvh::collapse(const vector<BuildNode> &tree, int root){
+    int index=node_count++;
+    vector<int> children;
+    const BuildNode &r=tree[root];
+    if(r.count>0){
+        children.push_back(root);
+    }
+    else{
+        children.push_back(r.left);
+        children.push_back(r.right);
+    }
+    while((int)children.size()<BVH_WIDTH){
+        int open=-1;
+        float largest=-1.f;
+        for(size_t i=0; i<children.size(); i++){
+            const BuildNode &c=tree[children[i]];
+            float a=area(c.bmin, c.bmax);
+            if(c.count==0 && a>largest){
+                largest=a;
+                open=i;
+            }
+        }
+        if(open<0){
+            break;
+        }
+        const BuildNode &c=tree[children[open]];
+        children[open]=c.left;
+        children.push_back(c.right);
+    }
+
+    WideBvhNode &node=nodes[index];
+    for(int i=0; i<BVH_WIDTH; i++){
+        if(i>=(int)children.size()){
+            node.bmin_x[i]=node.bmin_y[i]=node.bmin_z[i]=FLT_MAX;
+            node.bmax_x[i]=node.bmax_y[i]=node.bmax_z[i]=-FLT_MAX;
+            node.child[i]=-1;
+            node.count[i]=0;
+            continue;
+        }
+        const BuildNode &c=tree[children[i]];
+        node.bmin_x[i]=c.bmin.x;
+        node.bmin_y[i]=c.bmin.y;
+        node.bmin_z[i]=c.bmin.z;
+        node.bmax_x[i]=c.bmax.x;
+        node.bmax_y[i]=c.bmax.y;
+        node.bmax_z[i]=c.bmax.z;
+        node.child[i]=c.count>0 ? c.first : -1;
+        node.count[i]=c.count;
+    }
+    //children after the slots are filled, nodes is allocated up front so node stays valid
+    for(int i=0; i<(int)children.size(); i++){
+        const BuildNode &c=tree[children[i]];
+        if(c.count==0){
+            int child=collapse(tree, children[i]);
+            nodes[index].child[i]=child;
+        }
+    }
+    return index;
+}
+
+void WideBvh::computeStats(){
+    double build_ms=stats.build_ms;
+    memset(&stats, 0, sizeof(stats));
+    stats.build_ms=build_ms;
+    stats.nodes=node_count;
+    stats.prims=prims.size();
+    stats.bytes=node_count*sizeof(WideBvhNode)+prims.size()*sizeof(int);
+    stack_size=1;
+    if(node_count==0){
+        return;
+    }
+
+    const WideBvhNode &root=nodes[0];
+    float3 bmin=make_float3(FLT_MAX), bmax=make_float3(-FLT_MAX);
+    for(int i=0; i<BVH_WIDTH; i++){
+        bmin=fminf(bmin, make_float3(root.bmin_x[i], root.bmin_y[i], root.bmin_z[i]));
+        bmax=fmaxf(bmax, make_float3(root.bmax_x[i], root.bmax_y[i], root.bmax_z[i]));
+    }
+    float root_area=max(area(bmin, bmax), 1e-30f);
+
+    //nodes are stored parents first, so one pass assigns every child its depth and box area
+    vector<int> depth(node_count, 1);
+    vector<float> node_area(node_count, root_area);
+    int used=0;
+    double leaf_depth=0.0;
+    double cost=0.0;
+    for(int n=0; n<node_count; n++){
+        const WideBvhNode &node=nodes[n];
+        cost+=BVH_TRAVERSAL_COST*node_area[n]/root_area;
+        for(int i=0; i<BVH_WIDTH; i++){
+            if(node.count[i]==0 && node.child[i]<0){
+                continue;
+            }
+            used++;
+            float a=area(make_float3(node.bmin_x[i], node.bmin_y[i], node.bmin_z[i]), make_float3(node.bmax_x[i], node.bmax_y[i], node.bmax_z[i]));
+            if(node.count[i]>0){
+                stats.leaves++;
+                stats.max_leaf_size=max(stats.max_leaf_size, (int)node.count[i]);
+                stats.max_depth=max(stats.max_depth, depth[n]);
+                leaf_depth+=depth[n];
+                cost+=BVH_INTERSECT_COST*node.count[i]*a/root_area;
+            }
+            else{
+                depth[node.child[i]]=depth[n]+1;
+                node_area[node.child[i]]=a;
+            }
+        }
+    }
+    //every level on the way down leaves at most its other children on the stack
+    stack_size=BVH_WIDTH*(*max_element(depth.begin(), depth.end()))+1;
+    stats.fill=(double)used/node_count;
+    stats.sah_cost=cost;
+    if(stats.leaves>0){
+        stats.mean_leaf_depth=leaf_depth/stats.leaves;
+        stats.mean_leaf_size=(double)stats.prims/stats.leaves;
+    }
+}
+
+void WideBvh::report(string name){
+    cout<<"BVH "<<name<<": "<<stats.prims<<" triangles, "<<stats.nodes<<" nodes, "<<stats.leaves<<" leaves, "
+        <<stats.bytes/1024<<" KB"<<endl;
+    cout<<"    SAH cost "<<stats.sah_cost<<", depth max "<<stats.max_depth<<" mean "<<stats.mean_leaf_depth
+        <<", leaf size mean "<<stats.mean_leaf_size<<" max "<<stats.max_leaf_size
+        <<", fill "<<stats.fill<<'/'<<BVH_WIDTH;
+    if(stats.build_ms>0.0){
+        cout<<", built in "<<stats.build_ms<<" ms";
+    }
+    else{
+        cout<<", loaded";
+    }
+    cout<<endl;
+}
+
+bool WideBvh::save(string file, uint64_t key){
+    BvhHeader header;
+    memcpy(header.magic, BVH_MAGIC, 4);
+    header.version=BVH_CACHE_VERSION;
+    header.width=BVH_WIDTH;
+    header.node_size=sizeof(WideBvhNode);
+    header.key=key;
+    header.triangle_count=triangle_count;
+    header.node_count=node_count;
+    header.prim_count=prims.size();
+
+    //written aside and renamed, so a reader never sees half a file
+    string tmp=file+".tmp";
+    FILE *f=fopen(tmp.c_str(), "wb");
+    if(!f){
+        return false;
+    }
+    bool ok=fwrite(&header, sizeof(header), 1, f)==1;
+    ok=ok && fwrite(nodes, sizeof(WideBvhNode), node_count, f)==(size_t)node_count;
+    ok=ok && (prims.empty() || fwrite(&prims[0], sizeof(int), prims.size(), f)==prims.size());
+    ok=fclose(f)==0 && ok;
+    if(!ok || rename(tmp.c_str(), file.c_str())!=0){
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool WideBvh::load(string file, uint64_t key, int ntriangles){
+    FILE *f=fopen(file.c_str(), "rb");
+    if(!f){
+        return false;
+    }
+    BvhHeader header;
+    bool ok=fread(&header, sizeof(header), 1, f)==1;
+    ok=ok && memcmp(header.magic, BVH_MAGIC, 4)==0 && header.version==BVH_CACHE_VERSION;
+    ok=ok && header.width==BVH_WIDTH && header.node_size==sizeof(WideBvhNode) && header.key==key;
+    ok=ok && header.triangle_count==(uint32_t)ntriangles;
+    if(ok){
+        allocate(header.node_count);
+        prims.resize(header.prim_count);
+        ok=fread(nodes, sizeof(WideBvhNode), header.node_count, f)==header.node_count;
+        ok=ok && (prims.empty() || fread(&prims[0], sizeof(int), prims.size(), f)==prims.size());
+        node_count=ok ? header.node_count : 0;
+        triangle_count=ntriangles;
+        ok=ok && validate();
+    }
+    fclose(f);
+    if(!ok){
+        release();
+        prims.clear();
+        return false;
+    }
+    stats.build_ms=0.0;
+    computeStats();
+    return true;
+}
+
+//zero area triangles are left out, so there are at most as many prims as triangles. Nodes are
+//stored parents first, a child index below its parent would loop
+bool WideBvh::validate(){
+    if(node_count<1 || prims.size()>(size_t)triangle_count){
+        return false;
+    }
+    for(size_t i=0; i<prims.size(); i++){
+        if(prims[i]<0 || prims[i]>=triangle_count){
+            return false;
+        }
+    }
+    int nprims=prims.size();
+    for(int n=0; n<node_count; n++){
+        const WideBvhNode &node=nodes[n];
+        for(int i=0; i<BVH_WIDTH; i++){
+            int child=node.child[i];
+            int count=node.count[i];
+            if(count<0){
+                return false;
+            }
+            if(count>0 && (child<0 || child>nprims-count)){
+                return false;
+            }
+            if(count==0 && child!=-1 && (child<=n || child>=node_count)){
+                return false;
+            }
+        }
+    }
+    return true;
+}